@@ -30,6 +30,15 @@
 
 #include "mcmc/mh/mh.hpp"
 #include "mcmc/hmc/nuts/nuts.hpp"
+#include "mcmc/hmc/hmc/hmc.hpp"
+#include "mcmc/hmc/chees/chees.hpp"
+#include "mcmc/pt/pt.hpp"
+#include "mcmc/smc/smc.hpp"
+
+#include "vi/advi/advi.hpp"
+
+#include "optim/optimize.hpp"
+#include "optim/laplace.hpp"
 
 #include "math/ess.hpp"
 
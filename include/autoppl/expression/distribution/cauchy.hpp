@@ -3,6 +3,7 @@
 #include <random>
 #include <fastad_bits/reverse/stat/cauchy.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 #include <autoppl/expression/distribution/dist_utils.hpp>
 #include <autoppl/math/density.hpp>
 #include <autoppl/math/math.hpp>
@@ -94,6 +95,8 @@ public:
     using value_t = util::cont_param_t;
     using base_t = util::DistExprBase<Cauchy<loc_t, scale_t>>; 
     using typename base_t::dist_value_t;
+    static constexpr bool narrowable =
+        util::is_narrowable_v<loc_t> && util::is_narrowable_v<scale_t>;
 
     Cauchy(const loc_t& loc, 
            const scale_t& scale)
@@ -128,6 +131,17 @@ public:
                                       scale_.ad(pack));
     }
 
+    /**
+     * Returns the cauchy distribution of the row-range [begin, begin + n)
+     * of the variable assigned to this distribution.
+     */
+    auto narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    {
+        auto loc = loc_.narrow(begin, n, cache);
+        auto scale = scale_.narrow(begin, n, cache);
+        return Cauchy<decltype(loc), decltype(scale)>(loc, scale);
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
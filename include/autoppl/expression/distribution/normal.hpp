@@ -1,6 +1,7 @@
 #pragma once
 #include <fastad_bits/reverse/stat/normal.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 #include <autoppl/expression/distribution/dist_utils.hpp>
 #include <autoppl/math/density.hpp>
 #include <autoppl/math/math.hpp>
@@ -110,6 +111,8 @@ public:
     using value_t = util::cont_param_t;
     using base_t = util::DistExprBase<Normal<mean_t, sigma_t>>;
     using typename base_t::dist_value_t;
+    static constexpr bool narrowable =
+        util::is_narrowable_v<mean_t> && util::is_narrowable_v<sigma_t>;
 
     Normal(const mean_t& mean, 
            const sigma_t& sigma)
@@ -147,6 +150,17 @@ public:
                                       sigma_.ad(pack));
     }
 
+    /**
+     * Returns the normal distribution of the row-range [begin, begin + n)
+     * of the variable assigned to this distribution.
+     */
+    auto narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    {
+        auto mean = mean_.narrow(begin, n, cache);
+        auto sigma = sigma_.narrow(begin, n, cache);
+        return Normal<decltype(mean), decltype(sigma)>(mean, sigma);
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
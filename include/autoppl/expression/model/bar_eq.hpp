@@ -1,5 +1,9 @@
 #pragma once
+#include <tuple>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/util/ad_boost/sharded_sum.hpp>
+#include <autoppl/util/ad_boost/tempered.hpp>
 
 #define PPL_VAR_DIST_CONT_DISC_MATCH \
     "A continuous variable can only be assigned to a continuous distribution. " \
@@ -33,6 +37,13 @@ struct BarEqNode: util::ModelExprBase<BarEqNode<VarType, DistType>>
     using dist_value_t = typename
         util::dist_expr_traits<dist_t>::dist_value_t;
 
+    // an observed vector can be split into row-ranges
+    // if its distribution can be restricted to the same row-ranges
+    static constexpr bool shardable =
+        util::is_data_v<var_t> &&
+        util::is_vec_v<var_t> &&
+        util::is_narrowable_v<dist_t>;
+
     BarEqNode(const var_t& var, 
               const dist_t& dist) noexcept
         : var_{var}
@@ -68,10 +79,16 @@ struct BarEqNode: util::ModelExprBase<BarEqNode<VarType, DistType>>
         return dist_.log_pdf(var_); 
     }
 
-    template <class PtrPackType>
+    /**
+     * AD expression of the log-pdf of this node.
+     * If the variable is a parameter and Jacobian is true,
+     * the log-jacobian of its transformation to the unconstrained space is added.
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
     auto ad_log_pdf(const PtrPackType& pack) const
     { 
-        if constexpr (util::is_param_v<var_t>) {
+        if constexpr (util::is_param_v<var_t> && Jacobian) {
             return dist_.ad_log_pdf(var_, pack) +
                     var_.logj_ad(pack); 
         } else {
@@ -79,6 +96,65 @@ struct BarEqNode: util::ModelExprBase<BarEqNode<VarType, DistType>>
         }
     }
 
+    /**
+     * Same as ad_log_pdf(pack), except that if the node is shardable,
+     * the observed vector is split into ctx.n_shards(size) contiguous row-ranges
+     * whose log-pdfs are summed by a single ad::boost::ShardedSumNode.
+     * The AD expression of each row-range is built from the narrowed variable
+     * and distribution (see narrow()).
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf(const PtrPackType& pack,
+                    util::ShardContext& ctx) const
+    {
+        if constexpr (shardable) {
+            const size_t n_rows = var_.size();
+            const size_t n_shards = ctx.n_shards(n_rows);
+            auto shard_ad_log_pdf = [&](size_t i, const PtrPackType& shard_pack) {
+                const size_t begin = (i * n_rows) / n_shards;
+                const size_t end = ((i + 1) * n_rows) / n_shards;
+                const size_t n = end - begin;
+                return dist_.narrow(begin, n, ctx.cache).ad_log_pdf(
+                        var_.narrow(begin, n, ctx.cache), shard_pack);
+            };
+            using shard_expr_t = decltype(shard_ad_log_pdf(0, pack));
+            return ad::boost::ShardedSumNode<shard_expr_t>(
+                    ctx.pool, n_shards, pack, ctx.offsets, shard_ad_log_pdf);
+        } else {
+            static_cast<void>(ctx);
+            return ad_log_pdf<Jacobian>(pack);
+        }
+    }
+
+    /**
+     * Returns a tuple containing the only term of this node (see GlueNode).
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf_terms(const PtrPackType& pack,
+                          util::ShardContext& ctx) const
+    {
+        return std::make_tuple(ad_log_pdf<Jacobian>(pack, ctx));
+    }
+
+    /**
+     * Same as ad_log_pdf_terms(pack, ctx), except that if the variable is observed (data),
+     * the term is scaled by the inverse temperature viewed by lik_beta (see ad::boost::TemperedNode).
+     */
+    template <class PtrPackType>
+    auto ad_log_pdf_terms(const PtrPackType& pack,
+                          util::ShardContext& ctx,
+                          const double* lik_beta) const
+    {
+        if constexpr (util::is_data_v<var_t>) {
+            return std::make_tuple(ad::boost::tempered(ad_log_pdf(pack, ctx), lik_beta));
+        } else {
+            static_cast<void>(lik_beta);
+            return ad_log_pdf_terms(pack, ctx);
+        }
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
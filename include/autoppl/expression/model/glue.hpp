@@ -1,6 +1,8 @@
 #pragma once
+#include <tuple>
 #include <type_traits>
 #include <autoppl/util/traits/model_expr_traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 namespace ppl {
 namespace expr {
@@ -73,6 +75,36 @@ struct GlueNode:
                 rhs_.ad_log_pdf(pack));
     }
 
+    /**
+     * Returns a tuple of the AD expressions of the log-pdf of every term (BarEqNode)
+     * in traversal order, where shardable terms are sharded (see BarEqNode).
+     * Unlike ad_log_pdf, the terms are not added together,
+     * so that the caller may evaluate independent terms concurrently
+     * (see ad::boost::ParallelSumNode).
+     * If Jacobian is false, log-jacobians of parameters are omitted.
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf_terms(const PtrPackType& pack,
+                          util::ShardContext& ctx) const
+    {
+        return std::tuple_cat(lhs_.template ad_log_pdf_terms<Jacobian>(pack, ctx),
+                              rhs_.template ad_log_pdf_terms<Jacobian>(pack, ctx));
+    }
+
+    /**
+     * Same as ad_log_pdf_terms(pack, ctx), except that the terms of observed variables
+     * are scaled by the inverse temperature viewed by lik_beta (see BarEqNode).
+     */
+    template <class PtrPackType>
+    auto ad_log_pdf_terms(const PtrPackType& pack,
+                          util::ShardContext& ctx,
+                          const double* lik_beta) const
+    {
+        return std::tuple_cat(lhs_.ad_log_pdf_terms(pack, ctx, lik_beta),
+                              rhs_.ad_log_pdf_terms(pack, ctx, lik_beta));
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <autoppl/util/traits/traits.hpp>
+
+namespace ppl {
+namespace expr {
+namespace model {
+
+/**
+ * Appends a functor that returns the current reference count
+ * of every (transformed) parameter assigned in expr, i.e.
+ * the variable of every BarEqNode in a model expression
+ * or the variable of every OpEqNode in a transformed parameter expression.
+ *
+ * @param   expr        model or transformed parameter expression
+ * @param   counters    vector of functors to append to
+ */
+template <class ExprType>
+inline void add_refcnt_counters(const ExprType& expr,
+                                std::vector<std::function<size_t()>>& counters)
+{
+    auto add__ = [&](const auto& eq_node) {
+        const auto& var = eq_node.get_variable();
+        using var_t = std::decay_t<decltype(var)>;
+        if constexpr (util::is_param_v<var_t> ||
+                      util::is_tparam_v<var_t>) {
+            counters.emplace_back([var]() { return var.refcnt(); });
+        }
+    };
+    expr.traverse(add__);
+}
+
+/**
+ * Activates the reference counts of every term (BarEqNode) of model in order,
+ * which is equivalent to model.activate_refcnt(),
+ * and groups the terms that (transitively) reference a common
+ * parameter or transformed parameter.
+ * The references of a term are found by the change in reference counts
+ * of every counter in counters when activating the term.
+ *
+ * Terms in different groups never write to the same adjoint, constrained value,
+ * or visit count during AD, so different groups can be differentiated concurrently.
+ *
+ * @param   model       model expression
+ * @param   counters    reference count of every (transformed) parameter (see add_refcnt_counters)
+ * @return  group index of every term in traversal order.
+ *          Groups are numbered in order of their first term.
+ */
+template <class ModelType>
+inline std::vector<size_t>
+activate_refcnt_grouped(const ModelType& model,
+                        const std::vector<std::function<size_t()>>& counters)
+{
+    constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    std::vector<size_t> parent;                     // union-find over terms
+    std::vector<size_t> owner(counters.size(), npos); // first term referencing a counter
+    std::vector<size_t> before(counters.size());
+
+    auto find = [&](size_t t) {
+        while (parent[t] != t) {
+            parent[t] = parent[parent[t]];
+            t = parent[t];
+        }
+        return t;
+    };
+
+    auto activate__ = [&](const auto& eq_node) {
+        for (size_t i = 0; i < counters.size(); ++i) {
+            before[i] = counters[i]();
+        }
+        eq_node.activate_refcnt();
+
+        const size_t t = parent.size();
+        parent.push_back(t);
+        for (size_t i = 0; i < counters.size(); ++i) {
+            if (counters[i]() == before[i]) continue;
+            if (owner[i] == npos) {
+                owner[i] = t;
+            } else {
+                parent[find(t)] = find(owner[i]);
+            }
+        }
+    };
+    model.traverse(activate__);
+
+    // number groups in order of their first term
+    std::vector<size_t> groups(parent.size());
+    std::vector<size_t> root_group(parent.size(), npos);
+    size_t n_groups = 0;
+    for (size_t t = 0; t < parent.size(); ++t) {
+        size_t root = find(t);
+        if (root_group[root] == npos) {
+            root_group[root] = n_groups++;
+        }
+        groups[t] = root_group[root];
+    }
+    return groups;
+}
+
+} // namespace model
+} // namespace expr
+} // namespace ppl
@@ -1,8 +1,14 @@
 #pragma once
+#include <functional>
 #include <tuple>
+#include <vector>
 #include <autoppl/expression/program/activate.hpp>
 #include <autoppl/expression/program/init_params.hpp>
+#include <autoppl/expression/model/term_groups.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/util/ad_boost/parallel_sum.hpp>
+#include <autoppl/util/ad_boost/sharded_sum.hpp>
 
 namespace ppl {
 namespace expr {
@@ -19,8 +25,108 @@ struct ProgramNodeBase
     auto& get_model() { return model_; }
     const auto& get_model() const { return model_; }
 
+    /**
+     * Returns the group index of every model term (in traversal order)
+     * such that terms in different groups reference disjoint (transformed) parameters.
+     * It is only valid after activation.
+     */
+    const std::vector<size_t>& term_groups() const { return term_groups_; }
+
 protected:
+
+    /**
+     * Activates the reference counts of the model
+     * and finds the independent groups of model terms (see term_groups).
+     *
+     * @param   counters    reference counters of (transformed) parameters
+     *                      not assigned in the model.
+     */
+    void activate_model_refcnt(
+            std::vector<std::function<size_t()>> counters = {}) const
+    {
+        expr::model::add_refcnt_counters(model_, counters);
+        term_groups_ = expr::model::activate_refcnt_grouped(model_, counters);
+    }
+
+    /**
+     * AD expression of the model log-pdf that evaluates 
+     * independent groups of terms concurrently if ctx.config.parallel_terms is true.
+     * Otherwise, all terms are evaluated in order on the calling thread.
+     * If Jacobian is false, log-jacobians of parameters are omitted.
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf_model(const PtrPackType& pack,
+                          util::ShardContext& ctx) const
+    {
+        return parallel_sum_terms(
+                model_.template ad_log_pdf_terms<Jacobian>(pack, ctx), ctx);
+    }
+
+    /**
+     * Same as ad_log_pdf_model(pack, ctx), except that the terms of observed variables
+     * are scaled by the inverse temperature viewed by lik_beta.
+     */
+    template <class PtrPackType>
+    auto ad_log_pdf_model(const PtrPackType& pack,
+                          util::ShardContext& ctx,
+                          const double* lik_beta) const
+    {
+        return parallel_sum_terms(model_.ad_log_pdf_terms(pack, ctx, lik_beta), ctx);
+    }
+
+    /**
+     * Log-likelihood of the model, i.e. the sum of the log-pdfs of the observed variables.
+     * Every term is evaluated as in log_pdf (only the terms of observed variables are summed),
+     * so that every parameter is visited exactly refcnt times
+     * and visit counts are back to zero for the next evaluation.
+     */
+    double log_lik_model()
+    {
+        double log_lik = 0.;
+        model_.traverse([&](auto& eq_node) {
+            using var_t = std::decay_t<decltype(eq_node.get_variable())>;
+            if constexpr (util::is_data_v<var_t>) {
+                log_lik += eq_node.log_pdf();
+            } else {
+                eq_node.log_pdf();
+            }
+        });
+        return log_lik;
+    }
+
+    /**
+     * Evaluates the constrained values of all parameters of the model
+     * by running only their inverse transforms (no distribution is evaluated).
+     * Unlike log_pdf, a parameter is not necessarily visited refcnt times,
+     * so visit counts must be reset to zero before every call.
+     */
+    void inv_transform_model()
+    {
+        model_.traverse([](auto& eq_node) {
+            auto& var = eq_node.get_variable();
+            using var_t = std::decay_t<decltype(var)>;
+            if constexpr (util::is_param_v<var_t>) {
+                var.eval();
+            }
+        });
+    }
+
     model_t model_;
+    mutable std::vector<size_t> term_groups_;   // set during activation
+
+private:
+    template <class TermsType>
+    auto parallel_sum_terms(const TermsType& terms,
+                            util::ShardContext& ctx) const
+    {
+        std::vector<size_t> groups(std::tuple_size_v<TermsType>, 0);
+        if (ctx.config.parallel_terms && 
+            (term_groups_.size() == groups.size())) {
+            groups = term_groups_;
+        }
+        return ad::boost::parallel_sum(ctx.pool, groups, terms);
+    }
 };
 
 /**
@@ -58,14 +164,48 @@ struct ProgramNode<std::tuple<ModelExpr>,
 
     auto log_pdf() { return model_.log_pdf(); }
 
+    double log_lik() { return base_t::log_lik_model(); }
+
+    void inv_transform() { base_t::inv_transform_model(); }
+
     template <class PtrPackType>
     auto ad_log_pdf(const PtrPackType& pack) const {
         return model_.ad_log_pdf(pack);
     }   
 
+    /**
+     * AD expression of log-pdf where large observed vectors are sharded
+     * and independent terms may be evaluated concurrently (see ShardContext).
+     * Shards keep their own visit counts, so the visit counts in pack
+     * are reset before every evaluation.
+     * If Jacobian is false, the log-jacobians of the parameter transformations are omitted,
+     * e.g. to find the mode in the constrained space (see optim::optimize_).
+     */
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf(const PtrPackType& pack,
+                    util::ShardContext& ctx) const {
+        return (ad::boost::VisitResetNode<util::cont_param_t>(
+                    pack.v_val, ctx.offsets.v_offset),
+                base_t::template ad_log_pdf_model<Jacobian>(pack, ctx));
+    }
+
+    /**
+     * Same as ad_log_pdf(pack, ctx), except that the log-likelihood
+     * is scaled by the inverse temperature viewed by lik_beta.
+     */
+    template <class PtrPackType>
+    auto ad_log_pdf(const PtrPackType& pack,
+                    util::ShardContext& ctx,
+                    const double* lik_beta) const {
+        return (ad::boost::VisitResetNode<util::cont_param_t>(
+                    pack.v_val, ctx.offsets.v_offset),
+                base_t::ad_log_pdf_model(pack, ctx, lik_beta));
+    }
+
     auto activate() const {
         auto res = expr::activate(model_);
-        model_.activate_refcnt();
+        base_t::activate_model_refcnt();
         return res;
     }
 
@@ -112,16 +252,52 @@ struct ProgramNode<std::tuple<TPExpr, ModelExpr>,
         return model_.log_pdf(); 
     }
 
+    double log_lik() {
+        tp_expr_.eval();
+        return base_t::log_lik_model();
+    }
+
+    /**
+     * Transformed parameters are evaluated first,
+     * since constraints may refer to them.
+     */
+    void inv_transform() {
+        tp_expr_.eval();
+        base_t::inv_transform_model();
+    }
+
     template <class PtrPackType>
     auto ad_log_pdf(const PtrPackType& pack) const {
         return (tp_expr_.ad(pack), model_.ad_log_pdf(pack));
     }   
 
+    template <bool Jacobian = true
+            , class PtrPackType>
+    auto ad_log_pdf(const PtrPackType& pack,
+                    util::ShardContext& ctx) const {
+        return (ad::boost::VisitResetNode<util::cont_param_t>(
+                    pack.v_val, ctx.offsets.v_offset),
+                tp_expr_.ad(pack), 
+                base_t::template ad_log_pdf_model<Jacobian>(pack, ctx));
+    }
+
+    template <class PtrPackType>
+    auto ad_log_pdf(const PtrPackType& pack,
+                    util::ShardContext& ctx,
+                    const double* lik_beta) const {
+        return (ad::boost::VisitResetNode<util::cont_param_t>(
+                    pack.v_val, ctx.offsets.v_offset),
+                tp_expr_.ad(pack), 
+                base_t::ad_log_pdf_model(pack, ctx, lik_beta));
+    }
+
     auto activate() const {
         auto tp_res = expr::activate(tp_expr_);
         auto model_res = expr::activate(model_);
         tp_expr_.activate_refcnt();
-        model_.activate_refcnt();
+        std::vector<std::function<size_t()>> counters;
+        expr::model::add_refcnt_counters(tp_expr_, counters);
+        base_t::activate_model_refcnt(std::move(counters));
 
         util::OffsetPack cont_res;
         util::OffsetPack disc_res;
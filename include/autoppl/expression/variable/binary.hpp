@@ -1,6 +1,7 @@
 #pragma once
 #include <fastad_bits/reverse/core/binary.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 #define PPL_BINOP_EQUAL_FIXED_SIZE \
     "If both lhs and rhs are of fixed size, " \
@@ -52,6 +53,8 @@ public:
             >;
     static constexpr bool has_param = 
         lhs_t::has_param || rhs_t::has_param;
+    static constexpr bool narrowable =
+        util::is_narrowable_v<lhs_t> && util::is_narrowable_v<rhs_t>;
 
 	BinaryNode(const lhs_t& lhs, 
                const rhs_t& rhs)
@@ -85,6 +88,16 @@ public:
                               rhs_.ad(pack));
     }
 
+    /**
+     * Returns the same binary operation applied to the narrowed expressions.
+     */
+    auto narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    {
+        auto lhs = lhs_.narrow(begin, n, cache);
+        auto rhs = rhs_.narrow(begin, n, cache);
+        return BinaryNode<BinaryOp, decltype(lhs), decltype(rhs)>(lhs, rhs);
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
@@ -1,6 +1,7 @@
 #pragma once
 #include <fastad_bits/reverse/core/constant.hpp>
 #include <autoppl/util/traits/var_expr_traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 #define PPL_CONSTANT_SHAPE_UNSUPPORTED \
     "Unsupported shape for constants. "
@@ -24,6 +25,7 @@ struct Constant<ValueType, ppl::scl>:
     using value_t = ValueType;
     using shape_t = ppl::scl;
     static constexpr bool has_param = false;
+    static constexpr bool narrowable = true;
 
     Constant(value_t c) : c_{c} {}
 
@@ -38,6 +40,9 @@ struct Constant<ValueType, ppl::scl>:
     auto ad(const PtrPackType&) const
     { return ad::constant(c_); }
 
+    Constant narrow(size_t, size_t, util::RowChunkCache&) const 
+    { return *this; }
+
     void activate_refcnt() const {}
 
 private:
@@ -4,6 +4,7 @@
 #include <autoppl/util/traits/var_traits.hpp>
 #include <autoppl/util/traits/shape_traits.hpp>
 #include <autoppl/util/traits/var_expr_traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 #define PPL_DATA_SHAPE_UNSUPPORTED \
     "Unsupported shape for Data. "
@@ -41,6 +42,7 @@ struct DataView<ValueType, ppl::scl>:
     using id_t = const void*;
     using shape_t = ppl::scl;
     static constexpr bool has_param = false;
+    static constexpr bool narrowable = true;
 
     DataView(const value_t* begin) noexcept
         : var_{begin} 
@@ -62,6 +64,12 @@ struct DataView<ValueType, ppl::scl>:
     auto ad(const PtrPackType&) const
     { return ad::constant(*var_); }
 
+    /**
+     * A scalar is shared by every row-range, so narrowing is a no-op.
+     */
+    DataView narrow(size_t, size_t, util::RowChunkCache&) const
+    { return *this; }
+
     template <class PtrType>
     void bind(PtrType begin) 
     { 
@@ -88,6 +96,7 @@ struct DataView<ValueType, ppl::vec> :
     using id_t = const void*;
     using shape_t = ppl::vec;
     static constexpr bool has_param = false;
+    static constexpr bool narrowable = true;
 
     DataView(const value_t* begin,
              size_t rows) noexcept
@@ -106,6 +115,16 @@ struct DataView<ValueType, ppl::vec> :
     auto ad(const PtrPackType&) const
     { return ad::constant_view(var_.data(), size()); }
 
+    /**
+     * Returns a view of the n elements starting at begin.
+     */
+    DataView narrow(size_t begin, size_t n, util::RowChunkCache&) const
+    { 
+        DataView res = *this;
+        new (&res.var_) var_t(var_.data() + begin, n);
+        return res;
+    }
+
     template <class PtrType>
     void bind(PtrType begin) 
     { 
@@ -132,6 +151,7 @@ struct DataView<ValueType, ppl::mat> :
     using id_t = const void*;
     using shape_t = ppl::mat;
     static constexpr bool has_param = false;
+    static constexpr bool narrowable = true;
 
     DataView(const value_t* begin,
              size_t rows,
@@ -151,6 +171,19 @@ struct DataView<ValueType, ppl::mat> :
     auto ad(const PtrPackType&) const
     { return ad::constant_view(var_.data(), rows(), cols()); }
 
+    /**
+     * Returns a view of the n rows starting at begin.
+     * Since these rows are not contiguous in memory,
+     * the view refers to a contiguous copy owned by cache.
+     */
+    DataView narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    { 
+        DataView res = *this;
+        new (&res.var_) var_t(
+                cache.get(var_.data(), rows(), cols(), begin, n), n, cols());
+        return res;
+    }
+
     template <class PtrType>
     void bind(PtrType begin) 
     { 
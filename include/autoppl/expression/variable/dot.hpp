@@ -1,6 +1,7 @@
 #pragma once
 #include <fastad_bits/reverse/core/dot.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 #define PPL_DOT_MAT_VEC \
     "Dot product is only supported for matrix as lhs argument " \
@@ -42,6 +43,7 @@ public:
     using shape_t = ad::core::details::dot_shape_t<lhs_t, rhs_t>;
     static constexpr bool has_param = 
         lhs_t::has_param || rhs_t::has_param;
+    static constexpr bool narrowable = util::is_narrowable_v<lhs_t>;
 
 	DotNode(const lhs_t& lhs, 
             const rhs_t& rhs)
@@ -65,6 +67,16 @@ public:
                        rhs_.ad(pack));
     }
 
+    /**
+     * Rows of a matrix product only depend on the same rows of lhs,
+     * so only lhs is narrowed.
+     */
+    auto narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    {
+        auto lhs = lhs_.narrow(begin, n, cache);
+        return DotNode<decltype(lhs), rhs_t>(lhs, rhs_);
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
@@ -4,7 +4,10 @@
 #include <autoppl/util/traits/shape_traits.hpp>
 #include <autoppl/util/packs/offset_pack.hpp>
 #include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/util/ad_boost/disc_view.hpp>
 #include <fastad_bits/reverse/core/var_view.hpp>
+#include <fastad_bits/reverse/core/constant.hpp>
 
 #define PPL_PARAMVIEW_SHAPE_UNSUPPORTED \
     "Unsupported shape for ParamView. "
@@ -51,6 +54,7 @@ struct ParamView:
     using var_t = util::var_t<value_t, shape_t>;
     using id_t = const void*;
     static constexpr bool has_param = true;
+    static constexpr bool narrowable = std::is_same_v<shape_t, ppl::scl>;
 
     ParamView(details::ParamInfoPack* i_pack,
               size_t rows=1,
@@ -116,6 +120,42 @@ struct ParamView:
         return transformer_.logj_inv_transform_ad(curr_pack, pack);
     }
 
+    /**
+     * A discrete parameter is held fixed in an AD expression 
+     * over continuous parameters (see mcmc::nuts_chain_).
+     * The resulting expression views the currently bound values,
+     * so the parameter must be bound (see bind) before calling this.
+     */
+    template <class PtrPackType
+            , class = std::enable_if_t<
+                util::is_disc_v<value_t> &&
+                !std::is_same_v<typename PtrPackType::uc_val_ptr_t, value_t*> > >
+    auto ad(const PtrPackType&) const {
+        const value_t* val = nullptr;
+        if constexpr (std::is_same_v<shape_t, ppl::scl>) {
+            val = &get();
+        } else {
+            val = get().data();
+        }
+        return ad::boost::DiscViewNode<value_t, shape_t>(val, rows(), cols());
+    }
+
+    template <class PtrPackType
+            , class = std::enable_if_t<
+                util::is_disc_v<value_t> &&
+                !std::is_same_v<typename PtrPackType::uc_val_ptr_t, value_t*> > >
+    auto logj_ad(const PtrPackType&) const { return ad::constant(0.); }
+
+    /**
+     * Only a scalar parameter can be narrowed, 
+     * in which case it is shared by every row-range.
+     */
+    ParamView narrow(size_t, size_t, util::RowChunkCache&) const
+    { 
+        static_assert(narrowable);
+        return *this; 
+    }
+
     /**
      * Initialize unconstrained values by generating constrained values
      * and then transforming to unconstrained values.
@@ -187,6 +227,7 @@ struct ParamView:
     // API specific to ParamView
     auto& offset() { return i_pack_->off_pack; }
     auto offset() const { return i_pack_->off_pack; }
+    size_t refcnt() const { return i_pack_->refcnt; }
     constexpr size_t size_uc() const { return transformer_.size_uc(); }
     constexpr size_t size_c() const { return transformer_.size_c(); }
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <autoppl/util/value.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 #include <autoppl/util/packs/offset_pack.hpp>
 #include <autoppl/util/packs/ptr_pack.hpp>
 #include <fastad_bits/reverse/core/var_view.hpp>
@@ -24,6 +25,7 @@ namespace details {
 
 struct TParamInfoPack 
 {
+    size_t refcnt = 0;          // total reference count
     util::OffsetPack off_pack;
 };
 
@@ -76,27 +78,27 @@ struct TParamViewBase<TParamView<ValueType, ShapeType>>
                                 value_t*,
                                 value_t*,
                                 CValPtrType>& pack) const { 
-        return ad::VarView<value_t, shape_t>(pack.tp_val + i_pack_->off_pack.tp_offset, 
-                                             pack.tp_adj + i_pack_->off_pack.tp_offset,
-                                             rows(), cols());
+        return ad_at(pack, i_pack_->off_pack.tp_offset);
     }
     
     void activate(util::OffsetPack& pack) const { 
         i_pack_->off_pack = pack;
+        i_pack_->refcnt = 0;
         pack.tp_offset += size();
     }
 
-    void activate_refcnt() const {}
+    /**
+     * Transformed parameters are never inverse-transformed,
+     * so the reference count is only used to find which 
+     * model terms depend on the transformed parameter (see activate_refcnt_grouped).
+     */
+    void activate_refcnt() const { ++i_pack_->refcnt; }
+    size_t refcnt() const { return i_pack_->refcnt; }
 
     template <class PtrPackType>
     void bind(const PtrPackType& pack) 
     { 
-        static_cast<void>(pack);
-        if constexpr (std::is_convertible_v<typename PtrPackType::tp_val_ptr_t, value_t*>) {
-            value_t* tcp = pack.tp_val;
-            util::bind(var_, tcp + i_pack_->off_pack.tp_offset, 
-                       rows(), cols());
-        }
+        bind_at(pack, i_pack_->off_pack.tp_offset);
     }
 
     var_t& get() { return util::get(var_); }
@@ -108,6 +110,38 @@ struct TParamViewBase<TParamView<ValueType, ShapeType>>
 
 protected:
     using view_t = ad::util::shape_to_raw_view_t<value_t, shape_t>;
+
+    /*
+     * Helpers that read/bind at an explicit offset into the tp buffers.
+     * The shared info pack is never modified after activation,
+     * so multiple programs viewing the same variable
+     * can be bound and differentiated concurrently.
+     */
+    template <class UCValPtrType
+            , class UCAdjPtrType
+            , class CValPtrType>
+    auto ad_at(const util::PtrPack<UCValPtrType, 
+                                   UCAdjPtrType, 
+                                   value_t*,
+                                   value_t*,
+                                   CValPtrType>& pack,
+               size_t offset) const { 
+        return ad::VarView<value_t, shape_t>(pack.tp_val + offset, 
+                                             pack.tp_adj + offset,
+                                             rows(), cols());
+    }
+
+    template <class PtrPackType>
+    void bind_at(const PtrPackType& pack, size_t offset) 
+    { 
+        static_cast<void>(pack);
+        static_cast<void>(offset);
+        if constexpr (std::is_convertible_v<typename PtrPackType::tp_val_ptr_t, value_t*>) {
+            value_t* tcp = pack.tp_val;
+            util::bind(var_, tcp + offset, rows(), cols());
+        }
+    }
+
     details::TParamInfoPack* const i_pack_;
     view_t var_;
     const id_t id_; 
@@ -147,6 +181,8 @@ struct TParamView<ValueType, scl>:
         , rel_offset_(rel_offset)
     {}
 
+    static constexpr bool narrowable = true;
+
     template <class UCValPtrType
             , class UCAdjPtrType
             , class CValPtrType>
@@ -155,20 +191,20 @@ struct TParamView<ValueType, scl>:
                                 typename base_t::value_t*,
                                 typename base_t::value_t*,
                                 CValPtrType>& pack) const { 
-        base_t::i_pack_->off_pack.tp_offset += rel_offset_;
-        auto&& res = base_t::ad(pack);
-        base_t::i_pack_->off_pack.tp_offset -= rel_offset_;
-        return res;
+        return base_t::ad_at(pack, 
+                base_t::i_pack_->off_pack.tp_offset + rel_offset_);
     }
 
     template <class PtrPackType>
     void bind(const PtrPackType& pack) 
     { 
-        base_t::i_pack_->off_pack.tp_offset += rel_offset_;
-        base_t::bind(pack);
-        base_t::i_pack_->off_pack.tp_offset -= rel_offset_;
+        base_t::bind_at(pack,
+                base_t::i_pack_->off_pack.tp_offset + rel_offset_);
     }
 
+    TParamView narrow(size_t, size_t, util::RowChunkCache&) const
+    { return *this; }
+
 private:
     size_t rel_offset_;
 };
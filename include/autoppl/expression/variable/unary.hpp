@@ -1,6 +1,7 @@
 #pragma once
 #include <fastad_bits/reverse/core/unary.hpp>
 #include <autoppl/util/traits/traits.hpp>
+#include <autoppl/util/sharding.hpp>
 
 namespace ppl {
 namespace expr {
@@ -30,6 +31,7 @@ public:
 	using value_t = typename util::var_expr_traits<expr_t>::value_t;
     using shape_t = typename util::shape_traits<expr_t>::shape_t;
     static constexpr bool has_param = expr_t::has_param;
+    static constexpr bool narrowable = util::is_narrowable_v<expr_t>;
 
 	UnaryNode(const expr_t& expr)
 		: expr_{expr}
@@ -56,6 +58,15 @@ public:
         return UnaryOp::fmap(expr_.ad(pack));
     }
 
+    /**
+     * Returns the same unary operation applied to the narrowed expression.
+     */
+    auto narrow(size_t begin, size_t n, util::RowChunkCache& cache) const
+    {
+        auto expr = expr_.narrow(begin, n, cache);
+        return UnaryNode<UnaryOp, decltype(expr)>(expr);
+    }
+
     template <class PtrPackType>
     void bind(const PtrPackType& pack)
     { 
@@ -10,6 +10,63 @@ inline size_t padded_length(size_t N)
     return std::pow(2, std::ceil(std::log(N)/std::log(2.)));
 }
 
+/**
+ * Workspace to compute the autocorrelation of one component of a process at a time.
+ * The FFT object (which caches its plans by length) and the padded buffers
+ * are kept between calls, so that computing the autocorrelation
+ * of many components of the same length only allocates on the first call.
+ *
+ * @tparam  T   underlying value type (usually double)
+ */
+template <class T>
+struct AutocorrelationWorkspace
+{
+    using value_t = T;
+    using complex_t = std::complex<value_t>;
+    using vec_t = Eigen::Matrix<value_t, Eigen::Dynamic, 1>;
+    using cvec_t = Eigen::Matrix<complex_t, Eigen::Dynamic, 1>;
+
+    /**
+     * Computes the autocorrelation of the process x (one value per time point) into out.
+     *
+     * @param   x       process vector (any Eigen vector expression, e.g. a column of a row-major block)
+     * @param   out     vector of the same size as x
+     */
+    template <class XType>
+    void compute(const Eigen::MatrixBase<XType>& x,
+                 Eigen::Ref<vec_t> out)
+    {
+        const size_t n_rows = x.size();
+        const size_t padded_len = 2*padded_length(n_rows);
+
+        // create centered copy of x
+        x_cent_.resize(padded_len);
+        x_cent_.setZero();
+        x_cent_.head(n_rows) = x.array() - x.mean();
+
+        // FFT
+        freq_.resize(padded_len);
+        fft_.fwd(freq_, x_cent_);
+
+        // compute complex-norm element-wise
+        freq_ = freq_.array().abs2();
+
+        // inverse FFT and trim to shape of x
+        ifreq_.resize(padded_len);
+        fft_.inv(ifreq_, freq_);
+
+        // get autocorrelation by normalizing by variance
+        out = ifreq_.head(n_rows).real() / (n_rows * n_rows * 2.);
+        out /= out(0);
+    }
+
+private:
+    Eigen::FFT<value_t> fft_;
+    vec_t x_cent_;
+    cvec_t freq_;
+    cvec_t ifreq_;
+};
+
 /**
  * Computes autocorrelation of x where each column of x
  * is a component of a process and hence each row is a time point.
@@ -26,37 +83,13 @@ template <class T>
 inline auto autocorrelation(const Eigen::MatrixBase<T>& x)
 {
     using scalar_t = typename T::Scalar;
-    using complex_t = std::complex<scalar_t>;
-
-    size_t n_rows = x.rows();
-    size_t padded_len = 2*padded_length(n_rows);
 
     Eigen::Matrix<scalar_t, Eigen::Dynamic, Eigen::Dynamic> out(x.rows(), x.cols());
 
-    Eigen::FFT<scalar_t> fft;
+    AutocorrelationWorkspace<scalar_t> workspace;
 
     for (int i = 0; i < x.cols(); ++i) {
-
-        // create centered copy of x
-        Eigen::Matrix<scalar_t, Eigen::Dynamic, 1> x_cent(padded_len);
-        x_cent.setZero();
-        x_cent.head(n_rows) = x.col(i).array() - x.col(i).mean();
-
-        // FFT 
-        Eigen::Matrix<complex_t, Eigen::Dynamic, 1> freq(padded_len);
-        fft.fwd(freq, x_cent);
-
-        // compute complex-norm element-wise
-        freq = freq.array().abs2();
-
-        // inverse FFT and trim to shape of x
-        Eigen::Matrix<complex_t, Eigen::Dynamic, 1> ifreq(padded_len);
-        fft.inv(ifreq, freq);
-
-        // get autocorrelation by normalizing by variance
-        out.col(i) = ifreq.head(n_rows).real() / (n_rows * n_rows * 2.);
-        out.col(i) /= out(0,i);
-
+        workspace.compute(x.col(i), out.col(i));
     }
 
     return out;
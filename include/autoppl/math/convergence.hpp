@@ -0,0 +1,203 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/math/density.hpp>
+#include <autoppl/math/ess.hpp>
+
+namespace ppl {
+namespace math {
+
+/**
+ * Computes the p-quantile of the standard normal distribution
+ * using Acklam's rational approximation followed by one step of Halley's method.
+ *
+ * @param   p   probability in (0, 1)
+ */
+inline double inv_normal_cdf(double p)
+{
+    static constexpr double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+                                   -2.759285104469687e+02, 1.383577518672690e+02,
+                                   -3.066479806614716e+01, 2.506628277459239e+00};
+    static constexpr double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+                                   -1.556989798598866e+02, 6.680131188771972e+01,
+                                   -1.328068155288572e+01};
+    static constexpr double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                                   -2.400758277161838e+00, -2.549732539343734e+00,
+                                   4.374664141464968e+00, 2.938163982698783e+00};
+    static constexpr double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+                                   2.445134137142996e+00, 3.754408661907416e+00};
+    static constexpr double p_low = 0.02425;
+
+    auto tail = [&](double q) {
+        return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+               ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.);
+    };
+
+    double x = 0.;
+    if (p < p_low) {
+        x = tail(std::sqrt(-2. * std::log(p)));
+    } else if (p <= 1. - p_low) {
+        const double q = p - 0.5;
+        const double r = q * q;
+        x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5]) * q /
+            (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1.);
+    } else {
+        x = -tail(std::sqrt(-2. * std::log1p(-p)));
+    }
+
+    // refinement
+    const double e = 0.5 * std::erfc(-x / std::sqrt(2.)) - p;
+    const double u = e * SQRT_TWO_PI * std::exp(0.5 * x * x);
+    return x - u / (1. + 0.5 * x * u);
+}
+
+/**
+ * Rank-normalizes every component (column) of the samples of all chains jointly,
+ * i.e. replaces every value by inv_normal_cdf((r - 3/8) / (S + 1/4))
+ * where r is its (average) rank among all S values of the component over all chains
+ * (Vehtari et al., 2021, Rank-normalization, folding, and localization).
+ *
+ * @param   samples     vector of sample matrices of every chain (see ess)
+ * @return  rank-normalized sample matrices
+ */
+template <class T>
+inline auto rank_normalize(const details::vec_cref_t<T>& samples)
+{
+    using mat_t = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+    std::vector<mat_t> out;
+    if (samples.empty()) return out;
+
+    const size_t M = samples.size();
+    const size_t N = samples[0].get().rows();
+    const size_t dim = samples[0].get().cols();
+    const size_t S = M * N;
+    for (size_t m = 0; m < M; ++m) out.emplace_back(N, dim);
+
+    std::vector<size_t> idx(S);
+    auto value = [&](size_t k, size_t d) { return samples[k / N].get()(k % N, d); };
+    for (size_t d = 0; d < dim; ++d) {
+        std::iota(idx.begin(), idx.end(), 0);
+        std::sort(idx.begin(), idx.end(), [&](size_t i, size_t j) {
+            return value(i, d) < value(j, d);
+        });
+        for (size_t begin = 0; begin < S;) {
+            // ties get the average rank
+            size_t end = begin + 1;
+            while (end < S && value(idx[end], d) == value(idx[begin], d)) ++end;
+            const double rank = 0.5 * (begin + 1 + end);
+            const double z = inv_normal_cdf((rank - 0.375) / (S + 0.25));
+            for (size_t i = begin; i < end; ++i) {
+                out[idx[i] / N](idx[i] % N, d) = z;
+            }
+            begin = end;
+        }
+    }
+    return out;
+}
+
+/**
+ * Splits every chain into its first and second half
+ * (dropping the middle sample if the number of samples is odd).
+ *
+ * @param   samples     vector of sample matrices of every chain (see ess)
+ * @return  vector of 2 * samples.size() sample matrices
+ */
+template <class T>
+inline auto split_chains(const details::vec_cref_t<T>& samples)
+{
+    using mat_t = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+    std::vector<mat_t> out;
+    for (const auto& chain : samples) {
+        const auto half = chain.get().rows() / 2;
+        out.emplace_back(chain.get().topRows(half));
+        out.emplace_back(chain.get().bottomRows(half));
+    }
+    return out;
+}
+
+/**
+ * Computes the potential scale reduction factor (R-hat) of every component
+ * from the within-chain variance W and between-chain variance B of the given chains:
+ * R-hat = sqrt(((N-1)/N W + B/N) / W).
+ *
+ * @param   samples     vector of sample matrices of every chain (see ess)
+ * @return  a vector of R-hat for each component
+ *          (empty if there are no chains or at most 1 sample)
+ */
+template <class T>
+inline auto rhat(const details::vec_cref_t<T>& samples)
+{
+    using vec_t = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+    using mat_t = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+
+    vec_t r_hat;
+    const size_t M = samples.size();
+    if (M == 0) return r_hat;
+    const size_t N = samples[0].get().rows();
+    const size_t dim = samples[0].get().cols();
+    if (N <= 1) return r_hat;
+
+    mat_t means(dim, M);
+    mat_t vars(dim, M);
+    for (size_t m = 0; m < M; ++m) {
+        const auto& x = samples[m].get();
+        means.col(m) = x.colwise().mean().transpose();
+        vars.col(m) = ((x.rowwise() - x.colwise().mean()).colwise().squaredNorm() /
+                       static_cast<T>(N-1)).transpose();
+    }
+
+    const vec_t W = vars.rowwise().mean();
+    const vec_t B_over_N = (M > 1) ?
+        vec_t((means.colwise() - means.rowwise().mean()).rowwise().squaredNorm() /
+              static_cast<T>(M-1)) :
+        vec_t(vec_t::Zero(dim));
+    r_hat = ((static_cast<T>(N-1) / N * W + B_over_N).array() / W.array()).sqrt().matrix();
+    return r_hat;
+}
+
+/**
+ * Computes the bulk effective sample size of every component,
+ * i.e. the ESS (see ess) of the rank-normalized split chains.
+ *
+ * @param   samples     vector of sample matrices of every chain (see ess)
+ * @param   estimator   ESS estimator whose buffers are reused (see ESSEstimator)
+ */
+template <class T>
+inline auto bulk_ess(const details::vec_cref_t<T>& samples,
+                     ESSEstimator<T>& estimator)
+{
+    using vec_t = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+    const auto z = rank_normalize(samples);
+    details::vec_cref_t<T> z_ref(z.begin(), z.end());
+    const auto split = split_chains(z_ref);
+    vec_t n_eff = estimator(split);
+    return n_eff;
+}
+
+template <class T>
+inline auto bulk_ess(const details::vec_cref_t<T>& samples)
+{
+    ESSEstimator<T> estimator;
+    return bulk_ess(samples, estimator);
+}
+
+/**
+ * Computes the (bulk) split R-hat of every component,
+ * i.e. the R-hat (see rhat) of the rank-normalized split chains.
+ *
+ * @param   samples     vector of sample matrices of every chain (see ess)
+ */
+template <class T>
+inline auto bulk_rhat(const details::vec_cref_t<T>& samples)
+{
+    const auto z = rank_normalize(samples);
+    details::vec_cref_t<T> z_ref(z.begin(), z.end());
+    const auto split = split_chains(z_ref);
+    return rhat<T>(details::vec_cref_t<T>(split.begin(), split.end()));
+}
+
+} // namespace math
+} // namespace ppl
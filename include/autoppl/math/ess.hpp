@@ -1,6 +1,11 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
 #include <Eigen/Dense>
 #include <autoppl/math/autocorrelation.hpp>
+#include <autoppl/util/thread_pool.hpp>
 
 namespace ppl {
 namespace math {
@@ -10,130 +15,209 @@ template <class T>
 using vec_cref_t = std::vector<
     std::reference_wrapper<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> >;
 
+/**
+ * Returns the sample matrix of a chain,
+ * which may be stored directly or through a reference wrapper.
+ */
+template <class MatType>
+inline const MatType& get_chain(const MatType& mat) { return mat; }
+
+template <class MatType>
+inline const MatType& get_chain(const std::reference_wrapper<MatType>& mat) { return mat.get(); }
+
 } // namespace details
 
 /**
- * Computes the effective sample size (ESS) for a given vector of samples (matrices).
- * Every element of the vector is a matrix of samples for each chain.
- * Every matrix contains the samples as rows, i.e.
- * every row is a sample of an p-dimensional vector, where p
- * is the number of columns of the matrix (number of parameters).
- *
- * The algorithm assumes that every sample matrix has the same dimensions.
+ * Batched effective sample size (ESS) estimator.
+ * Every component is processed independently with its own scratch buffers
+ * (see AutocorrelationWorkspace), so that components can be split across threads
+ * and the result does not depend on the number of threads.
+ * All buffers are kept between calls, hence repeatedly computing the ESS
+ * of samples of the same shape (e.g. during sampling) does not allocate.
  *
- * @tparam  T           underlying Eigen expression type
- * @param   samples     vector of samples
+ * The samples of every chain can be any Eigen matrix expression
+ * (e.g. Eigen::Ref or Eigen::Map of a row- or column-major block of a result),
+ * which is read in place.
  *
- * @return  a vector of ESS for each component
- *          If number of samples is 1 or less, or there are 0 components,
- *          or number of chains is 0, return an empty vector.
- *          In either case, the dimension of the return vector is same
- *          as the number of components.
+ * @tparam  T   underlying value type (usually double)
  */
-template <class T>
-inline auto ess(const details::vec_cref_t<T>& samples)
+template <class T = double>
+struct ESSEstimator
 {
     using value_t = T;
     using vec_t = Eigen::Matrix<value_t, Eigen::Dynamic, 1>;
-    using mat_t = Eigen::Matrix<value_t, Eigen::Dynamic, Eigen::Dynamic>;
 
-    vec_t tau_hat;
+    /**
+     * @param   pool    thread pool to split the components across (if nullptr, runs serially)
+     */
+    explicit ESSEstimator(util::ThreadPool* pool = nullptr)
+        : pool_(pool)
+    {}
+
+    /**
+     * Computes the ESS of every component (see ess).
+     *
+     * @param   samples     vector of sample matrices (or reference wrappers to them) of every chain
+     * @return  reference to a vector of ESS for each component,
+     *          which is valid until the next call.
+     */
+    template <class SamplesType>
+    const vec_t& operator()(const SamplesType& samples)
+    {
+        const size_t M = samples.size();      // number of chains
+        if (M == 0) {
+            n_eff_.resize(0);
+            return n_eff_;
+        }
 
-    size_t M = samples.size();      // number of chains
+        const size_t dim = details::get_chain(samples[0]).cols();   // sample dimension
+        const size_t N = details::get_chain(samples[0]).rows();     // number of samples
+        if (N <= 1 || dim == 0) {
+            n_eff_.resize(0);
+            return n_eff_;
+        }
 
-    if (M == 0) return tau_hat;
+        n_eff_.resize(dim);
 
-    size_t dim = samples[0].get().cols();    // sample dimension
-    size_t N = samples[0].get().rows();      // number of samples
+        const size_t n_tasks = pool_ ? std::min(pool_->size(), dim) : 1;
+        if (workspaces_.size() < n_tasks) workspaces_.resize(n_tasks);
 
-    if (N <= 1 || dim == 0) return tau_hat;
+        // task i processes a contiguous range of components
+        auto task = [&](size_t i) {
+            auto& workspace = workspaces_[i];
+            const size_t begin = dim * i / n_tasks;
+            const size_t end = dim * (i+1) / n_tasks;
+            for (size_t d = begin; d < end; ++d) {
+                n_eff_(d) = workspace.ess(samples, d);
+            }
+        };
 
-    tau_hat = vec_t::Zero(dim);
+        if (pool_) pool_->parallel_for(n_tasks, task);
+        else task(0);
 
-    auto var = [N](const auto& mat) {
-        return (mat.rowwise() - 
-                mat.colwise().mean()).colwise()
-                                     .squaredNorm() / (N-1);
-    };
-
-    // use N-1 scaling to compute variance
-    // each col is the sample variance per chain
-    mat_t sample_vars(dim, M);
-    for (size_t i = 0; i < M; ++i) {
-        sample_vars.col(i) = var(samples[i].get());
+        return n_eff_;
     }
 
-    // column vector of average of sample variances
-    vec_t W = sample_vars.rowwise().mean();
+private:
+    struct Workspace
+    {
+        /**
+         * Computes the ESS of component d.
+         */
+        template <class SamplesType>
+        value_t ess(const SamplesType& samples, size_t d)
+        {
+            const size_t M = samples.size();
+            const size_t N = details::get_chain(samples[0]).rows();
+
+            // use N-1 scaling to compute variance per chain
+            sample_means.resize(M);
+            sample_vars.resize(M);
+            for (size_t m = 0; m < M; ++m) {
+                const auto x = details::get_chain(samples[m]).col(d);
+                sample_means(m) = x.mean();
+                sample_vars(m) = (x.array() - sample_means(m)).matrix().squaredNorm() / (N-1);
+            }
 
-    // compute variance estimator
-    vec_t var_est = static_cast<T>(N-1) / N * W;
+            // average of sample variances
+            const value_t W = sample_vars.mean();
 
-    // if there is more than 1 chain, then update by N * B
-    // where B is the between-chain variance
-    if (M > 1) {
-        mat_t sample_mean(dim, M);
-        for (size_t i = 0; i < M; ++i) {
-            sample_mean.col(i) = samples[i].get().colwise().mean();
-        }
-        var_est += var(sample_mean.transpose());
-    }
+            // compute variance estimator
+            value_t var_est = static_cast<T>(N-1) / N * W;
 
-    // compute autocorrelation vector for each component
-    // every column vector (every component) is average AC over chains
-    mat_t acov_mean(N, dim);
-    acov_mean.setZero();
+            // if there is more than 1 chain, then update by N * B
+            // where B is the between-chain variance
+            if (M > 1) {
+                var_est += (sample_means.array() - sample_means.mean()).matrix().squaredNorm() / (N-1);
+            }
 
-    for (size_t m = 1; m <= M; ++m) {
-        mat_t next_acov = autocorrelation(samples[m-1].get());
-        for (int j = 0; j < next_acov.cols(); ++j) {
-            next_acov.col(j) *= sample_vars(j,m-1);
-        }
-        value_t m_inv = 1./m;
-        acov_mean = m_inv * next_acov + (m-1) * m_inv * acov_mean;
-    }
-    
-    // compute rho-hat at lag t for dimension d
-    auto rho_hat = [&](size_t t, size_t d) {
-        return 1. - (W(d) - acov_mean(t,d))/var_est(d);
-    };
+            // average autocovariance over chains
+            ac.resize(N);
+            acov_mean.resize(N);
+            acov_mean.setZero();
+            for (size_t m = 1; m <= M; ++m) {
+                ac_workspace.compute(details::get_chain(samples[m-1]).col(d), ac);
+                ac *= sample_vars(m-1);
+                value_t m_inv = 1./m;
+                acov_mean = m_inv * ac + (m-1) * m_inv * acov_mean;
+            }
 
-    // compute tau-hat directly to save memory
-    for (size_t d = 0; d < dim; ++d) {
-        
-        // first two should not be corrected for positive and monotoneness
-        value_t curr_rho_hat_even = rho_hat(0,d);
-        value_t curr_p_hat = curr_rho_hat_even + rho_hat(1,d);  // current P_hat(t)
-        value_t curr_min = curr_p_hat;                          // current min of P_hat(t)
-        tau_hat(d) = curr_min;                                  // update with P_hat(0)
-
-        // only estimate up to 3 samples before the end
-        // and Geyer's positive condition holds
-        size_t t = 2;
-        for (; t < (N-3) && curr_p_hat > 0; t += 2) {
-            curr_rho_hat_even = rho_hat(t,d);
-            curr_p_hat = curr_rho_hat_even + rho_hat(t+1,d);
-
-            // if positive condition holds, take the min 
-            // of current P_hat(t) with the min of previous P_hat's
-            // to create a monotone sequence and accumulate to tau_hat
-            if (curr_p_hat >= 0) {
-                curr_min = std::min(curr_min, curr_p_hat);
-                tau_hat(d) += curr_min;
+            // compute rho-hat at lag t
+            auto rho_hat = [&](size_t t) {
+                return 1. - (W - acov_mean(t))/var_est;
+            };
+
+            // first two should not be corrected for positive and monotoneness
+            value_t curr_rho_hat_even = rho_hat(0);
+            value_t curr_p_hat = curr_rho_hat_even + rho_hat(1);  // current P_hat(t)
+            value_t curr_min = curr_p_hat;                        // current min of P_hat(t)
+            value_t tau_hat = curr_min;                           // update with P_hat(0)
+
+            // only estimate up to 3 samples before the end
+            // and Geyer's positive condition holds
+            size_t t = 2;
+            for (; t < (N-3) && curr_p_hat > 0; t += 2) {
+                curr_rho_hat_even = rho_hat(t);
+                curr_p_hat = curr_rho_hat_even + rho_hat(t+1);
+
+                // if positive condition holds, take the min 
+                // of current P_hat(t) with the min of previous P_hat's
+                // to create a monotone sequence and accumulate to tau_hat
+                if (curr_p_hat >= 0) {
+                    curr_min = std::min(curr_min, curr_p_hat);
+                    tau_hat += curr_min;
+                }
             }
-        }
 
-        // correct to improve estimate (see STAN's implementation)
-        value_t correction = (curr_rho_hat_even > 0) ? 
-                curr_rho_hat_even : rho_hat(t,d);
+            // correct to improve estimate (see STAN's implementation)
+            value_t correction = (curr_rho_hat_even > 0) ? 
+                    curr_rho_hat_even : rho_hat(t);
 
-        tau_hat(d) *= 2.; // 2 * sum of adjusted P_hat(t)
-        tau_hat(d) -= 1.; // -1 + 2 * sum of adjusted P_hat(t) 
-        tau_hat(d) += correction;   
-    }
+            tau_hat *= 2.; // 2 * sum of adjusted P_hat(t)
+            tau_hat -= 1.; // -1 + 2 * sum of adjusted P_hat(t) 
+            tau_hat += correction;   
+
+            return N*M*std::min<value_t>(1./tau_hat, std::log10(N));
+        }
 
-    vec_t n_eff = N*M*(1./tau_hat.array()).min(std::log10(N)).matrix();
+        AutocorrelationWorkspace<value_t> ac_workspace;
+        vec_t sample_means;     // mean of every chain
+        vec_t sample_vars;      // variance of every chain
+        vec_t ac;               // autocorrelation of current chain
+        vec_t acov_mean;        // average autocovariance over chains
+    };
 
+    util::ThreadPool* pool_;
+    std::vector<Workspace> workspaces_;     // one per task
+    vec_t n_eff_;
+};
+
+/**
+ * Computes the effective sample size (ESS) for a given vector of samples (matrices).
+ * Every element of the vector is a matrix of samples for each chain.
+ * Every matrix contains the samples as rows, i.e.
+ * every row is a sample of an p-dimensional vector, where p
+ * is the number of columns of the matrix (number of parameters).
+ *
+ * The algorithm assumes that every sample matrix has the same dimensions.
+ * To reuse buffers between calls, read views without copying,
+ * or split the components across threads, see ESSEstimator.
+ *
+ * @tparam  T           underlying Eigen expression type
+ * @param   samples     vector of samples
+ *
+ * @return  a vector of ESS for each component
+ *          If number of samples is 1 or less, or there are 0 components,
+ *          or number of chains is 0, return an empty vector.
+ *          In either case, the dimension of the return vector is same
+ *          as the number of components.
+ */
+template <class T>
+inline auto ess(const details::vec_cref_t<T>& samples)
+{
+    using vec_t = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+    ESSEstimator<T> estimator;
+    vec_t n_eff = estimator(samples);
     return n_eff;
 }
 
@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <Eigen/Dense>
+#include <autoppl/math/welford.hpp>
+
+namespace ppl {
+namespace math {
+
+/**
+ * Streaming Monte Carlo standard error (MCSE) of the mean of n-dimensional draws
+ * using non-overlapping batch means.
+ * Consecutive draws are grouped into batches of batch_size draws,
+ * and the variance of the a batch means (estimated with WelfordVar)
+ * gives MCSE = sqrt(var(batch means) / a).
+ * Draws of an incomplete last batch are ignored.
+ * A common choice of batch_size is floor(sqrt(n)) for n draws.
+ */
+struct BatchMeans
+{
+    BatchMeans(size_t n_params, size_t batch_size)
+        : batch_size_(std::max<size_t>(batch_size, 1))
+        , batch_sum_(Eigen::VectorXd::Zero(n_params))
+        , batch_means_(n_params)
+    {}
+
+    /*
+     * Update batch means with new draw x.
+     */
+    template <class MatType>
+    void update(const MatType& x)
+    {
+        batch_sum_ += x;
+        if (++n_in_batch_ == batch_size_) {
+            batch_sum_ *= 1./static_cast<double>(batch_size_);
+            batch_means_.update(batch_sum_);
+            batch_sum_.setZero();
+            n_in_batch_ = 0;
+        }
+    }
+
+    /**
+     * Populates mcse with the current MCSE estimates
+     * (NaN while fewer than 2 batches are complete).
+     */
+    template <class VecType>
+    void get_mcse(VecType& mcse) const
+    {
+        const double a = get_n_batches();
+        if (a < 2) {
+            mcse.setConstant(std::numeric_limits<double>::quiet_NaN());
+            return;
+        }
+        mcse = (batch_means_.get_variance().array() / ((a - 1.) * a)).sqrt().matrix();
+    }
+
+    size_t get_batch_size() const { return batch_size_; }
+    size_t get_n_batches() const { return batch_means_.get_n_samples(); }
+
+    /**
+     * Resets to no draws.
+     * Equivalent to constructing a new object of this type.
+     */
+    void reset()
+    {
+        batch_sum_.setZero();
+        batch_means_.reset();
+        n_in_batch_ = 0;
+    }
+
+private:
+    size_t batch_size_;
+    Eigen::VectorXd batch_sum_;     // sum of draws of the current batch
+    WelfordVar batch_means_;        // estimator of variance of batch means
+    size_t n_in_batch_ = 0;
+};
+
+} // namespace math
+} // namespace ppl
@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace ppl {
+namespace math {
+
+/**
+ * Streaming estimate of the p-quantile of scalar data
+ * using the P^2 algorithm (Jain and Chlamtac, 1985).
+ * Only 5 markers are stored, i.e. memory does not grow with the number of observations.
+ * Until 5 observations have been seen, the exact (linearly interpolated) quantile is returned.
+ */
+struct P2Quantile
+{
+    P2Quantile(double p = 0.5)
+        : p_(p)
+        , dn_{0., p/2., p, (1.+p)/2., 1.}
+    {}
+
+    /*
+     * Update markers with new observation x.
+     */
+    void update(double x)
+    {
+        if (n_obs_ < 5) {
+            q_[n_obs_++] = x;
+            if (n_obs_ == 5) {
+                std::sort(q_.begin(), q_.end());
+                for (size_t i = 0; i < 5; ++i) {
+                    n_[i] = i + 1;
+                    np_[i] = 1. + 4. * dn_[i];
+                }
+            }
+            return;
+        }
+        ++n_obs_;
+
+        // find cell k such that q_k <= x < q_{k+1} (adjusting extreme markers)
+        size_t k = 0;
+        if (x < q_[0]) {
+            q_[0] = x;
+            k = 0;
+        } else if (x >= q_[4]) {
+            q_[4] = x;
+            k = 3;
+        } else {
+            while (x >= q_[k+1]) ++k;
+        }
+
+        for (size_t i = k+1; i < 5; ++i) ++n_[i];
+        for (size_t i = 0; i < 5; ++i) np_[i] += dn_[i];
+
+        // adjust heights of middle markers if necessary
+        for (size_t i = 1; i < 4; ++i) {
+            const double d = np_[i] - n_[i];
+            if ((d >= 1. && n_[i+1] - n_[i] > 1.) ||
+                (d <= -1. && n_[i-1] - n_[i] < -1.)) {
+                const double s = (d >= 0.) ? 1. : -1.;
+                double q_new = parabolic_(i, s);
+                if (!(q_[i-1] < q_new && q_new < q_[i+1])) {
+                    q_new = linear_(i, s);
+                }
+                q_[i] = q_new;
+                n_[i] += s;
+            }
+        }
+    }
+
+    /**
+     * Returns the current estimate of the p-quantile (NaN if no observations).
+     */
+    double get_quantile() const
+    {
+        if (n_obs_ == 0) return std::numeric_limits<double>::quiet_NaN();
+        if (n_obs_ >= 5) return q_[2];
+        std::array<double, 5> sorted = q_;
+        std::sort(sorted.begin(), sorted.begin() + n_obs_);
+        const double h = p_ * (n_obs_ - 1);
+        const size_t lo = static_cast<size_t>(std::floor(h));
+        const size_t hi = std::min(lo + 1, n_obs_ - 1);
+        return sorted[lo] + (h - lo) * (sorted[hi] - sorted[lo]);
+    }
+
+    double get_p() const { return p_; }
+    size_t get_n_samples() const { return n_obs_; }
+
+    /**
+     * Resets to no observations.
+     * Equivalent to constructing a new object of this type with the same p.
+     */
+    void reset() { n_obs_ = 0; }
+
+private:
+    double parabolic_(size_t i, double s) const
+    {
+        return q_[i] + s / (n_[i+1] - n_[i-1]) * (
+                (n_[i] - n_[i-1] + s) * (q_[i+1] - q_[i]) / (n_[i+1] - n_[i]) +
+                (n_[i+1] - n_[i] - s) * (q_[i] - q_[i-1]) / (n_[i] - n_[i-1]) );
+    }
+
+    double linear_(size_t i, double s) const
+    {
+        const size_t j = (s > 0.) ? i+1 : i-1;
+        return q_[i] + s * (q_[j] - q_[i]) / (n_[j] - n_[i]);
+    }
+
+    double p_;
+    std::array<double, 5> dn_;  // increments of desired marker positions
+    std::array<double, 5> q_;   // marker heights
+    std::array<double, 5> n_;   // marker positions
+    std::array<double, 5> np_;  // desired marker positions
+    size_t n_obs_ = 0;          // number of observations
+};
+
+} // namespace math
+} // namespace ppl
@@ -1,21 +1,23 @@
 #pragma once
-#include <type_traits>
 #include <Eigen/Dense>
+#include <autoppl/util/serialize.hpp>
 
 namespace ppl {
 namespace math {
 
 /**
  * Estimates sample variance for n-dimensional data using
- * Welford's online algorithm
+ * Welford's online algorithm.
+ * get_variance() returns the sum of squared deviations from the mean
+ * (not yet divided by the number of samples).
  */
 struct WelfordVar
 {
     WelfordVar(size_t n_params)
-        : m_{n_params, 2}
-        , mean_{m_.col(0)}
-        , m2n_{m_.col(1)}
-    { m_.setZero(); }
+        : mean_(n_params)
+        , delta_(n_params)
+        , m2n_(n_params)
+    { reset(); }
 
     /*
      * Update sample mean and sample variance with new sample x.
@@ -24,11 +26,12 @@ struct WelfordVar
     void update(const MatType& x)
     {
         ++n_;
-        auto delta = x - mean_;
-        mean_ += (1./static_cast<double>(n_)) * delta;
-        m2n_ += (delta.array() * (x - mean_).array()).matrix();
+        delta_ = x - mean_;
+        mean_ += (1./static_cast<double>(n_)) * delta_;
+        m2n_ += (delta_.array() * (x - mean_).array()).matrix();
     }
 
+    const auto& get_mean() const { return mean_; }
     const auto& get_variance() const { return m2n_; }
     size_t get_n_samples() const { return n_; }
 
@@ -38,18 +41,102 @@ struct WelfordVar
      */
     void reset()
     {
-        m_.setZero();
+        mean_.setZero();
+        m2n_.setZero();
         n_ = 0;
     }
 
+    /**
+     * Saves (loads) the estimator state (see util::write_mat).
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_mat(os, mean_);
+        util::write_mat(os, m2n_);
+        util::write_pod(os, static_cast<uint64_t>(n_));
+    }
+
+    void load(std::istream& is)
+    {
+        uint64_t n = 0;
+        util::read_mat(is, mean_);
+        util::read_mat(is, m2n_);
+        util::read_pod(is, n);
+        n_ = n;
+    }
+
 private:
-    Eigen::MatrixXd m_; 
+    Eigen::VectorXd mean_;
+    Eigen::VectorXd delta_;     // cache for current deviation from mean
+    Eigen::VectorXd m2n_;
+    size_t n_ = 0;              // number of samples
+};
+
+/**
+ * Estimates sample covariance matrix for n-dimensional data using
+ * Welford's online algorithm.
+ * Like WelfordVar, get_covariance() returns the sum of outer products
+ * of deviations from the mean (not yet divided by the number of samples).
+ */
+struct WelfordCov
+{
+    WelfordCov(size_t n_params)
+        : mean_(n_params)
+        , delta_(n_params)
+        , m2n_(n_params, n_params)
+    { reset(); }
 
-    using col_t = std::decay_t<decltype(m_.col(0))>;
-    col_t mean_;
-    col_t m2n_;
+    /*
+     * Update sample mean and sample covariance with new sample x.
+     */
+    template <class MatType>
+    void update(const MatType& x)
+    {
+        ++n_;
+        delta_ = x - mean_;
+        mean_ += (1./static_cast<double>(n_)) * delta_;
+        m2n_.noalias() += (x - mean_) * delta_.transpose();
+    }
 
-    size_t n_ = 0;  // number of samples
+    const auto& get_mean() const { return mean_; }
+    const auto& get_covariance() const { return m2n_; }
+    size_t get_n_samples() const { return n_; }
+
+    /**
+     * Resets sample mean, sample covariance, and number of samples to 0
+     * Equivalent to constructing a new object of this type.
+     */
+    void reset()
+    {
+        mean_.setZero();
+        m2n_.setZero();
+        n_ = 0;
+    }
+
+    /**
+     * Saves (loads) the estimator state (see util::write_mat).
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_mat(os, mean_);
+        util::write_mat(os, m2n_);
+        util::write_pod(os, static_cast<uint64_t>(n_));
+    }
+
+    void load(std::istream& is)
+    {
+        uint64_t n = 0;
+        util::read_mat(is, mean_);
+        util::read_mat(is, m2n_);
+        util::read_pod(is, n);
+        n_ = n;
+    }
+
+private:
+    Eigen::VectorXd mean_;
+    Eigen::VectorXd delta_;     // cache for current deviation from mean
+    Eigen::MatrixXd m2n_;
+    size_t n_ = 0;              // number of samples
 };
 
 } // namespace math
@@ -1,34 +1,63 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 #include <autoppl/util/traits/traits.hpp>
 #include <autoppl/util/packs/ptr_pack.hpp>
 #include <autoppl/util/value.hpp>
+#include <autoppl/util/thread_pool.hpp>
 #include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/sink.hpp>
 
 namespace ppl {
 namespace mcmc {
 
-template <class ExprType
-        , class ConfigType
-        , class Sampler>
-inline MCMCResult<> base_mcmc(const ExprType& expr,
-                              const ConfigType& config,
-                              Sampler f)
+/**
+ * Runs config.n_chains independent chains on the thread pool.
+ * The functor is called as f(chain, warmup_time, sampling_time)
+ * where chain is the chain index and warmup_time, sampling_time
+ * are references to the timing results of that chain.
+ * The result object's timing information is set to be the maximum over all chains.
+ *
+ * @param   config      configuration object (only n_chains is used)
+ * @param   pool        thread pool to run chains on
+ * @param   res         result object whose timing information is populated
+ * @param   f           functor that runs a single chain
+ */
+template <class ConfigType
+        , class MCMCResultType
+        , class ChainFunc>
+inline void run_chains(const ConfigType& config,
+                       util::ThreadPool& pool,
+                       MCMCResultType& res,
+                       ChainFunc&& f)
 {
-    using program_t = util::convert_to_program_t<ExprType>;
-    program_t program = expr;
+    std::vector<double> warmup_times(config.n_chains, 0);
+    std::vector<double> sampling_times(config.n_chains, 0);
 
-    auto pack = program.activate();
-    size_t n_cont = std::get<0>(pack).uc_offset;
-    size_t n_disc = std::get<1>(pack).uc_offset;
-    MCMCResult<Eigen::RowMajor> res(config.samples, n_cont, n_disc);
+    pool.parallel_for(config.n_chains, [&](size_t chain) {
+        f(chain, warmup_times[chain], sampling_times[chain]);
+    });
 
-    f(program, config, pack, res); // call actual sampling algorithm and populate res
-
-    // Note: discrete cannot be constrained, so we only need to transform continuous
+    res.warmup_time = 0;
+    res.sampling_time = 0;
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        res.warmup_time = std::max(res.warmup_time, warmup_times[c]);
+        res.sampling_time = std::max(res.sampling_time, sampling_times[c]);
+    }
+}
 
-    // Compute total size of purely only constrained parameters.
-    // Note that this is NOT the same pack.c_offset after activating.
-    // The latter is always >= the former, but may be > (see PosDef constraint for example).
+/**
+ * Returns the total size of purely constrained continuous parameters of program.
+ * Note that this is NOT the same as pack.c_offset after activating.
+ * The latter is always >= the former, but may be > (see PosDef constraint for example).
+ */
+template <class ProgramType>
+inline size_t n_constrained_params(ProgramType& program)
+{
     size_t n_cont_c = 0;
     auto n_cont_c__ = [&](auto& eq_node) {
         auto& var = eq_node.get_variable();
@@ -39,48 +68,74 @@ inline MCMCResult<> base_mcmc(const ExprType& expr,
         }
     };
     program.get_model().traverse(n_cont_c__);
+    return n_cont_c;
+}
 
-    // Create transformed result object
-    // Note that the number of cols for continuous sample is n_cont_c + 1,
-    // where +1 is for the log-pdf.
-    //
-    // Computing logpdf solves two issues:
-    // 1) we can save logpdf to get summary
-    // 2) calling logpdf automatically evaluates all expressions properly
-    // such that, in particular, constrained values are evaluated properly.
+/**
+ * Transforms unconstrained draws into constrained draws.
+ * It owns a copy of the program bound to its own buffers,
+ * so it must not be moved after construction.
+ *
+ * If the sampler recorded the log-pdf of a draw (see DrawStats::log_pdf),
+ * only the inverse transforms of the parameters are evaluated (see ProgramNode::inv_transform).
+ * Otherwise, computing the log-pdf solves two issues:
+ * 1) we can save the log-pdf to get summary
+ * 2) calling log-pdf automatically evaluates all expressions properly
+ * such that, in particular, constrained values are evaluated properly.
+ *
+ * Note: discrete cannot be constrained, so we only need to transform continuous.
+ */
+template <class ProgramType>
+struct ConstrainedDraw
+{
+    template <class OffsetPackType>
+    ConstrainedDraw(const ProgramType& program,
+                    const OffsetPackType& pack)
+        : program_(program)
+        , disc_uc_val_(std::get<1>(pack).uc_offset)
+        , cont_uc_val_(std::get<0>(pack).uc_offset)
+        , cont_tp_val_(std::get<0>(pack).tp_offset)
+        , cont_c_val_(Eigen::VectorXd::Zero(std::get<0>(pack).c_offset))
+        , cont_v_val_(Eigen::Matrix<size_t, Eigen::Dynamic, 1>::Zero(std::get<0>(pack).v_offset))
+    {
+        values.resize(n_constrained_params(program_) + 1);
 
-    MCMCResult<> t_res(config.samples, n_cont_c + 1, n_disc);
-    std::swap(t_res.name, res.name);
-    std::swap(t_res.warmup_time, res.warmup_time);
-    std::swap(t_res.sampling_time, res.sampling_time);
-    t_res.disc_samples.swap(res.disc_samples);
+        util::cont_ptr_pack_t cont_ptr_pack;
+        cont_ptr_pack.uc_val = cont_uc_val_.data();
+        cont_ptr_pack.tp_val = cont_tp_val_.data();
+        cont_ptr_pack.c_val = cont_c_val_.data();
+        cont_ptr_pack.v_val = cont_v_val_.data();
+        program_.bind(cont_ptr_pack);
+
+        util::disc_ptr_pack_t disc_ptr_pack;
+        disc_ptr_pack.uc_val = disc_uc_val_.data();
+        program_.bind(disc_ptr_pack);
+    }
+
+    ConstrainedDraw(const ConstrainedDraw&) =delete;
+    ConstrainedDraw& operator=(const ConstrainedDraw&) =delete;
 
-    // Transform every unconstrained params to constrained
-    auto& cont_pack = std::get<0>(pack);
-    auto& disc_pack = std::get<1>(pack);
-    Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1> disc_uc_val(disc_pack.uc_offset);
-    Eigen::VectorXd cont_uc_val(cont_pack.uc_offset);
-    Eigen::VectorXd cont_tp_val(cont_pack.tp_offset);
-    Eigen::VectorXd cont_c_val(cont_pack.c_offset);
-    Eigen::Matrix<size_t, Eigen::Dynamic, 1> cont_v_val(cont_pack.v_offset);
-    cont_c_val.setZero();
-    cont_v_val.setZero();
-
-    util::cont_ptr_pack_t cont_ptr_pack;
-    cont_ptr_pack.uc_val = cont_uc_val.data();
-    cont_ptr_pack.tp_val = cont_tp_val.data();
-    cont_ptr_pack.c_val = cont_c_val.data();
-    cont_ptr_pack.v_val = cont_v_val.data();
-    program.bind(cont_ptr_pack);
-
-    util::disc_ptr_pack_t disc_ptr_pack;
-    disc_ptr_pack.uc_val = disc_uc_val.data();
-    program.bind(disc_ptr_pack);
-
-    for (int i = 0; i < res.cont_samples.rows(); ++i) {
-        disc_uc_val = t_res.disc_samples.row(i);
-        cont_uc_val = res.cont_samples.row(i);
-        auto lpdf = program.log_pdf();
+    /**
+     * Populates values with the constrained values of the draw (cont_uc, disc_uc)
+     * in the order of the model, followed by its log-pdf.
+     *
+     * @param   log_pdf     log-pdf of the draw recorded by the sampler
+     *                      (NaN if it must be evaluated)
+     */
+    template <class ContType, class DiscType>
+    void operator()(const ContType& cont_uc,
+                    const DiscType& disc_uc,
+                    double log_pdf = std::numeric_limits<double>::quiet_NaN())
+    {
+        disc_uc_val_ = disc_uc;
+        cont_uc_val_ = cont_uc;
+        cont_v_val_.setZero();
+        double lpdf = log_pdf;
+        if (std::isnan(lpdf)) {
+            lpdf = program_.log_pdf();
+        } else {
+            program_.inv_transform();
+        }
         size_t offset = 0;
         auto copy__ = [&](auto& eq_node) {
             auto& var = eq_node.get_variable();
@@ -93,16 +148,329 @@ inline MCMCResult<> base_mcmc(const ExprType& expr,
                 } else {
                     util::bind(mp, var.get().data(), 1, var.size());
                 }
-                t_res.cont_samples.block(i, offset, 1, var.size()) = mp;
+                values.segment(offset, var.size()) = mp.transpose();
                 offset += var.size();
             }        
         };
-        program.get_model().traverse(copy__);
-        t_res.cont_samples(i, offset) = lpdf;
+        program_.get_model().traverse(copy__);
+        values(offset) = lpdf;
+    }
+
+    Eigen::VectorXd values;     // constrained values followed by log-pdf
+
+private:
+    ProgramType program_;
+    Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1> disc_uc_val_;
+    Eigen::VectorXd cont_uc_val_;
+    Eigen::VectorXd cont_tp_val_;
+    Eigen::VectorXd cont_c_val_;
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> cont_v_val_;
+};
+
+/**
+ * Output of a streaming sampling algorithm (see stream_mcmc).
+ * It takes the place of the result object of base_mcmc,
+ * i.e. samplers populate name and timing information
+ * and obtain the writer of every chain through chain_writer.
+ */
+template <class SinkType
+        , class ProgramType
+        , class OffsetPackType>
+struct SinkOutput
+{
+    SinkOutput(SinkType& _sink,
+               const ProgramType& _program,
+               const OffsetPackType& _pack)
+        : sink(_sink)
+        , program(_program)
+        , pack(_pack)
+    {}
+
+    SinkType& sink;
+    const ProgramType& program;
+    const OffsetPackType& pack;
+    std::string name;
+    double warmup_time = 0;
+    double sampling_time = 0;
+};
+
+/**
+ * Writer of a single chain that transforms every (thinned) draw
+ * with its own ConstrainedDraw and passes it to the sink
+ * (along with its stats, whose log_pdf is always set).
+ */
+template <class SinkType
+        , class ProgramType
+        , class OffsetPackType>
+struct SinkChainWriter
+{
+    SinkChainWriter(SinkOutput<SinkType, ProgramType, OffsetPackType>& out,
+                    size_t chain)
+        : sink_(out.sink)
+        , chain_(chain)
+        , draw_(out.program, out.pack)
+    {}
+
+    template <class ContType, class DiscType>
+    void operator()(size_t i,
+                    const ContType& cont,
+                    const DiscType& disc,
+                    const DrawStats& stats)
+    {
+        if (i % sink_.thin) return;
+        draw_(cont, disc, stats.log_pdf);
+        DrawStats draw_stats = stats;
+        draw_stats.log_pdf = draw_.values(draw_.values.size() - 1);
+        sink_.write(chain_, draw_.values, disc, draw_stats);
     }
 
+private:
+    SinkType& sink_;
+    size_t chain_;
+    ConstrainedDraw<ProgramType> draw_;
+};
+
+/**
+ * Output of a sampling algorithm whose draws are transformed as they are produced
+ * directly into their rows of the final (constrained) result (see transform_mcmc).
+ * It takes the place of the result object of base_mcmc
+ * and samplers obtain the writer of every chain through chain_writer.
+ */
+template <class ProgramType
+        , class OffsetPackType>
+struct TransformOutput: MCMCResult<>
+{
+    TransformOutput(size_t n_samples,
+                    size_t n_cont_params,
+                    size_t n_disc_params,
+                    size_t n_chains,
+                    const ProgramType& _program,
+                    const OffsetPackType& _pack)
+        : MCMCResult<>(n_samples, n_cont_params, n_disc_params, n_chains)
+        , program(_program)
+        , pack(_pack)
+    {}
+
+    const ProgramType& program;
+    const OffsetPackType& pack;
+};
+
+/**
+ * Writer of a single chain that transforms every draw
+ * with its own ConstrainedDraw into row i of the chain in the result.
+ */
+template <class ProgramType
+        , class OffsetPackType>
+struct TransformChainWriter
+{
+    TransformChainWriter(TransformOutput<ProgramType, OffsetPackType>& out,
+                         size_t chain)
+        : cont_samples_(out.cont_chain(chain))
+        , disc_samples_(out.disc_chain(chain))
+        , draw_(out.program, out.pack)
+    {}
+
+    template <class ContType, class DiscType>
+    void operator()(size_t i,
+                    const ContType& cont,
+                    const DiscType& disc,
+                    const DrawStats& stats)
+    {
+        draw_(cont, disc, stats.log_pdf);
+        cont_samples_.row(i) = draw_.values.transpose();
+        disc_samples_.row(i) = disc;
+    }
+
+private:
+    using cont_block_t = decltype(std::declval<MCMCResult<>&>().cont_chain(0));
+    using disc_block_t = decltype(std::declval<MCMCResult<>&>().disc_chain(0));
+
+    cont_block_t cont_samples_;
+    disc_block_t disc_samples_;
+    ConstrainedDraw<ProgramType> draw_;
+};
+
+/**
+ * Returns the writer of chain c that samplers call as
+ * f(i, cont, disc, stats) with the i'th draw after warmup (unconstrained continuous values cont,
+ * discrete values disc) and the DrawStats of the transition that produced it.
+ * The writer of a result object stores the unconstrained draw in row i of the chain
+ * and its log-pdf in res.log_pdf_samples (if allocated).
+ */
+template <int Major>
+inline auto chain_writer(MCMCResult<Major>& res, size_t c)
+{
+    double* log_pdfs = (res.log_pdf_samples.size() == 0) ? nullptr :
+        res.log_pdf_samples.data() + c * res.n_samples();
+    return [cont_samples = res.cont_chain(c), disc_samples = res.disc_chain(c), log_pdfs](
+            size_t i, const auto& cont, const auto& disc, const DrawStats& stats) mutable {
+        cont_samples.row(i) = cont;
+        disc_samples.row(i) = disc;
+        if (log_pdfs) log_pdfs[i] = stats.log_pdf;
+    };
+}
+
+template <class SinkType
+        , class ProgramType
+        , class OffsetPackType>
+inline auto chain_writer(SinkOutput<SinkType, ProgramType, OffsetPackType>& out, size_t c)
+{
+    return SinkChainWriter<SinkType, ProgramType, OffsetPackType>(out, c);
+}
+
+template <class ProgramType
+        , class OffsetPackType>
+inline auto chain_writer(TransformOutput<ProgramType, OffsetPackType>& out, size_t c)
+{
+    return TransformChainWriter<ProgramType, OffsetPackType>(out, c);
+}
+
+/**
+ * Base routine for all MCMC algorithms.
+ * Converts the expression into a program, activates it,
+ * invokes the sampling algorithm f as f(program, config, pack, res, pool),
+ * and finally transforms the unconstrained samples in res into constrained samples
+ * (along with log-pdf values) in parallel on the same thread pool.
+ * Samplers that record the log-pdf of their draws (see chain_writer)
+ * save a full evaluation of the model for every draw.
+ *
+ * @param   expr    model (or program) expression
+ * @param   config  configuration object
+ * @param   f       sampling algorithm
+ */
+template <class ExprType
+        , class ConfigType
+        , class Sampler>
+inline MCMCResult<> base_mcmc(const ExprType& expr,
+                              const ConfigType& config,
+                              Sampler f)
+{
+    using program_t = util::convert_to_program_t<ExprType>;
+    program_t program = expr;
+
+    auto pack = program.activate();
+    size_t n_cont = std::get<0>(pack).uc_offset;
+    size_t n_disc = std::get<1>(pack).uc_offset;
+    MCMCResult<Eigen::RowMajor> res(config.samples, n_cont, n_disc, config.n_chains);
+    res.log_pdf_samples.setConstant(res.cont_samples.rows(),
+                                    std::numeric_limits<double>::quiet_NaN());
+
+    // thread pool shared by all parallel sections of the sampling algorithm
+    util::ThreadPool pool(config.n_threads);
+
+    f(program, config, pack, res, pool); // call actual sampling algorithm and populate res
+
+    // Create transformed result object
+    // Note that the number of cols for continuous sample is n_cont_c + 1,
+    // where +1 is for the log-pdf.
+    const size_t n_cont_c = n_constrained_params(program);
+    MCMCResult<> t_res(res.n_samples(), n_cont_c + 1, n_disc, config.n_chains);
+    std::swap(t_res.name, res.name);
+    std::swap(t_res.warmup_time, res.warmup_time);
+    std::swap(t_res.sampling_time, res.sampling_time);
+    t_res.disc_samples.swap(res.disc_samples);
+
+    // Transform every unconstrained params to constrained.
+    // Every task transforms a contiguous range of rows with its own copy of the program.
+    // Rows are independent, so the output does not depend on the number of threads.
+    const size_t n_rows = res.cont_samples.rows();
+    const size_t n_tasks = std::min(pool.size(), n_rows);
+    pool.parallel_for(n_tasks, [&](size_t k) {
+        const size_t begin = n_rows * k / n_tasks;
+        const size_t end = n_rows * (k+1) / n_tasks;
+        ConstrainedDraw<program_t> draw(program, pack);
+        for (size_t i = begin; i < end; ++i) {
+            draw(res.cont_samples.row(i).transpose(), t_res.disc_samples.row(i).transpose(),
+                 res.log_pdf_samples(i));
+            t_res.cont_samples.row(i) = draw.values.transpose();
+        }
+    });
+
     return t_res;
 }
 
+/**
+ * Counterpart of base_mcmc for sampling algorithms that pass their draws to chain_writer.
+ * Every chain transforms each of its draws into constrained values (along with the log-pdf)
+ * as it is produced and writes them directly into the returned result,
+ * so that the unconstrained draws are never stored
+ * and the result is the only sample matrix held in memory.
+ * The sampling algorithm f is invoked as f(program, config, pack, out, pool)
+ * where out is a TransformOutput.
+ * Note that sampling times then include the transformations.
+ *
+ * @param   expr    model (or program) expression
+ * @param   config  configuration object
+ * @param   f       sampling algorithm
+ */
+template <class ExprType
+        , class ConfigType
+        , class Sampler>
+inline MCMCResult<> transform_mcmc(const ExprType& expr,
+                                   const ConfigType& config,
+                                   Sampler f)
+{
+    using program_t = util::convert_to_program_t<ExprType>;
+    program_t program = expr;
+
+    auto pack = program.activate();
+    const size_t n_cont_c = n_constrained_params(program);
+    const size_t n_disc = std::get<1>(pack).uc_offset;
+
+    // thread pool shared by all parallel sections of the sampling algorithm
+    util::ThreadPool pool(config.n_threads);
+
+    TransformOutput<program_t, decltype(pack)> out(
+            config.samples, n_cont_c + 1, n_disc, config.n_chains, program, pack);
+    f(program, config, pack, out, pool);
+    return MCMCResult<>(std::move(out));
+}
+
+/**
+ * Streaming counterpart of base_mcmc.
+ * Instead of storing all draws in a result object,
+ * every chain transforms each of its draws into constrained values (along with the log-pdf)
+ * as it is produced and passes it to sink (see SinkBase),
+ * so that memory does not grow with config.samples (unless the sink keeps the draws).
+ * The sampling algorithm f is invoked as f(program, config, pack, out, pool)
+ * where out is a SinkOutput.
+ *
+ * @param   expr    model (or program) expression
+ * @param   config  configuration object
+ * @param   sink    sink receiving the draws
+ * @param   f       sampling algorithm
+ * @return  result object with name and timing information but no draws
+ */
+template <class ExprType
+        , class ConfigType
+        , class SinkType
+        , class Sampler>
+inline MCMCResult<> stream_mcmc(const ExprType& expr,
+                                const ConfigType& config,
+                                SinkType& sink,
+                                Sampler f)
+{
+    using program_t = util::convert_to_program_t<ExprType>;
+    program_t program = expr;
+
+    auto pack = program.activate();
+    const size_t n_cont_c = n_constrained_params(program);
+    const size_t n_disc = std::get<1>(pack).uc_offset;
+
+    // thread pool shared by all parallel sections of the sampling algorithm
+    util::ThreadPool pool(config.n_threads);
+
+    sink.init(config.n_chains, sink.n_draws(config.samples), n_cont_c + 1, n_disc);
+    SinkOutput<SinkType, program_t, decltype(pack)> out(sink, program, pack);
+    f(program, config, pack, out, pool);
+    sink.finish();
+
+    MCMCResult<> res(0, n_cont_c + 1, n_disc, config.n_chains);
+    res.name = std::move(out.name);
+    res.warmup_time = out.warmup_time;
+    res.sampling_time = out.sampling_time;
+    return res;
+}
+
 } // namespace mcmc
 } // namespace ppl
@@ -0,0 +1,281 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <Eigen/Dense>
+#include <autoppl/util/serialize.hpp>
+#include <autoppl/util/traits/dist_expr_traits.hpp>
+#include <autoppl/mcmc/sink.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for checkpointing every chain of a sampler
+ * so that an interrupted run can be resumed (see mcmc::ChainCheckpoint).
+ * Checkpointing is disabled if every is 0.
+ * If resume is true, every chain with a checkpoint resumes from it
+ * and the other chains start from scratch,
+ * so a run can always be restarted with the same configuration.
+ */
+struct CheckpointConfig
+{
+    std::string prefix = "checkpoint"; // files of chain c start with prefix + "_" + c
+    size_t every = 0;                   // iterations (warmup and sampling) between checkpoints
+    bool resume = false;                // resume from existing checkpoints
+};
+
+namespace mcmc {
+
+/**
+ * Checkpoint of a single chain, made of two files:
+ *
+ *  - state file (see state_path): a header (magic number, name of the chain type,
+ *    n_cont, n_disc, and the number of iterations completed)
+ *    followed by the full state of the chain (e.g. NUTSChain::save).
+ *    The chain type encodes the program (model) and configuration types,
+ *    and n_cont is the size of every parameter buffer of the chain.
+ *    It is replaced atomically (written to a temporary file, then renamed),
+ *    so it always holds a complete checkpoint.
+ *  - draws file (see draws_path): a header of 3 uint64_t values (magic number, n_cont, n_disc)
+ *    followed by every draw of the chain, i.e. the unconstrained continuous parameters (doubles),
+ *    discrete parameters (util::disc_param_t) and DrawStats as (double, uint64_t, double, double).
+ *    It is flushed before the state file is replaced.
+ *
+ * When resuming, the state of the chain is loaded and the draws up to the checkpoint
+ * are passed again to the writer and the stopping rule, as if they had just been sampled.
+ * Since the state includes the random number generator and every cached random number,
+ * the resumed chain continues with exactly the same draws as an uninterrupted one.
+ * A checkpoint must be resumed with the same program, data, and configuration
+ * (other than samples).
+ * A chain without a state file starts from scratch,
+ * but a checkpoint that does not match the chain (different model or configuration),
+ * or whose files are missing, truncated or corrupted,
+ * makes resume throw std::runtime_error.
+ * All values are written in native byte order (see util::write_pod).
+ */
+struct ChainCheckpoint
+{
+    static constexpr uint64_t magic = 0x3154504b43505050;  // "PPPCKPT1"
+
+    using cont_vec_t = Eigen::Matrix<util::cont_param_t, Eigen::Dynamic, 1>;
+    using disc_vec_t = Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1>;
+
+    /**
+     * @param   config  checkpoint configuration (must outlive this object)
+     * @param   chain   chain index
+     * @param   n_cont  number of continuous parameters of a draw
+     * @param   n_disc  number of discrete parameters of a draw
+     */
+    ChainCheckpoint(const CheckpointConfig& config,
+                    size_t chain,
+                    size_t n_cont,
+                    size_t n_disc)
+        : config_(config)
+        , chain_(chain)
+        , cont_(n_cont)
+        , disc_(n_disc)
+    {}
+
+    std::string state_path() const
+    {
+        return config_.prefix + "_" + std::to_string(chain_) + ".ckpt";
+    }
+
+    std::string draws_path() const
+    {
+        return config_.prefix + "_" + std::to_string(chain_) + ".draws";
+    }
+
+    bool enabled() const { return config_.every > 0; }
+
+    /**
+     * Resumes chain from its checkpoint (if config.resume is true and one exists)
+     * and prepares the draws file for the next draws (if enabled).
+     * Draw k (0-indexed) of the checkpoint is passed to writer(k, cont, disc, stats)
+     * followed by stop(k+1).
+     *
+     * @param   chain       chain state to load (see NUTSChain::load)
+     * @param   warmup      number of warmup iterations
+     * @param   samples     maximum number of draws to pass to writer
+     * @param   writer      called with every draw up to the checkpoint
+     * @param   stop        called after every draw up to the checkpoint
+     * @param   stopped     set to true if stop returned true
+     * @return  the first iteration to run (0 if no checkpoint was loaded)
+     * @throws  std::runtime_error if the checkpoint does not match the chain
+     *          or its files are missing, truncated or corrupted
+     */
+    template <class ChainType
+            , class WriterType
+            , class StopType>
+    size_t resume(ChainType& chain,
+                  size_t warmup,
+                  size_t samples,
+                  WriterType&& writer,
+                  StopType&& stop,
+                  bool& stopped)
+    {
+        stopped = false;
+        const size_t iter = config_.resume ? load_(chain) : 0;
+        const size_t n_draws = (iter > warmup) ? iter - warmup : 0;
+
+        if (iter > 0) {
+            std::ifstream file(draws_path(), std::ios::binary);
+            check_draws_(file, n_draws);
+            DrawStats stats;
+            for (size_t k = 0; k < std::min(n_draws, samples) && !stopped; ++k) {
+                read_draw_(file, stats);
+                if (!file) fail_(draws_path(), "is corrupted");
+                writer(k, cont_, disc_, stats);
+                stopped = stop(k+1);
+            }
+        }
+
+        if (enabled()) open_draws_(iter > 0, n_draws);
+        return iter;
+    }
+
+    /**
+     * Appends a draw to the draws file (if enabled).
+     */
+    template <class ContType, class DiscType>
+    void write_draw(const ContType& cont,
+                    const DiscType& disc,
+                    const DrawStats& stats)
+    {
+        if (!enabled()) return;
+        for (Eigen::Index i = 0; i < cont.size(); ++i) util::write_pod(draws_, cont(i));
+        for (Eigen::Index i = 0; i < disc.size(); ++i) util::write_pod(draws_, disc(i));
+        util::write_pod(draws_, stats.accept_stat);
+        util::write_pod(draws_, static_cast<uint64_t>(stats.n_steps));
+        util::write_pod(draws_, stats.step_size);
+        util::write_pod(draws_, stats.log_pdf);
+    }
+
+    /**
+     * Saves the state of chain after iteration iter (0-indexed)
+     * if checkpointing is enabled and a checkpoint is due.
+     * If writing fails, the previous checkpoint is kept.
+     */
+    template <class ChainType>
+    void update(const ChainType& chain, size_t iter)
+    {
+        if (!enabled() || (iter + 1) % config_.every) return;
+        draws_.flush();
+        if (!draws_) return;
+
+        const std::string tmp_path = state_path() + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            util::write_pod(file, magic);
+            util::write_string(file, typeid(ChainType).name());
+            util::write_pod(file, static_cast<uint64_t>(cont_.size()));
+            util::write_pod(file, static_cast<uint64_t>(disc_.size()));
+            util::write_pod(file, static_cast<uint64_t>(iter + 1));
+            chain.save(file);
+            file.flush();
+            if (!file) return;
+        }
+        std::rename(tmp_path.c_str(), state_path().c_str());
+    }
+
+private:
+
+    [[noreturn]] static void fail_(const std::string& path, const std::string& what)
+    {
+        throw std::runtime_error("checkpoint file " + path + " " + what);
+    }
+
+    // returns the number of iterations completed (0 if there is no checkpoint)
+    template <class ChainType>
+    size_t load_(ChainType& chain)
+    {
+        std::ifstream file(state_path(), std::ios::binary);
+        if (!file) return 0;
+
+        uint64_t m = 0, n_cont = 0, n_disc = 0, iter = 0;
+        util::read_pod(file, m);
+        if (!file || m != magic) fail_(state_path(), "is not a checkpoint");
+        const std::string type = util::read_string(file);
+        util::read_pod(file, n_cont);
+        util::read_pod(file, n_disc);
+        util::read_pod(file, iter);
+        if (!file) fail_(state_path(), "is truncated");
+        if (type != typeid(ChainType).name() ||
+            n_cont != static_cast<uint64_t>(cont_.size()) ||
+            n_disc != static_cast<uint64_t>(disc_.size())) {
+            fail_(state_path(), "was written by a different model or configuration");
+        }
+
+        chain.load(file);
+        if (!file) fail_(state_path(), "is truncated or corrupted");
+        return iter;
+    }
+
+    size_t record_size_() const
+    {
+        return cont_.size() * sizeof(util::cont_param_t) +
+               disc_.size() * sizeof(util::disc_param_t) +
+               3 * sizeof(double) + sizeof(uint64_t);
+    }
+
+    // checks that the draws file matches the chain and holds at least n_draws draws
+    void check_draws_(std::ifstream& file, size_t n_draws) const
+    {
+        if (!file) fail_(draws_path(), "is missing");
+        uint64_t m = 0, n_cont = 0, n_disc = 0;
+        util::read_pod(file, m);
+        util::read_pod(file, n_cont);
+        util::read_pod(file, n_disc);
+        if (!file || m != magic) fail_(draws_path(), "is not a checkpoint");
+        if (n_cont != static_cast<uint64_t>(cont_.size()) ||
+            n_disc != static_cast<uint64_t>(disc_.size())) {
+            fail_(draws_path(), "was written by a different model");
+        }
+        if (!util::has_bytes(file, n_draws * record_size_())) {
+            fail_(draws_path(), "is truncated");
+        }
+    }
+
+    void read_draw_(std::ifstream& file, DrawStats& stats)
+    {
+        uint64_t n_steps = 0;
+        for (Eigen::Index i = 0; i < cont_.size(); ++i) util::read_pod(file, cont_(i));
+        for (Eigen::Index i = 0; i < disc_.size(); ++i) util::read_pod(file, disc_(i));
+        util::read_pod(file, stats.accept_stat);
+        util::read_pod(file, n_steps);
+        util::read_pod(file, stats.step_size);
+        util::read_pod(file, stats.log_pdf);
+        stats.n_steps = n_steps;
+    }
+
+    // Opens the draws file to append draws after the first n_draws.
+    // If resumed, later draws (written after the checkpoint) are discarded,
+    // otherwise the file is recreated.
+    void open_draws_(bool resumed, size_t n_draws)
+    {
+        if (resumed) {
+            std::filesystem::resize_file(draws_path(),
+                    3 * sizeof(uint64_t) + n_draws * record_size_());
+            draws_.open(draws_path(), std::ios::binary | std::ios::app);
+            return;
+        }
+        draws_.open(draws_path(), std::ios::binary | std::ios::trunc);
+        util::write_pod(draws_, magic);
+        util::write_pod(draws_, static_cast<uint64_t>(cont_.size()));
+        util::write_pod(draws_, static_cast<uint64_t>(disc_.size()));
+    }
+
+    const CheckpointConfig& config_;
+    size_t chain_;
+    cont_vec_t cont_;       // buffers for draws read from the draws file
+    disc_vec_t disc_;
+    std::ofstream draws_;
+};
+
+} // namespace mcmc
+} // namespace ppl
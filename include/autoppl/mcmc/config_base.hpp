@@ -10,6 +10,8 @@ struct ConfigBase
     size_t samples = 1000;
     size_t seed = mcmc::random_seed();
     bool prune = true;
+    size_t n_chains = 1;    // number of independent chains (chain c is seeded with seed + c)
+    size_t n_threads = 1;   // number of threads shared by all chains (0 means hardware concurrency)
 };
 
 } // namespace ppl
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <autoppl/math/math.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for updating discrete parameters
+ * inside a sampler of continuous parameters (see mcmc::disc_gibbs_sweep).
+ * Every iteration sweeps over each discrete parameter element in order
+ * while every other parameter is held fixed.
+ *
+ * If enumerate is true, each element is drawn from its full conditional
+ * restricted to the values [lower, upper].
+ * This is an exact Gibbs update if the support of every discrete parameter
+ * lies within [lower, upper] (e.g. class labels of a mixture with upper - lower + 1 classes).
+ * Otherwise, each element is updated by a Metropolis step that proposes
+ * to move by -1 or +1 with probability alpha each,
+ * which is valid for any (unbounded) integer support.
+ */
+struct DiscConfig
+{
+    bool enumerate = false;
+    int lower = 0;
+    int upper = 1;
+    double alpha = 0.25;
+};
+
+namespace mcmc {
+
+/**
+ * Updates every element of disc, one at a time,
+ * according to config (see DiscConfig).
+ * Program must be bound to disc (and to the current continuous parameters)
+ * such that program.log_pdf() computes the log-pdf at the current state.
+ * Log-jacobians of continuous parameters do not depend on discrete parameters,
+ * so they are not needed.
+ * If beta is not 1, the updates target the tempered log-pdf beta * program.log_pdf().
+ *
+ * @param   program     program expression bound to disc
+ * @param   config      discrete update configuration
+ * @param   disc        vector of discrete parameter values to update in-place
+ * @param   log_pdf     log-pdf of program at the current state
+ * @param   log_weights buffer of size at least config.upper - config.lower + 1
+ *                      (only used if config.enumerate is true)
+ * @param   gen         random number generator
+ * @param   beta        inverse temperature
+ * @return  (untempered) log-pdf of program at the updated state
+ */
+template <class ProgramType
+        , class DiscVecType
+        , class GenType>
+inline double disc_gibbs_sweep(ProgramType& program,
+                               const DiscConfig& config,
+                               DiscVecType& disc,
+                               double log_pdf,
+                               std::vector<double>& log_weights,
+                               GenType& gen,
+                               double beta = 1.)
+{
+    std::uniform_real_distribution unif_sampler(0., 1.);
+
+    if (config.enumerate) {
+        const int n_values = config.upper - config.lower + 1;
+        for (int j = 0; j < disc.size(); ++j) {
+            const auto curr = disc(j);
+            double max_log_weight = math::neg_inf<double>;
+            for (int k = 0; k < n_values; ++k) {
+                disc(j) = config.lower + k;
+                log_weights[k] = program.log_pdf();
+                max_log_weight = std::max(max_log_weight, beta * log_weights[k]);
+            }
+
+            // no value in range has positive density: keep current value
+            if (max_log_weight == math::neg_inf<double>) {
+                disc(j) = curr;
+                continue;
+            }
+
+            // inverse-cdf sampling from the (unnormalized) conditional
+            double total = 0.;
+            for (int k = 0; k < n_values; ++k) {
+                total += std::exp(beta * log_weights[k] - max_log_weight);
+            }
+            double u = total * unif_sampler(gen);
+            int k = 0;
+            for (; k < n_values - 1; ++k) {
+                u -= std::exp(beta * log_weights[k] - max_log_weight);
+                if (u < 0) break;
+            }
+            disc(j) = config.lower + k;
+            log_pdf = log_weights[k];
+        }
+    } else {
+        std::discrete_distribution step_sampler(
+                {config.alpha, 1-2*config.alpha, config.alpha});
+        for (int j = 0; j < disc.size(); ++j) {
+            const int step = step_sampler(gen) - 1;
+            if (step == 0) continue;
+            const auto curr = disc(j);
+            disc(j) += step;
+            const double cand_log_pdf = program.log_pdf();
+            if (std::log(unif_sampler(gen)) <= beta * (cand_log_pdf - log_pdf)) {
+                log_pdf = cand_log_pdf;
+            } else {
+                disc(j) = curr;
+            }
+        }
+    }
+
+    return log_pdf;
+}
+
+} // namespace mcmc
+} // namespace ppl
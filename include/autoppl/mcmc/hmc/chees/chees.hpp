@@ -0,0 +1,349 @@
+#pragma once
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/var_view.hpp>
+#include <fastad_bits/reverse/core/eval.hpp>
+#include <autoppl/util/traits/var_traits.hpp>
+#include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/math/math.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/hmc/leapfrog.hpp>
+#include <autoppl/mcmc/hmc/hamiltonian.hpp>
+#include <autoppl/mcmc/hmc/reasonable_epsilon.hpp>
+#include <autoppl/mcmc/hmc/trajectory_adapter.hpp>
+#include <autoppl/mcmc/hmc/hmc/hmc.hpp>
+#include <autoppl/mcmc/hmc/chees/configs.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * State of a single chain of ChEES-HMC.
+ * It owns a copy of the program, the AD expression of its log-pdf,
+ * and every buffer the expression is bound to,
+ * so it must not be moved after construction.
+ */
+template <class ProgramType
+        , class MomentumHandlerType>
+struct ChEESChain
+{
+    using program_t = ProgramType;
+    using ptr_pack_t = decltype(util::make_ptr_pack(
+                (double*)nullptr, (double*)nullptr,
+                (double*)nullptr, (double*)nullptr,
+                (double*)nullptr, (size_t*)nullptr));
+    using ad_expr_t = decltype(std::declval<program_t&>().ad_log_pdf(
+                std::declval<const ptr_pack_t&>(),
+                std::declval<util::ShardContext&>()));
+
+    /**
+     * Binds the AD expression and initializes the first sample.
+     *
+     * @param   program         program to copy
+     * @param   offset_pack     continuous offset pack result of activating program
+     * @param   shard_ctx       context used to build sharded AD expressions
+     * @param   seed            seed of this chain
+     * @param   prune           see ConfigBase
+     */
+    template <class OffsetPackType>
+    ChEESChain(const program_t& _program,
+               const OffsetPackType& offset_pack,
+               util::ShardContext& shard_ctx,
+               size_t seed,
+               bool prune)
+        : program(_program)
+        , gen(seed)
+        , momentum_handler(offset_pack.uc_offset)
+        , tp_mat(Eigen::MatrixXd::Zero(offset_pack.tp_offset, 2))
+        , cache_mat(Eigen::MatrixXd::Zero(offset_pack.uc_offset, 6))
+        , constrained(Eigen::VectorXd::Zero(offset_pack.c_offset))
+        , visit(Eigen::Matrix<size_t, Eigen::Dynamic, 1>::Zero(offset_pack.v_offset))
+        , tp_val(tp_mat.col(0).data(), offset_pack.tp_offset)
+        , tp_adj(tp_mat.col(1).data(), offset_pack.tp_offset)
+        , theta(cache_mat.col(0).data(), offset_pack.uc_offset)
+        , theta_adj(cache_mat.col(1).data(), offset_pack.uc_offset)
+        , theta_curr(cache_mat.col(2).data(), offset_pack.uc_offset)
+        , theta_curr_adj(cache_mat.col(3).data(), offset_pack.uc_offset)
+        , theta_prev(cache_mat.col(4).data(), offset_pack.uc_offset)
+        , p(cache_mat.col(5).data(), offset_pack.uc_offset)
+        , ad_expr(program.ad_log_pdf(util::make_ptr_pack(
+                    theta.data(), theta_adj.data(),
+                    tp_val.data(), tp_adj.data(),
+                    constrained.data(), visit.data()), shard_ctx))
+    {
+        auto size_pack = ad_expr.bind_cache_size();
+        ad_val_buf.resize(size_pack(0));
+        ad_adj_buf.resize(size_pack(1));
+        ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+
+        program.bind(util::make_ptr_pack(
+                    theta_curr.data(), nullptr,
+                    tp_val.data(), nullptr,
+                    constrained.data(), visit.data()));
+        program.init_params(gen, prune);
+
+        theta = theta_curr;
+        potential_curr = -mcmc::reset_autodiff(ad_expr, theta_adj, tp_adj);
+        theta_curr_adj = theta_adj;
+    }
+
+    ChEESChain(const ChEESChain&) =delete;
+    ChEESChain& operator=(const ChEESChain&) =delete;
+
+    /**
+     * Takes n_steps leapfrog steps of size epsilon from the current sample
+     * followed by a metropolis correction.
+     * After the call, theta_prev is the previous sample,
+     * theta is the proposal, and p is the momentum at the proposal.
+     *
+     * @return  acceptance probability of the proposal (0 if divergent)
+     */
+    double transition(double epsilon, size_t n_steps)
+    {
+        constexpr double delta_max = 1000;  // same divergence threshold as NUTS
+
+        theta_prev = theta_curr;
+        theta = theta_curr;
+        theta_adj = theta_curr_adj;
+
+        momentum_handler.sample(p, gen);
+        const double ham_curr = mcmc::hamiltonian(
+                potential_curr, momentum_handler.kinetic(p));
+
+        double potential = potential_curr;
+        double ham = ham_curr;
+        for (size_t s = 0; s < n_steps; ++s) {
+            potential = mcmc::leapfrog(ad_expr, theta, theta_adj, tp_adj,
+                                       p, momentum_handler, epsilon, true);
+            ham = mcmc::hamiltonian(potential, momentum_handler.kinetic(p));
+            if (!(ham - ham_curr <= delta_max)) return 0.;
+        }
+
+        const double accept_prob = std::min(1., std::exp(ham_curr - ham));
+        if (mcmc::accept_or_reject(accept_prob, unif_sampler, gen)) {
+            theta_curr = theta;
+            theta_curr_adj = theta_adj;
+            potential_curr = potential;
+        }
+        return accept_prob;
+    }
+
+    program_t program;
+    std::mt19937 gen;
+    std::uniform_real_distribution<> unif_sampler{0., 1.};
+    MomentumHandlerType momentum_handler;
+
+    Eigen::MatrixXd tp_mat;
+    Eigen::MatrixXd cache_mat;
+    Eigen::VectorXd constrained;
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit;
+
+    Eigen::Map<Eigen::VectorXd> tp_val;
+    Eigen::Map<Eigen::VectorXd> tp_adj;
+    Eigen::Map<Eigen::VectorXd> theta;          // position along the trajectory
+    Eigen::Map<Eigen::VectorXd> theta_adj;
+    Eigen::Map<Eigen::VectorXd> theta_curr;     // current sample
+    Eigen::Map<Eigen::VectorXd> theta_curr_adj;
+    Eigen::Map<Eigen::VectorXd> theta_prev;     // sample before last transition
+    Eigen::Map<Eigen::VectorXd> p;              // momentum along the trajectory
+    double potential_curr = 0.;
+
+    ad_expr_t ad_expr;
+    Eigen::VectorXd ad_val_buf;
+    Eigen::VectorXd ad_adj_buf;
+};
+
+/**
+ * ChEES-HMC: many chains of static HMC run in lockstep.
+ * Every iteration, all chains take the same number of leapfrog steps
+ * (with the same step size and metric) concurrently on the thread pool.
+ * During warmup, the shared parameters are adapted jointly across chains:
+ * - step size: dual averaging (StepAdapter) on the mean acceptance probability
+ * - metric: windowed adaptation (VarAdapter) on the draws of all chains
+ * - integration time: Adam on the ChEES criterion (TrajectoryAdapter)
+ *
+ * Chain c is seeded with config.seed + c.
+ * Adaptation and jitter are driven by a separate generator seeded with config.seed + n_chains.
+ * Hence, the samples never depend on the number of threads.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      ChEES configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object of calling ChEES-HMC that will be populated with samples and other information.
+ * @param   pool        thread pool to run chains on
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class ChEESConfigType = ChEESConfig<>>
+void chees_(const ProgramType& program,
+            const ChEESConfigType& config,
+            const OffsetPackType& pack,
+            MCMCResultType& res,
+            util::ThreadPool& pool)
+{
+    assert(std::get<1>(pack).uc_offset == 0);
+    assert(config.n_chains > 0);
+
+    using var_adapter_policy_t = typename
+        chees_config_traits<ChEESConfigType>::var_adapter_policy_t;
+    using momentum_handler_t = mcmc::MomentumHandler<var_adapter_policy_t>;
+    using chain_t = ChEESChain<ProgramType, momentum_handler_t>;
+
+    auto& offset_pack = std::get<0>(pack);
+    const size_t n_params = offset_pack.uc_offset;
+    const size_t n_chains = config.n_chains;
+
+    util::ShardContext shard_ctx(pool, config.shard_config, offset_pack);
+
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+    stopwatch_warmup.start();
+
+    std::vector<std::unique_ptr<chain_t>> chains(n_chains);
+    pool.parallel_for(n_chains, [&](size_t c) {
+        chains[c] = std::make_unique<chain_t>(
+                program, offset_pack, shard_ctx, config.seed + c, config.prune);
+    });
+
+    // shared adaptation state
+    std::mt19937 gen(config.seed + n_chains);
+    std::uniform_real_distribution unif_sampler(0., 1.);
+    momentum_handler_t momentum_handler(n_params);
+
+    auto& chain0 = *chains[0];
+    const double log_eps = std::log(
+        mcmc::find_reasonable_epsilon(
+            1., // initial epsilon
+            chain0.ad_expr, chain0.theta, chain0.theta_adj, chain0.tp_adj,
+            gen, momentum_handler));
+    mcmc::StepAdapter step_adapter(log_eps);
+    step_adapter.step_config = config.step_config;
+
+    mcmc::TrajectoryAdapter traj_adapter(config.traj_config.init_integration_time);
+    traj_adapter.traj_config = config.traj_config;
+
+    auto var_adapter = mcmc::make_var_adapter<var_adapter_policy_t>(
+            n_params, config.warmup, config.var_config);
+
+    // draws of every chain in the last iteration (column-wise)
+    Eigen::MatrixXd prev(n_params, n_chains);
+    Eigen::MatrixXd prop(n_params, n_chains);
+    Eigen::MatrixXd velocity(n_params, n_chains);
+    Eigen::MatrixXd curr(n_params, n_chains);
+    Eigen::VectorXd accept(n_chains);
+
+    auto logger = util::ProgressLogger(config.samples + config.warmup, "ChEES");
+
+    for (size_t i = 0; i < config.samples + config.warmup; ++i) {
+
+        if (i == config.warmup) {
+            stopwatch_warmup.stop();
+            stopwatch_sampling.start();
+        }
+
+        logger.printProgress(i);
+
+        // common step size and number of steps for all chains
+        const double epsilon = std::exp(step_adapter.log_eps);
+        double t = traj_adapter.integration_time();
+        if (config.jitter > 0) {
+            t *= 1. + config.jitter * (2. * unif_sampler(gen) - 1.);
+        }
+        const size_t n_steps = mcmc::n_leapfrog_steps(
+                t, 0., config.max_steps, epsilon, unif_sampler, gen);
+
+        pool.parallel_for(n_chains, [&](size_t c) {
+            accept(c) = chains[c]->transition(epsilon, n_steps);
+        });
+
+        // Warmup Adapt!
+        if (i < config.warmup) {
+
+            for (size_t c = 0; c < n_chains; ++c) {
+                auto& chain = *chains[c];
+                prev.col(c) = chain.theta_prev;
+                prop.col(c) = chain.theta;
+                velocity.col(c) = chain.momentum_handler.dkinetic_dr(chain.p);
+                curr.col(c) = chain.theta_curr;
+            }
+
+            // epsilon dual averaging
+            step_adapter.adapt(accept.mean());
+
+            // integration time (in units of the current step size)
+            const double grad = mcmc::chees_gradient(
+                    prev, prop, velocity, accept,
+                    static_cast<double>(n_steps) * epsilon);
+            const double new_epsilon = std::exp(step_adapter.log_eps);
+            traj_adapter.adapt(grad, new_epsilon,
+                               new_epsilon * std::max<size_t>(config.max_steps, 1));
+
+            // adapt variance only if adapting policy is not unit_var
+            if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+                const bool update = var_adapter.adapt(curr, momentum_handler.get_m_inverse());
+                if (update) {
+                    momentum_handler.update_metric();
+                    chain0.theta = chain0.theta_curr;
+                    chain0.theta_adj = chain0.theta_curr_adj;
+                    double log_eps = std::log( mcmc::find_reasonable_epsilon(
+                                        std::exp(step_adapter.log_eps),
+                                        chain0.ad_expr, chain0.theta,
+                                        chain0.theta_adj, chain0.tp_adj,
+                                        gen, momentum_handler) );
+                    step_adapter.reset();
+                    step_adapter.init(log_eps);
+                    // only the metric is shared: every chain keeps its own
+                    // momentum distribution (and any normal it has cached)
+                    for (auto& chain : chains) {
+                        chain->momentum_handler.get_m_inverse() =
+                            momentum_handler.get_m_inverse();
+                        chain->momentum_handler.update_metric();
+                    }
+                }
+            }
+
+            // if last warmup iteration
+            if (i == config.warmup - 1) {
+                step_adapter.log_eps = step_adapter.log_eps_bar;
+            }
+        }
+
+        // store samples only after burning
+        if (i >= config.warmup) {
+            for (size_t c = 0; c < n_chains; ++c) {
+                res.cont_chain(c).row(i-config.warmup) = chains[c]->theta_curr;
+            }
+        }
+    }
+
+    stopwatch_sampling.stop();
+
+    res.warmup_time = stopwatch_warmup.elapsed();
+    res.sampling_time = stopwatch_sampling.elapsed();
+}
+
+} // namespace mcmc
+
+template <class ExprType
+        , class ChEESConfigType = ChEESConfig<>>
+inline auto chees(const ExprType& expr,
+                  const ChEESConfigType& config = ChEESConfigType())
+{
+    return mcmc::base_mcmc(expr, config,
+            [](auto& program, const auto& config,
+               const auto& pack, auto& res, auto& pool) {
+                res.name = "chees";
+                mcmc::chees_(program, config, pack, res, pool);
+            });
+}
+
+} // namespace ppl
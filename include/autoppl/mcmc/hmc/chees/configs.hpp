@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/hmc/step_adapter.hpp>
+#include <autoppl/mcmc/hmc/trajectory_adapter.hpp>
+#include <autoppl/mcmc/hmc/momentum_handler.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/util/sharding.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for ChEES-HMC algorithm.
+ * All chains run in lockstep with the same step size, integration time,
+ * and metric, which are adapted jointly during warmup.
+ * Every iteration, the integration time is multiplied by a common factor 
+ * drawn uniformly from [1-jitter, 1+jitter].
+ */
+template <class VarAdapterPolicy=diag_var>
+struct ChEESConfig: ConfigBase
+{
+    using var_adapter_policy_t = VarAdapterPolicy;
+
+    // the criterion is estimated across chains, so more than one is needed
+    ChEESConfig() { this->n_chains = 4; }
+
+    // configuration for sampling
+    double jitter = 1.;
+    size_t max_steps = 1024;
+
+    // configuration for integration time adaptation
+    TrajectoryConfig traj_config;
+
+    // configuration for step-size adaptation
+    StepConfig step_config;
+
+    // configuration for variance adaptation
+    VarConfig var_config;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+};
+
+/**
+ * Traits to get member aliases of any ChEES config object.
+ */
+template <class ChEESConfigType>
+struct chees_config_traits
+{
+    using var_adapter_policy_t = 
+        typename ChEESConfigType::var_adapter_policy_t;
+};
+
+} // namespace ppl
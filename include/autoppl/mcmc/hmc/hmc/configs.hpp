@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/hmc/step_adapter.hpp>
+#include <autoppl/mcmc/hmc/momentum_handler.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/util/sharding.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for static HMC algorithm.
+ * Every iteration integrates for a total time of integration_time
+ * (multiplied by a uniform factor in [1-jitter, 1+jitter]),
+ * i.e. the number of leapfrog steps is integration_time/epsilon
+ * (at least 1 and at most max_steps).
+ */
+template <class VarAdapterPolicy=diag_var>
+struct HMCConfig: ConfigBase
+{
+    using var_adapter_policy_t = VarAdapterPolicy;
+
+    // configuration for sampling
+    double integration_time = 1.;
+    double jitter = 0.;
+    size_t max_steps = 1024;
+
+    // configuration for step-size adaptation
+    StepConfig step_config;
+
+    // configuration for variance adaptation
+    VarConfig var_config;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+};
+
+/**
+ * Traits to get member aliases of any HMC config object.
+ */
+template <class HMCConfigType>
+struct hmc_config_traits
+{
+    using var_adapter_policy_t = 
+        typename HMCConfigType::var_adapter_policy_t;
+};
+
+} // namespace ppl
@@ -0,0 +1,303 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/var_view.hpp>
+#include <fastad_bits/reverse/core/eval.hpp>
+#include <autoppl/util/traits/var_traits.hpp>
+#include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/math/math.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/hmc/leapfrog.hpp>
+#include <autoppl/mcmc/hmc/hamiltonian.hpp>
+#include <autoppl/mcmc/hmc/reasonable_epsilon.hpp>
+#include <autoppl/mcmc/hmc/hmc/configs.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * Computes the number of leapfrog steps to integrate for
+ * a total time of integration_time with step size epsilon.
+ * If jitter is positive, integration_time is multiplied by a factor
+ * drawn uniformly from [1-jitter, 1+jitter].
+ * Otherwise, no random number is drawn.
+ *
+ * @return  number of steps in [1, max_steps]
+ */
+template <class UniformDistType
+        , class GenType>
+inline size_t n_leapfrog_steps(double integration_time,
+                               double jitter,
+                               size_t max_steps,
+                               double epsilon,
+                               UniformDistType& unif_sampler,
+                               GenType& gen)
+{
+    if (jitter > 0) {
+        integration_time *= 1. + jitter * (2. * unif_sampler(gen) - 1.);
+    }
+    double n_steps = std::round(integration_time / epsilon);
+    if (!(n_steps >= 1.)) return 1;
+    if (n_steps >= static_cast<double>(max_steps)) return std::max<size_t>(max_steps, 1);
+    return static_cast<size_t>(n_steps);
+}
+
+/**
+ * Runs a single chain of static Hamiltonian Monte Carlo (HMC).
+ * Every iteration takes a fixed number of leapfrog steps (see n_leapfrog_steps)
+ * followed by a metropolis correction.
+ * During warmup, step size and variance are adapted exactly like NUTS.
+ *
+ * The program is bound to buffers owned by this chain,
+ * so every concurrently running chain must be given its own copy of the program.
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          HMC configuration object
+ * @param   pack            offset pack result of activating program (see hmc_)
+ * @param   chain           chain index. The chain is seeded with config.seed + chain
+ *                          and only chain 0 prints progress.
+ * @param   samples         matrix-like block of size (config.samples x n_params)
+ *                          that will be populated with samples of this chain.
+ * @param   shard_ctx       context used to build sharded AD expressions
+ * @param   warmup_time     populated with warmup time of this chain
+ * @param   sampling_time   populated with sampling time of this chain
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class SamplesType
+        , class HMCConfigType = HMCConfig<>>
+void hmc_chain_(ProgramType& program,
+                const HMCConfigType& config,
+                const OffsetPackType& pack,
+                size_t chain,
+                SamplesType&& samples,
+                util::ShardContext& shard_ctx,
+                double& warmup_time,
+                double& sampling_time)
+{
+    assert(std::get<1>(pack).uc_offset == 0);
+    assert(std::get<1>(pack).tp_offset == 0);
+    assert(std::get<1>(pack).c_offset == 0);
+    assert(std::get<1>(pack).v_offset == 0);
+
+    constexpr double delta_max = 1000;  // same divergence threshold as NUTS
+
+    auto& offset_pack = std::get<0>(pack);
+    size_t n_params = offset_pack.uc_offset;
+
+    // initialization of meta-variables
+    std::mt19937 gen(config.seed + chain);
+    std::uniform_real_distribution unif_sampler(0., 1.);
+
+    // Transformed parameters, constrained parameter, visit count cache
+    Eigen::MatrixXd tp_mat(offset_pack.tp_offset, 2);
+    Eigen::Map<Eigen::VectorXd> tp_val(tp_mat.col(0).data(), offset_pack.tp_offset);
+    Eigen::Map<Eigen::VectorXd> tp_adj(tp_mat.col(1).data(), offset_pack.tp_offset);
+    Eigen::VectorXd constrained(offset_pack.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit(offset_pack.v_offset);
+    tp_mat.setZero();
+    constrained.setZero();
+    visit.setZero();
+
+    // theta, theta_adj: position (and gradient) along the trajectory
+    // theta_curr, theta_curr_adj: current sample (and gradient)
+    // p: momentum along the trajectory
+    Eigen::MatrixXd cache_mat(n_params, 5);
+    cache_mat.setZero();
+    Eigen::Map<Eigen::VectorXd> theta(cache_mat.col(0).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_adj(cache_mat.col(1).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_curr(cache_mat.col(2).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_curr_adj(cache_mat.col(3).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> p(cache_mat.col(4).data(), n_params);
+
+    // AD expression for L(theta) (log-pdf up to constant at theta)
+    auto ad_expr = program.ad_log_pdf(util::make_ptr_pack(
+            theta.data(), theta_adj.data(),
+            tp_val.data(), tp_adj.data(),
+            constrained.data(), visit.data() ), shard_ctx);
+    auto size_pack = ad_expr.bind_cache_size();
+    Eigen::VectorXd ad_val_buf(size_pack(0));
+    Eigen::VectorXd ad_adj_buf(size_pack(1));
+    ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+
+    // initializes first sample into theta_curr
+    program.bind(util::make_ptr_pack(
+                theta_curr.data(), nullptr,
+                tp_val.data(), nullptr,
+                constrained.data(), visit.data()));
+    program.init_params(gen, config.prune);
+
+    // initialize current potential and its gradient
+    theta = theta_curr;
+    double potential_curr = -mcmc::reset_autodiff(ad_expr, theta_adj, tp_adj);
+    theta_curr_adj = theta_adj;
+
+    // initialize momentum handler
+    using var_adapter_policy_t = typename
+        hmc_config_traits<HMCConfigType>::var_adapter_policy_t;
+    mcmc::MomentumHandler<var_adapter_policy_t> momentum_handler(n_params);
+
+    // initialize step adapter
+    const double log_eps = std::log(
+        mcmc::find_reasonable_epsilon(
+            1., // initial epsilon
+            ad_expr, theta, theta_adj, tp_adj,
+            gen, momentum_handler));
+    mcmc::StepAdapter step_adapter(log_eps);
+    step_adapter.step_config = config.step_config;
+
+    // initialize variance adapter
+    auto var_adapter = mcmc::make_var_adapter<var_adapter_policy_t>(
+            n_params, config.warmup, config.var_config);
+
+    // construct miscellaneous objects
+    auto logger = util::ProgressLogger(config.samples + config.warmup, "HMC",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    stopwatch_warmup.start();
+
+    for (size_t i = 0; i < config.samples + config.warmup; ++i) {
+
+        if (i == config.warmup) {
+            stopwatch_warmup.stop();
+            stopwatch_sampling.start();
+        }
+
+        logger.printProgress(i);
+
+        // start trajectory at current sample (gradient is already known)
+        theta = theta_curr;
+        theta_adj = theta_curr_adj;
+
+        // p ~ N(0, M) (depending on momentum handler)
+        momentum_handler.sample(p, gen);
+        const double ham_curr = mcmc::hamiltonian(
+                potential_curr, momentum_handler.kinetic(p));
+
+        const double epsilon = std::exp(step_adapter.log_eps);
+        const size_t n_steps = mcmc::n_leapfrog_steps(
+                config.integration_time, config.jitter, config.max_steps,
+                epsilon, unif_sampler, gen);
+
+        double potential = potential_curr;
+        double ham = ham_curr;
+        bool diverged = false;
+        for (size_t s = 0; s < n_steps; ++s) {
+            potential = mcmc::leapfrog(ad_expr, theta, theta_adj, tp_adj,
+                                       p, momentum_handler, epsilon, true);
+            ham = mcmc::hamiltonian(potential, momentum_handler.kinetic(p));
+            if (!(ham - ham_curr <= delta_max)) {
+                diverged = true;
+                break;
+            }
+        }
+
+        // metropolis correction
+        const double accept_prob = diverged ? 0. :
+            std::min(1., std::exp(ham_curr - ham));
+        if (!diverged &&
+            mcmc::accept_or_reject(accept_prob, unif_sampler, gen)) {
+            theta_curr = theta;
+            theta_curr_adj = theta_adj;
+            potential_curr = potential;
+        }
+
+        // Warmup Adapt!
+        if (i < config.warmup) {
+
+            // epsilon dual averaging
+            step_adapter.adapt(accept_prob);
+
+            // adapt variance only if adapting policy is not unit_var
+            if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+                const bool update = var_adapter.adapt(theta_curr, momentum_handler.get_m_inverse());
+                if (update) {
+                    momentum_handler.update_metric();
+                    theta = theta_curr;
+                    theta_adj = theta_curr_adj;
+                    double log_eps = std::log( mcmc::find_reasonable_epsilon(
+                                        std::exp(step_adapter.log_eps),
+                                        ad_expr, theta, theta_adj, tp_adj,
+                                        gen, momentum_handler) );
+                    step_adapter.reset();
+                    step_adapter.init(log_eps);
+                }
+            }
+
+            // if last warmup iteration
+            if (i == config.warmup - 1) {
+                step_adapter.log_eps = step_adapter.log_eps_bar;
+            }
+        }
+
+        // store sample theta_curr only after burning
+        if (i >= config.warmup) {
+            samples.row(i-config.warmup) = theta_curr;
+        }
+    }
+
+    stopwatch_sampling.stop();
+
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * Static Hamiltonian Monte Carlo (HMC)
+ *
+ * User must ensure that the program does not have any discrete parameters.
+ * Discrete data is allowed.
+ *
+ * Runs config.n_chains independent chains on the thread pool (see nuts_).
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      HMC configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object of calling HMC that will be populated with samples and other information.
+ * @param   pool        thread pool to run chains on
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class HMCConfigType = HMCConfig<>>
+void hmc_(const ProgramType& program,
+          const HMCConfigType& config,
+          const OffsetPackType& pack,
+          MCMCResultType& res,
+          util::ThreadPool& pool)
+{
+    util::ShardContext shard_ctx(pool, config.shard_config, std::get<0>(pack));
+    run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                ProgramType chain_program = program;
+                hmc_chain_(chain_program, config, pack, chain,
+                           res.cont_chain(chain), shard_ctx,
+                           warmup_time, sampling_time);
+            });
+}
+
+} // namespace mcmc
+
+template <class ExprType
+        , class HMCConfigType = HMCConfig<>>
+inline auto hmc(const ExprType& expr,
+                const HMCConfigType& config = HMCConfigType())
+{
+    return mcmc::base_mcmc(expr, config,
+            [](auto& program, const auto& config,
+               const auto& pack, auto& res, auto& pool) {
+                res.name = "hmc";
+                mcmc::hmc_(program, config, pack, res, pool);
+            });
+}
+
+} // namespace ppl
@@ -1,6 +1,8 @@
 #pragma once
 #include <random>
+#include <Eigen/Dense>
 #include <autoppl/mcmc/hmc/var_adapter.hpp>
+#include <autoppl/util/serialize.hpp>
 
 namespace ppl {
 namespace mcmc {
@@ -18,6 +20,7 @@ template <>
 struct MomentumHandler<unit_var>
 {
     using adapter_policy_t = unit_var;
+    using variance_t = UnitMetric;
 
     // Constructor takes in size_t for consistent API with other specializations.
     MomentumHandler(size_t=0) 
@@ -47,6 +50,17 @@ struct MomentumHandler<unit_var>
     const MatType& dkinetic_dr(const MatType& rho) const
     { return rho; }
 
+    /**
+     * Discards any normal draw cached by the momentum distribution.
+     */
+    void reset() { dist.reset(); }
+
+    /**
+     * Saves (loads) the momentum distribution (see util::write_state).
+     */
+    void save(std::ostream& os) const { util::write_state(os, dist); }
+    void load(std::istream& is) { util::read_state(is, dist); }
+
 private:
     std::normal_distribution<> dist;
 };
@@ -95,9 +109,242 @@ struct MomentumHandler<diag_var>
     variance_t& get_m_inverse() { return m_inverse_; }
     const variance_t& get_m_inverse() const { return m_inverse_; }
 
+    /**
+     * Must be called after M inverse is modified through get_m_inverse().
+     * Nothing is cached for diagonal variance.
+     */
+    void update_metric() {}
+
+    /**
+     * Discards any normal draw cached by the momentum distribution.
+     */
+    void reset() { dist.reset(); }
+
+    /**
+     * Saves (loads) the momentum distribution and M inverse.
+     * Cached quantities are recomputed after loading.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_state(os, dist);
+        util::write_mat(os, m_inverse_);
+    }
+
+    void load(std::istream& is)
+    {
+        util::read_state(is, dist);
+        util::read_mat(is, m_inverse_);
+        update_metric();
+    }
+
+private:
+    std::normal_distribution<> dist;
+    variance_t m_inverse_;
+};
+
+/**
+ * Dense variance with adaptation.
+ * The Cholesky decomposition of M inverse is cached 
+ * so that sampling momentum is O(n^2).
+ */
+template <>
+struct MomentumHandler<dense_var>
+{
+    using adapter_policy_t = dense_var;
+    using variance_t = Eigen::MatrixXd;
+
+    // initialize m inverse to be identity 
+    MomentumHandler(size_t n_params)
+        : dist(0., 1.)
+        , m_inverse_(n_params, n_params)
+        , z_(n_params)
+        , dkinetic_dr_(n_params)
+    {
+        m_inverse_.setIdentity();
+        update_metric();
+    }
+
+    /**
+     * Sample from N(0, M) where M inverse ~ sample covariance matrix.
+     * If M inverse = L L^T, then L^{-T} z ~ N(0, M) for z ~ N(0, I).
+     */
+    template <class MatType
+            , class GenType>
+    void sample(Eigen::MatrixBase<MatType>& rho,
+                GenType& gen) 
+    { 
+        z_ = Eigen::VectorXd::NullaryExpr(z_.rows(), 
+                [&]() { return dist(gen); });
+        llt_.matrixU().solveInPlace(z_);
+        rho = z_;
+    }
+
+    /**
+     * Compute corresponding kinetic energy
+     */
+    template <class MatType>
+    double kinetic(const Eigen::MatrixBase<MatType>& rho) const
+    { return 0.5 * rho.dot(dkinetic_dr(rho)); }
+
+    /**
+     * Computes M^{-1} rho into an internal buffer to avoid allocation.
+     * The returned reference is only valid until the next call.
+     */
+    template <class MatType>
+    const Eigen::VectorXd& dkinetic_dr(const Eigen::MatrixBase<MatType>& rho) const
+    { 
+        dkinetic_dr_.noalias() = m_inverse_ * rho; 
+        return dkinetic_dr_;
+    }
+
+    variance_t& get_m_inverse() { return m_inverse_; }
+    const variance_t& get_m_inverse() const { return m_inverse_; }
+
+    /**
+     * Must be called after M inverse is modified through get_m_inverse().
+     * Recomputes the Cholesky decomposition of M inverse.
+     */
+    void update_metric() { llt_.compute(m_inverse_); }
+
+    /**
+     * Discards any normal draw cached by the momentum distribution.
+     */
+    void reset() { dist.reset(); }
+
+    /**
+     * Saves (loads) the momentum distribution and M inverse.
+     * Cached quantities are recomputed after loading.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_state(os, dist);
+        util::write_mat(os, m_inverse_);
+    }
+
+    void load(std::istream& is)
+    {
+        util::read_state(is, dist);
+        util::read_mat(is, m_inverse_);
+        update_metric();
+    }
+
+private:
+    std::normal_distribution<> dist;
+    variance_t m_inverse_;
+    Eigen::LLT<variance_t> llt_;
+    Eigen::VectorXd z_;                     // cache for standard normal draws
+    mutable Eigen::VectorXd dkinetic_dr_;   // cache for M^{-1} rho
+};
+
+/**
+ * Low-rank plus diagonal variance with adaptation (see LowRankMetric).
+ * Sampling momentum, kinetic energy, and dkinetic_dr are all O(n_params * k).
+ */
+template <>
+struct MomentumHandler<lowrank_var>
+{
+    using adapter_policy_t = lowrank_var;
+    using variance_t = LowRankMetric;
+
+    // initialize m inverse to be identity 
+    MomentumHandler(size_t n_params)
+        : dist(0., 1.)
+        , m_inverse_(n_params)
+        , z_(n_params)
+        , dkinetic_dr_(n_params)
+    {
+        update_metric();
+    }
+
+    /**
+     * Sample from N(0, M).
+     * Since (I + U(Lambda-I)U^T)^{-1/2} = I + U(Lambda^{-1/2}-I)U^T,
+     * S^{-1} (z + U((Lambda^{-1/2}-1) * U^T z)) ~ N(0, M) for z ~ N(0, I).
+     */
+    template <class MatType
+            , class GenType>
+    void sample(Eigen::MatrixBase<MatType>& rho,
+                GenType& gen) 
+    { 
+        z_ = Eigen::VectorXd::NullaryExpr(z_.rows(), 
+                [&]() { return dist(gen); });
+        w_.noalias() = m_inverse_.U.transpose() * z_;
+        w_.array() *= lambda_isqrt_m1_.array();
+        z_.noalias() += m_inverse_.U * w_;
+        rho = (z_.array() / m_inverse_.scale.array()).matrix();
+    }
+
+    /**
+     * Compute corresponding kinetic energy
+     */
+    template <class MatType>
+    double kinetic(const Eigen::MatrixBase<MatType>& rho) const
+    { return 0.5 * rho.dot(dkinetic_dr(rho)); }
+
+    /**
+     * Computes M^{-1} rho = S (S rho + U((Lambda-1) * U^T S rho)) 
+     * into an internal buffer to avoid allocation.
+     * The returned reference is only valid until the next call.
+     */
+    template <class MatType>
+    const Eigen::VectorXd& dkinetic_dr(const Eigen::MatrixBase<MatType>& rho) const
+    { 
+        dkinetic_dr_ = (m_inverse_.scale.array() * rho.array()).matrix();
+        w_.noalias() = m_inverse_.U.transpose() * dkinetic_dr_;
+        w_.array() *= lambda_m1_.array();
+        dkinetic_dr_.noalias() += m_inverse_.U * w_;
+        dkinetic_dr_.array() *= m_inverse_.scale.array();
+        return dkinetic_dr_;
+    }
+
+    variance_t& get_m_inverse() { return m_inverse_; }
+    const variance_t& get_m_inverse() const { return m_inverse_; }
+
+    /**
+     * Must be called after M inverse is modified through get_m_inverse().
+     * Caches functions of the eigenvalues.
+     */
+    void update_metric() 
+    { 
+        lambda_m1_ = m_inverse_.lambda.array() - 1.;
+        lambda_isqrt_m1_ = m_inverse_.lambda.array().rsqrt() - 1.;
+        w_.resize(m_inverse_.lambda.size());
+    }
+
+    /**
+     * Discards any normal draw cached by the momentum distribution.
+     */
+    void reset() { dist.reset(); }
+
+    /**
+     * Saves (loads) the momentum distribution and M inverse.
+     * Cached quantities are recomputed after loading.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_state(os, dist);
+        util::write_mat(os, m_inverse_.scale);
+        util::write_mat(os, m_inverse_.U);
+        util::write_mat(os, m_inverse_.lambda);
+    }
+
+    void load(std::istream& is)
+    {
+        util::read_state(is, dist);
+        util::read_mat(is, m_inverse_.scale);
+        util::read_mat(is, m_inverse_.U);
+        util::read_mat(is, m_inverse_.lambda);
+        update_metric();
+    }
+
 private:
     std::normal_distribution<> dist;
     variance_t m_inverse_;
+    Eigen::VectorXd lambda_m1_;             // Lambda - 1
+    Eigen::VectorXd lambda_isqrt_m1_;       // Lambda^{-1/2} - 1
+    Eigen::VectorXd z_;                     // cache for standard normal draws
+    mutable Eigen::VectorXd w_;             // cache for (k-dimensional) projections
+    mutable Eigen::VectorXd dkinetic_dr_;   // cache for M^{-1} rho
 };
 
 } // namespace mcmc
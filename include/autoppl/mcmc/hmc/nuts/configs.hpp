@@ -1,12 +1,52 @@
 #pragma once
 #include <cstddef>
+#include <vector>
+#include <Eigen/Dense>
 #include <autoppl/mcmc/hmc/step_adapter.hpp>
 #include <autoppl/mcmc/hmc/momentum_handler.hpp>
 #include <autoppl/mcmc/sampler_tools.hpp>
 #include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/mcmc/disc_gibbs.hpp>
+#include <autoppl/mcmc/stopping.hpp>
+#include <autoppl/mcmc/checkpoint.hpp>
+#include <autoppl/optim/pathfinder.hpp>
+#include <autoppl/util/sharding.hpp>
 
 namespace ppl {
 
+/**
+ * Adapted state of a NUTS chain at the end of a run (see NUTSResult).
+ * It can be passed back to warm-start another run of the same model (see WarmStartConfig).
+ */
+template <class VarAdapterPolicy=diag_var>
+struct NUTSAdaptedState
+{
+    using variance_t = typename 
+        mcmc::MomentumHandler<VarAdapterPolicy>::variance_t;
+
+    double log_eps = 0.;        // log step size (log_eps_bar once warmup is finished)
+    variance_t m_inverse;       // inverse metric (see MomentumHandler)
+    Eigen::VectorXd theta;      // last sample (unconstrained)
+    Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1> disc;  // last discrete values
+                                                                // (if empty, they are initialized)
+};
+
+/**
+ * Configuration to warm-start NUTS from adapted states of a previous run.
+ * Chain c starts from states[c % states.size()] (no warm start if states is empty):
+ * its first sample, step size, and inverse metric are taken from the state,
+ * so that neither the initialization (see PathfinderConfig) 
+ * nor find_reasonable_epsilon is run, and warmup can be shortened or skipped (warmup = 0).
+ * During warmup, the step size is adapted again starting from the state,
+ * while the metric is kept unless adapt_metric is true.
+ */
+template <class VarAdapterPolicy=diag_var>
+struct WarmStartConfig
+{
+    std::vector<NUTSAdaptedState<VarAdapterPolicy>> states;
+    bool adapt_metric = false;
+};
+
 /**
  * User configuration for NUTS algorithm.
  */
@@ -23,6 +63,24 @@ struct NUTSConfig: ConfigBase
 
     // configuration for variance adaptation
     VarConfig var_config;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+
+    // configuration for updating discrete parameters
+    DiscConfig disc_config;
+
+    // configuration for initializing the first sample and metric
+    PathfinderConfig pathfinder_config;
+
+    // configuration for stopping once chains have converged
+    StoppingConfig stop_config;
+
+    // configuration for checkpointing and resuming chains
+    CheckpointConfig checkpoint_config;
+
+    // configuration for starting from the adapted states of a previous run
+    WarmStartConfig<VarAdapterPolicy> warm_start_config;
 };
 
 /**
@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <type_traits>
+#include <vector>
 #include <Eigen/Dense>
 #include <fastad_bits/reverse/core/var_view.hpp>
 #include <fastad_bits/reverse/core/eval.hpp>
@@ -7,14 +9,23 @@
 #include <autoppl/util/packs/ptr_pack.hpp>
 #include <autoppl/util/logging.hpp>
 #include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/serialize.hpp>
 #include <autoppl/math/math.hpp>
 #include <autoppl/mcmc/sampler_tools.hpp>
 #include <autoppl/mcmc/result.hpp>
 #include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/stopping.hpp>
+#include <autoppl/mcmc/checkpoint.hpp>
 #include <autoppl/mcmc/hmc/nuts/tree_utils.hpp>
+#include <autoppl/util/ad_boost/tempered.hpp>
 #include <autoppl/mcmc/hmc/leapfrog.hpp>
 #include <autoppl/mcmc/hmc/hamiltonian.hpp>
+#include <autoppl/mcmc/hmc/reasonable_epsilon.hpp>
 #include <autoppl/mcmc/hmc/nuts/configs.hpp>
+#include <autoppl/mcmc/disc_gibbs.hpp>
+#include <autoppl/optim/objective.hpp>
+#include <autoppl/optim/pathfinder.hpp>
 
 namespace ppl {
 namespace mcmc {
@@ -43,19 +54,25 @@ bool check_entropy(const MatType1& rho,
  * Helper function to obtain the forward/backward-most position and momentum.
  * Accept/reject policy is based on UniformDistType parameter and GenType
  *
+ * The tree is built iteratively: leaves are created in order (one leapfrog each)
+ * and pushed onto a checkpoint stack of complete subtrees.
+ * Whenever the two top-most subtrees have the same height, they are merged,
+ * which is exactly the post-order traversal of the recursive formulation
+ * (hence also the same order of random draws).
+ * Building stops as soon as a leaf diverges or a merged subtree U-turns.
+ *
  * Note that the caller, i.e. nuts(), MUST have theta_adj already pre-computed
  * (theta_adj is a member of input and input will be an instance of TreeInput).
  *
  * @param   n_params            number of (continuous) parameters
  * @param   input               TreeInput-like input object
- * @param   depth               current depth of building tree
+ * @param   depth               depth of tree to build (2^depth leapfrogs)
  * @param   unif_sampler        an object like std::uniform_distribution(0,1)
  *                              used for metropolis acceptance
  * @param   gen                 rng device
  * @param   momentum_handler    MomentumHandler-like object to compute 
  *                              kinetic energy and momentum
- * @param   tree_cache          pointer to cache memory that will be used by build_tree.
- *                              The array of doubles must be of size n_params * 7 * max_depth.
+ * @param   arena               TreeArena constructed with at least depth as max depth.
  */
 template <class InputType
         , class UniformDistType
@@ -68,411 +85,306 @@ TreeOutput build_tree(size_t n_params,
                       UniformDistType& unif_sampler,
                       GenType& gen,
                       MomentumHandlerType& momentum_handler,
-                      double* tree_cache)
+                      TreeArena& arena)
 {
+    static_cast<void>(n_params);
     constexpr double delta_max = 1000;  // suggested by Gelman
 
-    // base case
-    if (depth == 0) {
+    auto& theta = input.theta_ref.get();
+    auto& p_most = input.p_most_ref.get();
+    const size_t n_leaves = static_cast<size_t>(1) << depth;
+    size_t top = 0;     // number of subtrees in the checkpoint stack
+
+    for (size_t leaf = 0; leaf < n_leaves; ++leaf) {
+
         double new_potential = leapfrog(input.ad_expr_ref.get(),
-                                        input.theta_ref.get(),
+                                        theta,
                                         input.theta_adj_ref.get(),
                                         input.tp_adj_ref.get(),
-                                        input.p_most_ref.get(),
+                                        p_most,
                                         momentum_handler,
                                         input.v * input.epsilon,
                                         true // always reuse previous adjoint
                                         );
-        double new_kinetic = momentum_handler.kinetic(input.p_most_ref.get());
+        double new_kinetic = momentum_handler.kinetic(p_most);
         double new_ham = hamiltonian(new_potential, new_kinetic);
 
         // update number of leapfrogs
         ++(input.n_leapfrog_ref.get());
 
-        // update LSE of weights
-        if (std::isnan(new_ham)) { new_ham = math::inf<double>; }
-        input.log_sum_weight_ref.get() = math::lse(
-                input.log_sum_weight_ref.get(), 
-                input.ham - new_ham);
-
         // update sum of probabilities
+        if (std::isnan(new_ham)) { new_ham = math::inf<double>; }
         input.sum_metro_prob_ref.get() += (input.ham - new_ham > 0) ? 
                 1 : std::exp(input.ham - new_ham);
 
-        // always copy into theta_prime 
-        input.theta_prime_ref.get() = input.theta_ref.get();
-
-        // update momenta of beginning of subtree (moving in the direction of input.v)
-        input.p_beg_ref.get() = input.p_most_ref.get();
-        input.p_beg_scaled_ref.get() = 
-            momentum_handler.dkinetic_dr(input.p_most_ref.get());
-
-        // update momenta of end of subtree (moving in the direction of input.v)
-        input.p_end_ref.get() = input.p_beg_ref.get();
-        input.p_end_scaled_ref.get() = input.p_beg_scaled_ref.get();
-
-        // update integrated momentum
-        input.rho_ref.get() += input.p_most_ref.get();
+        // divergent leaf invalidates the whole tree
+        if (!(new_ham - input.ham <= delta_max)) {
+            return TreeOutput(false, new_potential);
+        }
 
-        // return validity and new potential 
-        return TreeOutput(
-                (new_ham - input.ham <= delta_max),
-                new_potential
-            );
-    }
+        // push new leaf as a subtree of height 0
+        TreeState& leaf_state = arena.state(top++);
+        arena.vec(leaf_state, TreeState::theta_prime) = theta;
+        arena.vec(leaf_state, TreeState::p_beg) = p_most;
+        arena.vec(leaf_state, TreeState::p_beg_scaled) = 
+            momentum_handler.dkinetic_dr(p_most);
+        arena.vec(leaf_state, TreeState::p_end) = p_most;
+        arena.vec(leaf_state, TreeState::p_end_scaled) = 
+            arena.vec(leaf_state, TreeState::p_beg_scaled);
+        arena.vec(leaf_state, TreeState::rho) = p_most;
+        leaf_state.log_sum_weight = input.ham - new_ham;
+        leaf_state.potential = new_potential;
+        leaf_state.height = 0;
+
+        // merge top two subtrees while they have the same height
+        while (top >= 2 && 
+               arena.state(top-1).height == arena.state(top-2).height) {
+
+            TreeState& first = arena.state(top-2);
+            TreeState& second = arena.state(top-1);
+
+            // sample proposal and update corresponding potential
+            // note: accept_prob is mathematically guaranteed to be <= 1
+            double log_sum_weight_curr = math::lse(
+                    first.log_sum_weight, second.log_sum_weight);
+            double accept_prob = std::exp(second.log_sum_weight - log_sum_weight_curr);
+            if (accept_or_reject(accept_prob, unif_sampler, gen)) {
+                std::swap(first.vecs[TreeState::theta_prime],
+                          second.vecs[TreeState::theta_prime]);
+                first.potential = second.potential;
+            }
 
-    // recursion
-    Eigen::Map<Eigen::VectorXd> p_end_inner(tree_cache, n_params);
-    Eigen::Map<Eigen::VectorXd> p_end_scaled_inner(tree_cache + n_params, n_params);
-    Eigen::Map<Eigen::VectorXd> rho_first(tree_cache + 2*n_params, n_params);
-    rho_first.setZero();
-    double log_sum_weight_first = math::neg_inf<double>;
-
-    tree_cache += 3 * n_params; // update position of tree cache
-
-    // create a new input for first recursion
-    // some references have to rebound
-    InputType first_input = input; 
-    first_input.p_end_ref = p_end_inner;
-    first_input.p_end_scaled_ref = p_end_scaled_inner;
-    first_input.rho_ref = rho_first;
-    first_input.log_sum_weight_ref = log_sum_weight_first;
-
-    // build first subtree
-    TreeOutput first_output = 
-        build_tree(n_params, first_input, depth - 1, 
-                   unif_sampler, gen, momentum_handler,
-                   tree_cache);
-
-    // if first subtree is already invalid, early exit
-    // note that caller will break out of doubling process now,
-    // so we do not have to worry about updating the other momentum vectors
-    if (!first_output.valid) { return first_output; }
-
-    // second recursion
-    Eigen::Map<Eigen::VectorXd> theta_double_prime(tree_cache, n_params);
-    Eigen::Map<Eigen::VectorXd> p_beg_inner(tree_cache + n_params, n_params);
-    Eigen::Map<Eigen::VectorXd> p_beg_scaled_inner(tree_cache + 2*n_params, n_params);
-    Eigen::Map<Eigen::VectorXd> rho_second(tree_cache + 3*n_params, n_params);
-    rho_second.setZero();
-    double log_sum_weight_second = math::neg_inf<double>;
-
-    tree_cache += 4 * n_params;
-
-    // create a new input for second recursion
-    InputType second_input = input;
-    second_input.theta_prime_ref = theta_double_prime;
-    second_input.p_beg_ref = p_beg_inner;
-    second_input.p_beg_scaled_ref = p_beg_scaled_inner;
-    second_input.rho_ref = rho_second;
-    second_input.log_sum_weight_ref = log_sum_weight_second;
-
-    // build second subtree
-    TreeOutput second_output = 
-        build_tree(n_params, second_input, depth - 1, 
-                   unif_sampler, gen, momentum_handler,
-                   tree_cache);
-
-    // if second subtree is invalid, early exit
-    // note that we must return first output since it has the potential
-    // of the first proposal and we ignore the second proposal
-    if (!second_output.valid) { 
-        first_output.valid = false;
-        return first_output; 
+            // check if merged subtree is still valid based on entropy condition
+            auto rho_first = arena.vec(first, TreeState::rho);
+            auto rho_second = arena.vec(second, TreeState::rho);
+            auto p_beg_scaled = arena.vec(first, TreeState::p_beg_scaled);
+            auto p_end_scaled = arena.vec(second, TreeState::p_end_scaled);
+            bool valid =
+                check_entropy(rho_first + arena.vec(second, TreeState::p_beg),
+                              p_beg_scaled,
+                              arena.vec(second, TreeState::p_beg_scaled)) &&
+                check_entropy(arena.vec(first, TreeState::p_end) + rho_second,
+                              arena.vec(first, TreeState::p_end_scaled),
+                              p_end_scaled);
+            rho_first += rho_second;
+            valid = valid && check_entropy(rho_first, p_beg_scaled, p_end_scaled);
+
+            if (!valid) { return TreeOutput(false, first.potential); }
+
+            // end of merged subtree is the end of second subtree
+            std::swap(first.vecs[TreeState::p_end], 
+                      second.vecs[TreeState::p_end]);
+            std::swap(first.vecs[TreeState::p_end_scaled], 
+                      second.vecs[TreeState::p_end_scaled]);
+            first.log_sum_weight = log_sum_weight_curr;
+            ++first.height;
+            --top;
+        }
     }
 
-    // create output to return at the end
-    TreeOutput output;
-
-    // sample proposal and update corresponding potential
-    double log_sum_weight_curr = math::lse(
-            log_sum_weight_first, log_sum_weight_second
-            );
+    // copy the full tree into output
+    TreeState& tree = arena.state(0);
+    input.theta_prime_ref.get() = arena.vec(tree, TreeState::theta_prime);
+    input.p_beg_ref.get() = arena.vec(tree, TreeState::p_beg);
+    input.p_beg_scaled_ref.get() = arena.vec(tree, TreeState::p_beg_scaled);
+    input.p_end_ref.get() = arena.vec(tree, TreeState::p_end);
+    input.p_end_scaled_ref.get() = arena.vec(tree, TreeState::p_end_scaled);
+    input.rho_ref.get() += arena.vec(tree, TreeState::rho);
     input.log_sum_weight_ref.get() = math::lse(
-            input.log_sum_weight_ref.get(), log_sum_weight_curr
-            );
-
-    // note: accept_prob is mathematically guaranteed to be <= 1
-    double accept_prob = std::exp(log_sum_weight_second - log_sum_weight_curr);
-    bool accept = accept_or_reject(accept_prob, unif_sampler, gen);
-    if (accept) { 
-        input.theta_prime_ref.get() = 
-            second_input.theta_prime_ref.get();
-        output.potential = second_output.potential;
-    } else {
-        output.potential = first_output.potential;
-    }
+            input.log_sum_weight_ref.get(), tree.log_sum_weight);
 
-    // check if current subtree is still valid based
-    // on entropy condition
-    auto rho_curr = rho_first + rho_second;
-    input.rho_ref.get() += rho_curr;
-    output.valid =
-        check_entropy(rho_curr,
-                      input.p_beg_scaled_ref.get(),
-                      input.p_end_scaled_ref.get()) &&
-        check_entropy(rho_first + p_beg_inner, 
-                      input.p_beg_scaled_ref.get(), 
-                      p_beg_scaled_inner) &&
-        check_entropy(p_end_inner + rho_second, 
-                      p_end_scaled_inner, 
-                      input.p_end_scaled_ref.get());
-
-    return output;
+    return TreeOutput(true, tree.potential);
 }
 
 /**
- * Finds a reasonable epsilon for NUTS algorithm.
- *
- * @param   eps                 initial epsilon (see Gelman's paper)
- * @param   ad_expr             AD expression bound to theta and theta_adj
- * @param   theta               vector of theta values
- * @param   theta_adj           vector of theta adjoints
- * @param   gen                 rng device
- * @param   momentum_handler    MomentumHandler-like object 
+ * Builds the AD expression of the log-pdf of program at pack.
+ * The part of the log-pdf given by T (see Tempering) is scaled 
+ * by the inverse temperature viewed by beta (see ad::boost::TemperedNode).
  */
-template <class ADExprType
-        , class MatType
-        , class GenType
-        , class MomentumHandlerType>
-double find_reasonable_epsilon(double eps,
-                               ADExprType& ad_expr,
-                               MatType& theta,
-                               MatType& theta_adj,
-                               MatType& tp_adj,
-                               GenType& gen,
-                               MomentumHandlerType& momentum_handler)
+template <Tempering T
+        , class ProgramType
+        , class PtrPackType>
+inline auto make_log_pdf_ad_expr(const ProgramType& program,
+                                 const PtrPackType& pack,
+                                 util::ShardContext& shard_ctx,
+                                 const double* beta)
 {
-    // See (STAN) for reference: if epsilon is way out of bounds, just return eps
-    if (eps <= 0 || eps > 1e7) return eps;
-
-    const double diff_bound = std::log(0.8);
-
-    size_t n_params = theta.rows(); // theta is expected to be vector-like
-
-    Eigen::MatrixXd mat(n_params, 3);
-    Eigen::Map<Eigen::VectorXd> r(mat.col(0).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_orig(mat.col(1).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_adj_orig(mat.col(2).data(), n_params);
-
-    // sample momentum vector based on handler
-    momentum_handler.sample(r, gen);
-
-    // differentiate first to get adjoints and hamiltonian
-    const double potential_orig = -ad::autodiff(ad_expr); 
-    double kinetic_orig = momentum_handler.kinetic(r);
-    double ham_orig = hamiltonian(potential_orig, kinetic_orig);
-
-    // save original value and adjoint
-    theta_orig = theta;
-    theta_adj_orig = theta_adj;
-    
-    // get current hamiltonian after leapfrog
-    double potential_curr = leapfrog(
-            ad_expr, theta, theta_adj, tp_adj,
-            r, momentum_handler, eps, true);
-    double kinetic_curr = momentum_handler.kinetic(r);
-    double ham_curr = hamiltonian(potential_curr, kinetic_curr);
-
-    int a = (ham_orig - ham_curr > diff_bound) ? 1 : -1;
-
-    while (1) {
-
-        // check if break condition holds
-        if ( ((a == 1) && !(ham_orig - ham_curr > diff_bound)) || 
-             ((a == -1) && !(ham_orig - ham_curr < diff_bound)) ) {
-            break;
-        }
-
-        // update epsilon
-        eps *= (a == -1) ? 0.5 : 2;
-
-        // copy back original value and adjoint
-        theta = theta_orig;
-        theta_adj = theta_adj_orig;
-
-        // recompute original hamiltonian with new momentum
-        momentum_handler.sample(r, gen);
-        kinetic_orig = momentum_handler.kinetic(r);
-        ham_orig = hamiltonian(potential_orig, kinetic_orig);
-
-        // leapfrog and compute current hamiltonian
-        potential_curr = leapfrog(
-                ad_expr, theta, theta_adj, tp_adj,
-                r, momentum_handler, eps, true);
-        kinetic_curr = momentum_handler.kinetic(r);
-        ham_curr = hamiltonian(potential_curr, kinetic_curr);
-
+    if constexpr (T == Tempering::joint) {
+        return ad::boost::tempered(program.ad_log_pdf(pack, shard_ctx), beta);
+    } else if constexpr (T == Tempering::likelihood) {
+        return program.ad_log_pdf(pack, shard_ctx, beta);
+    } else {
+        static_cast<void>(beta);
+        return program.ad_log_pdf(pack, shard_ctx);
     }
-
-    // copy back original value and adjoint
-    theta = theta_orig;
-    theta_adj = theta_adj_orig;
-
-    return eps;
 }
 
 /**
- * No-U-Turn Sampler (NUTS)
+ * State of a single chain of No-U-Turn Sampler (NUTS).
+ * It owns a copy of the program, the AD expressions of its log-pdf,
+ * every buffer the expressions are bound to, and the step size and variance adapters,
+ * so it must not be moved after construction.
  *
- * User must ensure that the program does not have any discrete parameters.
- * Discrete data is allowed.
+ * If the program has discrete parameters, every transition is a compound update:
+ * a NUTS transition of the continuous parameters with the discrete parameters fixed,
+ * followed by a sweep over the discrete parameters with the continuous parameters fixed
+ * (see disc_gibbs_sweep and config.disc_config).
  *
- * @param   program     program expression used to determine log-pdf
- * @param   config      NUTS configuration object
- * @param   pack        offset pack result of activating program.
- *                      It will likely be util::OffsetPack where each offset
- *                      value is equivalent to the total number of values needed,
- *                      i.e. if pack.uc_offset is 10, there is exactly 10 unconstrained values
- *                      for the program.
- * @param   res         result object of calling NUTS that will be populated with samples and other information.
+ * If T is not Tempering::none, the log-pdf (or only the log-likelihood) 
+ * is scaled by the inverse temperature beta,
+ * which may be changed between transitions (see pt_ and smc_).
+ *
+ * @tparam  ProgramType     program expression type
+ * @tparam  NUTSConfigType  NUTS configuration type
+ * @tparam  T               part of the log-pdf scaled by beta
  */
-
 template <class ProgramType
-        , class OffsetPackType
-        , class MCMCResultType
-        , class NUTSConfigType = NUTSConfig<>>
-void nuts_(ProgramType& program, 
-           const NUTSConfigType& config,
-           const OffsetPackType& pack,
-           MCMCResultType& res)
+        , class NUTSConfigType = NUTSConfig<>
+        , Tempering T = Tempering::none>
+struct NUTSChain
 {
-    assert(std::get<1>(pack).uc_offset == 0);
-    assert(std::get<1>(pack).tp_offset == 0);
-    assert(std::get<1>(pack).c_offset == 0);
-    assert(std::get<1>(pack).v_offset == 0);
-
-    auto& offset_pack = std::get<0>(pack);
-    size_t n_params = offset_pack.uc_offset;
-
-    // initialization of meta-variables
-    std::mt19937 gen(config.seed);
-    std::uniform_int_distribution direction_sampler(0, 1);
-    std::uniform_real_distribution unif_sampler(0., 1.);
-
-    // Transformed parameters, constrained parameter, visit count cache
-    // This can be shared across all AD expressions since only one expression
-    // will be evaluated at a time.
-    Eigen::MatrixXd tp_mat(offset_pack.tp_offset, 2);
-    Eigen::Map<Eigen::VectorXd> tp_val(tp_mat.col(0).data(), offset_pack.tp_offset);
-    Eigen::Map<Eigen::VectorXd> tp_adj(tp_mat.col(1).data(), offset_pack.tp_offset);
-    Eigen::VectorXd constrained(offset_pack.c_offset);
-    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit(offset_pack.v_offset);
-    tp_mat.setZero();
-    constrained.setZero();
-    visit.setZero();
-
-    // momentum matrix (for stability reasons we require knowing 4 momentum)
-    // left-subtree backwardmost momentum => bb
-    // left-subtree forwardmost momentum => bf
-    // right-subtree backwardmost momentum => fb
-    // right-subtree forwardmost momentum => ff
-    // scaled versions are based on hamiltonian adjusted covariance matrix
-    Eigen::MatrixXd cache_mat(n_params, 18);
-    cache_mat.setZero();
-    Eigen::Map<Eigen::VectorXd> p_bb(cache_mat.col(0).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_bb_scaled(cache_mat.col(1).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_bf(cache_mat.col(2).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_bf_scaled(cache_mat.col(3).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_fb(cache_mat.col(4).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_fb_scaled(cache_mat.col(5).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_ff(cache_mat.col(6).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> p_ff_scaled(cache_mat.col(7).data(), n_params);
-
-    // position matrix for thetas and adjoints
-    Eigen::Map<Eigen::VectorXd> theta_bb(cache_mat.col(8).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_bb_adj(cache_mat.col(9).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_ff(cache_mat.col(10).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_ff_adj(cache_mat.col(11).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_curr(cache_mat.col(12).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_curr_adj(cache_mat.col(13).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> theta_prime(cache_mat.col(14).data(), n_params);
-
-    // integrated momentum vectors (more stable than checking entropy with theta_ff - theta_bb)
-    // forward-subtree => rho_f
-    // backward-subtree => rho_b
-    // combined subtrees => rho
-    Eigen::Map<Eigen::VectorXd> rho_f(cache_mat.col(15).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> rho_b(cache_mat.col(16).data(), n_params);
-    Eigen::Map<Eigen::VectorXd> rho(cache_mat.col(17).data(), n_params);
-
-    // build-tree helper function cache line
-    Eigen::VectorXd tree_cache(n_params * 7 * config.max_depth);
-    tree_cache.setZero();
-
-    // AD Expressions for L(theta) (log-pdf up to constant at theta)
-    // Note that these expressions are the only ones used ever.
-    auto theta_bb_ad_expr = program.ad_log_pdf(util::make_ptr_pack(
-            theta_bb.data(), theta_bb_adj.data(), 
-            tp_val.data(), tp_adj.data(),
-            constrained.data(), visit.data() ));
-    auto theta_ff_ad_expr = program.ad_log_pdf(util::make_ptr_pack(
-            theta_ff.data(), theta_ff_adj.data(),
-            tp_val.data(), tp_adj.data(),
-            constrained.data(), visit.data() ));
-    auto theta_curr_ad_expr = program.ad_log_pdf(util::make_ptr_pack(
-            theta_curr.data(), theta_curr_adj.data(),
-            tp_val.data(), tp_adj.data(),
-            constrained.data(), visit.data() ));
-
-    // bind every AD expression to the same cache line
-    auto size_pack = theta_bb_ad_expr.bind_cache_size();
-    Eigen::VectorXd ad_val_buf(size_pack(0));
-    Eigen::VectorXd ad_adj_buf(size_pack(1));
-    theta_bb_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
-    theta_ff_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
-    theta_curr_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
-    
-    // initializes first sample into theta_curr
-    // TODO: allow users to choose how to initialize first point?
-    program.bind(util::make_ptr_pack(
-                theta_curr.data(), nullptr,
-                tp_val.data(), nullptr,
-                constrained.data(), visit.data()));
-    program.init_params(gen, config.prune);
-
-    // initialize current potential (will be "previous" starting in for-loop)
-    double potential_prev = -ad::evaluate(theta_curr_ad_expr);
-
-    // initialize momentum handler
+    using program_t = ProgramType;
     using var_adapter_policy_t = typename 
         nuts_config_traits<NUTSConfigType>::var_adapter_policy_t;
-    mcmc::MomentumHandler<var_adapter_policy_t> momentum_handler(n_params);
-
-    // initialize step adapter
-    const double log_eps = std::log(
-        mcmc::find_reasonable_epsilon(
-            1., // initial epsilon
-            theta_curr_ad_expr, theta_curr, 
-            theta_curr_adj, tp_adj,
-            gen, momentum_handler)); 
-    mcmc::StepAdapter step_adapter(log_eps);        // initialize step adapter with initial log-epsilon
-    step_adapter.step_config = config.step_config;  // copy step configs from user
-
-    // initialize variance adapter
-    mcmc::VarAdapter<var_adapter_policy_t> var_adapter(
-            n_params, config.warmup, config.var_config.init_buffer,
-            config.var_config.term_buffer, config.var_config.window_base
-            );
-
-    // construct miscellaneous objects 
-    auto logger = util::ProgressLogger(config.samples + config.warmup, "NUTS");
-    util::StopWatch<> stopwatch_warmup;
-    util::StopWatch<> stopwatch_sampling;
-
-    // start timing warmup
-    stopwatch_warmup.start();
-
-    for (size_t i = 0; i < config.samples + config.warmup; ++i) {
-
-        // if warmup is finished, stop timing warmup and start timing sampling
-        if (i == config.warmup) {
-            stopwatch_warmup.stop();
-            stopwatch_sampling.start();
+    using momentum_handler_t = mcmc::MomentumHandler<var_adapter_policy_t>;
+    using adapted_state_t = NUTSAdaptedState<var_adapter_policy_t>;
+    using var_adapter_t = decltype(mcmc::make_var_adapter<var_adapter_policy_t>(
+                0, 0, std::declval<const VarConfig&>()));
+    using disc_vec_t = Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1>;
+    using ptr_pack_t = decltype(util::make_ptr_pack(
+                (double*)nullptr, (double*)nullptr,
+                (double*)nullptr, (double*)nullptr,
+                (double*)nullptr, (size_t*)nullptr));
+    using ad_expr_t = decltype(make_log_pdf_ad_expr<T>(
+                std::declval<const program_t&>(),
+                std::declval<const ptr_pack_t&>(),
+                std::declval<util::ShardContext&>(),
+                (const double*)nullptr));
+
+    /**
+     * Binds the AD expressions, initializes the first sample,
+     * and finds an initial step size.
+     * If init_state is not null, the first sample, step size, and inverse metric
+     * are taken from it instead (see WarmStartConfig).
+     *
+     * @param   _program        program to copy
+     * @param   _config         NUTS configuration object (must outlive this object)
+     * @param   pack            offset pack result of activating program (see nuts_)
+     * @param   shard_ctx       context used to build sharded AD expressions
+     * @param   seed            seed of this chain
+     * @param   _beta           inverse temperature (must be 1 if T is Tempering::none)
+     * @param   init_state      adapted state of a previous run to start from (may be null)
+     */
+    template <class OffsetPackType>
+    NUTSChain(const program_t& _program,
+              const NUTSConfigType& _config,
+              const OffsetPackType& pack,
+              util::ShardContext& shard_ctx,
+              size_t seed,
+              double _beta = 1.,
+              const adapted_state_t* init_state = nullptr)
+        : config(_config)
+        , beta{_beta}
+        , n_params{std::get<0>(pack).uc_offset}
+        , disc_curr(disc_vec_t::Zero(std::get<1>(pack).uc_offset))
+        , program(bind_disc_(_program, disc_curr))
+        , gen(seed)
+        , tp_mat(Eigen::MatrixXd::Zero(std::get<0>(pack).tp_offset, 2))
+        , constrained(Eigen::VectorXd::Zero(std::get<0>(pack).c_offset))
+        , visit(Eigen::Matrix<size_t, Eigen::Dynamic, 1>::Zero(std::get<0>(pack).v_offset))
+        , tp_val(tp_mat.col(0).data(), tp_mat.rows())
+        , tp_adj(tp_mat.col(1).data(), tp_mat.rows())
+        , disc_log_weights(std::max(config.disc_config.upper - config.disc_config.lower + 1, 0))
+        , cache_mat(Eigen::MatrixXd::Zero(n_params, 18))
+        , p_bb(cache_mat.col(0).data(), n_params)
+        , p_bb_scaled(cache_mat.col(1).data(), n_params)
+        , p_bf(cache_mat.col(2).data(), n_params)
+        , p_bf_scaled(cache_mat.col(3).data(), n_params)
+        , p_fb(cache_mat.col(4).data(), n_params)
+        , p_fb_scaled(cache_mat.col(5).data(), n_params)
+        , p_ff(cache_mat.col(6).data(), n_params)
+        , p_ff_scaled(cache_mat.col(7).data(), n_params)
+        , theta_bb(cache_mat.col(8).data(), n_params)
+        , theta_bb_adj(cache_mat.col(9).data(), n_params)
+        , theta_ff(cache_mat.col(10).data(), n_params)
+        , theta_ff_adj(cache_mat.col(11).data(), n_params)
+        , theta_curr(cache_mat.col(12).data(), n_params)
+        , theta_curr_adj(cache_mat.col(13).data(), n_params)
+        , theta_prime(cache_mat.col(14).data(), n_params)
+        , rho_f(cache_mat.col(15).data(), n_params)
+        , rho_b(cache_mat.col(16).data(), n_params)
+        , rho(cache_mat.col(17).data(), n_params)
+        , tree_arena(n_params, config.max_depth)
+        , theta_bb_ad_expr(make_log_pdf_ad_expr<T>(program, util::make_ptr_pack(
+                theta_bb.data(), theta_bb_adj.data(), 
+                tp_val.data(), tp_adj.data(),
+                constrained.data(), visit.data() ), shard_ctx, &beta))
+        , theta_ff_ad_expr(make_log_pdf_ad_expr<T>(program, util::make_ptr_pack(
+                theta_ff.data(), theta_ff_adj.data(),
+                tp_val.data(), tp_adj.data(),
+                constrained.data(), visit.data() ), shard_ctx, &beta))
+        , theta_curr_ad_expr(make_log_pdf_ad_expr<T>(program, util::make_ptr_pack(
+                theta_curr.data(), theta_curr_adj.data(),
+                tp_val.data(), tp_adj.data(),
+                constrained.data(), visit.data() ), shard_ctx, &beta))
+        , momentum_handler(n_params)
+        , var_adapter(mcmc::make_var_adapter<var_adapter_policy_t>(
+                n_params, config.warmup, config.var_config))
+    {
+        assert(std::get<1>(pack).tp_offset == 0);
+        assert(std::get<1>(pack).c_offset == 0);
+        assert(std::get<1>(pack).v_offset == 0);
+        assert((T != Tempering::none) || beta == 1.);
+
+        // bind every AD expression to the same cache line
+        auto size_pack = theta_bb_ad_expr.bind_cache_size();
+        ad_val_buf.resize(size_pack(0));
+        ad_adj_buf.resize(size_pack(1));
+        theta_bb_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+        theta_ff_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+        theta_curr_ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+
+        // initializes first sample into theta_curr (and disc_curr).
+        // A warm start still initializes all parameters first,
+        // so that discrete values it does not provide are valid.
+        const bool pathfinder = !init_state && config.pathfinder_config.enabled;
+        if (pathfinder) {
+            pathfinder_init_(pack, shard_ctx);
+        }
+        program.bind(util::make_ptr_pack(
+                    theta_curr.data(), nullptr,
+                    tp_val.data(), nullptr,
+                    constrained.data(), visit.data()));
+        if (!pathfinder) {
+            program.init_params(gen, config.prune);
+        }
+        if (init_state) {
+            warm_start_(*init_state);
         }
 
-        logger.printProgress(i);
+        // initialize current potential (will be "previous" starting in transition)
+        refresh();
+
+        // initialize step adapter with initial log-epsilon
+        const double log_eps = init_state ? init_state->log_eps : std::log(
+            mcmc::find_reasonable_epsilon(
+                1., // initial epsilon
+                theta_curr_ad_expr, theta_curr, 
+                theta_curr_adj, tp_adj,
+                gen, momentum_handler)); 
+        step_adapter.init(log_eps);
+        step_adapter.step_config = config.step_config;  // copy step configs from user
+    }
+
+    NUTSChain(const NUTSChain&) =delete;
+    NUTSChain& operator=(const NUTSChain&) =delete;
 
+    /**
+     * Takes one NUTS transition from theta_curr (followed by a discrete sweep if needed).
+     * After the call, theta_curr and disc_curr hold the next sample.
+     */
+    void transition()
+    {
         // re-initialize vectors to current theta as the "root" of tree
         theta_bb = theta_curr;
         theta_ff = theta_bb;
@@ -484,8 +396,8 @@ void nuts_(ProgramType& program,
         double log_sum_weight = 0.;
 
         // initialize values used to adapt stepsize
-        size_t n_leapfrog = 0;
-        double sum_metro_prob = 0.;
+        n_leapfrog = 0;
+        sum_metro_prob = 0.;
 
         // p ~ N(0, M) (depending on momentum handler)
         momentum_handler.sample(p_bb, gen); 
@@ -536,7 +448,7 @@ void nuts_(ProgramType& program,
 
                 output = mcmc::build_tree(n_params, input, depth, 
                                           unif_sampler, gen, momentum_handler,
-                                          tree_cache.data());
+                                          tree_arena);
             } else {
                 auto input = mcmc::TreeInput(
                     // correct position information to update
@@ -555,7 +467,7 @@ void nuts_(ProgramType& program,
 
                 output = mcmc::build_tree(n_params, input, depth, 
                                           unif_sampler, gen, momentum_handler,
-                                          tree_cache.data());
+                                          tree_arena);
             }
 
             // early break if starting to U-Turn
@@ -595,62 +507,493 @@ void nuts_(ProgramType& program,
             if (!valid) break;
 
         } // end tree doubling for-loop
-        
-        // Warmup Adapt!
-        if (i < config.warmup) {
 
-            // epsilon dual averaging
-            step_adapter.adapt(sum_metro_prob / static_cast<double>(n_leapfrog));
-
-            // adapt variance only if adapting policy is diag_var or dense_var 
-            if constexpr (std::is_same_v<var_adapter_policy_t, diag_var> ||
-                          std::is_same_v<var_adapter_policy_t, dense_var>) {
-                const bool update = var_adapter.adapt(theta_curr, momentum_handler.get_m_inverse());
-                if (update) {
-                    double log_eps = std::log( mcmc::find_reasonable_epsilon(
-                                        std::exp(step_adapter.log_eps),
-                                        theta_curr_ad_expr, theta_curr, 
-                                        theta_curr_adj, tp_adj,
-                                        gen, momentum_handler) ); 
-                    step_adapter.reset();
-                    step_adapter.init(log_eps);
-                }
+        // update discrete parameters given the new continuous parameters
+        // (program is bound to theta_curr and disc_curr).
+        if (disc_curr.size()) {
+            mcmc::disc_gibbs_sweep(program, config.disc_config, disc_curr,
+                                   program.log_pdf(), disc_log_weights, gen, beta);
+            refresh();
+        }
+    }
+
+    /**
+     * Adapts step size and variance after the transition of warmup iteration i.
+     */
+    void adapt(size_t i)
+    {
+        // epsilon dual averaging
+        step_adapter.adapt(sum_metro_prob / static_cast<double>(n_leapfrog));
+
+        // adapt variance only if adapting policy is not unit_var
+        if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+            const bool update = adapt_metric &&
+                var_adapter.adapt(theta_curr, momentum_handler.get_m_inverse());
+            if (update) {
+                momentum_handler.update_metric();
+                double log_eps = std::log( mcmc::find_reasonable_epsilon(
+                                    std::exp(step_adapter.log_eps),
+                                    theta_curr_ad_expr, theta_curr, 
+                                    theta_curr_adj, tp_adj,
+                                    gen, momentum_handler) ); 
+                step_adapter.reset();
+                step_adapter.init(log_eps);
             }
+        }
+
+        // if last warmup iteration
+        if (i == config.warmup - 1) {
+            step_adapter.log_eps = step_adapter.log_eps_bar;
+        }
+    }
+
+    /**
+     * Re-evaluates the potential at the current sample.
+     * Must be called whenever theta_curr, disc_curr, or beta is modified externally.
+     */
+    void refresh() { potential_prev = -ad::evaluate(theta_curr_ad_expr); }
+
+    /**
+     * Returns the (untempered) log-pdf at the current sample.
+     * It is not available if only the log-likelihood is tempered.
+     */
+    double log_pdf() const 
+    { 
+        static_assert(T != Tempering::likelihood);
+        return -potential_prev / beta; 
+    }
+
+    /**
+     * Returns the log-likelihood at the current sample (see ProgramNode::log_lik).
+     */
+    double log_lik() { return program.log_lik(); }
+
+    /**
+     * Re-seeds the generator and discards any random numbers cached by distributions,
+     * so that the next transitions only depend on seq and the current sample (see smc_).
+     */
+    void reseed(std::seed_seq& seq)
+    {
+        gen.seed(seq);
+        direction_sampler.reset();
+        unif_sampler.reset();
+        momentum_handler.reset();
+    }
+
+    /**
+     * Exchanges the current samples of this chain and other.
+     */
+    void swap_state(NUTSChain& other)
+    {
+        std::swap_ranges(theta_curr.data(), theta_curr.data() + n_params,
+                         other.theta_curr.data());
+        std::swap_ranges(disc_curr.data(), disc_curr.data() + disc_curr.size(),
+                         other.disc_curr.data());
+        refresh();
+        other.refresh();
+    }
+
+    /**
+     * Returns the current sample (continuous and discrete), step size, and inverse metric,
+     * e.g. to warm-start another run once warmup is finished (see WarmStartConfig).
+     */
+    adapted_state_t adapted_state() const
+    {
+        adapted_state_t state;
+        state.log_eps = step_adapter.log_eps;
+        if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+            state.m_inverse = momentum_handler.get_m_inverse();
+        }
+        state.theta = theta_curr;
+        state.disc = disc_curr;
+        return state;
+    }
 
-            // if last warmup iteration
-            if (i == config.warmup - 1) {
-                step_adapter.log_eps = step_adapter.log_eps_bar;
+    /**
+     * Saves (loads) the full state of the chain (see ChainCheckpoint):
+     * the generator and distributions, the current sample and its potential,
+     * the momentum handler, and the step size and variance adapters.
+     * A state must be loaded into a chain constructed with the same program and configuration.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_state(os, gen);
+        util::write_state(os, direction_sampler);
+        util::write_state(os, unif_sampler);
+        util::write_mat(os, theta_curr);
+        util::write_mat(os, disc_curr);
+        util::write_pod(os, potential_prev);
+        momentum_handler.save(os);
+        step_adapter.save(os);
+        var_adapter.save(os);
+    }
+
+    void load(std::istream& is)
+    {
+        util::read_state(is, gen);
+        util::read_state(is, direction_sampler);
+        util::read_state(is, unif_sampler);
+        util::read_mat(is, theta_curr);
+        util::read_mat(is, disc_curr);
+        util::read_pod(is, potential_prev);
+        momentum_handler.load(is);
+        step_adapter.load(is);
+        var_adapter.load(is);
+    }
+
+private:
+    static program_t bind_disc_(program_t program, disc_vec_t& disc)
+    {
+        // every AD expression views the bound discrete parameters (see ParamView::ad),
+        // so the program must be bound to them before building any AD expression.
+        util::disc_ptr_pack_t disc_ptr_pack;
+        disc_ptr_pack.uc_val = disc.data();
+        program.bind(disc_ptr_pack);
+        return program;
+    }
+
+    /**
+     * Initializes theta_curr, disc_curr (if state holds discrete values)
+     * and the inverse metric from the state of a previous run.
+     * The metric is only adapted further if config.warm_start_config.adapt_metric is true.
+     */
+    void warm_start_(const adapted_state_t& state)
+    {
+        assert(state.theta.size() == static_cast<Eigen::Index>(n_params));
+        theta_curr = state.theta;
+        if (state.disc.size()) {
+            assert(state.disc.size() == disc_curr.size());
+            disc_curr = state.disc;
+        }
+        if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+            momentum_handler.get_m_inverse() = state.m_inverse;
+            momentum_handler.update_metric();
+        }
+        adapt_metric = config.warm_start_config.adapt_metric;
+    }
+
+    /**
+     * Initializes theta_curr with a draw of Pathfinder (see optim::pathfinder)
+     * on the untempered log-pdf, and the inverse metric (if adapted)
+     * with the marginal variances of the selected approximation.
+     */
+    template <class OffsetPackType>
+    void pathfinder_init_(const OffsetPackType& pack,
+                          util::ShardContext& shard_ctx)
+    {
+        Eigen::VectorXd x(n_params);
+        Eigen::VectorXd variance(n_params);
+        {
+            optim::NegLogPdf<true, program_t> objective(program, std::get<0>(pack), shard_ctx);
+            objective.init_params(x, gen, config.prune);
+            optim::pathfinder(objective, x, variance, config.pathfinder_config, gen);
+        }
+        theta_curr = x;
+
+        if constexpr (!std::is_same_v<var_adapter_policy_t, unit_var>) {
+            if (!variance.allFinite() || !(variance.array() > 0.).all()) return;
+            auto& m_inverse = momentum_handler.get_m_inverse();
+            if constexpr (std::is_same_v<var_adapter_policy_t, diag_var>) {
+                m_inverse = variance;
+            } else if constexpr (std::is_same_v<var_adapter_policy_t, dense_var>) {
+                m_inverse = variance.asDiagonal();
+            } else {
+                m_inverse.scale = variance.cwiseSqrt();
             }
+            momentum_handler.update_metric();
+        }
+    }
+
+public:
+    const NUTSConfigType& config;
+    double beta;
+    size_t n_params;
+    disc_vec_t disc_curr;   // current discrete parameters
+    program_t program;
+    std::mt19937 gen;
+    std::uniform_int_distribution<> direction_sampler{0, 1};
+    std::uniform_real_distribution<> unif_sampler{0., 1.};
+
+    // Transformed parameters, constrained parameter, visit count cache
+    // This can be shared across all AD expressions since only one expression
+    // will be evaluated at a time.
+    Eigen::MatrixXd tp_mat;
+    Eigen::VectorXd constrained;
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit;
+    Eigen::Map<Eigen::VectorXd> tp_val;
+    Eigen::Map<Eigen::VectorXd> tp_adj;
+    std::vector<double> disc_log_weights;
+
+    // momentum matrix (for stability reasons we require knowing 4 momentum)
+    // left-subtree backwardmost momentum => bb
+    // left-subtree forwardmost momentum => bf
+    // right-subtree backwardmost momentum => fb
+    // right-subtree forwardmost momentum => ff
+    // scaled versions are based on hamiltonian adjusted covariance matrix
+    Eigen::MatrixXd cache_mat;
+    Eigen::Map<Eigen::VectorXd> p_bb;
+    Eigen::Map<Eigen::VectorXd> p_bb_scaled;
+    Eigen::Map<Eigen::VectorXd> p_bf;
+    Eigen::Map<Eigen::VectorXd> p_bf_scaled;
+    Eigen::Map<Eigen::VectorXd> p_fb;
+    Eigen::Map<Eigen::VectorXd> p_fb_scaled;
+    Eigen::Map<Eigen::VectorXd> p_ff;
+    Eigen::Map<Eigen::VectorXd> p_ff_scaled;
+
+    // position matrix for thetas and adjoints
+    Eigen::Map<Eigen::VectorXd> theta_bb;
+    Eigen::Map<Eigen::VectorXd> theta_bb_adj;
+    Eigen::Map<Eigen::VectorXd> theta_ff;
+    Eigen::Map<Eigen::VectorXd> theta_ff_adj;
+    Eigen::Map<Eigen::VectorXd> theta_curr;
+    Eigen::Map<Eigen::VectorXd> theta_curr_adj;
+    Eigen::Map<Eigen::VectorXd> theta_prime;
+
+    // integrated momentum vectors (more stable than checking entropy with theta_ff - theta_bb)
+    // forward-subtree => rho_f
+    // backward-subtree => rho_b
+    // combined subtrees => rho
+    Eigen::Map<Eigen::VectorXd> rho_f;
+    Eigen::Map<Eigen::VectorXd> rho_b;
+    Eigen::Map<Eigen::VectorXd> rho;
+
+    // checkpoint stack used by build_tree
+    mcmc::TreeArena tree_arena;
+
+    // AD Expressions for L(theta) (log-pdf up to constant at theta)
+    // Note that these expressions are the only ones used ever.
+    ad_expr_t theta_bb_ad_expr;
+    ad_expr_t theta_ff_ad_expr;
+    ad_expr_t theta_curr_ad_expr;
+    Eigen::VectorXd ad_val_buf;
+    Eigen::VectorXd ad_adj_buf;
+
+    momentum_handler_t momentum_handler;
+    mcmc::StepAdapter step_adapter{0.};
+    var_adapter_t var_adapter;
+    bool adapt_metric = true;       // false if warm-started with a fixed metric
+
+    double potential_prev = 0.;     // potential at theta_curr
+
+    // stats of the last transition used to adapt step size
+    size_t n_leapfrog = 0;
+    double sum_metro_prob = 0.;
+};
+
+/**
+ * Runs a single chain of No-U-Turn Sampler (NUTS) (see NUTSChain).
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          NUTS configuration object
+ * @param   pack            offset pack result of activating program (see nuts_)
+ * @param   chain           chain index. The chain is seeded with config.seed + chain
+ *                          and only chain 0 prints progress.
+ * @param   writer          called with every draw of this chain after warmup (see chain_writer)
+ * @param   stop            called with the number of draws after every draw.
+ *                          Sampling stops if it returns true (see StoppingConfig).
+ *                          If the chain resumes from a checkpoint (see CheckpointConfig),
+ *                          writer and stop are first called with every draw up to the checkpoint.
+ * @param   shard_ctx       context used to build sharded AD expressions
+ * @param   warmup_time     populated with warmup time of this chain
+ * @param   sampling_time   populated with sampling time of this chain
+ * @param   adapted         populated with the adapted state at the end of the chain (if not null).
+ *                          The chain is warm-started from config.warm_start_config (see WarmStartConfig).
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class WriterType
+        , class StopType
+        , class NUTSConfigType = NUTSConfig<>>
+void nuts_chain_(const ProgramType& program, 
+                 const NUTSConfigType& config,
+                 const OffsetPackType& pack,
+                 size_t chain,
+                 WriterType&& writer,
+                 StopType&& stop,
+                 util::ShardContext& shard_ctx,
+                 double& warmup_time,
+                 double& sampling_time,
+                 typename NUTSChain<ProgramType, NUTSConfigType>::adapted_state_t* adapted = nullptr)
+{
+    const auto& init_states = config.warm_start_config.states;
+    const auto* init_state = init_states.empty() ? nullptr : 
+                             &init_states[chain % init_states.size()];
+    NUTSChain<ProgramType, NUTSConfigType> nuts_chain(
+            program, config, pack, shard_ctx, config.seed + chain, 1., init_state);
+
+    // resume from checkpoint (if any)
+    ChainCheckpoint checkpoint(config.checkpoint_config, chain,
+                               nuts_chain.n_params, nuts_chain.disc_curr.size());
+    bool stopped = false;
+    const size_t begin = checkpoint.resume(nuts_chain, config.warmup, config.samples, 
+                                           writer, stop, stopped);
+
+    // construct miscellaneous objects 
+    auto logger = util::ProgressLogger(config.samples + config.warmup, "NUTS",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    // start timing warmup (or sampling if resumed after warmup)
+    stopwatch_warmup.start();
+    if (begin > config.warmup) {
+        stopwatch_warmup.stop();
+        stopwatch_sampling.start();
+    }
+
+    for (size_t i = begin; !stopped && i < config.samples + config.warmup; ++i) {
+
+        // if warmup is finished, stop timing warmup and start timing sampling
+        if (i == config.warmup) {
+            stopwatch_warmup.stop();
+            stopwatch_sampling.start();
+        }
+
+        logger.printProgress(i);
+
+        nuts_chain.transition();
+
+        // Warmup Adapt!
+        if (i < config.warmup) {
+            nuts_chain.adapt(i);
         }
 
         // store sample theta_curr only after burning
         if (i >= config.warmup) {
-            res.cont_samples.row(i-config.warmup) = theta_curr;
+            DrawStats stats;
+            stats.accept_stat = nuts_chain.sum_metro_prob / 
+                                static_cast<double>(nuts_chain.n_leapfrog);
+            stats.n_steps = nuts_chain.n_leapfrog;
+            stats.step_size = std::exp(nuts_chain.step_adapter.log_eps);
+            writer(i-config.warmup, nuts_chain.theta_curr, nuts_chain.disc_curr, stats);
+            checkpoint.write_draw(nuts_chain.theta_curr, nuts_chain.disc_curr, stats);
         }
 
+        checkpoint.update(nuts_chain, i);
+
+        if (i >= config.warmup && stop(i-config.warmup+1)) break;
+
     } // end for-loop to sample 1 point
 
     // stop timing sampling
     stopwatch_sampling.stop();
 
     // save output results
-    res.warmup_time = stopwatch_warmup.elapsed();
-    res.sampling_time = stopwatch_sampling.elapsed();
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+    if (adapted) *adapted = nuts_chain.adapted_state();
+}
+
+/**
+ * No-U-Turn Sampler (NUTS)
+ *
+ * Discrete parameters are updated within each chain 
+ * by a sweep of Gibbs or discrete Metropolis updates after every NUTS transition
+ * (see nuts_chain_ and config.disc_config).
+ * Discrete data is allowed.
+ *
+ * Runs config.n_chains independent chains on the thread pool.
+ * Each chain owns a copy of the program (and hence its own AD expressions
+ * and adapters), while data is shared across all chains.
+ * Large observed vectors are sharded according to config.shard_config,
+ * in which case the shards of every chain are evaluated on the same thread pool.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      NUTS configuration object
+ * @param   pack        offset pack result of activating program.
+ *                      It will likely be util::OffsetPack where each offset
+ *                      value is equivalent to the total number of values needed,
+ *                      i.e. if pack.uc_offset is 10, there is exactly 10 unconstrained values
+ *                      for the program.
+ * @param   res         result object of calling NUTS that will be populated with samples and other information
+ *                      (or TransformOutput/SinkOutput if draws are transformed/streamed,
+ *                      see transform_mcmc and stream_mcmc).
+ * @param   pool        thread pool to run chains on
+ * @param   adapted     populated with the adapted state of every chain at the end (if not null)
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class NUTSConfigType = NUTSConfig<>>
+void nuts_(const ProgramType& program, 
+           const NUTSConfigType& config,
+           const OffsetPackType& pack,
+           MCMCResultType& res,
+           util::ThreadPool& pool,
+           std::vector<typename NUTSChain<ProgramType, NUTSConfigType>::adapted_state_t>* adapted = nullptr)
+{
+    util::ShardContext shard_ctx(pool, config.shard_config, std::get<0>(pack));
+    if (adapted) adapted->assign(config.n_chains, {});
+    run_chains(config, config.stop_config, pool, res, 
+            [&](size_t chain, auto&& stop, double& warmup_time, double& sampling_time) {
+                nuts_chain_(program, config, pack, chain,
+                            chain_writer(res, chain), stop, shard_ctx,
+                            warmup_time, sampling_time,
+                            adapted ? &(*adapted)[chain] : nullptr);
+            });
 }
 
 } // namespace mcmc
 
+/**
+ * Result of NUTS.
+ * Additionally, every chain provides its adapted state at the end of sampling,
+ * which can warm-start another run (see WarmStartConfig).
+ */
+template <class VarAdapterPolicy = diag_var>
+struct NUTSResult: MCMCResult<>
+{
+    NUTSResult() =default;
+    NUTSResult(MCMCResult<>&& res)
+        : MCMCResult<>(std::move(res))
+    {}
+
+    std::vector<NUTSAdaptedState<VarAdapterPolicy>> adapted;   // adapted state of every chain
+};
+
 template <class ExprType
         , class NUTSConfigType = NUTSConfig<>>
 inline auto nuts(const ExprType& expr, 
                  const NUTSConfigType& config = NUTSConfigType())
 {
-    return mcmc::base_mcmc(expr, config, 
-            [](auto& program, const auto& config,
-               const auto& pack, auto& res) {
+    using var_adapter_policy_t = typename 
+        nuts_config_traits<NUTSConfigType>::var_adapter_policy_t;
+    std::vector<NUTSAdaptedState<var_adapter_policy_t>> adapted;
+    NUTSResult<var_adapter_policy_t> nuts_res(mcmc::transform_mcmc(expr, config, 
+            [&](auto& program, const auto& config,
+                const auto& pack, auto& res, auto& pool) {
                 res.name = "nuts";
-                mcmc::nuts_(program, config, pack, res);
-            });
+                mcmc::nuts_(program, config, pack, res, pool, &adapted);
+            }));
+    nuts_res.adapted = std::move(adapted);
+    return nuts_res;
+}
+
+/**
+ * Streaming version of nuts: every draw is passed to sink
+ * as it is produced instead of being returned (see mcmc::stream_mcmc).
+ * The result only holds the name, timing information, and adapted states.
+ * Throws std::invalid_argument if config.stop_config is enabled.
+ */
+template <class ExprType
+        , class SinkType
+        , class NUTSConfigType = NUTSConfig<>>
+inline auto nuts(const ExprType& expr, 
+                 const NUTSConfigType& config,
+                 SinkType& sink)
+{
+    mcmc::check_stream_stopping(config.stop_config);
+    using var_adapter_policy_t = typename 
+        nuts_config_traits<NUTSConfigType>::var_adapter_policy_t;
+    std::vector<NUTSAdaptedState<var_adapter_policy_t>> adapted;
+    NUTSResult<var_adapter_policy_t> nuts_res(mcmc::stream_mcmc(expr, config, sink,
+            [&](auto& program, const auto& config,
+                const auto& pack, auto& out, auto& pool) {
+                out.name = "nuts";
+                mcmc::nuts_(program, config, pack, out, pool, &adapted);
+            }));
+    nuts_res.adapted = std::move(adapted);
+    return nuts_res;
 }
 
 } // namespace ppl
@@ -1,7 +1,11 @@
 #pragma once
+#include <array>
 #include <optional>
 #include <functional>
 #include <type_traits>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
 
 namespace ppl {
 namespace mcmc {
@@ -89,5 +93,71 @@ struct TreeOutput
     double potential;
 };
 
+/**
+ * State of a complete subtree in the (iterative) trajectory builder.
+ * Vectors are not owned; they point into a TreeArena.
+ * Merging two subtrees only swaps pointers, so no vector is ever copied.
+ */
+struct TreeState
+{
+    enum : size_t {
+        p_beg = 0,      // momentum at the beginning of subtree (in the direction of v)
+        p_beg_scaled,   // scaled momentum at the beginning of subtree
+        p_end,          // momentum at the end of subtree (in the direction of v)
+        p_end_scaled,   // scaled momentum at the end of subtree
+        rho,            // integrated momentum of subtree
+        theta_prime,    // proposal of subtree
+        n_vecs
+    };
+
+    std::array<double*, n_vecs> vecs;
+    double log_sum_weight;
+    double potential;
+    size_t height;
+};
+
+/**
+ * Contiguous, aligned memory for the checkpoint stack of the 
+ * iterative trajectory builder (see build_tree).
+ * It is sized once from the maximum tree depth:
+ * building a tree of depth d requires at most d+1 subtrees to be alive at once.
+ * Every vector is padded to start on a maximally aligned boundary.
+ */
+struct TreeArena
+{
+    using map_t = Eigen::Map<Eigen::VectorXd, Eigen::AlignedMax>;
+
+    TreeArena(size_t n_params, size_t max_depth)
+        : n_params_{n_params}
+        , stride_{padded_size(n_params)}
+        , buf_(stride_ * TreeState::n_vecs * (max_depth + 1))
+        , states_(max_depth + 1)
+    {
+        buf_.setZero();
+        for (size_t i = 0; i < states_.size(); ++i) {
+            for (size_t k = 0; k < TreeState::n_vecs; ++k) {
+                states_[i].vecs[k] = buf_.data() + 
+                    (i * TreeState::n_vecs + k) * stride_;
+            }
+        }
+    }
+
+    TreeState& state(size_t i) { return states_[i]; }
+    map_t vec(TreeState& state, size_t k) { return map_t(state.vecs[k], n_params_); }
+
+private:
+    static size_t padded_size(size_t n)
+    {
+        constexpr size_t align = EIGEN_MAX_ALIGN_BYTES / sizeof(double);
+        if constexpr (align <= 1) return n;
+        else return ((n + align - 1) / align) * align;
+    }
+
+    const size_t n_params_;
+    const size_t stride_;
+    Eigen::VectorXd buf_;
+    std::vector<TreeState> states_;
+};
+
 } // namespace mcmc
 } // namespace ppl
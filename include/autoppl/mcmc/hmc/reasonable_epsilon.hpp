@@ -0,0 +1,103 @@
+#pragma once
+#include <cmath>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/eval.hpp>
+#include <autoppl/mcmc/hmc/leapfrog.hpp>
+#include <autoppl/mcmc/hmc/hamiltonian.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * Finds a reasonable epsilon for HMC-based algorithms (NUTS, HMC).
+ *
+ * @param   eps                 initial epsilon (see Gelman's paper)
+ * @param   ad_expr             AD expression bound to theta and theta_adj
+ * @param   theta               vector of theta values
+ * @param   theta_adj           vector of theta adjoints
+ * @param   gen                 rng device
+ * @param   momentum_handler    MomentumHandler-like object 
+ */
+template <class ADExprType
+        , class MatType
+        , class GenType
+        , class MomentumHandlerType>
+double find_reasonable_epsilon(double eps,
+                               ADExprType& ad_expr,
+                               MatType& theta,
+                               MatType& theta_adj,
+                               MatType& tp_adj,
+                               GenType& gen,
+                               MomentumHandlerType& momentum_handler)
+{
+    // See (STAN) for reference: if epsilon is way out of bounds, just return eps
+    if (eps <= 0 || eps > 1e7) return eps;
+
+    const double diff_bound = std::log(0.8);
+
+    size_t n_params = theta.rows(); // theta is expected to be vector-like
+
+    Eigen::MatrixXd mat(n_params, 3);
+    Eigen::Map<Eigen::VectorXd> r(mat.col(0).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_orig(mat.col(1).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_adj_orig(mat.col(2).data(), n_params);
+
+    // sample momentum vector based on handler
+    momentum_handler.sample(r, gen);
+
+    // differentiate first to get adjoints and hamiltonian
+    const double potential_orig = -ad::autodiff(ad_expr); 
+    double kinetic_orig = momentum_handler.kinetic(r);
+    double ham_orig = hamiltonian(potential_orig, kinetic_orig);
+
+    // save original value and adjoint
+    theta_orig = theta;
+    theta_adj_orig = theta_adj;
+    
+    // get current hamiltonian after leapfrog
+    double potential_curr = leapfrog(
+            ad_expr, theta, theta_adj, tp_adj,
+            r, momentum_handler, eps, true);
+    double kinetic_curr = momentum_handler.kinetic(r);
+    double ham_curr = hamiltonian(potential_curr, kinetic_curr);
+
+    int a = (ham_orig - ham_curr > diff_bound) ? 1 : -1;
+
+    while (1) {
+
+        // check if break condition holds
+        if ( ((a == 1) && !(ham_orig - ham_curr > diff_bound)) || 
+             ((a == -1) && !(ham_orig - ham_curr < diff_bound)) ) {
+            break;
+        }
+
+        // update epsilon
+        eps *= (a == -1) ? 0.5 : 2;
+
+        // copy back original value and adjoint
+        theta = theta_orig;
+        theta_adj = theta_adj_orig;
+
+        // recompute original hamiltonian with new momentum
+        momentum_handler.sample(r, gen);
+        kinetic_orig = momentum_handler.kinetic(r);
+        ham_orig = hamiltonian(potential_orig, kinetic_orig);
+
+        // leapfrog and compute current hamiltonian
+        potential_curr = leapfrog(
+                ad_expr, theta, theta_adj, tp_adj,
+                r, momentum_handler, eps, true);
+        kinetic_curr = momentum_handler.kinetic(r);
+        ham_curr = hamiltonian(potential_curr, kinetic_curr);
+
+    }
+
+    // copy back original value and adjoint
+    theta = theta_orig;
+    theta_adj = theta_adj_orig;
+
+    return eps;
+}
+
+} // namespace mcmc
+} // namespace ppl
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstddef>
 #include <cmath>
+#include <autoppl/util/serialize.hpp>
 
 namespace ppl {
 
@@ -67,6 +68,30 @@ struct StepAdapter
         H_bar = 0.;
     }
 
+    /**
+     * Saves (loads) every adaptive value.
+     * step_config is not saved since it is copied from the user configuration.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_pod(os, static_cast<uint64_t>(counter));
+        util::write_pod(os, log_eps);
+        util::write_pod(os, log_eps_bar);
+        util::write_pod(os, H_bar);
+        util::write_pod(os, mu);
+    }
+
+    void load(std::istream& is)
+    {
+        uint64_t n = 0;
+        util::read_pod(is, n);
+        counter = n;
+        util::read_pod(is, log_eps);
+        util::read_pod(is, log_eps_bar);
+        util::read_pod(is, H_bar);
+        util::read_pod(is, mu);
+    }
+
     size_t counter = 0;
     double log_eps = 0.;
     double log_eps_bar = 0.;
@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include <Eigen/Dense>
+
+namespace ppl {
+
+/**
+ * Constants that can be set by user and used by TrajectoryAdapter.
+ */
+struct TrajectoryConfig
+{
+    double init_integration_time = 1.;
+    double learning_rate = 0.025;
+    double beta1 = 0.;
+    double beta2 = 0.95;
+};
+
+namespace mcmc {
+
+/**
+ * Computes the gradient of the ChEES criterion 
+ * (change in the estimator of the expected square)
+ * with respect to the log integration time from one transition of every chain.
+ * See Hoffman, Radul, Sountsov (2021): 
+ * "An Adaptive MCMC Scheme for Setting Trajectory Lengths in Hamiltonian Monte Carlo".
+ *
+ * Every column corresponds to a chain.
+ * Chains are weighted by their acceptance probability,
+ * so that divergent proposals (zero acceptance probability) are ignored.
+ *
+ * @param   prev        positions at the beginning of the trajectories
+ * @param   prop        proposals (positions at the end of the trajectories)
+ * @param   velocity    velocities (dkinetic_dr of momentum) at the end of the trajectories
+ * @param   accept      acceptance probability of every chain
+ * @param   t           (jittered) integration time of the trajectories
+ *
+ * @return  weighted gradient or 0 if no proposal can be accepted
+ */
+template <class MatType1
+        , class MatType2
+        , class MatType3
+        , class VecType>
+inline double chees_gradient(const Eigen::MatrixBase<MatType1>& prev,
+                             const Eigen::MatrixBase<MatType2>& prop,
+                             const Eigen::MatrixBase<MatType3>& velocity,
+                             const Eigen::MatrixBase<VecType>& accept,
+                             double t)
+{
+    const auto n_chains = prev.cols();
+    Eigen::VectorXd w(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        w(c) = (accept(c) > 0 && prop.col(c).allFinite()) ? accept(c) : 0.;
+    }
+    const double w_sum = w.sum();
+    if (!(w_sum > 0)) return 0.;
+
+    Eigen::VectorXd prev_mean = prev.rowwise().mean();
+    Eigen::VectorXd prop_mean = Eigen::VectorXd::Zero(prev.rows());
+    for (int c = 0; c < n_chains; ++c) {
+        if (w(c) > 0) prop_mean += (w(c) / w_sum) * prop.col(c);
+    }
+
+    double grad = 0.;
+    for (int c = 0; c < n_chains; ++c) {
+        if (w(c) == 0) continue;
+        auto prop_centered = prop.col(c) - prop_mean;
+        const double diff = prop_centered.squaredNorm() -
+                            (prev.col(c) - prev_mean).squaredNorm();
+        grad += w(c) * t * diff * prop_centered.dot(velocity.col(c));
+    }
+    return grad / w_sum;
+}
+
+/**
+ * Adapts the log integration time of HMC by maximizing the ChEES criterion
+ * (see chees_gradient) with Adam.
+ */
+struct TrajectoryAdapter
+{
+    TrajectoryAdapter(double integration_time)
+        : log_T{std::log(integration_time)}
+    {}
+
+    /**
+     * Takes one (ascent) step of Adam with the given gradient
+     * and restricts the integration time to [min_T, max_T].
+     */
+    void adapt(double grad, double min_T, double max_T)
+    {
+        ++counter;
+        const double t = counter;
+        m = traj_config.beta1 * m + (1 - traj_config.beta1) * grad;
+        v = traj_config.beta2 * v + (1 - traj_config.beta2) * grad * grad;
+        const double m_hat = m / (1 - std::pow(traj_config.beta1, t));
+        const double v_hat = v / (1 - std::pow(traj_config.beta2, t));
+        log_T += traj_config.learning_rate * m_hat / (std::sqrt(v_hat) + 1e-8);
+        log_T = std::clamp(log_T, std::log(min_T), std::log(max_T));
+    }
+
+    double integration_time() const { return std::exp(log_T); }
+
+    size_t counter = 0;
+    double log_T = 0.;
+    double m = 0.;
+    double v = 0.;
+    TrajectoryConfig traj_config;
+};
+
+} // namespace mcmc
+} // namespace ppl
@@ -1,5 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <Eigen/Dense>
 #include <autoppl/math/welford.hpp>
+#include <autoppl/util/serialize.hpp>
 
 namespace ppl {
 
@@ -9,23 +14,25 @@ namespace ppl {
 struct unit_var {};
 struct diag_var {};
 struct dense_var {};
+struct lowrank_var {};
 
 /**
  * Configuration for variance adapter.
- * They will only be meaningful when policy is either diag_var or dense_var.
+ * They will only be meaningful when policy is diag_var, dense_var, or lowrank_var.
  */
 struct VarConfig
 {
     size_t init_buffer = 75;
     size_t term_buffer = 50;
     size_t window_base = 25;
+    size_t rank = 5;            // number of eigenvectors estimated (lowrank_var only)
 };
 
 namespace mcmc {
 
 /**
  * Variance adapter.
- * @tparam  VarPolicy   one of unit_var, diag_var, dense_var
+ * @tparam  VarPolicy   one of unit_var, diag_var, dense_var, lowrank_var
  */
 template <class VarPolicy>
 struct VarAdapter {};
@@ -43,25 +50,28 @@ struct VarAdapter<unit_var>
                size_t,
                size_t)
     {}
+
+    void save(std::ostream&) const {}
+    void load(std::istream&) {}
 };
 
 /**
- * Diagonal precision matrix M is estimated for momentum covariance matrix.
- * M inverse is estimated as sample variance and is regularized towards identity.
+ * Windowed adaptation schedule shared by all adapting variance adapters.
+ * Warmup is split into an initial buffer, a series of doubling windows, 
+ * and a terminal buffer.
+ * Samples are only collected inside windows 
+ * and the metric is updated at the end of every window.
  *
  * Follows STAN guide: https://mc-stan.org/docs/2_18/reference-manual/hmc-algorithm-parameters.html
  * STAN implementation: https://github.com/stan-dev/stan/blob/develop/src/stan/mcmc/windowed_adaptation.hpp
  */
-template <>
-struct VarAdapter<diag_var>
+struct WindowedAdapter
 {
-    VarAdapter(size_t n_params,
-               size_t warmup,
-               size_t init_buffer,
-               size_t term_buffer,
-               size_t window_base)
-        : var_estimator_(n_params)
-        , warmup_{warmup}
+    WindowedAdapter(size_t warmup,
+                    size_t init_buffer,
+                    size_t term_buffer,
+                    size_t window_base)
+        : warmup_{warmup}
         , counter_{0}
         , window_begin_{init_buffer}
         , window_end_{warmup - term_buffer}
@@ -97,38 +107,53 @@ struct VarAdapter<diag_var>
         }
     }
 
-    // If in init buffer or term buffer, don't adapt variance
-    // otherwise, adapt variance if within window.
-    // If reached end of current window, update variance, reset estimator, get new window.
-    template <class MatType1, class MatType2>
-    bool adapt(const Eigen::MatrixBase<MatType1>& x, 
-               Eigen::MatrixBase<MatType2>& var) 
+    /**
+     * Saves (loads) the position in the adaptation schedule.
+     */
+    void save(std::ostream& os) const
     {
-        // if counter is not at the end of all windows
-        if (counter_ >= init_buffer_ &&
-            counter_ < warmup_ - term_buffer_) {
-            var_estimator_.update(x);
+        for (size_t x : {counter_, window_begin_, window_end_,
+                         init_buffer_, term_buffer_, window_base_}) {
+            util::write_pod(os, static_cast<uint64_t>(x));
         }
+    }
 
-        // if currently at the end of the window,
-        // get updated variance and reset estimator
-        if (counter_ == window_end_ - 1) {
-            auto&& v = var_estimator_.get_variance();
-            double n = var_estimator_.get_n_samples();
-            // regularized sample variance (see STAN)
-            var.array() = ( (n / ((n + 5.0) * (n - 1.))) * v.array() + 
-                            1e-3 * (5.0 / (n + 5.0)) );
-            var_estimator_.reset();
-            shift_window();
-            ++counter_;
-            return true;
+    void load(std::istream& is)
+    {
+        for (size_t* x : {&counter_, &window_begin_, &window_end_,
+                          &init_buffer_, &term_buffer_, &window_base_}) {
+            uint64_t n = 0;
+            util::read_pod(is, n);
+            *x = n;
         }
+    }
 
-        // init or term buffer => no adapt variance
-        static_cast<void>(x); 
-        static_cast<void>(var); 
+protected:
+
+    // number of iterations in current window
+    size_t window_size() const { return window_end_ - window_begin_; }
+
+    // true if current iteration is the first one of the current window
+    bool begin_of_window() const { return counter_ == window_begin_; }
+
+    // true if current iteration is not in init or term buffer
+    bool in_window() const 
+    {
+        return counter_ >= init_buffer_ &&
+               counter_ < warmup_ - term_buffer_;
+    }
+
+    // true if current iteration is the last one of the current window
+    bool end_of_window() const 
+    { 
+        return counter_ == window_end_ - 1; 
+    }
+
+    // moves to the next iteration (and next window if at the end of current one)
+    void next()
+    {
+        if (end_of_window()) { shift_window(); }
         ++counter_;
-        return false;
     }
 
 private:
@@ -153,7 +178,6 @@ private:
         }
     }
 
-    math::WelfordVar var_estimator_;
     const size_t warmup_;
     size_t counter_;
     size_t window_begin_;
@@ -163,5 +187,326 @@ private:
     size_t window_base_;
 };
 
+/**
+ * Diagonal precision matrix M is estimated for momentum covariance matrix.
+ * M inverse is estimated as sample variance and is regularized towards identity.
+ */
+template <>
+struct VarAdapter<diag_var> : WindowedAdapter
+{
+    VarAdapter(size_t n_params,
+               size_t warmup,
+               size_t init_buffer,
+               size_t term_buffer,
+               size_t window_base)
+        : WindowedAdapter(warmup, init_buffer, term_buffer, window_base)
+        , var_estimator_(n_params)
+    {}
+
+    // If in init buffer or term buffer, don't adapt variance
+    // otherwise, adapt variance if within window.
+    // If reached end of current window, update variance, reset estimator, get new window.
+    // Every column of x is a draw of the current iteration 
+    // (more than one if draws of many chains are pooled).
+    template <class MatType1, class MatType2>
+    bool adapt(const Eigen::MatrixBase<MatType1>& x, 
+               Eigen::MatrixBase<MatType2>& var) 
+    {
+        // if counter is not at the end of all windows
+        if (in_window()) {
+            for (int j = 0; j < x.cols(); ++j) {
+                var_estimator_.update(x.col(j));
+            }
+        }
+
+        // if currently at the end of the window,
+        // get updated variance and reset estimator
+        if (end_of_window()) {
+            auto&& v = var_estimator_.get_variance();
+            double n = var_estimator_.get_n_samples();
+            // regularized sample variance (see STAN)
+            var.array() = ( (n / ((n + 5.0) * (n - 1.))) * v.array() + 
+                            1e-3 * (5.0 / (n + 5.0)) );
+            var_estimator_.reset();
+            next();
+            return true;
+        }
+
+        // init or term buffer => no adapt variance
+        next();
+        return false;
+    }
+
+    /**
+     * Saves (loads) the schedule and the estimator of the current window.
+     */
+    void save(std::ostream& os) const
+    {
+        WindowedAdapter::save(os);
+        var_estimator_.save(os);
+    }
+
+    void load(std::istream& is)
+    {
+        WindowedAdapter::load(is);
+        var_estimator_.load(is);
+    }
+
+private:
+    math::WelfordVar var_estimator_;
+};
+
+/**
+ * Dense precision matrix M is estimated for momentum covariance matrix.
+ * M inverse is estimated as sample covariance and is regularized towards
+ * (a multiple of) identity.
+ */
+template <>
+struct VarAdapter<dense_var> : WindowedAdapter
+{
+    VarAdapter(size_t n_params,
+               size_t warmup,
+               size_t init_buffer,
+               size_t term_buffer,
+               size_t window_base)
+        : WindowedAdapter(warmup, init_buffer, term_buffer, window_base)
+        , cov_estimator_(n_params)
+    {}
+
+    // Same windowing scheme as VarAdapter<diag_var>, 
+    // but var is the full (square) inverse metric.
+    template <class MatType1, class MatType2>
+    bool adapt(const Eigen::MatrixBase<MatType1>& x, 
+               Eigen::MatrixBase<MatType2>& var) 
+    {
+        if (in_window()) {
+            for (int j = 0; j < x.cols(); ++j) {
+                cov_estimator_.update(x.col(j));
+            }
+        }
+
+        if (end_of_window()) {
+            auto&& c = cov_estimator_.get_covariance();
+            double n = cov_estimator_.get_n_samples();
+            // regularized sample covariance (see STAN)
+            var = (n / ((n + 5.0) * (n - 1.))) * c;
+            var.diagonal().array() += 1e-3 * (5.0 / (n + 5.0));
+            cov_estimator_.reset();
+            next();
+            return true;
+        }
+
+        next();
+        return false;
+    }
+
+    /**
+     * Saves (loads) the schedule and the estimator of the current window.
+     */
+    void save(std::ostream& os) const
+    {
+        WindowedAdapter::save(os);
+        cov_estimator_.save(os);
+    }
+
+    void load(std::istream& is)
+    {
+        WindowedAdapter::load(is);
+        cov_estimator_.load(is);
+    }
+
+private:
+    math::WelfordCov cov_estimator_;
+};
+
+/**
+ * Identity inverse metric (nothing to store).
+ */
+struct UnitMetric {};
+
+/**
+ * Low-rank plus diagonal representation of inverse metric:
+ *
+ *      M^{-1} = S (I + U (Lambda - I) U^T) S
+ *
+ * where S = diag(scale), U is (n_params x k) with orthonormal columns,
+ * and Lambda = diag(lambda) holds the k leading eigenvalues 
+ * of the (standardized) posterior correlation matrix.
+ * Both storage and matrix-vector products are O(n_params * k).
+ */
+struct LowRankMetric
+{
+    LowRankMetric(size_t n_params = 0)
+        : scale(n_params)
+        , U(n_params, 0)
+        , lambda(0)
+    { scale.setOnes(); }
+
+    Eigen::VectorXd scale;
+    Eigen::MatrixXd U;
+    Eigen::VectorXd lambda;
+};
+
+/**
+ * Low-rank plus diagonal precision matrix M is estimated for momentum covariance matrix.
+ * The diagonal part is estimated and regularized exactly like VarAdapter<diag_var>.
+ * The draws in each window are then standardized and the top-k eigenpairs 
+ * of their sample correlation matrix are estimated with subspace iteration,
+ * which only ever requires O(n_samples * n_params * k) operations.
+ * Eigenvalues are regularized towards 1 (identity correlation).
+ */
+template <>
+struct VarAdapter<lowrank_var> : WindowedAdapter
+{
+    VarAdapter(size_t n_params,
+               size_t warmup,
+               size_t init_buffer,
+               size_t term_buffer,
+               size_t window_base,
+               size_t rank)
+        : WindowedAdapter(warmup, init_buffer, term_buffer, window_base)
+        , n_params_{n_params}
+        , rank_{std::min(rank, n_params)}
+        , n_{0}
+        , draws_(n_params, 0)
+    {}
+
+    template <class MatType>
+    bool adapt(const Eigen::MatrixBase<MatType>& x, 
+               LowRankMetric& metric) 
+    {
+        if (in_window()) {
+            if (begin_of_window()) {
+                draws_.resize(n_params_, window_size() * x.cols());
+                n_ = 0;
+            }
+            draws_.middleCols(n_, x.cols()) = x;
+            n_ += x.cols();
+        }
+
+        if (end_of_window()) {
+            update_metric(metric);
+            next();
+            return true;
+        }
+
+        next();
+        return false;
+    }
+
+    /**
+     * Saves (loads) the schedule and the draws of the current window
+     * (only the number of columns allocated for the window is saved for the remaining draws).
+     */
+    void save(std::ostream& os) const
+    {
+        WindowedAdapter::save(os);
+        util::write_pod(os, static_cast<uint64_t>(draws_.cols()));
+        util::write_mat(os, draws_.leftCols(n_));
+    }
+
+    void load(std::istream& is)
+    {
+        uint64_t n_cols = 0;
+        Eigen::MatrixXd draws;
+        WindowedAdapter::load(is);
+        util::read_pod(is, n_cols);
+        util::read_mat(is, draws);
+        if (!is) return;
+        if ((draws.rows() != static_cast<Eigen::Index>(n_params_)) ||
+            (n_cols < static_cast<uint64_t>(draws.cols()))) {
+            is.setstate(std::ios::failbit);
+            return;
+        }
+        n_ = draws.cols();
+        draws_.resize(n_params_, n_cols);
+        draws_.leftCols(n_) = draws;
+    }
+
+private:
+
+    void update_metric(LowRankMetric& metric)
+    {
+        static constexpr size_t n_subspace_iter = 30;
+
+        const double n = n_;
+        auto draws = draws_.leftCols(n_);
+
+        // regularized sample variance (see VarAdapter<diag_var>)
+        Eigen::VectorXd mean = draws.rowwise().mean();
+        draws.colwise() -= mean;
+        Eigen::VectorXd sd = draws.rowwise().norm() / std::sqrt(n - 1.);
+        metric.scale.array() = ( (n / (n + 5.0)) * sd.array().square() + 
+                                 1e-3 * (5.0 / (n + 5.0)) ).sqrt();
+
+        // standardize (in-place) so that eigenvectors describe correlations only
+        for (size_t i = 0; i < n_params_; ++i) {
+            if (sd(i) > 0) draws.row(i) /= sd(i);
+        }
+
+        // not enough draws to estimate any correlation
+        const size_t k = std::min(rank_, n_ > 1 ? n_ - 1 : 0);
+        if (k == 0) {
+            metric.U.resize(n_params_, 0);
+            metric.lambda.resize(0);
+            return;
+        }
+
+        // subspace iteration on C = Z Z^T / (n-1) without forming C.
+        // Initialized with the span of the first k (standardized) draws.
+        Eigen::MatrixXd Q = draws.leftCols(k);
+        Eigen::MatrixXd ZtQ(n_, k);
+        Eigen::HouseholderQR<Eigen::MatrixXd> qr(n_params_, k);
+        auto orthonormalize = [&]() {
+            qr.compute(Q);
+            Q = qr.householderQ() * Eigen::MatrixXd::Identity(n_params_, k);
+        };
+        orthonormalize();
+        for (size_t it = 0; it < n_subspace_iter; ++it) {
+            ZtQ.noalias() = draws.transpose() * Q;
+            Q.noalias() = draws * ZtQ;
+            orthonormalize();
+        }
+
+        // Rayleigh-Ritz: eigen-decompose projection of C onto subspace
+        ZtQ.noalias() = draws.transpose() * Q;
+        Eigen::MatrixXd B = (ZtQ.transpose() * ZtQ) / (n - 1.);
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(B);
+
+        // eigenvalues are in increasing order: reverse to decreasing
+        metric.U.noalias() = Q * eig.eigenvectors().rowwise().reverse();
+        metric.lambda = eig.eigenvalues().reverse();
+
+        // regularize eigenvalues towards 1 (same weights as variance)
+        metric.lambda.array() = (n / (n + 5.0)) * metric.lambda.array() + 
+                                (5.0 / (n + 5.0));
+    }
+
+    const size_t n_params_;
+    const size_t rank_;
+    size_t n_;                  // number of draws in current window
+    Eigen::MatrixXd draws_;     // draws of current window (column-wise)
+};
+
+/**
+ * Constructs variance adapter of given policy from user configuration.
+ * @tparam  VarPolicy   one of unit_var, diag_var, dense_var, lowrank_var
+ */
+template <class VarPolicy>
+inline auto make_var_adapter(size_t n_params,
+                             size_t warmup,
+                             const VarConfig& config)
+{
+    if constexpr (std::is_same_v<VarPolicy, lowrank_var>) {
+        return VarAdapter<VarPolicy>(
+                n_params, warmup, config.init_buffer,
+                config.term_buffer, config.window_base, config.rank);
+    } else {
+        return VarAdapter<VarPolicy>(
+                n_params, warmup, config.init_buffer,
+                config.term_buffer, config.window_base);
+    }
+}
+
 } // namespace mcmc
 } // namespace ppl
@@ -1,5 +1,8 @@
 #pragma once
 #include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/mcmc/hmc/var_adapter.hpp>
+#include <autoppl/mcmc/stopping.hpp>
+#include <autoppl/mcmc/checkpoint.hpp>
 
 namespace ppl {
 
@@ -7,6 +10,18 @@ struct MHConfig : ConfigBase
 {
     double sigma = 1.0;
     double alpha = 0.25;
+
+    // configuration for adaptive (continuous) proposals during warmup
+    bool adapt = false;
+    double target_accept = 0.234;
+    double kappa = 0.6;
+    VarConfig var_config;
+
+    // configuration for stopping once chains have converged
+    StoppingConfig stop_config;
+
+    // configuration for checkpointing and resuming chains
+    CheckpointConfig checkpoint_config;
 };
 
 } // namespace ppl
@@ -1,138 +1,409 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <optional>
 #include <random>
 #include <autoppl/util/logging.hpp>
 #include <autoppl/util/traits/traits.hpp>
 #include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
 #include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/serialize.hpp>
 #include <autoppl/mcmc/sampler_tools.hpp>
 #include <autoppl/mcmc/result.hpp>
 #include <autoppl/mcmc/mh/config.hpp>
+#include <autoppl/mcmc/mh/proposal_adapter.hpp>
 #include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/stopping.hpp>
+#include <autoppl/mcmc/checkpoint.hpp>
 
 namespace ppl {
 namespace mcmc {
 
 /**
- * Metropolis-Hastings algorithm to sample from posterior distribution.
- * Any variables that model references which are parameters are sampled.
+ * State of a single chain of Metropolis-Hastings.
+ * It owns two copies of the program, bound to the current and candidate parameters,
+ * so it must not be moved after construction.
+ * If config.adapt is true, the proposal of continuous parameters 
+ * may be adapted during warmup (see ProposalAdapter and adapt).
+ *
+ * The chain targets the tempered log-pdf given by T and beta (see Tempering),
+ * i.e. beta * log_pdf (see pt_) or log_pdf + (beta - 1) * log_lik (see smc_).
  *
  * @tparam  ProgramType     program expression type
- * @tparam  OffsetPackType  offset pack type (likely util::OffsetPack)
- * @param   program         program expression
- * @param   config          configuration object
- * @param   pack            offset pack from activating program expression
- * @param   res             sampling result object to populate
+ * @tparam  MHConfigType    MH configuration type
+ * @tparam  T               part of the log-pdf scaled by beta
  */
-
 template <class ProgramType
-        , class OffsetPackType
-        , class MCMCResultType>
-inline void mh_(const ProgramType& program,
-                const MHConfig& config,
-                const OffsetPackType& pack,
-                MCMCResultType& res)
+        , class MHConfigType = MHConfig
+        , Tempering T = Tempering::none>
+struct MHChain
 {
-    ProgramType program_curr = program;   // will be bound to curr
-    ProgramType program_cand = program;   // will be bound to cand
-
-    // data structure to keep track of param candidates
+    using program_t = ProgramType;
     using cont_vec_t = Eigen::Matrix<util::cont_param_t, Eigen::Dynamic, 1>;
     using disc_vec_t = Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1>;
     using visit_vec_t = Eigen::Matrix<size_t, Eigen::Dynamic, 1>;
 
-    cont_vec_t cont_curr(std::get<0>(pack).uc_offset); // total number of offsets is the number of parameters
-    cont_vec_t cont_cand(std::get<0>(pack).uc_offset); 
-    cont_vec_t cont_tp(std::get<0>(pack).tp_offset);
-    cont_vec_t cont_constrained(std::get<0>(pack).c_offset);
-    visit_vec_t cont_visit(std::get<0>(pack).v_offset);
-    cont_tp.setZero();
-    cont_constrained.setZero();
-    cont_visit.setZero();
-
-    disc_vec_t disc_curr(std::get<1>(pack).uc_offset); 
-    disc_vec_t disc_cand(std::get<1>(pack).uc_offset); 
-    disc_vec_t disc_tp(std::get<1>(pack).tp_offset);
-
-    util::cont_ptr_pack_t cont_ptr_pack;
-    cont_ptr_pack.uc_val = cont_curr.data();
-    cont_ptr_pack.c_val = cont_constrained.data();
-    cont_ptr_pack.v_val = cont_visit.data();
-    cont_ptr_pack.tp_val = cont_tp.data();
-
-    util::disc_ptr_pack_t disc_ptr_pack;
-    disc_ptr_pack.uc_val = disc_curr.data();
-    disc_ptr_pack.tp_val = disc_tp.data();
-
-    program_curr.bind(cont_ptr_pack);
-    program_curr.bind(disc_ptr_pack);
-
-    cont_ptr_pack.uc_val = cont_cand.data();
-    disc_ptr_pack.uc_val = disc_cand.data();
-    program_cand.bind(cont_ptr_pack);
-    program_cand.bind(disc_ptr_pack);
-
-    std::uniform_real_distribution metrop_sampler(0., 1.);
-    std::discrete_distribution disc_sampler({config.alpha, 1-2*config.alpha, config.alpha});
-    std::normal_distribution norm_sampler(0., config.sigma);
-    std::mt19937 gen(config.seed);
-
-    // references avoid making copies when swapping at the end of for-loop
-    std::reference_wrapper<ProgramType> program_curr_ref(program_curr);
-    std::reference_wrapper<ProgramType> program_cand_ref(program_cand);
-
-    program_curr_ref.get().init_params(gen, config.prune);
-    double curr_log_pdf = program_curr.log_pdf();
+    /**
+     * Binds both programs and initializes the first sample.
+     *
+     * @param   program     program to copy
+     * @param   _config     MH configuration object (must outlive this object)
+     * @param   pack        offset pack from activating program expression
+     * @param   seed        seed of this chain
+     * @param   _beta       inverse temperature
+     */
+    template <class OffsetPackType>
+    MHChain(const program_t& program,
+            const MHConfigType& _config,
+            const OffsetPackType& pack,
+            size_t seed,
+            double _beta = 1.)
+        : config(_config)
+        , beta{_beta}
+        , program_curr(program)
+        , program_cand(program)
+        , cont_curr(std::get<0>(pack).uc_offset) // total number of offsets is the number of parameters
+        , cont_cand(std::get<0>(pack).uc_offset)
+        , cont_tp(cont_vec_t::Zero(std::get<0>(pack).tp_offset))
+        , cont_constrained(cont_vec_t::Zero(std::get<0>(pack).c_offset))
+        , cont_visit(visit_vec_t::Zero(std::get<0>(pack).v_offset))
+        , disc_curr(std::get<1>(pack).uc_offset)
+        , disc_cand(std::get<1>(pack).uc_offset)
+        , disc_tp(std::get<1>(pack).tp_offset)
+        , disc_sampler({config.alpha, 1-2*config.alpha, config.alpha})
+        , norm_sampler(0., config.sigma)
+        , gen(seed)
+        , cont_step(std::get<0>(pack).uc_offset)
+    {
+        if (config.adapt) {
+            proposal_adapter.emplace(std::get<0>(pack).uc_offset, config.warmup, config);
+        }
 
-    // construct miscellaneous objects 
-    auto logger = util::ProgressLogger(config.samples + config.warmup, "Metropolis-Hastings");
-    util::StopWatch<> stopwatch_warmup;
-    util::StopWatch<> stopwatch_sampling;
+        util::cont_ptr_pack_t cont_ptr_pack;
+        cont_ptr_pack.uc_val = cont_curr.data();
+        cont_ptr_pack.c_val = cont_constrained.data();
+        cont_ptr_pack.v_val = cont_visit.data();
+        cont_ptr_pack.tp_val = cont_tp.data();
 
-    // start timing warmup
-    stopwatch_warmup.start();
+        util::disc_ptr_pack_t disc_ptr_pack;
+        disc_ptr_pack.uc_val = disc_curr.data();
+        disc_ptr_pack.tp_val = disc_tp.data();
 
-    for (size_t iter = 0; iter < config.samples + config.warmup; ++iter) {
+        program_curr.bind(cont_ptr_pack);
+        program_curr.bind(disc_ptr_pack);
 
-        // if warmup is finished, stop timing warmup and start timing sampling
-        if (iter == config.warmup) {
-            stopwatch_warmup.stop();
-            stopwatch_sampling.start();
-        }
+        cont_ptr_pack.uc_val = cont_cand.data();
+        disc_ptr_pack.uc_val = disc_cand.data();
+        program_cand.bind(cont_ptr_pack);
+        program_cand.bind(disc_ptr_pack);
 
-        logger.printProgress(iter);
+        program_curr_ref.get().init_params(gen, config.prune);
+        refresh();
+    }
 
-        double log_alpha = -curr_log_pdf;
+    MHChain(const MHChain&) =delete;
+    MHChain& operator=(const MHChain&) =delete;
 
+    /**
+     * Proposes a candidate from the current sample and accepts or rejects it.
+     * After the call, cont_curr and disc_curr hold the next sample.
+     */
+    void transition()
+    {
         // generate next candidates
-        cont_cand = cont_curr + cont_vec_t::NullaryExpr(cont_cand.size(), 
-                [&]() { return norm_sampler(gen); });
+        if (config.adapt) {
+            proposal_adapter->sample(cont_step, gen);
+            cont_cand = cont_curr + cont_step;
+        } else {
+            cont_cand = cont_curr + cont_vec_t::NullaryExpr(cont_cand.size(), 
+                    [&]() { return norm_sampler(gen); });
+        }
         disc_cand = disc_curr + disc_vec_t::NullaryExpr(disc_cand.size(),
                 [&]() { return disc_sampler(gen) - 1; });
 
-        // compute next candidate log pdf and update log_alpha
+        // compute next candidate log pdf and log_alpha
         double cand_log_pdf = program_cand_ref.get().log_pdf();
-        log_alpha += cand_log_pdf;
+        double cand_log_lik = 0.;
+        if constexpr (T == Tempering::likelihood) {
+            cand_log_lik = program_cand_ref.get().log_lik();
+            log_alpha = (cand_log_pdf - curr_log_pdf) + 
+                        (beta - 1.) * (cand_log_lik - curr_log_lik);
+        } else {
+            log_alpha = beta * (cand_log_pdf - curr_log_pdf);
+        }
         bool accept = (std::log(metrop_sampler(gen)) <= log_alpha);
 
+        // Note: swapping vectors swaps their buffers, 
+        // so the programs must be swapped as well to stay bound to curr and cand
         if (accept) {
             cont_curr.swap(cont_cand);
             disc_curr.swap(disc_cand);
             std::swap(program_curr_ref, program_cand_ref);
             curr_log_pdf = cand_log_pdf;
+            curr_log_lik = cand_log_lik;
+        }
+    }
+
+    /**
+     * Adapts the proposal after the transition of a warmup iteration
+     * (only if config.adapt is true).
+     */
+    void adapt()
+    {
+        if (config.adapt) {
+            proposal_adapter->adapt(cont_curr, std::min(1., std::exp(log_alpha)));
+        }
+    }
+
+    /**
+     * Re-evaluates the log-pdf at the current sample.
+     * Must be called whenever cont_curr or disc_curr is modified externally.
+     */
+    void refresh() 
+    { 
+        curr_log_pdf = program_curr_ref.get().log_pdf(); 
+        if constexpr (T == Tempering::likelihood) {
+            curr_log_lik = program_curr_ref.get().log_lik();
+        }
+    }
+
+    /**
+     * Returns the (untempered) log-pdf at the current sample.
+     */
+    double log_pdf() const { return curr_log_pdf; }
+
+    /**
+     * Returns the log-likelihood at the current sample (see ProgramNode::log_lik).
+     */
+    double log_lik() 
+    { 
+        if constexpr (T == Tempering::likelihood) return curr_log_lik;
+        else return program_curr_ref.get().log_lik();
+    }
+
+    /**
+     * Re-seeds the generator and discards any random numbers cached by distributions,
+     * so that the next transitions only depend on seq and the current sample (see smc_).
+     */
+    void reseed(std::seed_seq& seq)
+    {
+        gen.seed(seq);
+        metrop_sampler.reset();
+        disc_sampler.reset();
+        norm_sampler.reset();
+        if (proposal_adapter) proposal_adapter->reset();
+    }
+
+    /**
+     * Exchanges the current samples of this chain and other.
+     * Note: the contents are exchanged (not the buffers) since programs are bound to them.
+     */
+    void swap_state(MHChain& other)
+    {
+        std::swap_ranges(cont_curr.data(), cont_curr.data() + cont_curr.size(),
+                         other.cont_curr.data());
+        std::swap_ranges(disc_curr.data(), disc_curr.data() + disc_curr.size(),
+                         other.disc_curr.data());
+        std::swap(curr_log_pdf, other.curr_log_pdf);
+        std::swap(curr_log_lik, other.curr_log_lik);
+    }
+
+    /**
+     * Saves (loads) the full state of the chain (see ChainCheckpoint):
+     * the generator and distributions, the current sample and its log-pdf,
+     * and the proposal adapter (if config.adapt is true).
+     * A state must be loaded into a chain constructed with the same program and configuration.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_state(os, gen);
+        util::write_state(os, metrop_sampler);
+        util::write_state(os, disc_sampler);
+        util::write_state(os, norm_sampler);
+        util::write_mat(os, cont_curr);
+        util::write_mat(os, disc_curr);
+        util::write_pod(os, curr_log_pdf);
+        util::write_pod(os, curr_log_lik);
+        util::write_pod(os, log_alpha);
+        util::write_pod(os, static_cast<uint8_t>(proposal_adapter.has_value()));
+        if (proposal_adapter) proposal_adapter->save(os);
+    }
+
+    void load(std::istream& is)
+    {
+        util::read_state(is, gen);
+        util::read_state(is, metrop_sampler);
+        util::read_state(is, disc_sampler);
+        util::read_state(is, norm_sampler);
+        util::read_mat(is, cont_curr);
+        util::read_mat(is, disc_curr);
+        util::read_pod(is, curr_log_pdf);
+        util::read_pod(is, curr_log_lik);
+        util::read_pod(is, log_alpha);
+        uint8_t has_adapter = 0;
+        util::read_pod(is, has_adapter);
+        if (has_adapter != proposal_adapter.has_value()) {
+            is.setstate(std::ios::failbit);
+            return;
+        }
+        if (proposal_adapter) proposal_adapter->load(is);
+    }
+
+    const MHConfigType& config;
+    double beta;
+
+    program_t program_curr;   // will be bound to curr
+    program_t program_cand;   // will be bound to cand
+
+    // references avoid making copies when swapping at the end of transition
+    std::reference_wrapper<program_t> program_curr_ref{program_curr};
+    std::reference_wrapper<program_t> program_cand_ref{program_cand};
+
+    // data structure to keep track of param candidates
+    cont_vec_t cont_curr;
+    cont_vec_t cont_cand;
+    cont_vec_t cont_tp;
+    cont_vec_t cont_constrained;
+    visit_vec_t cont_visit;
+    disc_vec_t disc_curr;
+    disc_vec_t disc_cand;
+    disc_vec_t disc_tp;
+
+    std::uniform_real_distribution<> metrop_sampler{0., 1.};
+    std::discrete_distribution<> disc_sampler;
+    std::normal_distribution<> norm_sampler;
+    std::mt19937 gen;
+
+    cont_vec_t cont_step;
+    std::optional<ProposalAdapter> proposal_adapter;    // only constructed if config.adapt is true
+
+    double curr_log_pdf = 0.;
+    double curr_log_lik = 0.;  // only maintained if T is Tempering::likelihood
+    double log_alpha = 0.;      // log acceptance ratio of last transition
+};
+
+/**
+ * Runs a single chain of Metropolis-Hastings (see MHChain).
+ *
+ * @tparam  ProgramType     program expression type
+ * @tparam  OffsetPackType  offset pack type (likely util::OffsetPack)
+ * @param   program         program expression
+ * @param   config          configuration object
+ * @param   pack            offset pack from activating program expression
+ * @param   chain           chain index. The chain is seeded with config.seed + chain
+ *                          and only chain 0 prints progress.
+ * @param   writer          called with every draw of this chain after warmup (see chain_writer)
+ * @param   stop            called with the number of draws after every draw.
+ *                          Sampling stops if it returns true (see StoppingConfig).
+ *                          If the chain resumes from a checkpoint (see CheckpointConfig),
+ *                          writer and stop are first called with every draw up to the checkpoint.
+ * @param   warmup_time     populated with warmup time of this chain
+ * @param   sampling_time   populated with sampling time of this chain
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class WriterType
+        , class StopType>
+inline void mh_chain_(const ProgramType& program,
+                      const MHConfig& config,
+                      const OffsetPackType& pack,
+                      size_t chain,
+                      WriterType&& writer,
+                      StopType&& stop,
+                      double& warmup_time,
+                      double& sampling_time)
+{
+    MHChain<ProgramType> mh_chain(program, config, pack, config.seed + chain);
+
+    // resume from checkpoint (if any)
+    ChainCheckpoint checkpoint(config.checkpoint_config, chain,
+                               mh_chain.cont_curr.size(), mh_chain.disc_curr.size());
+    bool stopped = false;
+    const size_t begin = checkpoint.resume(mh_chain, config.warmup, config.samples,
+                                           writer, stop, stopped);
+
+    // construct miscellaneous objects 
+    auto logger = util::ProgressLogger(config.samples + config.warmup, "Metropolis-Hastings",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    // start timing warmup (or sampling if resumed after warmup)
+    stopwatch_warmup.start();
+    if (begin > config.warmup) {
+        stopwatch_warmup.stop();
+        stopwatch_sampling.start();
+    }
+
+    for (size_t iter = begin; !stopped && iter < config.samples + config.warmup; ++iter) {
+
+        // if warmup is finished, stop timing warmup and start timing sampling
+        if (iter == config.warmup) {
+            stopwatch_warmup.stop();
+            stopwatch_sampling.start();
+        }
+
+        logger.printProgress(iter);
+
+        mh_chain.transition();
+
+        if (iter < config.warmup) {
+            mh_chain.adapt();
         }
 
         if (iter >= config.warmup) {
-            res.cont_samples.row(iter-config.warmup) = cont_curr;
-            res.disc_samples.row(iter-config.warmup) = disc_curr;
+            DrawStats stats;
+            stats.accept_stat = std::min(1., std::exp(mh_chain.log_alpha));
+            stats.log_pdf = mh_chain.log_pdf();
+            writer(iter-config.warmup, mh_chain.cont_curr, mh_chain.disc_curr, stats);
+            checkpoint.write_draw(mh_chain.cont_curr, mh_chain.disc_curr, stats);
         }
+
+        checkpoint.update(mh_chain, iter);
+
+        if (iter >= config.warmup && stop(iter-config.warmup+1)) break;
     }
 
     // stop timing sampling
     stopwatch_sampling.stop();
 
     // save output results
-    res.warmup_time = stopwatch_warmup.elapsed();
-    res.sampling_time = stopwatch_sampling.elapsed();
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * Metropolis-Hastings algorithm to sample from posterior distribution.
+ * Any variables that model references which are parameters are sampled.
+ * Runs config.n_chains independent chains on the thread pool.
+ *
+ * @tparam  ProgramType     program expression type
+ * @tparam  OffsetPackType  offset pack type (likely util::OffsetPack)
+ * @param   program         program expression
+ * @param   config          configuration object
+ * @param   pack            offset pack from activating program expression
+ * @param   res             sampling result object to populate
+ *                          (or TransformOutput/SinkOutput if draws are transformed/streamed,
+ *                          see transform_mcmc and stream_mcmc)
+ * @param   pool            thread pool to run chains on
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType>
+inline void mh_(const ProgramType& program,
+                const MHConfig& config,
+                const OffsetPackType& pack,
+                MCMCResultType& res,
+                util::ThreadPool& pool)
+{
+    run_chains(config, config.stop_config, pool, res, 
+            [&](size_t chain, auto&& stop, double& warmup_time, double& sampling_time) {
+                mh_chain_(program, config, pack, chain,
+                          chain_writer(res, chain), stop,
+                          warmup_time, sampling_time);
+            });
 }
 
 } // namespace mcmc
@@ -141,11 +412,31 @@ template <class ExprType>
 inline auto mh(const ExprType& expr,
                const MHConfig& config = MHConfig())
 {
-    return mcmc::base_mcmc(expr, config, 
+    return mcmc::transform_mcmc(expr, config, 
             [](const auto& program, const auto& config,
-               const auto& pack, auto& res) {
+               const auto& pack, auto& res, auto& pool) {
                 res.name = "mh";
-                mcmc::mh_(program, config, pack, res);
+                mcmc::mh_(program, config, pack, res, pool);
+            });
+}
+
+/**
+ * Streaming version of mh: every draw is passed to sink
+ * as it is produced instead of being returned (see mcmc::stream_mcmc).
+ * Throws std::invalid_argument if config.stop_config is enabled.
+ */
+template <class ExprType
+        , class SinkType>
+inline auto mh(const ExprType& expr,
+               const MHConfig& config,
+               SinkType& sink)
+{
+    mcmc::check_stream_stopping(config.stop_config);
+    return mcmc::stream_mcmc(expr, config, sink,
+            [](const auto& program, const auto& config,
+               const auto& pack, auto& out, auto& pool) {
+                out.name = "mh";
+                mcmc::mh_(program, config, pack, out, pool);
             });
 }
 
@@ -0,0 +1,120 @@
+#pragma once
+#include <cmath>
+#include <random>
+#include <Eigen/Dense>
+#include <autoppl/mcmc/hmc/var_adapter.hpp>
+#include <autoppl/mcmc/mh/config.hpp>
+#include <autoppl/util/serialize.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * Adaptive random-walk proposal N(0, exp(2*log_scale) * Sigma) for continuous parameters
+ * (see Haario, Saksman, Tamminen (2001) and Andrieu, Thoms (2008)).
+ *
+ * Sigma is estimated from warmup draws with the same windowed scheme 
+ * and regularization as the dense metric of NUTS (see VarAdapter<dense_var>).
+ * Until the first window ends, Sigma is identity and log_scale is log(config.sigma).
+ * Every time Sigma is updated, log_scale is reset to the optimal scaling 
+ * log(2.38/sqrt(n_params)) for Gaussian targets and the Robbins-Monro schedule restarts.
+ * log_scale is then tuned towards config.target_accept with Robbins-Monro steps
+ * of size (t+1)^{-config.kappa}.
+ */
+struct ProposalAdapter
+{
+    ProposalAdapter(size_t n_params,
+                    size_t warmup,
+                    const MHConfig& config)
+        : n_params_{n_params}
+        , target_accept_{config.target_accept}
+        , kappa_{config.kappa}
+        , log_scale_{std::log(config.sigma)}
+        , cov_(Eigen::MatrixXd::Identity(n_params, n_params))
+        , chol_(Eigen::MatrixXd::Identity(n_params, n_params))
+        , z_(n_params)
+        , var_adapter_(make_var_adapter<dense_var>(
+                    n_params, warmup, config.var_config))
+        , dist_(0., 1.)
+    {}
+
+    /**
+     * Samples a random-walk step from the current proposal distribution.
+     */
+    template <class MatType, class GenType>
+    void sample(Eigen::MatrixBase<MatType>& step, GenType& gen)
+    {
+        z_ = Eigen::VectorXd::NullaryExpr(n_params_, 
+                [&]() { return dist_(gen); });
+        step.noalias() = chol_.triangularView<Eigen::Lower>() * z_;
+        step *= std::exp(log_scale_);
+    }
+
+    /**
+     * Adapts the proposal given the current (warmup) draw x 
+     * and the acceptance probability of the last proposal.
+     */
+    template <class MatType>
+    void adapt(const Eigen::MatrixBase<MatType>& x, double accept_prob)
+    {
+        if (n_params_ == 0) return;
+        if (std::isnan(accept_prob)) accept_prob = 0.;
+
+        ++counter_;
+        log_scale_ += std::pow(counter_, -kappa_) * (accept_prob - target_accept_);
+
+        if (var_adapter_.adapt(x, cov_)) {
+            chol_ = cov_.llt().matrixL();
+            log_scale_ = std::log(2.38 / std::sqrt(static_cast<double>(n_params_)));
+            counter_ = 0;
+        }
+    }
+
+    /**
+     * Discards any normal draw cached by the step distribution.
+     */
+    void reset() { dist_.reset(); }
+
+    /**
+     * Saves (loads) the proposal, its adaptation state, and the step distribution.
+     */
+    void save(std::ostream& os) const
+    {
+        util::write_pod(os, static_cast<uint64_t>(counter_));
+        util::write_pod(os, log_scale_);
+        util::write_mat(os, cov_);
+        util::write_mat(os, chol_);
+        var_adapter_.save(os);
+        util::write_state(os, dist_);
+    }
+
+    void load(std::istream& is)
+    {
+        uint64_t n = 0;
+        util::read_pod(is, n);
+        counter_ = n;
+        util::read_pod(is, log_scale_);
+        util::read_mat(is, cov_);
+        util::read_mat(is, chol_);
+        var_adapter_.load(is);
+        util::read_state(is, dist_);
+    }
+
+    double log_scale() const { return log_scale_; }
+    const Eigen::MatrixXd& cov() const { return cov_; }
+
+private:
+    const size_t n_params_;
+    const double target_accept_;
+    const double kappa_;
+    size_t counter_ = 0;
+    double log_scale_;
+    Eigen::MatrixXd cov_;       // estimated covariance Sigma
+    Eigen::MatrixXd chol_;      // lower cholesky factor of Sigma
+    Eigen::VectorXd z_;
+    VarAdapter<dense_var> var_adapter_;
+    std::normal_distribution<> dist_;
+};
+
+} // namespace mcmc
+} // namespace ppl
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/hmc/nuts/configs.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for parallel tempering (replica exchange).
+ * It extends the configuration of the kernel that updates every replica
+ * (NUTSConfig or MHConfig), whose settings are shared by all replicas.
+ * stop_config, checkpoint_config, and warm_start_config are not supported
+ * and must be left disabled (pt_ throws std::invalid_argument otherwise).
+ *
+ * Replica k targets the log-pdf scaled by the inverse temperature 1/T_k
+ * where 1 = T_0 < T_1 < ... < T_{n_replicas-1}.
+ * The temperatures are initially geometrically spaced up to max_temperature.
+ * If adapt_temperatures is true, the spacings are adapted during warmup
+ * such that swaps between adjacent replicas are accepted
+ * with probability target_swap.
+ */
+template <class KernelConfigType = NUTSConfig<>>
+struct PTConfig: KernelConfigType
+{
+    using kernel_config_t = KernelConfigType;
+
+    size_t n_replicas = 4;
+    double max_temperature = 10.;
+    size_t swap_interval = 1;       // number of iterations between swap rounds
+    bool adapt_temperatures = true;
+    double target_swap = 0.234;
+    double swap_kappa = 0.6;        // decay of temperature adaptation step size
+};
+
+} // namespace ppl
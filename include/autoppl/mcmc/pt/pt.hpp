@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/mh/mh.hpp>
+#include <autoppl/mcmc/hmc/nuts/nuts.hpp>
+#include <autoppl/mcmc/pt/config.hpp>
+#include <autoppl/mcmc/pt/temperature_adapter.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * Kernel that updates every replica of parallel tempering:
+ * MHChain if the configuration extends MHConfig and (tempered) NUTSChain otherwise.
+ */
+template <class ProgramType
+        , class PTConfigType>
+using pt_kernel_t = std::conditional_t<
+    std::is_base_of_v<MHConfig, PTConfigType>,
+    MHChain<ProgramType, PTConfigType, Tempering::joint>,
+    NUTSChain<ProgramType, PTConfigType, Tempering::joint> >;
+
+/**
+ * Runs a single chain of parallel tempering.
+ *
+ * Every iteration, each replica takes one transition of its kernel at its own temperature.
+ * Replicas are updated concurrently on the thread pool.
+ * Every config.swap_interval iterations, swaps of adjacent replicas are proposed,
+ * alternating between even pairs (0,1), (2,3), ... and odd pairs (1,2), (3,4), ...
+ * A swap of replicas k and k+1 is accepted with probability
+ *      min(1, exp((beta_k - beta_{k+1}) * (log_pdf_{k+1} - log_pdf_k))).
+ * During warmup, the kernel of every replica adapts to its temperature
+ * and the temperatures are adapted (see TemperatureAdapter).
+ *
+ * Replica k is seeded with config.seed + chain + k * config.n_chains
+ * and swaps are driven by a separate generator seeded with
+ * config.seed + chain + config.n_replicas * config.n_chains.
+ * Hence, the samples never depend on the number of threads.
+ * Only the samples of replica 0 (temperature 1) are stored.
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          parallel tempering configuration object
+ * @param   pack            offset pack result of activating program
+ * @param   chain           chain index. Only chain 0 prints progress.
+ * @param   cont_samples    matrix-like block of size (config.samples x n_cont_params) to populate
+ * @param   disc_samples    matrix-like block of size (config.samples x n_disc_params) to populate
+ * @param   shard_ctx       context used to build sharded AD expressions (NUTS only)
+ * @param   pool            thread pool to run replicas on
+ * @param   warmup_time     populated with warmup time of this chain
+ * @param   sampling_time   populated with sampling time of this chain
+ */
+template <class ProgramType
+        , class PTConfigType
+        , class OffsetPackType
+        , class ContSamplesType
+        , class DiscSamplesType>
+void pt_chain_(const ProgramType& program,
+               const PTConfigType& config,
+               const OffsetPackType& pack,
+               size_t chain,
+               ContSamplesType&& cont_samples,
+               DiscSamplesType&& disc_samples,
+               util::ShardContext& shard_ctx,
+               util::ThreadPool& pool,
+               double& warmup_time,
+               double& sampling_time)
+{
+    using kernel_t = pt_kernel_t<ProgramType, PTConfigType>;
+    constexpr bool is_mh = std::is_base_of_v<MHConfig, PTConfigType>;
+    const size_t n_replicas = config.n_replicas;
+    assert(n_replicas > 0);
+
+    TemperatureAdapter temp_adapter(n_replicas, config.max_temperature,
+                                    config.target_swap, config.swap_kappa);
+
+    // initialize every replica (initial samples and step sizes) concurrently
+    std::vector<std::unique_ptr<kernel_t>> replicas(n_replicas);
+    pool.parallel_for(n_replicas, [&](size_t k) {
+        const size_t seed = config.seed + chain + k * config.n_chains;
+        if constexpr (is_mh) {
+            static_cast<void>(shard_ctx);
+            replicas[k] = std::make_unique<kernel_t>(
+                    program, config, pack, seed, temp_adapter.beta(k));
+        } else {
+            replicas[k] = std::make_unique<kernel_t>(
+                    program, config, pack, shard_ctx, seed, temp_adapter.beta(k));
+        }
+    });
+
+    std::mt19937 gen(config.seed + chain + n_replicas * config.n_chains);
+    std::uniform_real_distribution unif_sampler(0., 1.);
+    size_t n_rounds = 0;
+
+    // construct miscellaneous objects
+    auto logger = util::ProgressLogger(config.samples + config.warmup, "Parallel Tempering",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    stopwatch_warmup.start();
+
+    for (size_t i = 0; i < config.samples + config.warmup; ++i) {
+
+        if (i == config.warmup) {
+            stopwatch_warmup.stop();
+            stopwatch_sampling.start();
+        }
+
+        logger.printProgress(i);
+
+        // within-temperature transitions
+        pool.parallel_for(n_replicas, [&](size_t k) {
+            auto& replica = *replicas[k];
+            replica.transition();
+            if (i < config.warmup) {
+                if constexpr (is_mh) replica.adapt();
+                else replica.adapt(i);
+            }
+        });
+
+        // swap round
+        if (n_replicas > 1 && ((i + 1) % config.swap_interval == 0)) {
+            bool temps_changed = false;
+            for (size_t k = n_rounds % 2; k + 1 < n_replicas; k += 2) {
+                auto& cold = *replicas[k];
+                auto& hot = *replicas[k+1];
+                const double log_alpha = (cold.beta - hot.beta) *
+                                         (hot.log_pdf() - cold.log_pdf());
+                const double swap_prob = std::isnan(log_alpha) ? 0. :
+                                         std::min(1., std::exp(log_alpha));
+                if (mcmc::accept_or_reject(swap_prob, unif_sampler, gen)) {
+                    cold.swap_state(hot);
+                }
+                if (config.adapt_temperatures && (i < config.warmup)) {
+                    temp_adapter.adapt(k, swap_prob);
+                    temps_changed = true;
+                }
+            }
+            ++n_rounds;
+
+            // changing the temperature of a (tempered) NUTS replica changes its potential
+            if (temps_changed) {
+                pool.parallel_for(n_replicas, [&](size_t k) {
+                    auto& replica = *replicas[k];
+                    replica.beta = temp_adapter.beta(k);
+                    if constexpr (!is_mh) replica.refresh();
+                });
+            }
+        }
+
+        if (i >= config.warmup) {
+            const auto& target = *replicas[0];
+            if constexpr (is_mh) {
+                cont_samples.row(i-config.warmup) = target.cont_curr;
+            } else {
+                cont_samples.row(i-config.warmup) = target.theta_curr;
+            }
+            disc_samples.row(i-config.warmup) = target.disc_curr;
+        }
+    }
+
+    stopwatch_sampling.stop();
+
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * Parallel tempering (replica exchange).
+ * Runs config.n_chains independent chains (see pt_chain_),
+ * each made up of config.n_replicas replicas, on the thread pool.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      parallel tempering configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object that will be populated with samples and other information.
+ * @param   pool        thread pool to run chains and replicas on
+ * @throws  std::invalid_argument if the stopping, checkpointing, or warm start
+ *          settings of the kernel configuration are enabled.
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class PTConfigType = PTConfig<>>
+void pt_(const ProgramType& program,
+         const PTConfigType& config,
+         const OffsetPackType& pack,
+         MCMCResultType& res,
+         util::ThreadPool& pool)
+{
+    // stopping, checkpointing, and warm starts of the kernel configuration
+    // only apply to ppl::nuts and ppl::mh
+    bool unsupported = config.stop_config.enabled ||
+                       config.checkpoint_config.every > 0 ||
+                       config.checkpoint_config.resume;
+    if constexpr (!std::is_base_of_v<MHConfig, PTConfigType>) {
+        unsupported = unsupported || !config.warm_start_config.states.empty();
+    }
+    if (unsupported) {
+        throw std::invalid_argument(
+                "pt does not support stop_config, checkpoint_config, or warm_start_config");
+    }
+
+    // only the NUTS kernel evaluates sharded AD expressions
+    ShardConfig shard_config;
+    if constexpr (!std::is_base_of_v<MHConfig, PTConfigType>) {
+        shard_config = config.shard_config;
+    }
+    util::ShardContext shard_ctx(pool, shard_config, std::get<0>(pack));
+    run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                pt_chain_(program, config, pack, chain,
+                          res.cont_chain(chain), res.disc_chain(chain),
+                          shard_ctx, pool, warmup_time, sampling_time);
+            });
+}
+
+} // namespace mcmc
+
+template <class ExprType
+        , class PTConfigType = PTConfig<>>
+inline auto pt(const ExprType& expr,
+               const PTConfigType& config = PTConfigType())
+{
+    return mcmc::base_mcmc(expr, config,
+            [](const auto& program, const auto& config,
+               const auto& pack, auto& res, auto& pool) {
+                res.name = "pt";
+                mcmc::pt_(program, config, pack, res, pool);
+            });
+}
+
+} // namespace ppl
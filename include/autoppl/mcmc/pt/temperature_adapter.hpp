@@ -0,0 +1,81 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace ppl {
+namespace mcmc {
+
+/**
+ * Ladder of temperatures 1 = T_0 < T_1 < ... < T_{n-1} for parallel tempering.
+ * The ladder is parametrized by the log-spacings log(T_{k+1} - T_k),
+ * which are initialized such that the temperatures are geometrically spaced
+ * from 1 to max_temperature.
+ *
+ * The spacing between T_k and T_{k+1} is adapted by stochastic approximation
+ * on the acceptance probability of swapping replicas k and k+1:
+ * it grows if swaps are accepted more often than target and shrinks otherwise
+ * (Miasojedow, Moulines, Vihola, 2013).
+ */
+struct TemperatureAdapter
+{
+    TemperatureAdapter(size_t n_replicas,
+                       double max_temperature,
+                       double target,
+                       double kappa)
+        : log_spacings_(n_replicas ? n_replicas - 1 : 0)
+        , counters_(log_spacings_.size(), 0)
+        , betas_(n_replicas, 1.)
+        , target_{target}
+        , kappa_{kappa}
+    {
+        assert(max_temperature > 1. || n_replicas <= 1);
+        const double n = static_cast<double>(log_spacings_.size());
+        double temp_prev = 1.;
+        for (size_t k = 0; k < log_spacings_.size(); ++k) {
+            const double temp = std::pow(max_temperature, (k+1) / n);
+            log_spacings_[k] = std::log(temp - temp_prev);
+            temp_prev = temp;
+        }
+        update_betas();
+    }
+
+    /**
+     * Adapts the spacing between replicas k and k+1
+     * given the acceptance probability of swapping them.
+     */
+    void adapt(size_t k, double swap_prob)
+    {
+        ++counters_[k];
+        const double gamma = std::pow(counters_[k], -kappa_);
+        log_spacings_[k] += gamma * (swap_prob - target_);
+        update_betas();
+    }
+
+    /**
+     * Returns the inverse temperature of replica k.
+     */
+    double beta(size_t k) const { return betas_[k]; }
+
+    size_t n_replicas() const { return betas_.size(); }
+
+private:
+    void update_betas()
+    {
+        double temp = 1.;
+        for (size_t k = 0; k < log_spacings_.size(); ++k) {
+            temp += std::exp(log_spacings_[k]);
+            betas_[k+1] = 1. / temp;
+        }
+    }
+
+    std::vector<double> log_spacings_;
+    std::vector<size_t> counters_;
+    std::vector<double> betas_;
+    double target_;
+    double kappa_;
+};
+
+} // namespace mcmc
+} // namespace ppl
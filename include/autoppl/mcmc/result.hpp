@@ -11,6 +11,10 @@ namespace ppl {
  * - continuous and discrete samples
  * - warmup and sampling time
  * - name of mcmc algorithm invoked
+ *
+ * When multiple chains are run, the samples of each chain are stacked vertically,
+ * i.e. chain c occupies rows [c * n_samples, (c+1) * n_samples).
+ * Warmup and sampling times are the maximum over all chains.
  */
 template <int Major = Eigen::ColMajor>
 struct MCMCResult
@@ -20,17 +24,60 @@ struct MCMCResult
 
     cont_samples_t cont_samples;
     disc_samples_t disc_samples;
+    Eigen::VectorXd log_pdf_samples;    // log-pdf of every sample recorded by the sampler
+                                        // (only used for unconstrained samples, see mcmc::base_mcmc)
     std::string name;
     double warmup_time = 0;
     double sampling_time = 0;
+    size_t n_chains = 1;
 
     MCMCResult() =default;
     MCMCResult(size_t n_samples,
                size_t n_cont_params,
-               size_t n_disc_params)
-        : cont_samples(n_samples, n_cont_params)
-        , disc_samples(n_samples, n_disc_params)
+               size_t n_disc_params,
+               size_t n_chains = 1)
+        : cont_samples(n_samples * n_chains, n_cont_params)
+        , disc_samples(n_samples * n_chains, n_disc_params)
+        , n_chains(n_chains)
     {}
+
+    /**
+     * Returns the number of samples per chain.
+     */
+    size_t n_samples() const { 
+        return (n_chains == 0) ? 0 : cont_samples.rows() / n_chains; 
+    }
+
+    /**
+     * Returns a view of the continuous/discrete samples of chain c.
+     */
+    auto cont_chain(size_t c) { return cont_samples.middleRows(c * n_samples(), n_samples()); }
+    auto cont_chain(size_t c) const { return cont_samples.middleRows(c * n_samples(), n_samples()); }
+    auto disc_chain(size_t c) { return disc_samples.middleRows(c * n_samples(), n_samples()); }
+    auto disc_chain(size_t c) const { return disc_samples.middleRows(c * n_samples(), n_samples()); }
+
+    /**
+     * Keeps only the first n samples of every chain (if n < n_samples()).
+     * The kept samples of every chain are moved to their new rows in increasing order,
+     * which never overwrites a row that is still to be moved.
+     */
+    void truncate(size_t n)
+    {
+        const size_t n_old = n_samples();
+        if (n >= n_old) return;
+        for (size_t c = 1; c < n_chains; ++c) {
+            for (size_t i = 0; i < n; ++i) {
+                cont_samples.row(c * n + i) = cont_samples.row(c * n_old + i);
+                disc_samples.row(c * n + i) = disc_samples.row(c * n_old + i);
+                if (log_pdf_samples.size()) {
+                    log_pdf_samples(c * n + i) = log_pdf_samples(c * n_old + i);
+                }
+            }
+        }
+        if (log_pdf_samples.size()) log_pdf_samples.conservativeResize(n * n_chains);
+        cont_samples.conservativeResize(n * n_chains, cont_samples.cols());
+        disc_samples.conservativeResize(n * n_chains, disc_samples.cols());
+    }
 };
 
 } // namespace ppl
@@ -13,6 +13,14 @@ inline size_t random_seed()
         (std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+/**
+ * Part of the log-pdf that a (tempered) kernel scales by its inverse temperature beta:
+ * - none:          log p(theta) (beta is always 1)
+ * - joint:         beta * log p(theta) (see pt_)
+ * - likelihood:    log prior(theta) + beta * log likelihood(theta) (see smc_)
+ */
+enum class Tempering { none, joint, likelihood };
+
 /**
  * Accepts or rejects with given probability using UniformDistType
  * object that works with GenType.
@@ -0,0 +1,236 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/mcmc/result.hpp>
+
+namespace ppl {
+
+/**
+ * Statistics of the sampler transition that produced a draw.
+ * Statistics that a sampler does not define are left as NaN (or 0).
+ * log_pdf is the log-pdf of the model at the constrained values of the draw (see ProgramNode::log_pdf),
+ * i.e. with normalizing constants and without the log-jacobians of the parameter transformations.
+ * Samplers only record it if they evaluate this exact value while sampling (e.g. MH);
+ * otherwise it is evaluated when the draw is transformed (see ConstrainedDraw).
+ */
+struct DrawStats
+{
+    double accept_stat = std::numeric_limits<double>::quiet_NaN();  // (average) acceptance probability
+    size_t n_steps = 0;                                             // number of leapfrog steps
+    double step_size = std::numeric_limits<double>::quiet_NaN();    // integrator step size
+    double log_pdf = std::numeric_limits<double>::quiet_NaN();      // log-pdf of the draw (see below)
+};
+
+/**
+ * Base of all sinks.
+ * A sink receives every draw of a streaming sampler (see mcmc::stream_mcmc) as it is produced
+ * instead of the draws being stored in an MCMCResult.
+ * A sink must provide:
+ *
+ *  - init(n_chains, n_draws, n_cont, n_disc): called once before sampling,
+ *    where n_draws is the number of draws per chain that will be written (after thinning),
+ *    n_cont the number of constrained continuous values of a draw (including the log-pdf)
+ *    and n_disc the number of discrete values of a draw.
+ *  - write(chain, cont, disc, stats): called for every kept draw of chain in order,
+ *    where cont holds the constrained continuous values followed by the log-pdf
+ *    (same layout as a row of the result of base_mcmc), disc the discrete values
+ *    and stats the DrawStats of the transition.
+ *    Chains run concurrently, so write must be safe to call concurrently for different chains.
+ *  - finish(): called once after all chains are done.
+ *
+ * Only every thin'th draw of each chain is written (starting with the first).
+ */
+struct SinkBase
+{
+    size_t thin = 1;
+
+    void init(size_t, size_t, size_t, size_t) {}
+    void finish() {}
+
+    /**
+     * Returns the number of draws written per chain out of n_samples draws.
+     */
+    size_t n_draws(size_t n_samples) const
+    {
+        return (n_samples + thin - 1) / thin;
+    }
+};
+
+/**
+ * Sink that drops every draw (e.g. when only timing or side effects are of interest).
+ */
+struct DiscardSink : SinkBase
+{
+    template <class ContType, class DiscType>
+    void write(size_t, const ContType&, const DiscType&, const DrawStats&) {}
+};
+
+/**
+ * Sink that keeps all (thinned) draws in memory.
+ * result has the same layout as the result of base_mcmc
+ * and stats[c * n_draws + i] holds the statistics of draw i of chain c.
+ */
+struct MemorySink : SinkBase
+{
+    void init(size_t n_chains, size_t n_draws, size_t n_cont, size_t n_disc)
+    {
+        result = MCMCResult<>(n_draws, n_cont, n_disc, n_chains);
+        stats.assign(n_chains * n_draws, DrawStats());
+        counts_.assign(n_chains, 0);
+    }
+
+    template <class ContType, class DiscType>
+    void write(size_t chain,
+               const ContType& cont,
+               const DiscType& disc,
+               const DrawStats& draw_stats)
+    {
+        const size_t i = counts_[chain]++;
+        const size_t row = chain * result.n_samples() + i;
+        result.cont_samples.row(row) = cont.transpose();
+        result.disc_samples.row(row) = disc.transpose();
+        stats[row] = draw_stats;
+    }
+
+    MCMCResult<> result;
+    std::vector<DrawStats> stats;
+
+private:
+    std::vector<size_t> counts_;
+};
+
+/**
+ * Sink that writes the draws of chain c to the binary file path(c),
+ * so that only O(n_params) memory is used regardless of the number of draws.
+ * Every file starts with a header of 3 uint64_t values (magic number, n_cont, n_disc)
+ * followed by one record per draw:
+ * n_cont doubles (constrained values followed by the log-pdf),
+ * n_disc util::disc_param_t and the DrawStats as (double, uint64_t, double).
+ * All values are written in native byte order (see read_draws).
+ */
+struct BinaryFileSink : SinkBase
+{
+    static constexpr uint64_t magic = 0x3157415244505050;  // "PPPDRAW1"
+
+    /**
+     * @param   prefix  chain c is written to prefix + "_" + c + ".bin"
+     */
+    BinaryFileSink(const std::string& prefix)
+        : prefix_(prefix)
+    {}
+
+    /**
+     * Returns the path of the file of chain c.
+     */
+    std::string path(size_t c) const
+    {
+        return prefix_ + "_" + std::to_string(c) + ".bin";
+    }
+
+    void init(size_t n_chains, size_t, size_t n_cont, size_t n_disc)
+    {
+        files_.clear();
+        for (size_t c = 0; c < n_chains; ++c) {
+            files_.emplace_back(std::make_unique<std::ofstream>(
+                        path(c), std::ios::binary | std::ios::trunc));
+            write_pod_(*files_.back(), magic);
+            write_pod_(*files_.back(), static_cast<uint64_t>(n_cont));
+            write_pod_(*files_.back(), static_cast<uint64_t>(n_disc));
+        }
+    }
+
+    template <class ContType, class DiscType>
+    void write(size_t chain,
+               const ContType& cont,
+               const DiscType& disc,
+               const DrawStats& stats)
+    {
+        auto& file = *files_[chain];
+        for (Eigen::Index i = 0; i < cont.size(); ++i) write_pod_(file, cont(i));
+        for (Eigen::Index i = 0; i < disc.size(); ++i) write_pod_(file, disc(i));
+        write_pod_(file, stats.accept_stat);
+        write_pod_(file, static_cast<uint64_t>(stats.n_steps));
+        write_pod_(file, stats.step_size);
+    }
+
+    void finish()
+    {
+        for (auto& file : files_) file->close();
+    }
+
+    /**
+     * Returns true if no write to any file has failed.
+     */
+    bool good() const
+    {
+        for (const auto& file : files_) {
+            if (file->fail()) return false;
+        }
+        return true;
+    }
+
+private:
+    template <class T>
+    static void write_pod_(std::ofstream& file, const T& x)
+    {
+        file.write(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+
+    std::string prefix_;
+    std::vector<std::unique_ptr<std::ofstream>> files_;
+};
+
+/**
+ * Reads a file written by BinaryFileSink into a single-chain result and its draw statistics.
+ *
+ * @param   path    path of the file (see BinaryFileSink::path)
+ * @param   res     populated with the draws
+ * @param   stats   populated with the statistics of the draws
+ * @return  false if the file could not be opened or is not a complete draw file
+ */
+inline bool read_draws(const std::string& path,
+                       MCMCResult<>& res,
+                       std::vector<DrawStats>& stats)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    const auto file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    auto read_pod = [&](auto& x) {
+        file.read(reinterpret_cast<char*>(&x), sizeof(x));
+    };
+
+    uint64_t magic = 0, n_cont = 0, n_disc = 0;
+    read_pod(magic);
+    read_pod(n_cont);
+    read_pod(n_disc);
+    if (!file || magic != BinaryFileSink::magic) return false;
+
+    const size_t header_size = 3 * sizeof(uint64_t);
+    const size_t record_size = n_cont * sizeof(double) +
+                               n_disc * sizeof(util::disc_param_t) +
+                               2 * sizeof(double) + sizeof(uint64_t);
+    if ((file_size - header_size) % record_size) return false;
+    const size_t n_draws = (file_size - header_size) / record_size;
+
+    res = MCMCResult<>(n_draws, n_cont, n_disc);
+    stats.assign(n_draws, DrawStats());
+    for (size_t i = 0; i < n_draws; ++i) {
+        for (size_t j = 0; j < n_cont; ++j) read_pod(res.cont_samples(i, j));
+        for (size_t j = 0; j < n_disc; ++j) read_pod(res.disc_samples(i, j));
+        uint64_t n_steps = 0;
+        read_pod(stats[i].accept_stat);
+        read_pod(n_steps);
+        read_pod(stats[i].step_size);
+        stats[i].n_steps = n_steps;
+    }
+    return static_cast<bool>(file);
+}
+
+} // namespace ppl
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/hmc/nuts/configs.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for Sequential Monte Carlo (SMC) with likelihood tempering.
+ * It extends the configuration of the kernel that moves the particles
+ * (NUTSConfig or MHConfig).
+ * stop_config, checkpoint_config, and warm_start_config are not supported
+ * and must be left disabled (smc_ throws std::invalid_argument otherwise).
+ *
+ * The number of particles is samples (per chain) and warmup is not used.
+ * Particles target prior(theta) * likelihood(theta)^beta, where beta increases from 0 to 1.
+ * Every increment of beta is chosen such that the effective sample size
+ * of the incremental weights is target_ess * samples.
+ * After every increment, the particles are resampled
+ * and moved by n_moves transitions of the kernel.
+ */
+template <class KernelConfigType = NUTSConfig<>>
+struct SMCConfig: KernelConfigType
+{
+    using kernel_config_t = KernelConfigType;
+
+    double target_ess = 0.5;
+    size_t n_moves = 5;         // kernel transitions per particle after every resampling
+    size_t n_prior_moves = 20;  // kernel transitions per particle targeting the prior (beta = 0)
+    size_t max_stages = 1000;   // beta is set to 1 at the last stage
+};
+
+} // namespace ppl
@@ -0,0 +1,433 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/math/math.hpp>
+#include <autoppl/mcmc/sampler_tools.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/mh/mh.hpp>
+#include <autoppl/mcmc/hmc/nuts/nuts.hpp>
+#include <autoppl/mcmc/smc/config.hpp>
+
+namespace ppl {
+
+/**
+ * Result of Sequential Monte Carlo.
+ * The samples of every chain are its final (equally weighted) particles.
+ * Additionally, every chain provides an estimate of the log marginal likelihood
+ * log p(data) = log integral of prior(theta) * likelihood(theta)
+ * and the sequence of inverse temperatures it went through.
+ */
+template <int Major = Eigen::ColMajor>
+struct SMCResult: MCMCResult<Major>
+{
+    SMCResult() =default;
+    SMCResult(MCMCResult<Major>&& res)
+        : MCMCResult<Major>(std::move(res))
+    {}
+
+    std::vector<double> log_evidence;       // log marginal likelihood estimate of every chain
+    std::vector<std::vector<double>> betas; // inverse temperatures of every chain
+};
+
+namespace mcmc {
+
+/**
+ * Kernel that moves the particles of SMC:
+ * MHChain if the configuration extends MHConfig and NUTSChain otherwise.
+ * Only the log-likelihood is tempered.
+ */
+template <class ProgramType
+        , class SMCConfigType>
+using smc_kernel_t = std::conditional_t<
+    std::is_base_of_v<MHConfig, SMCConfigType>,
+    MHChain<ProgramType, SMCConfigType, Tempering::likelihood>,
+    NUTSChain<ProgramType, SMCConfigType, Tempering::likelihood> >;
+
+/**
+ * Computes the log-weights (beta_next - beta) * log_liks into log_weights
+ * (NaN log-likelihoods have weight 0)
+ * and returns the effective sample size of the normalized weights.
+ */
+template <class LogLikVecType
+        , class LogWeightVecType>
+inline double smc_log_weights(const LogLikVecType& log_liks,
+                              double delta,
+                              LogWeightVecType& log_weights)
+{
+    log_weights = log_liks.unaryExpr([=](double ll) {
+            return std::isnan(ll) ? math::neg_inf<double> : delta * ll;
+        });
+    const double max_log_weight = log_weights.maxCoeff();
+    if (max_log_weight == math::neg_inf<double>) return 0.;
+    const double sum = (log_weights.array() - max_log_weight).exp().sum();
+    const double sum_sq = (2. * (log_weights.array() - max_log_weight)).exp().sum();
+    return sum * sum / sum_sq;
+}
+
+/**
+ * Returns the next inverse temperature after beta such that
+ * the effective sample size of the incremental weights is target_ess * n_particles,
+ * or 1 if the effective sample size at 1 is at least as large.
+ * The increment is found by bisection.
+ */
+template <class LogLikVecType
+        , class LogWeightVecType>
+inline double smc_next_beta(const LogLikVecType& log_liks,
+                            double beta,
+                            double target_ess,
+                            LogWeightVecType& log_weights)
+{
+    const double target = target_ess * log_liks.size();
+    double lower = 0.;
+    double upper = 1. - beta;
+    if (smc_log_weights(log_liks, upper, log_weights) >= target) return 1.;
+    for (size_t i = 0; i < 50; ++i) {
+        const double mid = 0.5 * (lower + upper);
+        if (smc_log_weights(log_liks, mid, log_weights) >= target) {
+            lower = mid;
+        } else {
+            upper = mid;
+        }
+    }
+    // always make progress
+    return beta + std::max(lower, std::numeric_limits<double>::epsilon());
+}
+
+/**
+ * Systematic resampling of particles (and their log-likelihoods) with the given log-weights.
+ * The resampled particles are written into the buffers and then swapped with the particles.
+ * Particles are kept as-is if every weight is 0.
+ */
+template <class ParticlesType
+        , class LogLikVecType
+        , class LogWeightVecType
+        , class GenType>
+inline void smc_resample(ParticlesType& particles,
+                         LogLikVecType& log_liks,
+                         const LogWeightVecType& log_weights,
+                         ParticlesType& particles_buf,
+                         LogLikVecType& log_liks_buf,
+                         GenType& gen)
+{
+    const double max_log_weight = log_weights.maxCoeff();
+    if (max_log_weight == math::neg_inf<double>) return;
+
+    const size_t n = log_weights.size();
+    const double total = (log_weights.array() - max_log_weight).exp().sum();
+    std::uniform_real_distribution unif_sampler(0., 1.);
+    const double u0 = unif_sampler(gen);
+
+    size_t j = 0;
+    double cum = std::exp(log_weights(0) - max_log_weight) / total;
+    for (size_t i = 0; i < n; ++i) {
+        const double u = (i + u0) / n;
+        while (u > cum && j + 1 < n) {
+            ++j;
+            cum += std::exp(log_weights(j) - max_log_weight) / total;
+        }
+        particles_buf.row(i) = particles.row(j);
+        log_liks_buf(i) = log_liks(j);
+    }
+    particles.swap(particles_buf);
+    log_liks.swap(log_liks_buf);
+}
+
+/**
+ * Runs a single chain of Sequential Monte Carlo with likelihood tempering.
+ *
+ * Particles are initialized by init_params and moved by config.n_prior_moves
+ * kernel transitions targeting the prior (beta = 0), which counts as warmup.
+ * Then, until beta reaches 1, every stage:
+ * - finds the next beta (see smc_next_beta),
+ * - updates the log marginal likelihood estimate with the mean incremental weight,
+ * - resamples the particles (see smc_resample),
+ * - moves every particle by config.n_moves kernel transitions targeting
+ *   prior(theta) * likelihood(theta)^beta.
+ * With NUTS, every stage sets the metric to the (regularized) variance of the particles
+ * and adapts the step size towards config.step_config.delta
+ * using the mean acceptance statistic over all particles.
+ *
+ * Particles are moved concurrently by one kernel per thread.
+ * Before moving particle i at stage s, the kernel is re-seeded from (config.seed, chain, s, i),
+ * so the samples never depend on the number of threads.
+ * Discrete parameters are not supported.
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          SMC configuration object
+ * @param   pack            offset pack result of activating program
+ * @param   chain           chain index. Only chain 0 prints progress.
+ * @param   cont_samples    matrix-like block of size (config.samples x n_cont_params) to populate
+ * @param   shard_ctx       context used to build sharded AD expressions (NUTS only)
+ * @param   pool            thread pool to move particles on
+ * @param   log_evidence    populated with the log marginal likelihood estimate
+ * @param   betas           populated with the inverse temperatures of every stage
+ * @param   warmup_time     populated with the time to initialize the particles
+ * @param   sampling_time   populated with the time to temper the particles
+ */
+template <class ProgramType
+        , class SMCConfigType
+        , class OffsetPackType
+        , class ContSamplesType>
+void smc_chain_(const ProgramType& program,
+                const SMCConfigType& config,
+                const OffsetPackType& pack,
+                size_t chain,
+                ContSamplesType&& cont_samples,
+                util::ShardContext& shard_ctx,
+                util::ThreadPool& pool,
+                double& log_evidence,
+                std::vector<double>& betas,
+                double& warmup_time,
+                double& sampling_time)
+{
+    using kernel_t = smc_kernel_t<ProgramType, SMCConfigType>;
+    using particles_t = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    constexpr bool is_mh = std::is_base_of_v<MHConfig, SMCConfigType>;
+    const size_t n_particles = config.samples;
+    const size_t n_params = std::get<0>(pack).uc_offset;
+    assert(n_particles > 0);
+    assert(std::get<1>(pack).uc_offset == 0);
+
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+    stopwatch_warmup.start();
+
+    // one kernel per thread
+    const size_t n_kernels = std::min(pool.size(), n_particles);
+    std::vector<std::unique_ptr<kernel_t>> kernels(n_kernels);
+    pool.parallel_for(n_kernels, [&](size_t k) {
+        const size_t seed = config.seed + chain + k * config.n_chains;
+        if constexpr (is_mh) {
+            static_cast<void>(shard_ctx);
+            kernels[k] = std::make_unique<kernel_t>(program, config, pack, seed, 0.);
+        } else {
+            kernels[k] = std::make_unique<kernel_t>(program, config, pack, shard_ctx, seed, 0.);
+        }
+    });
+
+    particles_t particles(n_particles, n_params);
+    particles_t particles_buf(n_particles, n_params);
+    Eigen::VectorXd log_liks(n_particles);
+    Eigen::VectorXd log_liks_buf(n_particles);
+    Eigen::VectorXd log_weights(n_particles);
+    Eigen::VectorXd accept_stats(n_particles);
+
+    std::seed_seq seq{config.seed, chain};
+    std::mt19937 gen(seq);
+    double beta = 0.;
+    double log_eps = 0.;
+    if constexpr (!is_mh) {
+        // initial step size is found by the first kernel only
+        log_eps = kernels[0]->step_adapter.log_eps;
+    }
+
+    // moves every particle by n_moves transitions at the current beta
+    // (or initializes it first if init is true)
+    auto move_particles = [&](size_t stage, size_t n_moves, bool init) {
+        pool.parallel_for(n_kernels, [&](size_t k) {
+            auto& kernel = *kernels[k];
+            kernel.beta = beta;
+            if constexpr (!is_mh) kernel.step_adapter.log_eps = log_eps;
+            auto& state = [&]() -> auto& {
+                if constexpr (is_mh) return kernel.cont_curr;
+                else return kernel.theta_curr;
+            }();
+
+            for (size_t i = k; i < n_particles; i += n_kernels) {
+                std::seed_seq particle_seq{config.seed, chain, stage, i};
+                kernel.reseed(particle_seq);
+                if (init) {
+                    if constexpr (is_mh) {
+                        kernel.program_curr_ref.get().init_params(kernel.gen, config.prune);
+                    } else {
+                        kernel.program.init_params(kernel.gen, config.prune);
+                    }
+                } else {
+                    state = particles.row(i).transpose();
+                }
+                kernel.refresh();
+
+                double accept_stat = 0.;
+                for (size_t m = 0; m < n_moves; ++m) {
+                    kernel.transition();
+                    if constexpr (is_mh) {
+                        accept_stat += std::min(1., std::exp(kernel.log_alpha));
+                    } else {
+                        accept_stat += kernel.sum_metro_prob /
+                                       static_cast<double>(kernel.n_leapfrog);
+                    }
+                }
+
+                particles.row(i) = state.transpose();
+                log_liks(i) = kernel.log_lik();
+                accept_stats(i) = (n_moves > 0) ? accept_stat / n_moves : 0.;
+            }
+        });
+
+        // adapt step size to the mean acceptance statistic
+        if constexpr (!is_mh) {
+            if (n_moves > 0) {
+                log_eps += accept_stats.mean() - config.step_config.delta;
+            }
+        }
+    };
+
+    // sets the metric of every kernel to the regularized variance of the particles
+    // (see VarAdapter)
+    auto update_metric = [&]() {
+        if constexpr (!is_mh) {
+            using var_adapter_policy_t = typename kernel_t::var_adapter_policy_t;
+            constexpr bool is_diag = std::is_same_v<var_adapter_policy_t, diag_var>;
+            constexpr bool is_dense = std::is_same_v<var_adapter_policy_t, dense_var>;
+            if constexpr (is_diag || is_dense) {
+                if (n_particles < 2) return;
+                const double n = n_particles;
+                particles_buf = particles.rowwise() - particles.colwise().mean();
+                for (auto& kernel : kernels) {
+                    auto& m_inverse = kernel->momentum_handler.get_m_inverse();
+                    if constexpr (is_diag) {
+                        m_inverse = particles_buf.colwise().squaredNorm().transpose();
+                        m_inverse.array() = ( (n / ((n + 5.0) * (n - 1.))) * m_inverse.array() +
+                                              1e-3 * (5.0 / (n + 5.0)) );
+                    } else {
+                        m_inverse.noalias() = particles_buf.transpose() * particles_buf;
+                        m_inverse *= n / ((n + 5.0) * (n - 1.));
+                        m_inverse.diagonal().array() += 1e-3 * (5.0 / (n + 5.0));
+                    }
+                    kernel->momentum_handler.update_metric();
+                }
+            }
+        }
+    };
+
+    auto logger = util::ProgressLogger(100, "Sequential Monte Carlo",
+                                       std::cout, chain == 0);
+
+    // draw initial particles and move them towards the prior
+    size_t stage = 0;
+    move_particles(stage, config.n_prior_moves, true);
+    log_evidence = 0.;
+    betas.assign(1, beta);
+
+    stopwatch_warmup.stop();
+    stopwatch_sampling.start();
+
+    while (beta < 1.) {
+        ++stage;
+        const double next_beta = (stage >= config.max_stages) ? 1. :
+            smc_next_beta(log_liks, beta, config.target_ess, log_weights);
+        smc_log_weights(log_liks, next_beta - beta, log_weights);
+
+        // log of mean incremental weight
+        const double max_log_weight = log_weights.maxCoeff();
+        log_evidence += max_log_weight +
+            std::log((log_weights.array() - max_log_weight).exp().mean());
+
+        smc_resample(particles, log_liks, log_weights,
+                     particles_buf, log_liks_buf, gen);
+        beta = next_beta;
+        betas.push_back(beta);
+
+        update_metric();
+        move_particles(stage, config.n_moves, false);
+
+        logger.printProgress(static_cast<size_t>(99. * beta));
+    }
+
+    cont_samples = particles;
+
+    stopwatch_sampling.stop();
+
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * Sequential Monte Carlo with likelihood tempering.
+ * Runs config.n_chains independent chains (see smc_chain_) on the thread pool.
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          SMC configuration object
+ * @param   pack            offset pack result of activating program.
+ * @param   res             result object that will be populated with the particles
+ * @param   pool            thread pool to run chains and particle moves on
+ * @param   log_evidence    populated with the log marginal likelihood estimate of every chain
+ * @param   betas           populated with the inverse temperatures of every chain
+ * @throws  std::invalid_argument if the stopping, checkpointing, or warm start
+ *          settings of the kernel configuration are enabled.
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class SMCConfigType = SMCConfig<>>
+void smc_(const ProgramType& program,
+          const SMCConfigType& config,
+          const OffsetPackType& pack,
+          MCMCResultType& res,
+          util::ThreadPool& pool,
+          std::vector<double>& log_evidence,
+          std::vector<std::vector<double>>& betas)
+{
+    // stopping, checkpointing, and warm starts of the kernel configuration
+    // only apply to ppl::nuts and ppl::mh
+    bool unsupported = config.stop_config.enabled ||
+                       config.checkpoint_config.every > 0 ||
+                       config.checkpoint_config.resume;
+    if constexpr (!std::is_base_of_v<MHConfig, SMCConfigType>) {
+        unsupported = unsupported || !config.warm_start_config.states.empty();
+    }
+    if (unsupported) {
+        throw std::invalid_argument(
+                "smc does not support stop_config, checkpoint_config, or warm_start_config");
+    }
+
+    // only the NUTS kernel evaluates sharded AD expressions
+    ShardConfig shard_config;
+    if constexpr (!std::is_base_of_v<MHConfig, SMCConfigType>) {
+        shard_config = config.shard_config;
+    }
+    util::ShardContext shard_ctx(pool, shard_config, std::get<0>(pack));
+    log_evidence.assign(config.n_chains, 0.);
+    betas.assign(config.n_chains, {});
+    run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                smc_chain_(program, config, pack, chain,
+                           res.cont_chain(chain), shard_ctx, pool,
+                           log_evidence[chain], betas[chain],
+                           warmup_time, sampling_time);
+            });
+}
+
+} // namespace mcmc
+
+template <class ExprType
+        , class SMCConfigType = SMCConfig<>>
+inline auto smc(const ExprType& expr,
+                const SMCConfigType& config = SMCConfigType())
+{
+    std::vector<double> log_evidence;
+    std::vector<std::vector<double>> betas;
+    SMCResult<> smc_res(mcmc::base_mcmc(expr, config,
+            [&](const auto& program, const auto& config,
+                const auto& pack, auto& res, auto& pool) {
+                res.name = "smc";
+                mcmc::smc_(program, config, pack, res, pool, log_evidence, betas);
+            }));
+    smc_res.log_evidence = std::move(log_evidence);
+    smc_res.betas = std::move(betas);
+    return smc_res;
+}
+
+} // namespace ppl
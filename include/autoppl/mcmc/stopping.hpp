@@ -0,0 +1,253 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/math/convergence.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for stopping sampling once the chains have converged.
+ * If enabled, the draws so far of all chains are checked every check_every draws (per chain)
+ * and sampling stops as soon as every continuous parameter has
+ * a bulk ESS of at least min_ess and a split R-hat of at most max_rhat
+ * (see math::bulk_ess and math::bulk_rhat).
+ * config.samples is the hard cap on the number of draws per chain.
+ * Diagnostics are computed on the draws stored while sampling
+ * (constrained values for ppl::nuts and ppl::mh, see mcmc::transform_mcmc);
+ * rank-normalization makes them invariant to the (monotone) transformations of scalar constraints.
+ * Streamed draws are not kept, so streaming samplers (e.g. ppl::nuts with a sink)
+ * throw std::invalid_argument if enabled is true.
+ */
+struct StoppingConfig
+{
+    bool enabled = false;
+    size_t check_every = 100;   // draws per chain between convergence checks
+    double min_ess = 400.;      // minimum bulk ESS of every parameter
+    double max_rhat = 1.01;     // maximum split R-hat of every parameter
+};
+
+namespace mcmc {
+
+/**
+ * Throws std::invalid_argument if stop_config is enabled.
+ * Called by streaming samplers (see stream_mcmc) since their draws are not kept.
+ */
+inline void check_stream_stopping(const StoppingConfig& stop_config)
+{
+    if (stop_config.enabled) {
+        throw std::invalid_argument(
+                "stopping once converged is not supported when draws are streamed to a sink");
+    }
+}
+
+/**
+ * Stopping rule that never stops a chain.
+ */
+struct NeverStop
+{
+    bool operator()(size_t) const { return false; }
+};
+
+/**
+ * Decides when chains have converged from the draws stored in a result object
+ * (only the first n_cols columns of the continuous draws are checked).
+ * Chains report every draw they store (see operator()).
+ * Once every chain has stored k * check_every draws (a round is complete),
+ * the chain that completes the round checks convergence on the first k * check_every draws of all chains,
+ * while the other chains continue.
+ * The number of draws to keep is the smallest complete round that has converged,
+ * so it does not depend on how chains are scheduled on threads.
+ *
+ * Chains never wait on each other, hence any number of threads can run the chains.
+ */
+template <class MCMCResultType>
+struct ConvergenceMonitor
+{
+    ConvergenceMonitor(const StoppingConfig& config,
+                       const MCMCResultType& res,
+                       size_t n_cols,
+                       size_t n_chains,
+                       size_t max_draws)
+        : config_(config)
+        , res_(res)
+        , n_cols_(n_cols)
+        , n_chains_(n_chains)
+        , n_stop_(max_draws)
+        , n_complete_(max_draws / std::max<size_t>(config.check_every, 1) + 1, 0)
+    {
+        assert(config.check_every > 0);
+    }
+
+    ConvergenceMonitor(const ConvergenceMonitor&) =delete;
+    ConvergenceMonitor& operator=(const ConvergenceMonitor&) =delete;
+
+    /**
+     * Reports that chain has stored n_draws draws so far.
+     *
+     * @return  true if chain should stop sampling
+     */
+    bool operator()(size_t n_draws)
+    {
+        if (n_draws % config_.check_every == 0 && n_draws < n_stop_) {
+            const size_t round = n_draws / config_.check_every;
+            bool check = false;
+            {
+                std::unique_lock lk(mtx_);
+                check = (++n_complete_[round] == n_chains_);
+            }
+            if (check && converged(n_draws)) {
+                size_t n_stop = n_stop_.load();
+                while (n_draws < n_stop &&
+                       !n_stop_.compare_exchange_weak(n_stop, n_draws)) {}
+            }
+        }
+        return n_draws >= n_stop_.load();
+    }
+
+    /**
+     * Returns true if the first n_draws draws of all chains have converged.
+     * Checks never overlap (a round can only complete after the check of the previous one),
+     * so the ESS estimator is shared by all checks.
+     */
+    bool converged(size_t n_draws)
+    {
+        using mat_t = Eigen::MatrixXd;
+        std::vector<mat_t> draws;
+        for (size_t c = 0; c < n_chains_; ++c) {
+            draws.emplace_back(res_.cont_chain(c).topLeftCorner(n_draws, n_cols_));
+        }
+        math::details::vec_cref_t<double> draws_ref(draws.begin(), draws.end());
+        const auto ess = math::bulk_ess(draws_ref, ess_);
+        const auto rhat = math::bulk_rhat(draws_ref);
+        if (ess.size() == 0 || rhat.size() == 0) return false;
+        return (ess.array() >= config_.min_ess).all() &&
+               (rhat.array() <= config_.max_rhat).all();
+    }
+
+    /**
+     * Returns the number of draws every chain must keep.
+     * Must only be called once all chains have stopped.
+     */
+    size_t n_draws() const { return n_stop_.load(); }
+
+private:
+    const StoppingConfig& config_;
+    const MCMCResultType& res_;
+    size_t n_cols_;
+    size_t n_chains_;
+    std::atomic<size_t> n_stop_;            // number of draws to keep
+    std::mutex mtx_;
+    std::vector<size_t> n_complete_;        // number of chains that completed every round
+    math::ESSEstimator<double> ess_;
+};
+
+namespace details {
+
+template <class ConfigType
+        , class MCMCResultType
+        , class ChainFunc>
+inline void run_chains(const ConfigType& config,
+                       const StoppingConfig& stop_config,
+                       util::ThreadPool& pool,
+                       MCMCResultType& res,
+                       size_t n_cols,
+                       ChainFunc&& f)
+{
+    if (!stop_config.enabled) {
+        mcmc::run_chains(config, pool, res,
+                [&](size_t chain, double& warmup_time, double& sampling_time) {
+                    f(chain, NeverStop(), warmup_time, sampling_time);
+                });
+        return;
+    }
+
+    ConvergenceMonitor<MCMCResultType> monitor(
+            stop_config, res, n_cols, config.n_chains, config.samples);
+    mcmc::run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                f(chain, [&](size_t n) { return monitor(n); },
+                  warmup_time, sampling_time);
+            });
+    res.truncate(monitor.n_draws());
+}
+
+} // namespace details
+
+/**
+ * Runs config.n_chains independent chains on the thread pool (see run_chains)
+ * that may stop early according to stop_config.
+ * The functor is called as f(chain, stop, warmup_time, sampling_time)
+ * where stop(n) must be called after every stored draw (n is the number of draws stored so far)
+ * and the chain must stop sampling if it returns true.
+ * Afterwards, res only keeps the draws up to the stopping point of every chain.
+ *
+ * @param   config          configuration object (only n_chains and samples are used)
+ * @param   stop_config     stopping configuration
+ * @param   pool            thread pool to run chains on
+ * @param   res             result object whose draws are checked
+ * @param   f               functor that runs a single chain
+ */
+template <class ConfigType
+        , int Major
+        , class ChainFunc>
+inline void run_chains(const ConfigType& config,
+                       const StoppingConfig& stop_config,
+                       util::ThreadPool& pool,
+                       MCMCResult<Major>& res,
+                       ChainFunc&& f)
+{
+    details::run_chains(config, stop_config, pool, res,
+                        res.cont_samples.cols(), f);
+}
+
+/**
+ * Overload for draws transformed as they are produced (see transform_mcmc).
+ * The log-pdf column is not checked.
+ */
+template <class ConfigType
+        , class ProgramType
+        , class OffsetPackType
+        , class ChainFunc>
+inline void run_chains(const ConfigType& config,
+                       const StoppingConfig& stop_config,
+                       util::ThreadPool& pool,
+                       TransformOutput<ProgramType, OffsetPackType>& out,
+                       ChainFunc&& f)
+{
+    details::run_chains(config, stop_config, pool, out,
+                        out.cont_samples.cols() - 1, f);
+}
+
+/**
+ * Overload for streamed draws (see stream_mcmc).
+ * Since draws are not kept, stopping early is not supported
+ * and std::invalid_argument is thrown if stop_config is enabled.
+ */
+template <class ConfigType
+        , class SinkType
+        , class ProgramType
+        , class OffsetPackType
+        , class ChainFunc>
+inline void run_chains(const ConfigType& config,
+                       const StoppingConfig& stop_config,
+                       util::ThreadPool& pool,
+                       SinkOutput<SinkType, ProgramType, OffsetPackType>& out,
+                       ChainFunc&& f)
+{
+    check_stream_stopping(stop_config);
+    run_chains(config, pool, out,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                f(chain, NeverStop(), warmup_time, sampling_time);
+            });
+}
+
+} // namespace mcmc
+} // namespace ppl
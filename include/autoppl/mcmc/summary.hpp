@@ -0,0 +1,177 @@
+#pragma once
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/math/welford.hpp>
+#include <autoppl/math/quantile.hpp>
+#include <autoppl/math/mcse.hpp>
+#include <autoppl/mcmc/sink.hpp>
+
+namespace ppl {
+
+/**
+ * Posterior summary of every continuous value of a draw
+ * (constrained values followed by the log-pdf, see SinkBase).
+ * Column j of quantiles holds the estimates of the probs-quantiles of value j.
+ */
+struct Summary
+{
+    size_t n_draws = 0;             // number of draws summarized
+    Eigen::VectorXd mean;           // sample mean
+    Eigen::VectorXd variance;       // sample variance
+    Eigen::VectorXd mcse;           // Monte Carlo standard error of the mean (batch means)
+    std::vector<double> probs;      // probabilities of the quantiles
+    Eigen::MatrixXd quantiles;      // (probs.size() x n_values)
+};
+
+/**
+ * Sink that only accumulates summaries of the (thinned) draws of every chain
+ * instead of storing them, so that memory and post-processing time
+ * do not grow with the number of draws.
+ * For every continuous value, it updates
+ *
+ *  - mean and variance (math::WelfordVar),
+ *  - MCSE of the mean with batches of floor(sqrt(n_draws)) draws (math::BatchMeans),
+ *  - quantiles at probs (math::P2Quantile).
+ *
+ * Discrete values are not summarized.
+ */
+struct SummarySink : SinkBase
+{
+    SummarySink(const std::vector<double>& probs = {0.05, 0.5, 0.95})
+        : probs_(probs)
+    {}
+
+    void init(size_t n_chains, size_t n_draws, size_t n_cont, size_t)
+    {
+        const size_t batch_size = std::floor(std::sqrt(static_cast<double>(n_draws)));
+        chains_.clear();
+        chains_.reserve(n_chains);
+        for (size_t c = 0; c < n_chains; ++c) {
+            chains_.emplace_back(n_cont, batch_size, probs_);
+        }
+    }
+
+    template <class ContType, class DiscType>
+    void write(size_t chain,
+               const ContType& cont,
+               const DiscType&,
+               const DrawStats&)
+    {
+        chains_[chain].update(cont);
+    }
+
+    /**
+     * Returns the number of chains being summarized.
+     */
+    size_t n_chains() const { return chains_.size(); }
+
+    /**
+     * Returns the summary of the draws of chain c.
+     */
+    Summary summary(size_t c) const
+    {
+        const auto& acc = chains_[c];
+        const size_t n_values = acc.welford.get_mean().size();
+        const size_t n = acc.welford.get_n_samples();
+
+        Summary res;
+        res.n_draws = n;
+        res.mean = acc.welford.get_mean();
+        res.variance = (n > 1) ?
+            Eigen::VectorXd(acc.welford.get_variance() / static_cast<double>(n - 1)) :
+            Eigen::VectorXd::Constant(n_values, std::numeric_limits<double>::quiet_NaN());
+        res.mcse.resize(n_values);
+        acc.batch_means.get_mcse(res.mcse);
+        res.probs = probs_;
+        res.quantiles.resize(probs_.size(), n_values);
+        for (size_t j = 0; j < n_values; ++j) {
+            for (size_t k = 0; k < probs_.size(); ++k) {
+                res.quantiles(k, j) = acc.quantiles[j * probs_.size() + k].get_quantile();
+            }
+        }
+        return res;
+    }
+
+    /**
+     * Returns the summary of the draws of all chains.
+     * Means and variances are exactly those of the pooled draws,
+     * the MCSE treats the chain means as independent,
+     * and quantiles are the averages of the chain quantiles (weighted by the number of draws).
+     */
+    Summary summary() const
+    {
+        Summary res;
+        res.probs = probs_;
+        if (chains_.empty()) return res;
+
+        std::vector<Summary> chain_res;
+        for (size_t c = 0; c < chains_.size(); ++c) {
+            chain_res.emplace_back(summary(c));
+            res.n_draws += chain_res.back().n_draws;
+        }
+
+        const auto n_values = chain_res[0].mean.size();
+        const double n = res.n_draws;
+        res.mean = Eigen::VectorXd::Zero(n_values);
+        res.quantiles = Eigen::MatrixXd::Zero(probs_.size(), n_values);
+        for (const auto& r : chain_res) {
+            res.mean += (r.n_draws / n) * r.mean;
+            res.quantiles += (r.n_draws / n) * r.quantiles;
+        }
+
+        // sum of squared deviations of pooled draws (Chan et al.)
+        Eigen::VectorXd m2n = Eigen::VectorXd::Zero(n_values);
+        Eigen::VectorXd mcse_sq = Eigen::VectorXd::Zero(n_values);
+        for (size_t c = 0; c < chains_.size(); ++c) {
+            const auto& r = chain_res[c];
+            m2n += chains_[c].welford.get_variance() +
+                   r.n_draws * (r.mean - res.mean).cwiseAbs2();
+            mcse_sq += (r.n_draws / n) * (r.n_draws / n) * r.mcse.cwiseAbs2();
+        }
+        res.variance = (n > 1) ?
+            Eigen::VectorXd(m2n / (n - 1.)) :
+            Eigen::VectorXd::Constant(n_values, std::numeric_limits<double>::quiet_NaN());
+        res.mcse = mcse_sq.cwiseSqrt();
+        return res;
+    }
+
+private:
+    struct ChainAccumulator
+    {
+        ChainAccumulator(size_t n_values,
+                         size_t batch_size,
+                         const std::vector<double>& probs)
+            : welford(n_values)
+            , batch_means(n_values, batch_size)
+        {
+            quantiles.reserve(n_values * probs.size());
+            for (size_t j = 0; j < n_values; ++j) {
+                for (double p : probs) quantiles.emplace_back(p);
+            }
+        }
+
+        template <class ContType>
+        void update(const ContType& cont)
+        {
+            welford.update(cont);
+            batch_means.update(cont);
+            const size_t n_probs = quantiles.size() / cont.size();
+            for (Eigen::Index j = 0; j < cont.size(); ++j) {
+                for (size_t k = 0; k < n_probs; ++k) {
+                    quantiles[j * n_probs + k].update(cont(j));
+                }
+            }
+        }
+
+        math::WelfordVar welford;
+        math::BatchMeans batch_means;
+        std::vector<math::P2Quantile> quantiles;    // quantiles[j * n_probs + k] for value j, probs[k]
+    };
+
+    std::vector<double> probs_;
+    std::vector<ChainAccumulator> chains_;
+};
+
+} // namespace ppl
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/optim/lbfgs.hpp>
+#include <autoppl/util/sharding.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for finding the posterior mode with L-BFGS (see ppl::optimize).
+ * Every chain minimizes the negative log-pdf over the unconstrained space
+ * starting from its own random initialization (chain c is seeded with seed + c),
+ * i.e. chains are independent restarts.
+ * warmup and samples are ignored: every chain stores exactly one row, namely its optimum.
+ *
+ * If jacobian is false (default), the log-jacobians of the parameter transformations
+ * are omitted, so that the result is the mode of the posterior in the constrained space
+ * (maximum a posteriori estimate).
+ * Otherwise, the result is the mode of the posterior density of the unconstrained parameters
+ * (mapped back to the constrained space), which is the center of a Laplace approximation.
+ */
+struct OptimizeConfig: ConfigBase
+{
+    bool jacobian = false;
+
+    // configuration for L-BFGS
+    LBFGSConfig lbfgs_config;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+};
+
+/**
+ * User configuration for the Laplace approximation (see ppl::laplace).
+ * Every chain first finds a mode with L-BFGS as in OptimizeConfig,
+ * then approximates the posterior of the unconstrained parameters by N(mode, H^{-1})
+ * where H is the Hessian of the negative log-pdf at the mode,
+ * and finally draws samples points from it (warmup is not used).
+ *
+ * The Hessian is computed by central finite differences of the gradient
+ * with step fd_step * max(1, |mode_i|) in direction i.
+ * If it is not positive-definite, it is regularized by adding a multiple of the identity.
+ * jacobian is true by default, since the approximation lives in the unconstrained space.
+ */
+struct LaplaceConfig: ConfigBase
+{
+    bool jacobian = true;
+    double fd_step = 6e-6;
+
+    // configuration for L-BFGS
+    LBFGSConfig lbfgs_config;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+};
+
+} // namespace ppl
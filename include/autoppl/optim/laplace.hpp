@@ -0,0 +1,291 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/optim/lbfgs.hpp>
+#include <autoppl/optim/objective.hpp>
+#include <autoppl/optim/config.hpp>
+#include <autoppl/optim/optimize.hpp>
+
+namespace ppl {
+
+/**
+ * Reason why a chain of the Laplace approximation succeeded or failed.
+ * The draws of a chain that failed are NaN.
+ *
+ *  - mode_failed: L-BFGS failed (LBFGSStatus::error) or the mode is not finite.
+ *  - hessian_not_finite: the finite difference Hessian has NaN or Inf entries.
+ *  - hessian_not_pd: the Hessian is not positive-definite
+ *    even after regularization (see optim::regularized_llt).
+ */
+enum class LaplaceStatus
+{
+    success,
+    mode_failed,
+    hessian_not_finite,
+    hessian_not_pd
+};
+
+namespace optim {
+
+/**
+ * Computes the Hessian of f at x by central finite differences of its gradient:
+ * column i is (grad(x + h_i e_i) - grad(x - h_i e_i)) / (2 h_i)
+ * where h_i = step * max(1, |x_i|).
+ * The result is symmetrized.
+ *
+ * @param   f           objective such that f(x, grad) returns the value at x
+ *                      and writes the gradient at x into grad
+ * @param   x           point at which the Hessian is computed
+ * @param   step        relative finite difference step
+ * @param   hessian     matrix of size (n x n) populated with the Hessian
+ */
+template <class ObjFunc>
+inline void fd_hessian(ObjFunc&& f,
+                       const Eigen::VectorXd& x,
+                       double step,
+                       Eigen::MatrixXd& hessian)
+{
+    const auto n = x.size();
+    Eigen::VectorXd x_step = x;
+    Eigen::VectorXd grad_plus(n);
+    Eigen::VectorXd grad_minus(n);
+    for (Eigen::Index i = 0; i < n; ++i) {
+        const double h = step * std::max(1., std::abs(x(i)));
+        x_step(i) = x(i) + h;
+        f(x_step, grad_plus);
+        x_step(i) = x(i) - h;
+        f(x_step, grad_minus);
+        x_step(i) = x(i);
+        hessian.col(i) = (grad_plus - grad_minus) / (2. * h);
+    }
+    hessian = 0.5 * (hessian + hessian.transpose()).eval();
+}
+
+/**
+ * Computes the Cholesky factorization of the symmetric matrix hessian.
+ * If it is not positive-definite, the smallest multiple tau of the identity
+ * (doubling from 1e-8 * max(1, max_i |H_ii|), at most max_doublings times)
+ * that makes it so is added.
+ *
+ * @param   hessian     symmetric matrix to factorize
+ * @param   llt         populated with the factorization of hessian + tau * I
+ * @return  hessian_not_finite if hessian has non-finite entries (llt is untouched),
+ *          hessian_not_pd if no tau succeeded, and success otherwise.
+ */
+inline LaplaceStatus regularized_llt(const Eigen::MatrixXd& hessian,
+                                     Eigen::LLT<Eigen::MatrixXd>& llt)
+{
+    constexpr size_t max_doublings = 64;
+    if (!hessian.allFinite()) return LaplaceStatus::hessian_not_finite;
+
+    const auto n = hessian.rows();
+    llt.compute(hessian);
+    double tau = 1e-8 * std::max(1., hessian.diagonal().cwiseAbs().maxCoeff());
+    for (size_t k = 0; (llt.info() != Eigen::Success) && (k < max_doublings); ++k) {
+        llt.compute(hessian + tau * Eigen::MatrixXd::Identity(n, n));
+        tau *= 2.;
+    }
+    return (llt.info() == Eigen::Success) ? 
+        LaplaceStatus::success : LaplaceStatus::hessian_not_pd;
+}
+
+/**
+ * Runs a single chain of the Laplace approximation.
+ * The mode is found as in optimize_chain_, the Hessian H of the negative log-pdf
+ * at the mode is computed with fd_hessian and its Cholesky factor L (H = L L^T)
+ * gives the draws mode + L^{-T} z where z ~ N(0, I).
+ * If H is not positive-definite, it is regularized (see regularized_llt).
+ * If the mode or the factorization cannot be found, every draw is NaN
+ * and laplace_status reports why.
+ *
+ * @tparam  Jacobian        if true, log-jacobians of the parameter transformations are included
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          Laplace configuration object
+ * @param   pack            offset pack result of activating program.
+ * @param   chain           chain index (seeds initialization and draws). Only chain 0 prints progress.
+ * @param   samples         matrix-like block of size (config.samples x n_params) to populate
+ * @param   shard_ctx       context used to build sharded AD expressions
+ * @param   log_pdf         populated with the log-pdf at the mode
+ * @param   n_iter          populated with the number of L-BFGS iterations
+ * @param   status          populated with the reason of termination of L-BFGS
+ * @param   laplace_status  populated with the outcome of the approximation
+ * @param   warmup_time     populated with the time to find the mode and Hessian
+ * @param   sampling_time   populated with the time to draw samples
+ */
+template <bool Jacobian
+        , class ProgramType
+        , class LaplaceConfigType
+        , class OffsetPackType
+        , class SamplesType>
+void laplace_chain_(ProgramType& program,
+                    const LaplaceConfigType& config,
+                    const OffsetPackType& pack,
+                    size_t chain,
+                    SamplesType&& samples,
+                    util::ShardContext& shard_ctx,
+                    double& log_pdf,
+                    size_t& n_iter,
+                    LBFGSStatus& status,
+                    LaplaceStatus& laplace_status,
+                    double& warmup_time,
+                    double& sampling_time)
+{
+    assert(std::get<1>(pack).uc_offset == 0);
+    assert(std::get<1>(pack).tp_offset == 0);
+    assert(std::get<1>(pack).c_offset == 0);
+    assert(std::get<1>(pack).v_offset == 0);
+
+    const size_t n_params = std::get<0>(pack).uc_offset;
+
+    std::mt19937 gen(config.seed + chain);
+    std::normal_distribution norm_sampler(0., 1.);
+
+    NegLogPdf<Jacobian, ProgramType> objective(program, std::get<0>(pack), shard_ctx);
+    Eigen::VectorXd mode(n_params);
+    objective.init_params(mode, gen, config.prune);
+
+    auto logger = util::ProgressLogger(config.lbfgs_config.max_iter, "L-BFGS",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    stopwatch_warmup.start();
+
+    LBFGS lbfgs(n_params, config.lbfgs_config);
+    status = lbfgs.minimize(objective, mode, [&](const LBFGS& state) {
+        logger.printProgress(state.n_iter() - 1);
+    });
+    log_pdf = -lbfgs.value();
+    n_iter = lbfgs.n_iter();
+
+    Eigen::LLT<Eigen::MatrixXd> llt(n_params);
+    laplace_status = LaplaceStatus::mode_failed;
+    if (status != LBFGSStatus::error && mode.allFinite()) {
+        Eigen::MatrixXd hessian(n_params, n_params);
+        fd_hessian(objective, mode, config.fd_step, hessian);
+        laplace_status = regularized_llt(hessian, llt);
+    }
+
+    stopwatch_warmup.stop();
+    stopwatch_sampling.start();
+
+    if (laplace_status == LaplaceStatus::success) {
+        Eigen::VectorXd z(n_params);
+        for (size_t i = 0; i < config.samples; ++i) {
+            z = Eigen::VectorXd::NullaryExpr(n_params,
+                    [&]() { return norm_sampler(gen); });
+            llt.matrixU().solveInPlace(z);
+            samples.row(i) = mode + z;
+        }
+    } else {
+        samples.setConstant(std::numeric_limits<double>::quiet_NaN());
+    }
+
+    stopwatch_sampling.stop();
+
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * Laplace approximation of the posterior around its mode.
+ * Runs config.n_chains independent chains on the thread pool.
+ * Every chain is given its own copy of the program since the program
+ * gets bound to buffers owned by the chain.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      Laplace configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object that will be populated with draws and other information.
+ * @param   pool        thread pool to run chains (and shards) on
+ * @param   log_pdf     populated with the log-pdf at the mode of every chain
+ * @param   n_iter      populated with the number of L-BFGS iterations of every chain
+ * @param   status      populated with the reason of termination of L-BFGS of every chain
+ * @param   laplace_status  populated with the outcome of the approximation of every chain
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class LaplaceConfigType = LaplaceConfig>
+void laplace_(const ProgramType& program,
+              const LaplaceConfigType& config,
+              const OffsetPackType& pack,
+              MCMCResultType& res,
+              util::ThreadPool& pool,
+              std::vector<double>& log_pdf,
+              std::vector<size_t>& n_iter,
+              std::vector<LBFGSStatus>& status,
+              std::vector<LaplaceStatus>& laplace_status)
+{
+    log_pdf.assign(config.n_chains, 0.);
+    n_iter.assign(config.n_chains, 0);
+    status.assign(config.n_chains, LBFGSStatus::max_iter);
+    laplace_status.assign(config.n_chains, LaplaceStatus::success);
+    util::ShardContext shard_ctx(pool, config.shard_config, std::get<0>(pack));
+    mcmc::run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                ProgramType chain_program = program;
+                auto run = [&](auto jacobian) {
+                    laplace_chain_<decltype(jacobian)::value>(
+                            chain_program, config, pack, chain,
+                            res.cont_chain(chain), shard_ctx,
+                            log_pdf[chain], n_iter[chain], status[chain],
+                            laplace_status[chain], warmup_time, sampling_time);
+                };
+                if (config.jacobian) run(std::true_type());
+                else run(std::false_type());
+            });
+}
+
+} // namespace optim
+
+/**
+ * Result of the Laplace approximation (see laplace).
+ * The draws of chain c are NaN if laplace_status[c] is not success.
+ */
+template <int Major = Eigen::ColMajor>
+struct LaplaceResult: OptimizeResult<Major>
+{
+    LaplaceResult() =default;
+    LaplaceResult(MCMCResult<Major>&& res)
+        : OptimizeResult<Major>(std::move(res))
+    {}
+
+    std::vector<LaplaceStatus> laplace_status;  // outcome of the approximation of every chain
+};
+
+template <class ExprType
+        , class LaplaceConfigType = LaplaceConfig>
+inline auto laplace(const ExprType& expr,
+                    const LaplaceConfigType& config = LaplaceConfigType())
+{
+    std::vector<double> log_pdf;
+    std::vector<size_t> n_iter;
+    std::vector<LBFGSStatus> status;
+    std::vector<LaplaceStatus> laplace_status;
+    LaplaceResult<> laplace_res(mcmc::base_mcmc(expr, config,
+            [&](const auto& program, const auto& config,
+                const auto& pack, auto& res, auto& pool) {
+                res.name = "laplace";
+                optim::laplace_(program, config, pack, res, pool,
+                                log_pdf, n_iter, status, laplace_status);
+            }));
+    laplace_res.log_pdf = std::move(log_pdf);
+    laplace_res.n_iter = std::move(n_iter);
+    laplace_res.status = std::move(status);
+    laplace_res.laplace_status = std::move(laplace_status);
+    return laplace_res;
+}
+
+} // namespace ppl
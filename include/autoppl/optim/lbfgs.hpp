@@ -0,0 +1,366 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <Eigen/Dense>
+
+namespace ppl {
+
+/**
+ * User configuration for L-BFGS.
+ * history is the number of most recent correction pairs used to approximate the inverse Hessian.
+ * The first iteration (and every iteration after the history is reset)
+ * takes a steepest descent step whose line search starts at init_alpha.
+ *
+ * The minimization stops once one of the following holds
+ * between two consecutive iterates x_{k-1}, x_k:
+ * - |f_k - f_{k-1}| < tol_obj
+ * - |f_k - f_{k-1}| / max(|f_{k-1}|, |f_k|, 1) < tol_rel_obj * machine epsilon
+ * - ||grad_k|| < tol_grad
+ * - grad_k^T H_k grad_k / max(|f_k|, 1) < tol_rel_grad * machine epsilon
+ *   where H_k is the current inverse Hessian approximation
+ * - ||x_k - x_{k-1}|| < tol_param
+ */
+struct LBFGSConfig
+{
+    size_t max_iter = 2000;
+    size_t history = 5;
+    double init_alpha = 1e-3;
+    double tol_obj = 1e-12;
+    double tol_rel_obj = 1e4;
+    double tol_grad = 1e-8;
+    double tol_rel_grad = 1e7;
+    double tol_param = 1e-8;
+};
+
+/**
+ * Reason why L-BFGS terminated (see LBFGSConfig).
+ * error means that the objective is not finite at the initial point.
+ */
+enum class LBFGSStatus
+{
+    max_iter,
+    tol_obj,
+    tol_rel_obj,
+    tol_grad,
+    tol_rel_grad,
+    tol_param,
+    line_search_failed,
+    error
+};
+
+namespace optim {
+
+/**
+ * History of the m most recent correction pairs
+ * s_k = x_{k+1} - x_k and y_k = grad_{k+1} - grad_k
+ * that defines the L-BFGS approximation of the inverse Hessian.
+ * The pairs are stored in a circular buffer such that updates never allocate.
+ */
+struct LBFGSHistory
+{
+    LBFGSHistory(size_t n_params, size_t m)
+        : s_(n_params, m)
+        , y_(n_params, m)
+        , rho_(m)
+        , alpha_(m)
+    {}
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return s_.cols(); }
+    void clear() { size_ = 0; }
+
+    /**
+     * Returns the k'th stored correction pair (k = 0 is the oldest).
+     */
+    auto s(size_t k) const { return s_.col(index(k)); }
+    auto y(size_t k) const { return y_.col(index(k)); }
+
+    /**
+     * Adds the correction pair (s, y).
+     * The pair is skipped if the curvature condition s^T y > 0 does not hold (numerically),
+     * which keeps the inverse Hessian approximation positive-definite.
+     *
+     * @return  true if the pair was added
+     */
+    template <class SType, class YType>
+    bool update(const Eigen::MatrixBase<SType>& s,
+                const Eigen::MatrixBase<YType>& y)
+    {
+        if (capacity() == 0) return false;
+        const double sy = s.dot(y);
+        if (!(sy > std::numeric_limits<double>::epsilon() * y.squaredNorm())) {
+            return false;
+        }
+        const size_t k = (begin_ + size_) % capacity();
+        s_.col(k) = s;
+        y_.col(k) = y;
+        rho_(k) = 1. / sy;
+        if (size_ < capacity()) ++size_;
+        else begin_ = (begin_ + 1) % capacity();
+        return true;
+    }
+
+    /**
+     * Computes the search direction dir = -H grad with the two-loop recursion,
+     * where H is the inverse Hessian approximation with initial scaling
+     * s^T y / y^T y of the most recent pair.
+     * If the history is empty, H is the identity.
+     */
+    template <class GradType, class DirType>
+    void direction(const Eigen::MatrixBase<GradType>& grad,
+                   Eigen::MatrixBase<DirType>& dir) const
+    {
+        dir = -grad;
+        if (size_ == 0) return;
+        for (size_t k = size_; k-- > 0;) {
+            const size_t j = index(k);
+            alpha_(j) = rho_(j) * s_.col(j).dot(dir);
+            dir -= alpha_(j) * y_.col(j);
+        }
+        const size_t last = index(size_ - 1);
+        dir *= 1. / (rho_(last) * y_.col(last).squaredNorm());
+        for (size_t k = 0; k < size_; ++k) {
+            const size_t j = index(k);
+            const double beta = rho_(j) * y_.col(j).dot(dir);
+            dir += (alpha_(j) - beta) * s_.col(j);
+        }
+    }
+
+private:
+    size_t index(size_t k) const { return (begin_ + k) % capacity(); }
+
+    Eigen::MatrixXd s_;
+    Eigen::MatrixXd y_;
+    Eigen::VectorXd rho_;
+    mutable Eigen::VectorXd alpha_;     // buffer of the two-loop recursion
+    size_t begin_ = 0;
+    size_t size_ = 0;
+};
+
+/**
+ * Minimizer of the safeguarded cubic interpolating (a0, f0, d0) and (a1, f1, d1)
+ * where f is the objective and d the directional derivative at step a.
+ * Falls back to bisection if the cubic has no minimizer
+ * or if it is too close to either end of the interval.
+ */
+inline double cubic_interpolate(double a0, double f0, double d0,
+                                double a1, double f1, double d1)
+{
+    const double lo = std::min(a0, a1);
+    const double hi = std::max(a0, a1);
+    const double mid = 0.5 * (a0 + a1);
+    if (!std::isfinite(f0) || !std::isfinite(f1)) return mid;
+    const double e1 = d0 + d1 - 3. * (f0 - f1) / (a0 - a1);
+    const double disc = e1 * e1 - d0 * d1;
+    if (!(disc >= 0.)) return mid;
+    const double e2 = std::copysign(std::sqrt(disc), a1 - a0);
+    const double a = a1 - (a1 - a0) * (d1 + e2 - e1) / (d1 - d0 + 2. * e2);
+    const double margin = 0.1 * (hi - lo);
+    if (!std::isfinite(a) || (a < lo + margin) || (a > hi - margin)) return mid;
+    return a;
+}
+
+/**
+ * Line search along dir from x satisfying the strong Wolfe conditions
+ *      f(x + a dir) <= f(x) + c1 a grad^T dir
+ *      |grad(x + a dir)^T dir| <= c2 |grad^T dir|
+ * (Nocedal and Wright, Algorithm 3.5 and 3.6).
+ * Steps at which f is not finite are treated as steps that increase f.
+ *
+ * @param   f           objective such that f(x, grad) returns the value at x
+ *                      and writes the gradient at x into grad
+ * @param   x           current point
+ * @param   fx          value of f at x
+ * @param   grad        gradient of f at x
+ * @param   dir         descent direction
+ * @param   alpha       initial step size. Populated with the accepted step size.
+ * @param   x_new       populated with x + alpha dir
+ * @param   f_new       populated with f(x_new)
+ * @param   grad_new    populated with the gradient of f at x_new
+ * @param   max_evals   maximum number of evaluations of f
+ * @return  true if a step satisfying the strong Wolfe conditions was found
+ */
+template <class ObjFunc>
+inline bool wolfe_line_search(ObjFunc&& f,
+                              const Eigen::VectorXd& x,
+                              double fx,
+                              const Eigen::VectorXd& grad,
+                              const Eigen::VectorXd& dir,
+                              double& alpha,
+                              Eigen::VectorXd& x_new,
+                              double& f_new,
+                              Eigen::VectorXd& grad_new,
+                              size_t max_evals = 40,
+                              double c1 = 1e-4,
+                              double c2 = 0.9)
+{
+    const double d0 = grad.dot(dir);
+    if (!(d0 < 0.)) return false;
+
+    auto eval = [&](double a) {
+        x_new = x + a * dir;
+        f_new = f(x_new, grad_new);
+        return std::isfinite(f_new) ? grad_new.dot(dir) :
+                                      std::numeric_limits<double>::quiet_NaN();
+    };
+    auto sufficient_decrease = [&](double a) {
+        return std::isfinite(f_new) && (f_new <= fx + c1 * a * d0);
+    };
+    auto curvature = [&](double d) { return std::abs(d) <= -c2 * d0; };
+
+    // bracketing phase: [a_lo, a_hi] is found such that it contains an acceptable step
+    double a_lo = 0., f_lo = fx, d_lo = d0;
+    double a_hi = 0., f_hi = fx, d_hi = d0;
+    bool bracketed = false;
+    size_t n_evals = 0;
+
+    for (double a = alpha; n_evals < max_evals; ++n_evals) {
+        const double d = eval(a);
+        if (!sufficient_decrease(a) || (n_evals > 0 && f_new >= f_lo)) {
+            a_hi = a; f_hi = f_new; d_hi = d;
+            bracketed = true;
+            ++n_evals;
+            break;
+        }
+        if (curvature(d)) { alpha = a; return true; }
+        if (d >= 0.) {
+            a_hi = a_lo; f_hi = f_lo; d_hi = d_lo;
+            a_lo = a; f_lo = f_new; d_lo = d;
+            bracketed = true;
+            ++n_evals;
+            break;
+        }
+        a_lo = a; f_lo = f_new; d_lo = d;
+        a *= 2.;
+    }
+    if (!bracketed) return false;
+
+    // zoom phase: shrink [a_lo, a_hi] while f(a_lo) is the lowest value satisfying
+    // sufficient decrease and d_lo (a_hi - a_lo) < 0
+    for (; n_evals < max_evals; ++n_evals) {
+        const double a = cubic_interpolate(a_lo, f_lo, d_lo, a_hi, f_hi, d_hi);
+        const double d = eval(a);
+        if (!sufficient_decrease(a) || (f_new >= f_lo)) {
+            a_hi = a; f_hi = f_new; d_hi = d;
+        } else {
+            if (curvature(d)) { alpha = a; return true; }
+            if (d * (a_hi - a_lo) >= 0.) {
+                a_hi = a_lo; f_hi = f_lo; d_hi = d_lo;
+            }
+            a_lo = a; f_lo = f_new; d_lo = d;
+        }
+        if (std::abs(a_hi - a_lo) <=
+            std::numeric_limits<double>::epsilon() * std::abs(a_lo)) break;
+    }
+    return false;
+}
+
+/**
+ * L-BFGS minimizer (Nocedal and Wright, Algorithm 7.5)
+ * with a strong Wolfe line search (see wolfe_line_search).
+ * If the line search fails, the history is reset and a steepest descent step is tried
+ * before giving up.
+ * All buffers are allocated once at construction.
+ */
+struct LBFGS
+{
+    LBFGS(size_t n_params, const LBFGSConfig& config = LBFGSConfig())
+        : config_(config)
+        , history_(n_params, config.history)
+        , grad_(n_params)
+        , x_new_(n_params)
+        , grad_new_(n_params)
+        , dir_(n_params)
+        , s_(n_params)
+        , y_(n_params)
+    {}
+
+    /**
+     * Minimizes f starting at x.
+     * After every iteration, callback(*this) is called
+     * where x holds the current iterate (see also value(), grad(), history()).
+     *
+     * @param   f           objective such that f(x, grad) returns the value at x
+     *                      and writes the gradient at x into grad
+     * @param   x           initial point. Populated with the last iterate.
+     * @param   callback    functor called after every iteration
+     * @return  reason of termination
+     */
+    template <class ObjFunc
+            , class CallbackType>
+    LBFGSStatus minimize(ObjFunc&& f,
+                         Eigen::VectorXd& x,
+                         CallbackType&& callback)
+    {
+        const double eps = std::numeric_limits<double>::epsilon();
+        history_.clear();
+        n_iter_ = 0;
+        value_ = f(x, grad_);
+        if (!std::isfinite(value_) || !grad_.allFinite()) return LBFGSStatus::error;
+        if (grad_.norm() < config_.tol_grad) return LBFGSStatus::tol_grad;
+
+        history_.direction(grad_, dir_);
+
+        while (n_iter_ < config_.max_iter) {
+            double alpha = (history_.size() == 0) ? config_.init_alpha : 1.;
+            double f_new = value_;
+            if (!wolfe_line_search(f, x, value_, grad_, dir_, alpha,
+                                   x_new_, f_new, grad_new_)) {
+                if (history_.size() == 0) return LBFGSStatus::line_search_failed;
+                history_.clear();
+                history_.direction(grad_, dir_);
+                continue;
+            }
+            ++n_iter_;
+
+            s_ = x_new_ - x;
+            y_ = grad_new_ - grad_;
+            const double f_prev = value_;
+            x.swap(x_new_);
+            grad_.swap(grad_new_);
+            value_ = f_new;
+            history_.update(s_, y_);
+            history_.direction(grad_, dir_);
+
+            callback(static_cast<const LBFGS&>(*this));
+
+            const double df = std::abs(f_prev - value_);
+            if (df < config_.tol_obj) return LBFGSStatus::tol_obj;
+            if (df / std::max({std::abs(f_prev), std::abs(value_), 1.}) <
+                config_.tol_rel_obj * eps) return LBFGSStatus::tol_rel_obj;
+            if (grad_.norm() < config_.tol_grad) return LBFGSStatus::tol_grad;
+            if (-grad_.dot(dir_) / std::max(std::abs(value_), 1.) <
+                config_.tol_rel_grad * eps) return LBFGSStatus::tol_rel_grad;
+            if (s_.norm() < config_.tol_param) return LBFGSStatus::tol_param;
+        }
+        return LBFGSStatus::max_iter;
+    }
+
+    template <class ObjFunc>
+    LBFGSStatus minimize(ObjFunc&& f, Eigen::VectorXd& x)
+    {
+        return minimize(f, x, [](const LBFGS&) {});
+    }
+
+    double value() const { return value_; }
+    const Eigen::VectorXd& grad() const { return grad_; }
+    const LBFGSHistory& history() const { return history_; }
+    size_t n_iter() const { return n_iter_; }
+
+private:
+    LBFGSConfig config_;
+    LBFGSHistory history_;
+    Eigen::VectorXd grad_;
+    Eigen::VectorXd x_new_;
+    Eigen::VectorXd grad_new_;
+    Eigen::VectorXd dir_;
+    Eigen::VectorXd s_;
+    Eigen::VectorXd y_;
+    double value_ = 0.;
+    size_t n_iter_ = 0;
+};
+
+} // namespace optim
+} // namespace ppl
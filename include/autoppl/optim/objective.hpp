@@ -0,0 +1,107 @@
+#pragma once
+#include <utility>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/eval.hpp>
+#include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/packs/offset_pack.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/mcmc/hmc/leapfrog.hpp>
+
+namespace ppl {
+namespace optim {
+
+/**
+ * Negative log-pdf of a program as a function of the unconstrained parameters
+ * (objective of L-BFGS, see LBFGS::minimize).
+ * It owns the buffers that the program and its AD expression are bound to,
+ * hence it cannot be copied and the program must not be bound to anything else while it is used.
+ *
+ * @tparam  Jacobian    if true, log-jacobians of the parameter transformations are included
+ */
+template <bool Jacobian
+        , class ProgramType>
+struct NegLogPdf
+{
+private:
+    using ad_expr_t = std::decay_t<decltype(
+            std::declval<const ProgramType&>().template ad_log_pdf<Jacobian>(
+                std::declval<util::cont_ptr_pack_t>(),
+                std::declval<util::ShardContext&>()) )>;
+
+public:
+    NegLogPdf(ProgramType& program,
+              const util::OffsetPack& offset_pack,
+              util::ShardContext& shard_ctx)
+        : program_(program)
+        , theta_(Eigen::VectorXd::Zero(offset_pack.uc_offset))
+        , theta_adj_(Eigen::VectorXd::Zero(offset_pack.uc_offset))
+        , tp_val_(Eigen::VectorXd::Zero(offset_pack.tp_offset))
+        , tp_adj_(Eigen::VectorXd::Zero(offset_pack.tp_offset))
+        , constrained_(Eigen::VectorXd::Zero(offset_pack.c_offset))
+        , visit_(Eigen::Matrix<size_t, Eigen::Dynamic, 1>::Zero(offset_pack.v_offset))
+        , ad_expr_(program.template ad_log_pdf<Jacobian>(util::make_ptr_pack(
+                    theta_.data(), theta_adj_.data(),
+                    tp_val_.data(), tp_adj_.data(),
+                    constrained_.data(), visit_.data() ), shard_ctx))
+    {
+        auto size_pack = ad_expr_.bind_cache_size();
+        ad_val_buf_.resize(size_pack(0));
+        ad_adj_buf_.resize(size_pack(1));
+        ad_expr_.bind_cache({ad_val_buf_.data(), ad_adj_buf_.data()});
+
+        program_.bind(util::make_ptr_pack(
+                    theta_.data(), nullptr,
+                    tp_val_.data(), nullptr,
+                    constrained_.data(), visit_.data()));
+    }
+
+    NegLogPdf(const NegLogPdf&) =delete;
+    NegLogPdf& operator=(const NegLogPdf&) =delete;
+
+    /**
+     * Populates x with random initial values (see init_params).
+     */
+    template <class GenType>
+    void init_params(Eigen::VectorXd& x, GenType& gen, bool prune)
+    {
+        program_.init_params(gen, prune);
+        x = theta_;
+    }
+
+    /**
+     * Returns the negative log-pdf at x and populates grad with its gradient.
+     */
+    double operator()(const Eigen::VectorXd& x,
+                      Eigen::VectorXd& grad)
+    {
+        theta_ = x;
+        const double log_pdf = mcmc::reset_autodiff(ad_expr_, theta_adj_, tp_adj_);
+        grad = -theta_adj_;
+        return -log_pdf;
+    }
+
+    /**
+     * Returns the negative log-pdf at x without computing the gradient.
+     */
+    template <class XType>
+    double operator()(const Eigen::MatrixBase<XType>& x)
+    {
+        theta_ = x;
+        return -ad::evaluate(ad_expr_);
+    }
+
+private:
+    ProgramType& program_;
+    Eigen::VectorXd theta_;
+    Eigen::VectorXd theta_adj_;
+    Eigen::VectorXd tp_val_;
+    Eigen::VectorXd tp_adj_;
+    Eigen::VectorXd constrained_;
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit_;
+    ad_expr_t ad_expr_;
+    Eigen::VectorXd ad_val_buf_;
+    Eigen::VectorXd ad_adj_buf_;
+};
+
+} // namespace optim
+} // namespace ppl
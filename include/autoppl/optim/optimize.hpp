@@ -0,0 +1,183 @@
+#pragma once
+#include <cmath>
+#include <random>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Dense>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/optim/lbfgs.hpp>
+#include <autoppl/optim/objective.hpp>
+#include <autoppl/optim/config.hpp>
+
+namespace ppl {
+
+/**
+ * Result of optimization.
+ * For ppl::optimize, row c of the samples is the optimum found by chain c (in the constrained space)
+ * followed by the log-pdf at that point.
+ * For ppl::laplace, the samples of every chain are draws of its approximation.
+ * Additionally, every chain provides the objective it maximized
+ * (log-pdf in the unconstrained space, including log-jacobians if config.jacobian is true),
+ * the number of L-BFGS iterations and the reason of termination.
+ */
+template <int Major = Eigen::ColMajor>
+struct OptimizeResult: MCMCResult<Major>
+{
+    OptimizeResult() =default;
+    OptimizeResult(MCMCResult<Major>&& res)
+        : MCMCResult<Major>(std::move(res))
+    {}
+
+    std::vector<double> log_pdf;        // maximized objective of every chain
+    std::vector<size_t> n_iter;         // number of L-BFGS iterations of every chain
+    std::vector<LBFGSStatus> status;    // reason of termination of every chain
+};
+
+namespace optim {
+
+/**
+ * Runs a single chain of optimization.
+ * Starting from a random initialization (see init_params),
+ * L-BFGS minimizes the negative log-pdf over the unconstrained parameters.
+ *
+ * @tparam  Jacobian        if true, log-jacobians of the parameter transformations are included
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          optimization configuration object
+ * @param   pack            offset pack result of activating program.
+ * @param   chain           chain index (seeds initialization). Only chain 0 prints progress.
+ * @param   samples         matrix-like block of size (1 x n_params) populated with the optimum
+ * @param   shard_ctx       context used to build sharded AD expressions
+ * @param   log_pdf         populated with the maximized objective
+ * @param   n_iter          populated with the number of L-BFGS iterations
+ * @param   status          populated with the reason of termination
+ * @param   sampling_time   populated with optimization time of this chain
+ */
+template <bool Jacobian
+        , class ProgramType
+        , class OptimizeConfigType
+        , class OffsetPackType
+        , class SamplesType>
+void optimize_chain_(ProgramType& program,
+                     const OptimizeConfigType& config,
+                     const OffsetPackType& pack,
+                     size_t chain,
+                     SamplesType&& samples,
+                     util::ShardContext& shard_ctx,
+                     double& log_pdf,
+                     size_t& n_iter,
+                     LBFGSStatus& status,
+                     double& sampling_time)
+{
+    assert(std::get<1>(pack).uc_offset == 0);
+    assert(std::get<1>(pack).tp_offset == 0);
+    assert(std::get<1>(pack).c_offset == 0);
+    assert(std::get<1>(pack).v_offset == 0);
+
+    const size_t n_params = std::get<0>(pack).uc_offset;
+
+    std::mt19937 gen(config.seed + chain);
+
+    NegLogPdf<Jacobian, ProgramType> objective(program, std::get<0>(pack), shard_ctx);
+    Eigen::VectorXd x(n_params);
+    objective.init_params(x, gen, config.prune);
+
+    auto logger = util::ProgressLogger(config.lbfgs_config.max_iter, "L-BFGS",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch;
+
+    stopwatch.start();
+
+    LBFGS lbfgs(n_params, config.lbfgs_config);
+    status = lbfgs.minimize(objective, x, [&](const LBFGS& state) {
+        logger.printProgress(state.n_iter() - 1);
+    });
+
+    stopwatch.stop();
+
+    samples.row(0) = x;
+    log_pdf = -lbfgs.value();
+    n_iter = lbfgs.n_iter();
+    sampling_time = stopwatch.elapsed();
+}
+
+/**
+ * Finds the posterior mode with L-BFGS.
+ * Runs config.n_chains independent chains (restarts) on the thread pool.
+ * Every chain is given its own copy of the program since the program
+ * gets bound to buffers owned by the chain.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      optimization configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object with one row per chain that will be populated with the optima.
+ * @param   pool        thread pool to run chains (and shards) on
+ * @param   log_pdf     populated with the maximized objective of every chain
+ * @param   n_iter      populated with the number of L-BFGS iterations of every chain
+ * @param   status      populated with the reason of termination of every chain
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class OptimizeConfigType = OptimizeConfig>
+void optimize_(const ProgramType& program,
+               const OptimizeConfigType& config,
+               const OffsetPackType& pack,
+               MCMCResultType& res,
+               util::ThreadPool& pool,
+               std::vector<double>& log_pdf,
+               std::vector<size_t>& n_iter,
+               std::vector<LBFGSStatus>& status)
+{
+    log_pdf.assign(config.n_chains, 0.);
+    n_iter.assign(config.n_chains, 0);
+    status.assign(config.n_chains, LBFGSStatus::max_iter);
+    util::ShardContext shard_ctx(pool, config.shard_config, std::get<0>(pack));
+    mcmc::run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                warmup_time = 0.;
+                ProgramType chain_program = program;
+                auto run = [&](auto jacobian) {
+                    optimize_chain_<decltype(jacobian)::value>(
+                            chain_program, config, pack, chain,
+                            res.cont_chain(chain), shard_ctx,
+                            log_pdf[chain], n_iter[chain], status[chain],
+                            sampling_time);
+                };
+                if (config.jacobian) run(std::true_type());
+                else run(std::false_type());
+            });
+}
+
+} // namespace optim
+
+template <class ExprType
+        , class OptimizeConfigType = OptimizeConfig>
+inline auto optimize(const ExprType& expr,
+                     const OptimizeConfigType& config = OptimizeConfigType())
+{
+    OptimizeConfigType optim_config = config;
+    optim_config.warmup = 0;
+    optim_config.samples = 1;
+
+    std::vector<double> log_pdf;
+    std::vector<size_t> n_iter;
+    std::vector<LBFGSStatus> status;
+    OptimizeResult<> optim_res(mcmc::base_mcmc(expr, optim_config,
+            [&](const auto& program, const auto& config,
+                const auto& pack, auto& res, auto& pool) {
+                res.name = "optimize";
+                optim::optimize_(program, config, pack, res, pool,
+                                 log_pdf, n_iter, status);
+            }));
+    optim_res.log_pdf = std::move(log_pdf);
+    optim_res.n_iter = std::move(n_iter);
+    optim_res.status = std::move(status);
+    return optim_res;
+}
+
+} // namespace ppl
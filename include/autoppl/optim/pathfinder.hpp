@@ -0,0 +1,240 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <Eigen/Dense>
+#include <autoppl/math/math.hpp>
+#include <autoppl/math/density.hpp>
+#include <autoppl/optim/lbfgs.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for Pathfinder initialization of a sampler (see optim::pathfinder).
+ * If enabled, every chain runs a short L-BFGS path from its random initial point,
+ * fits a Gaussian approximation at every iterate, and starts from a draw of
+ * the approximation with the highest ELBO (estimated with n_draws draws),
+ * using its marginal variances as the initial (diagonal) inverse metric.
+ */
+struct PathfinderConfig
+{
+    bool enabled = false;
+    size_t n_draws = 20;
+    LBFGSConfig lbfgs_config{100};  // max_iter = 100
+};
+
+namespace optim {
+
+/**
+ * Gaussian approximation N(mu, H) of a density at an iterate x of L-BFGS,
+ * where H is the L-BFGS inverse Hessian approximation and mu = x - H grad
+ * is the corresponding Newton step (Zhang et al., 2022, Pathfinder).
+ *
+ * With k correction pairs S, Y and initial scaling gamma = s^T y / y^T y of the most recent pair,
+ * the compact representation (Byrd, Nocedal and Schnabel, 1994) is
+ *      H = gamma I + W M W^T,  W = [S, gamma Y]
+ * (identical to the two-loop recursion of LBFGSHistory).
+ * If 2k < n, W = Q R is factored (thin QR) such that
+ *      H = Q A Q^T + gamma (I - Q Q^T),  A = gamma I + R M R^T,
+ * and only the (2k x 2k) matrix A is factored, i.e. fitting costs O(n k^2).
+ * Otherwise, H is formed and factored directly.
+ */
+struct LBFGSGaussian
+{
+    LBFGSGaussian(size_t n_params)
+        : mu(n_params)
+        , variance(Eigen::VectorXd::Ones(n_params))
+        , dir_(n_params)
+        , z_(n_params)
+    {}
+
+    /**
+     * Fits the approximation at x (with gradient grad of the negative log-density)
+     * from the correction pairs in history.
+     *
+     * @return  false if the approximation could not be factored
+     */
+    bool fit(const Eigen::VectorXd& x,
+             const Eigen::VectorXd& grad,
+             const LBFGSHistory& history)
+    {
+        const Eigen::Index n = x.size();
+        const Eigen::Index k = history.size();
+        history.direction(grad, dir_);
+        mu = x + dir_;
+
+        if (k == 0) {
+            dense_ = true;
+            chol_ = Eigen::MatrixXd::Identity(n, n);
+            variance.setOnes();
+            log_det_ = 0.;
+            return true;
+        }
+
+        Eigen::MatrixXd S(n, k), Y(n, k);
+        for (Eigen::Index i = 0; i < k; ++i) {
+            S.col(i) = history.s(i);
+            Y.col(i) = history.y(i);
+        }
+        gamma_ = S.col(k-1).dot(Y.col(k-1)) / Y.col(k-1).squaredNorm();
+
+        // M = [R^{-T} (D + gamma Y^T Y) R^{-1}, -R^{-T}; -R^{-1}, 0]
+        // where R is the upper triangle of S^T Y and D its diagonal
+        const Eigen::MatrixXd SY = S.transpose() * Y;
+        Eigen::MatrixXd R_inv = Eigen::MatrixXd::Identity(k, k);
+        SY.triangularView<Eigen::Upper>().solveInPlace(R_inv);
+        Eigen::MatrixXd inner = gamma_ * Y.transpose() * Y;
+        inner.diagonal() += SY.diagonal();
+        Eigen::MatrixXd M = Eigen::MatrixXd::Zero(2*k, 2*k);
+        M.topLeftCorner(k, k) = R_inv.transpose() * inner * R_inv;
+        M.topRightCorner(k, k) = -R_inv.transpose();
+        M.bottomLeftCorner(k, k) = -R_inv;
+
+        Eigen::MatrixXd W(n, 2*k);
+        W << S, gamma_ * Y;
+
+        if (n <= 2*k) {
+            dense_ = true;
+            Eigen::MatrixXd H = W * M * W.transpose();
+            H.diagonal().array() += gamma_;
+            Eigen::LLT<Eigen::MatrixXd> llt(H);
+            if (llt.info() != Eigen::Success) return false;
+            chol_ = llt.matrixL();
+            variance = H.diagonal();
+            log_det_ = 2. * chol_.diagonal().array().log().sum();
+        } else {
+            dense_ = false;
+            Eigen::HouseholderQR<Eigen::MatrixXd> qr(W);
+            Q_ = qr.householderQ() * Eigen::MatrixXd::Identity(n, 2*k);
+            const Eigen::MatrixXd R = qr.matrixQR().topRows(2*k)
+                                        .triangularView<Eigen::Upper>();
+            Eigen::MatrixXd A = R * M * R.transpose();
+            A.diagonal().array() += gamma_;
+            Eigen::LLT<Eigen::MatrixXd> llt(A);
+            if (llt.info() != Eigen::Success) return false;
+            chol_ = llt.matrixL();
+            variance = (Q_ * chol_).rowwise().squaredNorm() +
+                       gamma_ * (1. - Q_.rowwise().squaredNorm().array()).matrix();
+            log_det_ = 2. * chol_.diagonal().array().log().sum() +
+                       (n - 2*k) * std::log(gamma_);
+        }
+        return std::isfinite(log_det_) && mu.allFinite();
+    }
+
+    /**
+     * Draws theta ~ N(mu, H).
+     */
+    template <class GenType>
+    void sample(Eigen::VectorXd& theta, GenType& gen)
+    {
+        std::normal_distribution norm_sampler(0., 1.);
+        const Eigen::Index n = mu.size();
+        z_ = Eigen::VectorXd::NullaryExpr(n, [&]() { return norm_sampler(gen); });
+        if (dense_) {
+            theta = mu + chol_ * z_;
+        } else {
+            z_low_ = Eigen::VectorXd::NullaryExpr(chol_.rows(),
+                    [&]() { return norm_sampler(gen); });
+            theta = mu + std::sqrt(gamma_) * (z_ - Q_ * (Q_.transpose() * z_)) +
+                    Q_ * (chol_ * z_low_);
+        }
+    }
+
+    /**
+     * Entropy of N(mu, H).
+     */
+    double entropy() const
+    {
+        const double n = mu.size();
+        return 0.5 * (n * (1. + 2. * math::LOG_SQRT_TWO_PI) + log_det_);
+    }
+
+    /**
+     * Monte Carlo estimate of the ELBO E_q[-f(theta)] + entropy with n_draws draws,
+     * where f is the negative log-density (with a gradient).
+     * Returns -infinity if f is not finite at any draw.
+     */
+    template <class ObjFunc, class GenType>
+    double elbo(ObjFunc&& f,
+                size_t n_draws,
+                Eigen::VectorXd& theta,
+                Eigen::VectorXd& grad,
+                GenType& gen)
+    {
+        double log_pdf = 0.;
+        for (size_t i = 0; i < n_draws; ++i) {
+            sample(theta, gen);
+            const double value = f(theta, grad);
+            if (!std::isfinite(value)) return math::neg_inf<double>;
+            log_pdf -= value;
+        }
+        return log_pdf / static_cast<double>(n_draws) + entropy();
+    }
+
+    Eigen::VectorXd mu;
+    Eigen::VectorXd variance;   // marginal variances (diagonal of H)
+
+private:
+    bool dense_ = true;
+    double gamma_ = 1.;
+    double log_det_ = 0.;
+    Eigen::MatrixXd chol_;      // Cholesky factor of H (dense) or A (low-rank)
+    Eigen::MatrixXd Q_;
+    Eigen::VectorXd dir_;
+    Eigen::VectorXd z_;
+    Eigen::VectorXd z_low_;
+};
+
+/**
+ * Single-path Pathfinder.
+ * Runs L-BFGS on f from x for at most config.lbfgs_config.max_iter iterations,
+ * fits an LBFGSGaussian at every iterate and estimates its ELBO with config.n_draws draws.
+ * x is then replaced by a draw from the approximation with the highest ELBO
+ * and variance by its marginal variances.
+ * If no approximation has a finite ELBO, x is left at the last L-BFGS iterate
+ * and variance is set to ones.
+ *
+ * @param   f           negative log-density such that f(x, grad) returns the value at x
+ *                      and writes the gradient at x into grad
+ * @param   x           initial point. Populated with the selected draw.
+ * @param   variance    populated with the marginal variances of the selected approximation
+ * @param   config      Pathfinder configuration
+ * @param   gen         random number generator
+ * @return  highest ELBO along the path
+ */
+template <class ObjFunc
+        , class GenType>
+inline double pathfinder(ObjFunc&& f,
+                         Eigen::VectorXd& x,
+                         Eigen::VectorXd& variance,
+                         const PathfinderConfig& config,
+                         GenType& gen)
+{
+    const size_t n_params = x.size();
+    LBFGSGaussian approx(n_params);
+    LBFGSGaussian best(n_params);
+    Eigen::VectorXd theta(n_params);
+    Eigen::VectorXd grad(n_params);
+    double best_elbo = math::neg_inf<double>;
+
+    LBFGS lbfgs(n_params, config.lbfgs_config);
+    lbfgs.minimize(f, x, [&](const LBFGS& state) {
+        if (!approx.fit(x, state.grad(), state.history())) return;
+        const double elbo = approx.elbo(f, config.n_draws, theta, grad, gen);
+        if (elbo > best_elbo) {
+            best_elbo = elbo;
+            best = approx;
+        }
+    });
+
+    if (best_elbo == math::neg_inf<double>) {
+        variance.setOnes();
+        return best_elbo;
+    }
+    best.sample(x, gen);
+    variance = best.variance;
+    return best_elbo;
+}
+
+} // namespace optim
+} // namespace ppl
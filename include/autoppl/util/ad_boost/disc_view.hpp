@@ -0,0 +1,48 @@
+#pragma once
+#include <fastad_bits/reverse/core/expr_base.hpp>
+#include <fastad_bits/reverse/core/value_adj_view.hpp>
+#include <fastad_bits/util/type_traits.hpp>
+#include <fastad_bits/util/size_pack.hpp>
+
+namespace ad {
+namespace boost {
+
+/**
+ * DiscViewNode views the current values of a discrete parameter
+ * inside an AD expression over continuous parameters.
+ * It behaves like a constant (no adjoint, no cache),
+ * except that it re-reads the viewed values on every evaluation,
+ * so that a sampler may update the discrete parameter in-place
+ * between evaluations of the same AD expression.
+ */
+template <class ValueType
+        , class ShapeType>
+struct DiscViewNode:
+    core::ValueAdjView<ValueType, ShapeType>,
+    core::ExprBase<DiscViewNode<ValueType, ShapeType>>
+{
+    using value_adj_view_t = core::ValueAdjView<ValueType, ShapeType>;
+    using typename value_adj_view_t::value_t;
+    using typename value_adj_view_t::shape_t;
+    using typename value_adj_view_t::var_t;
+
+    DiscViewNode(const value_t* val,
+                 size_t rows,
+                 size_t cols)
+        : value_adj_view_t(const_cast<value_t*>(val), nullptr, rows, cols)
+    {}
+
+    const var_t& feval() const { return this->get(); }
+
+    template <class T>
+    void beval(const T&) const {}
+
+    template <class PtrPackType>
+    PtrPackType bind_cache(PtrPackType begin) const { return begin; }
+
+    util::SizePack bind_cache_size() const { return {0,0}; }
+    util::SizePack single_bind_cache_size() const { return {0,0}; }
+};
+
+} // namespace boost
+} // namespace ad
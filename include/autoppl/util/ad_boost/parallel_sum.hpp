@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fastad_bits/reverse/core/expr_base.hpp>
+#include <fastad_bits/reverse/core/value_adj_view.hpp>
+#include <fastad_bits/util/type_traits.hpp>
+#include <fastad_bits/util/size_pack.hpp>
+#include <autoppl/util/thread_pool.hpp>
+
+namespace ad {
+namespace boost {
+
+/**
+ * ParallelSumNode represents the sum of (scalar) AD expressions, called terms,
+ * that are partitioned into groups.
+ * Groups are evaluated concurrently on a thread pool, both in the forward and backward pass,
+ * while the terms of a group are evaluated in order on the same thread.
+ *
+ * The user must guarantee that terms of different groups never write to the same memory
+ * (other than their own cache), e.g. they do not reference a common parameter
+ * (see expr::model::activate_refcnt_grouped).
+ * Then, adjoints are propagated directly into the shared adjoint buffers without any races.
+ * The term values are summed in term order,
+ * so the result never depends on the number of threads.
+ *
+ * Every term is bound to its own (contiguous) region of the cache.
+ *
+ * @tparam  ExprTypes   types of terms
+ */
+template <class... ExprTypes>
+struct ParallelSumNode:
+    core::ValueAdjView<std::common_type_t<
+        typename util::expr_traits<ExprTypes>::value_t...>, ad::scl>,
+    core::ExprBase<ParallelSumNode<ExprTypes...>>
+{
+private:
+    using expr_value_t = std::common_type_t<
+        typename util::expr_traits<ExprTypes>::value_t...>;
+    using tuple_t = std::tuple<ExprTypes...>;
+    static constexpr size_t n_terms = sizeof...(ExprTypes);
+    static_assert((util::is_scl_v<ExprTypes> && ...));
+
+public:
+    using value_adj_view_t = core::ValueAdjView<expr_value_t, ad::scl>;
+    using typename value_adj_view_t::value_t;
+    using typename value_adj_view_t::shape_t;
+    using typename value_adj_view_t::var_t;
+    using typename value_adj_view_t::ptr_pack_t;
+
+    /**
+     * @param   pool    thread pool to evaluate groups on
+     * @param   groups  group index of every term.
+     *                  Groups must be numbered 0, 1, ..., n_groups-1.
+     * @param   exprs   tuple of terms
+     */
+    ParallelSumNode(ppl::util::ThreadPool& pool,
+                    const std::vector<size_t>& groups,
+                    const tuple_t& exprs)
+        : value_adj_view_t(nullptr, nullptr, 1, 1)
+        , pool_{&pool}
+        , exprs_{exprs}
+        , values_(n_terms, 0)
+    {
+        size_t n_groups = 0;
+        for (size_t g : groups) n_groups = std::max(n_groups, g + 1);
+        terms_.resize(n_groups);
+        for (size_t t = 0; t < n_terms; ++t) {
+            terms_[groups[t]].push_back(t);
+        }
+    }
+
+    const var_t& feval()
+    {
+        pool_->parallel_for(terms_.size(), [&](size_t g) {
+            for (size_t t : terms_[g]) {
+                apply_at(t, [&](auto& expr) { values_[t] = expr.feval(); });
+            }
+        });
+        value_t sum = 0;
+        for (value_t value : values_) { sum += value; }
+        this->get() = sum;
+        return this->get();
+    }
+
+    template <class T>
+    void beval(const T& seed)
+    {
+        pool_->parallel_for(terms_.size(), [&](size_t g) {
+            for (auto it = terms_[g].rbegin(); it != terms_[g].rend(); ++it) {
+                apply_at(*it, [&](auto& expr) { expr.beval(seed); });
+            }
+        });
+    }
+
+    ptr_pack_t bind_cache(ptr_pack_t begin)
+    {
+        std::apply([&](auto&... expr) {
+            ((begin = expr.bind_cache(begin)), ...);
+        }, exprs_);
+        return this->bind(begin);
+    }
+
+    util::SizePack bind_cache_size() const
+    {
+        return std::apply([&](const auto&... expr) {
+            return util::SizePack(
+                    (single_bind_cache_size() + ... + expr.bind_cache_size()));
+        }, exprs_);
+    }
+
+    util::SizePack single_bind_cache_size() const {
+        return {this->size(), this->size()};
+    }
+
+    size_t n_groups() const { return terms_.size(); }
+
+private:
+
+    /**
+     * Calls f on the term with (runtime) index i.
+     */
+    template <class F>
+    void apply_at(size_t i, F&& f)
+    {
+        apply_at_(i, f, std::index_sequence_for<ExprTypes...>());
+    }
+
+    template <class F, size_t... I>
+    void apply_at_(size_t i, F& f, std::index_sequence<I...>)
+    {
+        static_cast<void>(((i == I ? (f(std::get<I>(exprs_)), true) : false) || ...));
+    }
+
+    ppl::util::ThreadPool* pool_;
+    tuple_t exprs_;
+    std::vector<value_t> values_;
+    std::vector<std::vector<size_t>> terms_;    // terms of each group in order
+};
+
+/**
+ * Helper function to create a ParallelSumNode from a tuple of terms.
+ */
+template <class... ExprTypes>
+inline auto parallel_sum(ppl::util::ThreadPool& pool,
+                         const std::vector<size_t>& groups,
+                         const std::tuple<ExprTypes...>& exprs)
+{
+    return ParallelSumNode<ExprTypes...>(pool, groups, exprs);
+}
+
+} // namespace boost
+} // namespace ad
@@ -0,0 +1,256 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/expr_base.hpp>
+#include <fastad_bits/reverse/core/value_adj_view.hpp>
+#include <fastad_bits/util/type_traits.hpp>
+#include <fastad_bits/util/size_pack.hpp>
+#include <autoppl/util/thread_pool.hpp>
+
+namespace ad {
+namespace boost {
+
+/**
+ * ShardedSumNode represents the sum of n_shards scalar AD expressions,
+ * which are usually the log-pdfs of disjoint row-ranges of one observed variable.
+ * The shard expressions are evaluated concurrently on a thread pool,
+ * both in the forward and backward pass.
+ *
+ * Every shard is built with its own adjoint, constrained value, visit count
+ * and cache buffers, so that no two shards ever write to the same memory.
+ * Only the (read-only) unconstrained and transformed parameter values are shared.
+ * In the forward pass, the shard values are summed in shard order.
+ * In the backward pass, each shard propagates into its own adjoint buffers,
+ * whose non-zero entries are then added into the adjoint buffers 
+ * of the enclosing expression in shard order.
+ * Hence, the result only depends on the number of shards and never on the number of threads.
+ * Moreover, only adjoints of (transformed) parameters referenced by the shards are ever written,
+ * so the node can be evaluated concurrently with terms that reference other parameters
+ * (see ParallelSumNode).
+ *
+ * If n_shards is 1, the only shard is bound directly to the buffers
+ * of the enclosing expression and evaluated inline.
+ *
+ * Note: since shards own their visit counts, the visit counts of the enclosing expression
+ * do not see the references inside the shards.
+ * The enclosing expression must reset its visit counts before each evaluation
+ * (see VisitResetNode).
+ *
+ * @tparam  ExprType    type of the (scalar) AD expression of one shard
+ */
+template <class ExprType>
+struct ShardedSumNode:
+    core::ValueAdjView<typename util::expr_traits<ExprType>::value_t, ad::scl>,
+    core::ExprBase<ShardedSumNode<ExprType>>
+{
+private:
+    using expr_t = ExprType;
+    using expr_value_t = typename util::expr_traits<expr_t>::value_t;
+    static_assert(util::is_scl_v<expr_t>);
+
+public:
+    using value_adj_view_t = core::ValueAdjView<expr_value_t, ad::scl>;
+    using typename value_adj_view_t::value_t;
+    using typename value_adj_view_t::shape_t;
+    using typename value_adj_view_t::var_t;
+    using typename value_adj_view_t::ptr_pack_t;
+
+    /**
+     * Constructs every shard expression.
+     *
+     * @param   pool        thread pool to evaluate shards on
+     * @param   n_shards    number of shards (must be positive)
+     * @param   pack        pointer pack that the unsharded expression would be built with
+     * @param   offsets     offset pack containing the size of every buffer in pack
+     * @param   make_expr   functor such that make_expr(i, shard_pack) returns
+     *                      the AD expression of shard i built with shard_pack
+     */
+    template <class PtrPackType
+            , class OffsetPackType
+            , class ShardFunc>
+    ShardedSumNode(ppl::util::ThreadPool& pool,
+                   size_t n_shards,
+                   const PtrPackType& pack,
+                   const OffsetPackType& offsets,
+                   ShardFunc&& make_expr)
+        : value_adj_view_t(nullptr, nullptr, 1, 1)
+        , state_{std::make_shared<State>()}
+    {
+        auto& state = *state_;
+        state.pool = &pool;
+        state.uc_adj = pack.uc_adj;
+        state.tp_adj = pack.tp_adj;
+        state.shards.reserve(n_shards);
+
+        for (size_t i = 0; i < n_shards; ++i) {
+            auto& shard = state.shards.emplace_back();
+            PtrPackType shard_pack = pack;
+            if (n_shards > 1) {
+                shard.uc_adj.setZero(offsets.uc_offset);
+                shard.tp_adj.setZero(offsets.tp_offset);
+                shard.c_val.setZero(offsets.c_offset);
+                shard.v_val.setZero(offsets.v_offset);
+                shard_pack.uc_adj = shard.uc_adj.data();
+                shard_pack.tp_adj = shard.tp_adj.data();
+                shard_pack.c_val = shard.c_val.data();
+                shard_pack.v_val = shard.v_val.data();
+            }
+            shard.expr.emplace(make_expr(i, shard_pack));
+            auto size_pack = shard.expr->bind_cache_size();
+            shard.cache_val.setZero(size_pack(0));
+            shard.cache_adj.setZero(size_pack(1));
+            shard.expr->bind_cache({shard.cache_val.data(),
+                                    shard.cache_adj.data()});
+        }
+    }
+
+    const var_t& feval()
+    {
+        auto& shards = state_->shards;
+        if (shards.size() == 1) {
+            this->get() = shards[0].expr->feval();
+            return this->get();
+        }
+        state_->pool->parallel_for(shards.size(), [&](size_t i) {
+            auto& shard = shards[i];
+            shard.v_val.setZero();
+            shard.value = shard.expr->feval();
+        });
+        value_t sum = 0;
+        for (const auto& shard : shards) { sum += shard.value; }
+        this->get() = sum;
+        return this->get();
+    }
+
+    template <class T>
+    void beval(const T& seed)
+    {
+        auto& state = *state_;
+        auto& shards = state.shards;
+        if (shards.size() == 1) {
+            shards[0].expr->beval(seed);
+            return;
+        }
+        state.pool->parallel_for(shards.size(), [&](size_t i) {
+            auto& shard = shards[i];
+            shard.uc_adj.setZero();
+            shard.tp_adj.setZero();
+            shard.expr->beval(seed);
+        });
+        // reduce in shard order so that the result is independent of scheduling
+        for (const auto& shard : shards) {
+            reduce(shard.uc_adj, state.uc_adj);
+            reduce(shard.tp_adj, state.tp_adj);
+        }
+    }
+
+    ptr_pack_t bind_cache(ptr_pack_t begin)
+    {
+        return this->bind(begin);
+    }
+
+    util::SizePack bind_cache_size() const
+    {
+        return single_bind_cache_size();
+    }
+
+    util::SizePack single_bind_cache_size() const {
+        return {this->size(), this->size()};
+    }
+
+    size_t n_shards() const { return state_->shards.size(); }
+
+private:
+    using vec_t = Eigen::Matrix<value_t, Eigen::Dynamic, 1>;
+
+    static void reduce(const vec_t& src, value_t* dest)
+    {
+        if (!dest) return;
+        for (int i = 0; i < src.size(); ++i) {
+            if (src(i) != 0) dest[i] += src(i);
+        }
+    }
+
+    struct Shard
+    {
+        std::optional<expr_t> expr;
+        vec_t uc_adj;
+        vec_t tp_adj;
+        vec_t c_val;
+        Eigen::Matrix<size_t, Eigen::Dynamic, 1> v_val;
+        vec_t cache_val;
+        vec_t cache_adj;
+        value_t value = 0;
+    };
+
+    struct State
+    {
+        ppl::util::ThreadPool* pool = nullptr;
+        value_t* uc_adj = nullptr;
+        value_t* tp_adj = nullptr;
+        std::vector<Shard> shards;
+    };
+
+    // shared so that copies of this node (e.g. inside enclosing expressions)
+    // refer to the same shard expressions and buffers
+    std::shared_ptr<State> state_;
+};
+
+/**
+ * VisitResetNode resets a range of visit counts to 0 on every forward evaluation
+ * and evaluates to 0.
+ * It is placed first in an AD expression that contains ShardedSumNode objects,
+ * so that the first visitor of every constrained parameter always transforms
+ * regardless of how many references were evaluated inside shards.
+ */
+template <class ValueType>
+struct VisitResetNode:
+    core::ValueAdjView<ValueType, ad::scl>,
+    core::ExprBase<VisitResetNode<ValueType>>
+{
+    using value_adj_view_t = core::ValueAdjView<ValueType, ad::scl>;
+    using typename value_adj_view_t::value_t;
+    using typename value_adj_view_t::shape_t;
+    using typename value_adj_view_t::var_t;
+    using typename value_adj_view_t::ptr_pack_t;
+
+    VisitResetNode(size_t* v_val, size_t size)
+        : value_adj_view_t(nullptr, nullptr, 1, 1)
+        , v_val_{v_val}
+        , v_size_{size}
+    {}
+
+    const var_t& feval()
+    {
+        if (v_val_) std::fill(v_val_, v_val_ + v_size_, 0);
+        this->get() = 0;
+        return this->get();
+    }
+
+    template <class T>
+    void beval(const T&) {}
+
+    ptr_pack_t bind_cache(ptr_pack_t begin)
+    {
+        return this->bind(begin);
+    }
+
+    util::SizePack bind_cache_size() const
+    {
+        return single_bind_cache_size();
+    }
+
+    util::SizePack single_bind_cache_size() const {
+        return {this->size(), this->size()};
+    }
+
+private:
+    size_t* v_val_;
+    size_t v_size_;
+};
+
+} // namespace boost
+} // namespace ad
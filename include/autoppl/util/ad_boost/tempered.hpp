@@ -0,0 +1,85 @@
+#pragma once
+#include <fastad_bits/reverse/core/expr_base.hpp>
+#include <fastad_bits/reverse/core/value_adj_view.hpp>
+#include <fastad_bits/util/type_traits.hpp>
+#include <fastad_bits/util/size_pack.hpp>
+
+namespace ad {
+namespace boost {
+
+/**
+ * TemperedNode represents a (scalar) log-pdf expression
+ * scaled by an inverse temperature beta, i.e. beta * expr.
+ * It views beta such that the temperature may change
+ * between evaluations of the same AD expression (see mcmc::pt_).
+ *
+ * @tparam  ExprType    type of log-pdf expression
+ */
+template <class ExprType>
+struct TemperedNode:
+    core::ValueAdjView<typename util::expr_traits<ExprType>::value_t, ad::scl>,
+    core::ExprBase<TemperedNode<ExprType>>
+{
+private:
+    using expr_t = ExprType;
+    using expr_value_t = typename util::expr_traits<expr_t>::value_t;
+    static_assert(util::is_scl_v<expr_t>);
+
+public:
+    using value_adj_view_t = core::ValueAdjView<expr_value_t, ad::scl>;
+    using typename value_adj_view_t::value_t;
+    using typename value_adj_view_t::shape_t;
+    using typename value_adj_view_t::var_t;
+    using typename value_adj_view_t::ptr_pack_t;
+
+    TemperedNode(const expr_t& expr,
+                 const value_t* beta)
+        : value_adj_view_t(nullptr, nullptr, 1, 1)
+        , expr_{expr}
+        , beta_{beta}
+    {}
+
+    const var_t& feval()
+    {
+        this->get() = (*beta_) * expr_.feval();
+        return this->get();
+    }
+
+    template <class T>
+    void beval(const T& seed)
+    {
+        expr_.beval(seed * (*beta_));
+    }
+
+    ptr_pack_t bind_cache(ptr_pack_t begin)
+    {
+        begin = expr_.bind_cache(begin);
+        return this->bind(begin);
+    }
+
+    util::SizePack bind_cache_size() const
+    {
+        return single_bind_cache_size() + expr_.bind_cache_size();
+    }
+
+    util::SizePack single_bind_cache_size() const {
+        return {this->size(), this->size()};
+    }
+
+private:
+    expr_t expr_;
+    const value_t* beta_;
+};
+
+/**
+ * Helper function to create a TemperedNode.
+ */
+template <class ExprType>
+inline auto tempered(const ExprType& expr,
+                     const typename util::expr_traits<ExprType>::value_t* beta)
+{
+    return TemperedNode<ExprType>(expr, beta);
+}
+
+} // namespace boost
+} // namespace ad
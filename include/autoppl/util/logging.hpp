@@ -24,21 +24,27 @@ struct ProgressLogger
      * @param   max     the value being counted towards,    
      *                  e.g. the upper-bound of the for-loop
      * @param   name    string to print alongside the progress bar
+     * @param   os      output stream to print to
+     * @param   enabled if false, nothing is ever printed
+     *                  (e.g. for all but one of many concurrent chains)
      */
     ProgressLogger(size_t max, 
                    const std::string& name, 
-                   std::ostream& os = std::cout)
+                   std::ostream& os = std::cout,
+                   bool enabled = true)
         : max_(max)
         , name_(name)
         , os_(os)
+        , enabled_(enabled)
     {};
 
     /**
      * When the logger goes out of scope, append a new line
      */
-    ~ProgressLogger() { os_ << std::endl; }
+    ~ProgressLogger() { if (enabled_) os_ << std::endl; }
 
     void printProgress(size_t step) {
+        if (!enabled_) return;
         ++step;
         size_t denom = max_ <= 100 ? max_ : 100;
         if (step % (max_ / denom) == 0) {
@@ -57,6 +63,7 @@ private:
     size_t max_;        // maximum vaue to count progress towards
     std::string name_;  // name of the algorithm being measured, printed with progress bar
     std::ostream& os_;  // output stream to print to
+    bool enabled_;      // whether to print at all
 };
 
 } // namespace util
@@ -0,0 +1,148 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <Eigen/Dense>
+
+namespace ppl {
+namespace util {
+
+/**
+ * Helpers to save and load sampler states in a compact binary format
+ * (see mcmc::ChainCheckpoint).
+ * All values are written in native byte order,
+ * so a state can only be loaded on the same platform.
+ */
+
+template <class T>
+inline void write_pod(std::ostream& os, const T& x)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template <class T>
+inline void read_pod(std::istream& is, T& x)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    is.read(reinterpret_cast<char*>(&x), sizeof(T));
+}
+
+/**
+ * Returns true if is holds at least n_bytes more bytes
+ * (always true if is cannot report its length).
+ * It guards against allocating what a corrupted size asks for.
+ */
+inline bool has_bytes(std::istream& is, uint64_t n_bytes)
+{
+    const auto pos = is.tellg();
+    if (pos < 0) return true;
+    is.seekg(0, std::ios::end);
+    const auto end = is.tellg();
+    is.seekg(pos);
+    return (end >= pos) && (static_cast<uint64_t>(end - pos) >= n_bytes);
+}
+
+/**
+ * Writes the number of rows and columns (as uint64_t)
+ * followed by every coefficient in column-major order.
+ */
+template <class Derived>
+inline void write_mat(std::ostream& os, const Eigen::DenseBase<Derived>& x)
+{
+    write_pod(os, static_cast<uint64_t>(x.rows()));
+    write_pod(os, static_cast<uint64_t>(x.cols()));
+    for (Eigen::Index j = 0; j < x.cols(); ++j) {
+        for (Eigen::Index i = 0; i < x.rows(); ++i) {
+            write_pod(os, x(i, j));
+        }
+    }
+}
+
+/**
+ * Reads a matrix written by write_mat into x.
+ * x is resized if it is a plain matrix, otherwise (e.g. Eigen::Map)
+ * it must already have the stored dimensions.
+ * If it does not, or if is does not hold all stored values,
+ * the failbit of is is set and x is left untouched.
+ */
+template <class Derived>
+inline void read_mat(std::istream& is, Eigen::DenseBase<Derived>& x)
+{
+    using derived_t = std::decay_t<Derived>;
+    using value_t = typename derived_t::Scalar;
+    constexpr bool resizable = 
+        std::is_base_of_v<Eigen::PlainObjectBase<derived_t>, derived_t>;
+
+    uint64_t rows = 0, cols = 0;
+    read_pod(is, rows);
+    read_pod(is, cols);
+    if (!is) return;
+
+    const bool same_dims = (rows == static_cast<uint64_t>(x.rows())) &&
+                           (cols == static_cast<uint64_t>(x.cols()));
+    const bool fits = (cols == 0) || 
+        ((rows <= UINT64_MAX / cols / sizeof(value_t)) &&
+         has_bytes(is, rows * cols * sizeof(value_t)));
+    if ((!resizable && !same_dims) || !fits) {
+        is.setstate(std::ios::failbit);
+        return;
+    }
+    if constexpr (resizable) x.derived().resize(rows, cols);
+    for (Eigen::Index j = 0; j < x.cols(); ++j) {
+        for (Eigen::Index i = 0; i < x.rows(); ++i) {
+            read_pod(is, x(i, j));
+        }
+    }
+}
+
+inline void write_string(std::ostream& os, const std::string& s)
+{
+    write_pod(os, static_cast<uint64_t>(s.size()));
+    os.write(s.data(), s.size());
+}
+
+/**
+ * Reads a string written by write_string.
+ * If is does not hold the stored number of characters,
+ * the failbit of is is set and an empty string is returned.
+ */
+inline std::string read_string(std::istream& is)
+{
+    uint64_t size = 0;
+    read_pod(is, size);
+    if (is && !has_bytes(is, size)) is.setstate(std::ios::failbit);
+    std::string s(is ? size : 0, '\0');
+    is.read(s.data(), s.size());
+    return s;
+}
+
+/**
+ * Writes the state of a random number engine or distribution
+ * (any object with the standard stream operators, e.g. std::mt19937, std::normal_distribution).
+ * The standard textual representation is the only portable way to
+ * access the state (including any value cached by a distribution),
+ * and it restores the object exactly.
+ */
+template <class T>
+inline void write_state(std::ostream& os, const T& x)
+{
+    std::ostringstream ss;
+    ss << x;
+    write_string(os, ss.str());
+}
+
+template <class T>
+inline void read_state(std::istream& is, T& x)
+{
+    std::istringstream ss(read_string(is));
+    ss >> x;
+    if (!ss) is.setstate(std::ios::failbit);
+}
+
+} // namespace util
+} // namespace ppl
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <autoppl/util/packs/offset_pack.hpp>
+#include <autoppl/util/thread_pool.hpp>
+
+namespace ppl {
+
+/**
+ * User configuration for parallel log-pdf evaluation.
+ * An observed vector (with a narrowable distribution) is split into at most
+ * n_shards contiguous row-ranges of at least min_rows rows each.
+ * The log-pdf and gradient of every row-range are computed concurrently
+ * on the thread pool of the sampler.
+ * If parallel_terms is true, groups of model terms that reference
+ * disjoint parameters are also evaluated concurrently.
+ * By default, everything is evaluated on the thread of the chain.
+ */
+struct ShardConfig
+{
+    size_t n_shards = 1;
+    size_t min_rows = 1000;
+    bool parallel_terms = false;
+};
+
+namespace util {
+
+/**
+ * Checks if an expression can be restricted to a contiguous range of rows
+ * by calling narrow(begin, n, cache).
+ * Expressions opt in by defining a static constexpr bool member "narrowable".
+ */
+template <class T, class = void>
+struct is_narrowable : std::false_type
+{};
+
+template <class T>
+struct is_narrowable<T, std::enable_if_t<std::decay_t<T>::narrowable> >
+    : std::true_type
+{};
+
+template <class T>
+inline constexpr bool is_narrowable_v = is_narrowable<T>::value;
+
+/**
+ * RowChunkCache owns contiguous copies of row-ranges of column-major matrices.
+ * A range of rows of a column-major matrix is not contiguous,
+ * so a narrowed matrix data view must view a copy instead.
+ * Copies are keyed by (data, begin, n) so that every AD expression
+ * (and every chain) that narrows the same data shares the same copy.
+ * It is thread-safe.
+ */
+struct RowChunkCache
+{
+    /**
+     * Returns a pointer to a contiguous column-major copy of
+     * rows [begin, begin + n) of the rows x cols matrix starting at data.
+     * The pointer is valid for the lifetime of the cache.
+     */
+    template <class ValueType>
+    const ValueType* get(const ValueType* data,
+                         size_t rows,
+                         size_t cols,
+                         size_t begin,
+                         size_t n)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto key = std::make_tuple(static_cast<const void*>(data), begin, n);
+        auto it = chunks_.find(key);
+        if (it != chunks_.end()) {
+            return static_cast<const ValueType*>(it->second.get());
+        }
+        auto chunk = std::make_shared<std::vector<ValueType>>(n * cols);
+        for (size_t j = 0; j < cols; ++j) {
+            for (size_t i = 0; i < n; ++i) {
+                (*chunk)[j * n + i] = data[j * rows + begin + i];
+            }
+        }
+        const ValueType* ptr = chunk->data();
+        chunks_.emplace(key, std::shared_ptr<const void>(chunk, ptr));
+        return ptr;
+    }
+
+private:
+    using key_t = std::tuple<const void*, size_t, size_t>;
+    std::map<key_t, std::shared_ptr<const void>> chunks_;
+    std::mutex mutex_;
+};
+
+/**
+ * ShardContext holds everything needed to build sharded AD expressions
+ * (see model::BarEqNode::ad_log_pdf) and to evaluate independent model terms
+ * concurrently (see prog::ProgramNode::ad_log_pdf).
+ * It must outlive every AD expression built with it.
+ */
+struct ShardContext
+{
+    ShardContext(ThreadPool& _pool,
+                 const ShardConfig& _config,
+                 const OffsetPack& _offsets)
+        : pool{_pool}
+        , config{_config}
+        , offsets{_offsets}
+    {}
+
+    ShardContext(const ShardContext&) =delete;
+    ShardContext& operator=(const ShardContext&) =delete;
+
+    /**
+     * Returns the number of row-ranges to split an observed vector with n_rows rows into.
+     */
+    size_t n_shards(size_t n_rows) const
+    {
+        size_t n = std::min(config.n_shards, 
+                            n_rows / std::max<size_t>(config.min_rows, 1));
+        return std::max<size_t>(n, 1);
+    }
+
+    ThreadPool& pool;
+    const ShardConfig config;
+    const OffsetPack offsets;   // total offsets of the activated program
+    RowChunkCache cache;
+};
+
+} // namespace util
+} // namespace ppl
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ppl {
+namespace util {
+
+/**
+ * ThreadPool is a fixed-size pool of worker threads that is shared
+ * by every parallel section of an inference algorithm
+ * (chains, replicas, shards, post-processing, etc.).
+ *
+ * The calling thread always participates in parallel_for,
+ * so a pool of n threads only spawns n-1 workers.
+ * While a caller waits for its own tasks to finish,
+ * it only executes the pending tasks of its own call (never those of other calls),
+ * so a chain waiting for its shards cannot get stuck running another chain to completion.
+ * Since every pending task can always be run by the caller waiting for it,
+ * nested calls to parallel_for (from within a task) are deadlock-free.
+ */
+struct ThreadPool
+{
+    /**
+     * Constructs a thread pool with n_threads threads (including the caller).
+     * If n_threads is 0, std::thread::hardware_concurrency() threads are used.
+     */
+    explicit ThreadPool(size_t n_threads = 1)
+    {
+        if (n_threads == 0) {
+            n_threads = std::thread::hardware_concurrency();
+        }
+        for (size_t i = 1; i < n_threads; ++i) {
+            workers_.emplace_back([this]() { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) =delete;
+    ThreadPool& operator=(const ThreadPool&) =delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) { worker.join(); }
+    }
+
+    /**
+     * Calls f(i) for every i in [0, n) and returns once all calls have finished.
+     * The calls may be executed concurrently and in any order.
+     * If any call throws, the first exception caught is rethrown
+     * after all calls have finished.
+     *
+     * @param   n   number of tasks
+     * @param   f   functor invocable as f(size_t)
+     */
+    template <class F>
+    void parallel_for(size_t n, F&& f)
+    {
+        if (n == 0) return;
+
+        // no parallelism available: run in order on the calling thread
+        if (workers_.empty() || n == 1) {
+            for (size_t i = 0; i < n; ++i) { f(i); }
+            return;
+        }
+
+        Batch batch(n);
+        // Note: bookkeeping is done under the lock so that the caller
+        // cannot return (and destroy batch) before the last task is done with it.
+        auto run = [&](size_t i) {
+            std::exception_ptr error;
+            try {
+                f(i);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (error && !batch.error) batch.error = error;
+            if (--batch.remaining == 0) cv_.notify_all();
+        };
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (size_t i = 1; i < n; ++i) {
+                tasks_.push_back({&batch, [&run, i]() { run(i); }});
+            }
+            batch.pending = n - 1;
+        }
+        cv_.notify_all();
+
+        // caller always takes the first task
+        run(0);
+
+        // run the pending tasks of this batch, then wait for the ones taken by workers
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (batch.pending > 0) {
+            auto task = pop_task(&batch);
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+        cv_.wait(lock, [&]() { return batch.remaining == 0; });
+        lock.unlock();
+
+        if (batch.error) std::rethrow_exception(batch.error);
+    }
+
+    /**
+     * Returns the number of threads that execute tasks (including the caller).
+     */
+    size_t size() const { return workers_.size() + 1; }
+
+private:
+
+    struct Batch
+    {
+        Batch(size_t n) : remaining{n} {}
+        size_t remaining;           // tasks not finished yet
+        size_t pending = 0;         // tasks still in the queue
+        std::exception_ptr error;
+    };
+
+    struct Task
+    {
+        Batch* batch;
+        std::function<void()> f;
+    };
+
+    /**
+     * Removes the first queued task of batch (or of any batch if batch is nullptr)
+     * and returns its functor. There must be such a task and mutex_ must be held.
+     */
+    std::function<void()> pop_task(const Batch* batch)
+    {
+        auto it = tasks_.begin();
+        if (batch) {
+            it = std::find_if(tasks_.begin(), tasks_.end(),
+                    [&](const Task& task) { return task.batch == batch; });
+        }
+        auto f = std::move(it->f);
+        --it->batch->pending;
+        tasks_.erase(it);
+        return f;
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty()) return;
+            auto task = pop_task(nullptr);
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<Task> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+} // namespace util
+} // namespace ppl
@@ -0,0 +1,417 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+#include <fastad_bits/reverse/core/eval.hpp>
+#include <autoppl/util/packs/ptr_pack.hpp>
+#include <autoppl/util/logging.hpp>
+#include <autoppl/util/time/stopwatch.hpp>
+#include <autoppl/util/thread_pool.hpp>
+#include <autoppl/util/sharding.hpp>
+#include <autoppl/math/math.hpp>
+#include <autoppl/math/density.hpp>
+#include <autoppl/mcmc/result.hpp>
+#include <autoppl/mcmc/base_mcmc.hpp>
+#include <autoppl/mcmc/hmc/leapfrog.hpp>
+#include <autoppl/vi/advi/config.hpp>
+
+namespace ppl {
+namespace vi {
+
+/**
+ * Gaussian variational family in the unconstrained space (see meanfield and fullrank).
+ * All variational parameters are stored in a single vector params
+ * such that they can be updated by the same step size sequence.
+ * Every draw is theta = T(eps) for eps ~ N(0, I).
+ */
+template <class FamilyPolicy>
+struct GaussianFamily;
+
+/**
+ * Mean-field family: params = [mu; omega] and theta = mu + exp(omega) * eps.
+ */
+template <>
+struct GaussianFamily<meanfield>
+{
+    GaussianFamily(size_t n_params)
+        : params(Eigen::VectorXd::Zero(2 * n_params))
+        , n_params_{n_params}
+    {}
+
+    auto mu() { return params.head(n_params_); }
+    auto mu() const { return params.head(n_params_); }
+    auto omega() const { return params.tail(n_params_); }
+
+    template <class EpsType, class ThetaType>
+    void transform(const Eigen::MatrixBase<EpsType>& eps,
+                   Eigen::MatrixBase<ThetaType>& theta) const
+    {
+        theta = mu() + (omega().array().exp() * eps.array()).matrix();
+    }
+
+    /**
+     * Entropy of N(mu, diag(exp(omega))^2).
+     */
+    double entropy() const
+    { return omega().sum() + n_params_ * (0.5 + math::LOG_SQRT_TWO_PI); }
+
+    /**
+     * Adds the gradient of log p(T(eps)) w.r.t. params into grad
+     * given the gradient grad_log_pdf of log p at T(eps).
+     */
+    template <class EpsType, class GradLogPdfType>
+    void add_grad(const Eigen::MatrixBase<EpsType>& eps,
+                  const Eigen::MatrixBase<GradLogPdfType>& grad_log_pdf,
+                  Eigen::VectorXd& grad) const
+    {
+        grad.head(n_params_) += grad_log_pdf;
+        grad.tail(n_params_).array() += grad_log_pdf.array() * eps.array() *
+                                        omega().array().exp();
+    }
+
+    /**
+     * Adds the gradient of the entropy w.r.t. params into grad.
+     */
+    void add_entropy_grad(Eigen::VectorXd& grad) const
+    { grad.tail(n_params_).array() += 1.; }
+
+    Eigen::VectorXd params;
+
+private:
+    size_t n_params_;
+};
+
+/**
+ * Full-rank family: params = [mu; L] where the lower-triangular L
+ * is packed column-major, and theta = mu + L * eps.
+ */
+template <>
+struct GaussianFamily<fullrank>
+{
+    GaussianFamily(size_t n_params)
+        : params(Eigen::VectorXd::Zero(n_params + (n_params * (n_params + 1)) / 2))
+        , n_params_{n_params}
+    {
+        // L = I
+        for (size_t j = 0, k = n_params_; j < n_params_; k += n_params_ - j, ++j) {
+            params(k) = 1.;
+        }
+    }
+
+    auto mu() { return params.head(n_params_); }
+    auto mu() const { return params.head(n_params_); }
+
+    template <class EpsType, class ThetaType>
+    void transform(const Eigen::MatrixBase<EpsType>& eps,
+                   Eigen::MatrixBase<ThetaType>& theta) const
+    {
+        theta = mu();
+        size_t k = n_params_;
+        for (size_t j = 0; j < n_params_; ++j) {
+            for (size_t i = j; i < n_params_; ++i, ++k) {
+                theta(i) += params(k) * eps(j);
+            }
+        }
+    }
+
+    /**
+     * Entropy of N(mu, L L^T).
+     */
+    double entropy() const
+    {
+        double log_det = 0.;
+        for (size_t j = 0, k = n_params_; j < n_params_; k += n_params_ - j, ++j) {
+            log_det += std::log(std::abs(params(k)));
+        }
+        return log_det + n_params_ * (0.5 + math::LOG_SQRT_TWO_PI);
+    }
+
+    template <class EpsType, class GradLogPdfType>
+    void add_grad(const Eigen::MatrixBase<EpsType>& eps,
+                  const Eigen::MatrixBase<GradLogPdfType>& grad_log_pdf,
+                  Eigen::VectorXd& grad) const
+    {
+        grad.head(n_params_) += grad_log_pdf;
+        size_t k = n_params_;
+        for (size_t j = 0; j < n_params_; ++j) {
+            for (size_t i = j; i < n_params_; ++i, ++k) {
+                grad(k) += grad_log_pdf(i) * eps(j);
+            }
+        }
+    }
+
+    void add_entropy_grad(Eigen::VectorXd& grad) const
+    {
+        for (size_t j = 0, k = n_params_; j < n_params_; k += n_params_ - j, ++j) {
+            grad(k) += 1. / params(k);
+        }
+    }
+
+    Eigen::VectorXd params;
+
+private:
+    size_t n_params_;
+};
+
+/**
+ * Runs a single chain of ADVI: maximizes the ELBO of the variational family
+ * given by config by stochastic gradient ascent
+ * and populates samples with draws from the optimized approximation.
+ *
+ * The ELBO gradient is estimated by reparametrization (see GaussianFamily)
+ * using the gradient of the AD expression of the log-pdf (including log-jacobians),
+ * so the approximation lives in the unconstrained space.
+ * The step size sequence is the adaptive sequence of Kucukelbir et al. (2017):
+ *      params += eta * iter^(-1/2 + 1e-16) * grad / (1 + sqrt(s)),
+ *      s = 0.1 * grad^2 + 0.9 * s (s = grad^2 at the first iteration).
+ * The mean of the approximation is initialized by init_params.
+ *
+ * @param   program         program expression used to determine log-pdf
+ * @param   config          ADVI configuration object
+ * @param   pack            offset pack result of activating program
+ * @param   chain           chain index. The chain is seeded with config.seed + chain
+ *                          and only chain 0 prints progress.
+ * @param   samples         matrix-like block of size (config.samples x n_params)
+ *                          that will be populated with draws of this chain.
+ * @param   shard_ctx       context used to build sharded AD expressions
+ * @param   warmup_time     populated with time spent choosing eta
+ * @param   sampling_time   populated with time spent optimizing and drawing samples
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class SamplesType
+        , class ADVIConfigType = ADVIConfig<>>
+void advi_chain_(ProgramType& program,
+                 const ADVIConfigType& config,
+                 const OffsetPackType& pack,
+                 size_t chain,
+                 SamplesType&& samples,
+                 util::ShardContext& shard_ctx,
+                 double& warmup_time,
+                 double& sampling_time)
+{
+    assert(std::get<1>(pack).uc_offset == 0);
+    assert(std::get<1>(pack).tp_offset == 0);
+    assert(std::get<1>(pack).c_offset == 0);
+    assert(std::get<1>(pack).v_offset == 0);
+
+    using family_t = GaussianFamily<typename ADVIConfigType::family_policy_t>;
+
+    auto& offset_pack = std::get<0>(pack);
+    size_t n_params = offset_pack.uc_offset;
+
+    // initialization of meta-variables
+    std::mt19937 gen(config.seed + chain);
+    std::normal_distribution norm_sampler(0., 1.);
+
+    // Transformed parameters, constrained parameter, visit count cache
+    Eigen::MatrixXd tp_mat(offset_pack.tp_offset, 2);
+    Eigen::Map<Eigen::VectorXd> tp_val(tp_mat.col(0).data(), offset_pack.tp_offset);
+    Eigen::Map<Eigen::VectorXd> tp_adj(tp_mat.col(1).data(), offset_pack.tp_offset);
+    Eigen::VectorXd constrained(offset_pack.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> visit(offset_pack.v_offset);
+    tp_mat.setZero();
+    constrained.setZero();
+    visit.setZero();
+
+    // theta, theta_adj: draw from the approximation (and gradient of log-pdf)
+    // eps: standard normal draw such that theta = T(eps)
+    Eigen::MatrixXd cache_mat(n_params, 3);
+    cache_mat.setZero();
+    Eigen::Map<Eigen::VectorXd> theta(cache_mat.col(0).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> theta_adj(cache_mat.col(1).data(), n_params);
+    Eigen::Map<Eigen::VectorXd> eps(cache_mat.col(2).data(), n_params);
+
+    // AD expression for L(theta) (log-pdf up to constant at theta)
+    auto ad_expr = program.ad_log_pdf(util::make_ptr_pack(
+            theta.data(), theta_adj.data(),
+            tp_val.data(), tp_adj.data(),
+            constrained.data(), visit.data() ), shard_ctx);
+    auto size_pack = ad_expr.bind_cache_size();
+    Eigen::VectorXd ad_val_buf(size_pack(0));
+    Eigen::VectorXd ad_adj_buf(size_pack(1));
+    ad_expr.bind_cache({ad_val_buf.data(), ad_adj_buf.data()});
+
+    // initializes mean of approximation
+    program.bind(util::make_ptr_pack(
+                theta.data(), nullptr,
+                tp_val.data(), nullptr,
+                constrained.data(), visit.data()));
+    program.init_params(gen, config.prune);
+
+    family_t family(n_params);
+    family.mu() = theta;
+    const Eigen::VectorXd params_init = family.params;
+    Eigen::VectorXd grad(family.params.size());
+    Eigen::VectorXd s_k(family.params.size());
+
+    auto sample_eps = [&]() {
+        eps = Eigen::VectorXd::NullaryExpr(n_params,
+                [&]() { return norm_sampler(gen); });
+    };
+
+    // Monte Carlo estimate of the ELBO with n draws
+    auto calc_elbo = [&](size_t n) {
+        double log_pdf = 0.;
+        for (size_t s = 0; s < n; ++s) {
+            sample_eps();
+            family.transform(eps, theta);
+            const double lp = ad::evaluate(ad_expr);
+            if (!std::isfinite(lp)) return math::neg_inf<double>;
+            log_pdf += lp;
+        }
+        return log_pdf / static_cast<double>(n) + family.entropy();
+    };
+
+    // Monte Carlo estimate of the ELBO gradient into grad
+    auto calc_grad = [&]() {
+        grad.setZero();
+        for (size_t s = 0; s < config.grad_samples; ++s) {
+            sample_eps();
+            family.transform(eps, theta);
+            mcmc::reset_autodiff(ad_expr, theta_adj, tp_adj);
+            family.add_grad(eps, theta_adj, grad);
+        }
+        grad /= static_cast<double>(config.grad_samples);
+        family.add_entropy_grad(grad);
+    };
+
+    // one step of stochastic gradient ascent at iteration iter (starting at 1)
+    auto step = [&](double eta, size_t iter) {
+        calc_grad();
+        if (!grad.allFinite()) return;
+        if (iter == 1) {
+            s_k = grad.array().square();
+        } else {
+            s_k = 0.1 * grad.array().square() + 0.9 * s_k.array();
+        }
+        const double eta_scaled = eta / std::sqrt(static_cast<double>(iter));
+        family.params.array() += eta_scaled * grad.array() / (1. + s_k.array().sqrt());
+    };
+
+    // construct miscellaneous objects
+    auto logger = util::ProgressLogger(config.max_iter, "ADVI",
+                                       std::cout, chain == 0);
+    util::StopWatch<> stopwatch_warmup;
+    util::StopWatch<> stopwatch_sampling;
+
+    stopwatch_warmup.start();
+
+    // choose eta with the highest ELBO after adapt_iter iterations
+    double eta = config.eta;
+    if (!(eta > 0.)) {
+        const double eta_sequence[] = {100., 10., 1., 0.1, 0.01};
+        double elbo_best = math::neg_inf<double>;
+        eta = eta_sequence[4];
+        for (double eta_curr : eta_sequence) {
+            family.params = params_init;
+            for (size_t iter = 1; iter <= config.adapt_iter; ++iter) {
+                step(eta_curr, iter);
+            }
+            const double elbo = calc_elbo(config.elbo_samples);
+            if (elbo > elbo_best) {
+                elbo_best = elbo;
+                eta = eta_curr;
+            }
+        }
+        family.params = params_init;
+    }
+
+    stopwatch_warmup.stop();
+    stopwatch_sampling.start();
+
+    // relative changes of the ELBO over the recent evaluations
+    const size_t cb_size = std::max<size_t>(
+            0.1 * config.max_iter / std::max<size_t>(config.eval_elbo, 1), 2);
+    std::vector<double> rel_changes;
+    std::vector<double> rel_changes_sorted;
+    double elbo_prev = math::neg_inf<double>;
+
+    for (size_t iter = 1; iter <= config.max_iter; ++iter) {
+
+        logger.printProgress(iter-1);
+
+        step(eta, iter);
+
+        if (config.eval_elbo && (iter % config.eval_elbo == 0)) {
+            const double elbo = calc_elbo(config.elbo_samples);
+            if (std::isfinite(elbo_prev) && std::isfinite(elbo)) {
+                if (rel_changes.size() == cb_size) {
+                    rel_changes.erase(rel_changes.begin());
+                }
+                rel_changes.push_back(std::abs((elbo - elbo_prev) / elbo));
+                const double mean_change = std::accumulate(
+                        rel_changes.begin(), rel_changes.end(), 0.) / rel_changes.size();
+                rel_changes_sorted = rel_changes;
+                auto mid = rel_changes_sorted.begin() + rel_changes_sorted.size() / 2;
+                std::nth_element(rel_changes_sorted.begin(), mid, rel_changes_sorted.end());
+                if (mean_change < config.tol_rel_obj || *mid < config.tol_rel_obj) break;
+            }
+            elbo_prev = elbo;
+        }
+    }
+
+    // draw samples from the approximation
+    for (size_t i = 0; i < config.samples; ++i) {
+        sample_eps();
+        family.transform(eps, theta);
+        samples.row(i) = theta;
+    }
+
+    stopwatch_sampling.stop();
+
+    warmup_time = stopwatch_warmup.elapsed();
+    sampling_time = stopwatch_sampling.elapsed();
+}
+
+/**
+ * ADVI to approximate the posterior distribution.
+ * Runs config.n_chains independent chains on the thread pool.
+ * Every chain is given its own copy of the program since the program
+ * gets bound to buffers owned by the chain.
+ *
+ * @param   program     program expression used to determine log-pdf
+ * @param   config      ADVI configuration object
+ * @param   pack        offset pack result of activating program.
+ * @param   res         result object that will be populated with draws and other information.
+ * @param   pool        thread pool to run chains (and shards) on
+ */
+template <class ProgramType
+        , class OffsetPackType
+        , class MCMCResultType
+        , class ADVIConfigType = ADVIConfig<>>
+void advi_(const ProgramType& program,
+           const ADVIConfigType& config,
+           const OffsetPackType& pack,
+           MCMCResultType& res,
+           util::ThreadPool& pool)
+{
+    util::ShardContext shard_ctx(pool, config.shard_config, std::get<0>(pack));
+    mcmc::run_chains(config, pool, res,
+            [&](size_t chain, double& warmup_time, double& sampling_time) {
+                ProgramType chain_program = program;
+                advi_chain_(chain_program, config, pack, chain,
+                            res.cont_chain(chain), shard_ctx,
+                            warmup_time, sampling_time);
+            });
+}
+
+} // namespace vi
+
+template <class ExprType
+        , class ADVIConfigType = ADVIConfig<>>
+inline auto advi(const ExprType& expr,
+                 const ADVIConfigType& config = ADVIConfigType())
+{
+    return mcmc::base_mcmc(expr, config,
+            [](const auto& program, const auto& config,
+               const auto& pack, auto& res, auto& pool) {
+                res.name = "advi";
+                vi::advi_(program, config, pack, res, pool);
+            });
+}
+
+} // namespace ppl
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <autoppl/mcmc/config_base.hpp>
+#include <autoppl/util/sharding.hpp>
+
+namespace ppl {
+
+/**
+ * Variational families of ADVI (Gaussians in the unconstrained space).
+ * - meanfield: N(mu, diag(exp(omega))^2)
+ * - fullrank:  N(mu, L L^T) where L is lower-triangular
+ */
+struct meanfield {};
+struct fullrank {};
+
+/**
+ * User configuration for Automatic Differentiation Variational Inference (ADVI).
+ * Every chain maximizes the ELBO independently with stochastic gradient ascent
+ * and then draws samples from its approximation (warmup is not used).
+ *
+ * Every gradient of the ELBO is a Monte Carlo estimate with grad_samples draws.
+ * Every eval_elbo iterations, the ELBO is estimated with elbo_samples draws
+ * and the optimization stops once the relative change of the ELBO
+ * (mean or median over recent evaluations) is below tol_rel_obj.
+ * If eta is not positive, it is chosen among 100, 10, 1, 0.1, 0.01
+ * by running adapt_iter iterations with each and keeping the one with the highest ELBO.
+ */
+template <class FamilyPolicy=meanfield>
+struct ADVIConfig: ConfigBase
+{
+    using family_policy_t = FamilyPolicy;
+
+    size_t max_iter = 10000;
+    size_t grad_samples = 1;
+    size_t elbo_samples = 100;
+    size_t eval_elbo = 100;
+    double tol_rel_obj = 0.01;
+
+    // configuration for step size sequence
+    double eta = 0.;
+    size_t adapt_iter = 50;
+
+    // configuration for sharded likelihood evaluation
+    ShardConfig shard_config;
+};
+
+} // namespace ppl
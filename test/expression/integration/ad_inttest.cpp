@@ -9,6 +9,7 @@
 #include <autoppl/expression/constraint/pos_def.hpp>
 #include <autoppl/expression/variable/binary.hpp>
 #include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/dot.hpp>
 #include <autoppl/expression/variable/for_each.hpp>
 #include <autoppl/expression/variable/op_eq.hpp>
 #include <autoppl/expression/variable/glue.hpp>
@@ -16,6 +17,7 @@
 #include <autoppl/util/ad_boost/lower_inv_transform.hpp>
 #include <autoppl/util/ad_boost/cov_inv_transform.hpp>
 #include <autoppl/util/iterator/counting_iterator.hpp>
+#include <autoppl/util/sharding.hpp>
 #include <autoppl/expression/distribution/normal.hpp>
 #include <autoppl/expression/distribution/uniform.hpp>
 #include <autoppl/expression/distribution/cauchy.hpp>
@@ -382,4 +384,153 @@ TEST_F(ad_integration_fixture, stochastic_volatility)
     EXPECT_NEAR(adjs[4], 0.927008680929915396, tol);    // h_std[1]
 }
 
+TEST_F(ad_integration_fixture, ad_log_pdf_sharded)
+{
+    constexpr size_t n = 11;
+    mat_d_t X(n, 2);
+    vec_d_t z(n);
+    for (size_t i = 0; i < n; ++i) {
+        X.get()(i, 0) = 1.;
+        X.get()(i, 1) = std::sin(0.7 * i);
+        z.get()(i) = 0.5 - 1.5 * X.get()(i, 1) + 0.3 * std::cos(1.3 * i);
+    }
+    Param<value_t, vec> w(2);
+    Param s = make_param<value_t>(lower(0.));
+
+    auto model = (
+        s |= uniform(0., 5.),
+        w |= normal(0., 1.),
+        z |= normal(dot(X, w), s)
+    );
+    using program_t = util::convert_to_program_t<std::decay_t<decltype(model)>>;
+    program_t program = model;
+    auto res = program.activate();
+    const auto& offsets = std::get<0>(res);
+
+    EXPECT_EQ(offsets.uc_offset, 3ul);
+    EXPECT_EQ(offsets.v_offset, 1ul);
+
+    vals.resize(offsets.uc_offset);
+    adjs.resize(offsets.uc_offset);
+
+    // sharded expressions reset visit counts, 
+    // so they must not share them with unsharded expressions.
+    Eigen::VectorXd c_vals(offsets.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> v_vals(offsets.v_offset);
+    Eigen::VectorXd sharded_c_vals(offsets.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> sharded_v_vals(offsets.v_offset);
+    v_vals.setZero();
+    sharded_v_vals.setZero();
+
+    ptr_pack.uc_val = vals.data();
+    ptr_pack.uc_adj = adjs.data();
+    ptr_pack.c_val = c_vals.data();
+    ptr_pack.v_val = v_vals.data();
+    auto expr = ad::bind(program.ad_log_pdf(ptr_pack));
+
+    util::ThreadPool pool(3);
+    ShardConfig config;
+    config.n_shards = 4;
+    config.min_rows = 1;
+    util::ShardContext ctx(pool, config, offsets);
+    EXPECT_EQ(ctx.n_shards(n), 4ul);
+
+    auto sharded_pack = ptr_pack;
+    sharded_pack.c_val = sharded_c_vals.data();
+    sharded_pack.v_val = sharded_v_vals.data();
+    auto sharded_expr = ad::bind(program.ad_log_pdf(sharded_pack, ctx));
+
+    // evaluate at different points to check that nothing is stale
+    for (size_t k = 0; k < 3; ++k) {
+        vals << std::log(0.8 + 0.2 * k), 0.4 - 0.1 * k, -1. + 0.3 * k;
+
+        adjs.setZero();
+        value_t expected = ad::autodiff(expr);
+        Eigen::VectorXd expected_adjs = adjs;
+
+        adjs.setZero();
+        value_t actual = ad::autodiff(sharded_expr);
+
+        EXPECT_NEAR(actual, expected, 1e-12);
+        for (int i = 0; i < adjs.size(); ++i) {
+            EXPECT_NEAR(adjs(i), expected_adjs(i), 1e-12);
+        }
+    }
+}
+
+TEST_F(ad_integration_fixture, ad_log_pdf_parallel_terms)
+{
+    constexpr size_t n = 7;
+    vec_d_t x(n);
+    vec_d_t y(n);
+    for (size_t i = 0; i < n; ++i) {
+        x.get()(i) = 1. + std::sin(0.7 * i);
+        y.get()(i) = std::cos(1.3 * i);
+    }
+    Param<value_t> mu;
+    Param s = make_param<value_t>(lower(0.));
+    Param t = make_param<value_t>(lower(0.));
+    Param<value_t> nu;
+
+    auto model = (
+        mu |= normal(0., 1.),
+        s |= uniform(0., 5.),
+        x |= normal(mu, 1.),
+        t |= normal(s, 2.),
+        y |= normal(0., t),
+        nu |= normal(0., 3.)
+    );
+    using program_t = util::convert_to_program_t<std::decay_t<decltype(model)>>;
+    program_t program = model;
+    auto res = program.activate();
+    const auto& offsets = std::get<0>(res);
+
+    // s and t are grouped through the distribution of t.
+    std::vector<size_t> expected_groups = {0, 1, 0, 1, 1, 2};
+    EXPECT_EQ(program.term_groups(), expected_groups);
+
+    vals.resize(offsets.uc_offset);
+    adjs.resize(offsets.uc_offset);
+
+    Eigen::VectorXd c_vals(offsets.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> v_vals(offsets.v_offset);
+    Eigen::VectorXd parallel_c_vals(offsets.c_offset);
+    Eigen::Matrix<size_t, Eigen::Dynamic, 1> parallel_v_vals(offsets.v_offset);
+    v_vals.setZero();
+    parallel_v_vals.setZero();
+
+    ptr_pack.uc_val = vals.data();
+    ptr_pack.uc_adj = adjs.data();
+    ptr_pack.c_val = c_vals.data();
+    ptr_pack.v_val = v_vals.data();
+    auto expr = ad::bind(program.ad_log_pdf(ptr_pack));
+
+    util::ThreadPool pool(3);
+    ShardConfig config;
+    config.parallel_terms = true;
+    util::ShardContext ctx(pool, config, offsets);
+
+    auto parallel_pack = ptr_pack;
+    parallel_pack.c_val = parallel_c_vals.data();
+    parallel_pack.v_val = parallel_v_vals.data();
+    auto parallel_expr = ad::bind(program.ad_log_pdf(parallel_pack, ctx));
+
+    for (size_t k = 0; k < 3; ++k) {
+        vals << 0.2 * k - 0.1, std::log(1.2 + 0.3 * k), 
+                std::log(0.5 + 0.1 * k), 0.7 - 0.4 * k;
+
+        adjs.setZero();
+        value_t expected = ad::autodiff(expr);
+        Eigen::VectorXd expected_adjs = adjs;
+
+        adjs.setZero();
+        value_t actual = ad::autodiff(parallel_expr);
+
+        EXPECT_NEAR(actual, expected, 1e-12);
+        for (int i = 0; i < adjs.size(); ++i) {
+            EXPECT_NEAR(adjs(i), expected_adjs(i), 1e-12);
+        }
+    }
+}
+
 } // namespace ppl
@@ -74,5 +74,20 @@ TEST_F(autocorrelation_fixture, two_vec_seven)
     check_results(ac, ac_true);
 }
 
+TEST_F(autocorrelation_fixture, workspace_reuse_row_major)
+{
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> x(7,2);
+    x.col(0) << 1.,-3.,2.,5.,1.,-0.32,0.32;
+    x.col(1) << 8.9,0.1,-0.2,0.32,1.32,0.3,-0.001;
+
+    AutocorrelationWorkspace<double> workspace;
+    Eigen::MatrixXd ac(7,2);
+    workspace.compute(x.col(0), ac.col(0));
+    workspace.compute(x.col(1), ac.col(1));
+    Eigen::MatrixXd ac_true = brute_force(x);
+
+    check_results(ac, ac_true);
+}
+
 } // namespace math
 } // namespace ppl
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <autoppl/math/convergence.hpp>
+#include <gtest/gtest.h>
+
+namespace ppl {
+namespace math {
+
+struct convergence_fixture : ::testing::Test
+{
+protected:
+    using mat_t = Eigen::MatrixXd;
+
+    std::mt19937 gen{0};
+    std::normal_distribution<> norm{0., 1.};
+
+    mat_t iid(size_t n, size_t dim, double mean = 0.)
+    {
+        return mat_t::NullaryExpr(n, dim, [&]() { return mean + norm(gen); });
+    }
+};
+
+TEST_F(convergence_fixture, inv_normal_cdf)
+{
+    EXPECT_NEAR(inv_normal_cdf(0.5), 0., 1e-14);
+    EXPECT_NEAR(inv_normal_cdf(0.975), 1.959963984540054, 1e-12);
+    EXPECT_NEAR(inv_normal_cdf(0.025), -1.959963984540054, 1e-12);
+    EXPECT_NEAR(inv_normal_cdf(1e-6), -4.753424308822899, 1e-10);
+    EXPECT_NEAR(inv_normal_cdf(1. - 1e-6), 4.753424308822899, 1e-8);
+}
+
+TEST_F(convergence_fixture, rank_normalize_invariant_to_monotone_transform)
+{
+    std::vector<mat_t> x = {iid(100, 2), iid(100, 2)};
+    std::vector<mat_t> y = {x[0].array().exp(), x[1].array().exp()};
+    auto zx = rank_normalize<double>({x.begin(), x.end()});
+    auto zy = rank_normalize<double>({y.begin(), y.end()});
+    EXPECT_EQ(zx[0], zy[0]);
+    EXPECT_EQ(zx[1], zy[1]);
+    // ranks are symmetric around the median
+    EXPECT_NEAR(zx[0].col(0).sum() + zx[1].col(0).sum(), 0., 1e-10);
+}
+
+TEST_F(convergence_fixture, rank_normalize_ties)
+{
+    mat_t x(4, 1);
+    x << 1., 2., 2., 3.;
+    std::vector<mat_t> v = {x};
+    auto z = rank_normalize<double>({v.begin(), v.end()});
+    EXPECT_DOUBLE_EQ(z[0](1,0), z[0](2,0));
+    EXPECT_NEAR(z[0](1,0), 0., 1e-14);
+}
+
+TEST_F(convergence_fixture, split_chains_odd)
+{
+    mat_t x(5, 1);
+    x << 1., 2., 3., 4., 5.;
+    std::vector<mat_t> v = {x};
+    auto split = split_chains<double>({v.begin(), v.end()});
+    EXPECT_EQ(split.size(), static_cast<size_t>(2));
+    EXPECT_EQ(split[0].rows(), 2);
+    EXPECT_DOUBLE_EQ(split[0](1,0), 2.);
+    EXPECT_DOUBLE_EQ(split[1](0,0), 4.);
+}
+
+TEST_F(convergence_fixture, rhat_converged)
+{
+    std::vector<mat_t> v = {iid(1000, 3), iid(1000, 3), iid(1000, 3), iid(1000, 3)};
+    details::vec_cref_t<double> v_ref(v.begin(), v.end());
+    auto r = bulk_rhat(v_ref);
+    auto n_eff = bulk_ess(v_ref);
+    EXPECT_EQ(r.size(), 3);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_LT(r(i), 1.01);
+        EXPECT_GT(n_eff(i), 3000.);
+    }
+}
+
+TEST_F(convergence_fixture, rhat_not_converged)
+{
+    // one chain stuck in a different mode
+    std::vector<mat_t> v = {iid(500, 1), iid(500, 1), iid(500, 1, 3.)};
+    details::vec_cref_t<double> v_ref(v.begin(), v.end());
+    EXPECT_GT(rhat(v_ref)(0), 1.1);
+    EXPECT_GT(bulk_rhat(v_ref)(0), 1.1);
+}
+
+TEST_F(convergence_fixture, rhat_split_detects_trend)
+{
+    // a single chain with a trend is only detected after splitting
+    mat_t x(1000, 1);
+    for (int i = 0; i < x.rows(); ++i) x(i,0) = 0.01 * i + norm(gen);
+    std::vector<mat_t> v = {x};
+    details::vec_cref_t<double> v_ref(v.begin(), v.end());
+    EXPECT_DOUBLE_EQ(rhat(v_ref)(0), std::sqrt(999./1000.));
+    EXPECT_GT(bulk_rhat(v_ref)(0), 1.1);
+}
+
+} // namespace math
+} // namespace ppl
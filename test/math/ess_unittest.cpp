@@ -64,5 +64,35 @@ TEST_F(ess_fixture, test)
     Eigen::VectorXd ESS = ess(v_ref);
 }
 
+TEST_F(ess_fixture, estimator_views_threads)
+{
+    for (size_t m = 0; m < v.size(); ++m) {
+        for (int i = 0; i < v[m].rows(); ++i) {
+            v[m](i,0) = std::sin(1. + i + 3.*m);
+            v[m](i,1) = std::cos(2.*i - m) + 0.1*i;
+        }
+    }
+    Eigen::VectorXd ESS = ess(v_ref);
+
+    // row-major result with chains stacked
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> res(18, 2);
+    std::vector<Eigen::Ref<const decltype(res)>> blocks;
+    for (size_t m = 0; m < v.size(); ++m) {
+        res.middleRows(6*m, 6) = v[m];
+        blocks.emplace_back(res.middleRows(6*m, 6));
+    }
+
+    util::ThreadPool pool(2);
+    ESSEstimator<double> estimator(&pool);
+    for (size_t k = 0; k < 2; ++k) {
+        const auto& ESS_views = estimator(blocks);
+        EXPECT_EQ(ESS_views.size(), 2);
+        for (int d = 0; d < ESS.size(); ++d) {
+            EXPECT_NEAR(ESS_views(d), ESS(d), 1e-12 * std::abs(ESS(d)));
+        }
+    }
+    EXPECT_EQ(ESSEstimator<double>()(v), ESS);
+}
+
 } // namespace math
 } // namespace ppl
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <random>
+#include <autoppl/math/mcse.hpp>
+#include <gtest/gtest.h>
+
+namespace ppl {
+namespace math {
+
+struct mcse_fixture : ::testing::Test
+{
+protected:
+    std::mt19937 gen{0};
+    std::normal_distribution<> norm{0., 1.};
+};
+
+TEST_F(mcse_fixture, too_few_batches)
+{
+    BatchMeans bm(2, 10);
+    Eigen::VectorXd x = Eigen::VectorXd::Ones(2);
+    Eigen::VectorXd mcse(2);
+    for (int i = 0; i < 19; ++i) bm.update(x);
+    EXPECT_EQ(bm.get_n_batches(), static_cast<size_t>(1));
+    bm.get_mcse(mcse);
+    EXPECT_TRUE(std::isnan(mcse(0)));
+    EXPECT_TRUE(std::isnan(mcse(1)));
+}
+
+TEST_F(mcse_fixture, batch_means_exact)
+{
+    // batches of size 2: means 1, 3, 5 => variance 4, mcse = sqrt(4 / 3)
+    BatchMeans bm(1, 2);
+    Eigen::VectorXd x(1);
+    Eigen::VectorXd mcse(1);
+    for (double xi : {0., 2., 2., 4., 4., 6., 100.}) {
+        x(0) = xi;
+        bm.update(x);
+    }
+    EXPECT_EQ(bm.get_n_batches(), static_cast<size_t>(3));
+    bm.get_mcse(mcse);
+    EXPECT_DOUBLE_EQ(mcse(0), std::sqrt(4./3.));
+}
+
+TEST_F(mcse_fixture, iid_matches_sd_over_sqrt_n)
+{
+    constexpr size_t n = 40000;
+    BatchMeans bm(1, 200);
+    Eigen::VectorXd x(1);
+    Eigen::VectorXd mcse(1);
+    for (size_t i = 0; i < n; ++i) {
+        x(0) = norm(gen);
+        bm.update(x);
+    }
+    bm.get_mcse(mcse);
+    EXPECT_NEAR(mcse(0), 1./std::sqrt(n), 0.25/std::sqrt(n));
+}
+
+TEST_F(mcse_fixture, ar1_larger_than_iid)
+{
+    // AR(1) with rho = 0.9 has MCSE sqrt((1 + rho) / (1 - rho)) times larger than iid draws
+    constexpr size_t n = 100000;
+    constexpr double rho = 0.9;
+    BatchMeans bm(1, 316);
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(1);
+    Eigen::VectorXd mcse(1);
+    for (size_t i = 0; i < n; ++i) {
+        x(0) = rho * x(0) + std::sqrt(1 - rho * rho) * norm(gen);
+        bm.update(x);
+    }
+    bm.get_mcse(mcse);
+    const double expected = std::sqrt((1 + rho) / (1 - rho) / n);
+    EXPECT_NEAR(mcse(0), expected, 0.25 * expected);
+}
+
+} // namespace math
+} // namespace ppl
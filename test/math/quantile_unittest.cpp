@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <autoppl/math/quantile.hpp>
+#include <gtest/gtest.h>
+
+namespace ppl {
+namespace math {
+
+struct quantile_fixture : ::testing::Test
+{
+protected:
+    std::mt19937 gen{0};
+};
+
+TEST_F(quantile_fixture, empty)
+{
+    P2Quantile q(0.3);
+    EXPECT_EQ(q.get_n_samples(), static_cast<size_t>(0));
+    EXPECT_TRUE(std::isnan(q.get_quantile()));
+}
+
+TEST_F(quantile_fixture, few_samples_exact)
+{
+    P2Quantile q(0.5);
+    q.update(3.);
+    EXPECT_DOUBLE_EQ(q.get_quantile(), 3.);
+    q.update(1.);
+    EXPECT_DOUBLE_EQ(q.get_quantile(), 2.);
+    q.update(2.);
+    EXPECT_DOUBLE_EQ(q.get_quantile(), 2.);
+}
+
+TEST_F(quantile_fixture, normal_quantiles)
+{
+    std::normal_distribution<> norm(1., 2.);
+    std::vector<double> probs = {0.05, 0.25, 0.5, 0.75, 0.95};
+    std::vector<P2Quantile> qs(probs.begin(), probs.end());
+    std::vector<double> x(100000);
+    for (auto& xi : x) {
+        xi = norm(gen);
+        for (auto& q : qs) q.update(xi);
+    }
+    std::sort(x.begin(), x.end());
+    for (size_t k = 0; k < probs.size(); ++k) {
+        const double expected = x[static_cast<size_t>(probs[k] * (x.size() - 1))];
+        EXPECT_EQ(qs[k].get_n_samples(), x.size());
+        EXPECT_NEAR(qs[k].get_quantile(), expected, 0.02);
+    }
+}
+
+TEST_F(quantile_fixture, skewed_quantiles)
+{
+    std::exponential_distribution<> expo(1.);
+    P2Quantile q(0.9);
+    std::vector<double> x(100000);
+    for (auto& xi : x) {
+        xi = expo(gen);
+        q.update(xi);
+    }
+    std::sort(x.begin(), x.end());
+    EXPECT_NEAR(q.get_quantile(), x[static_cast<size_t>(0.9 * (x.size() - 1))], 0.02);
+}
+
+TEST_F(quantile_fixture, reset)
+{
+    P2Quantile q(0.5);
+    for (int i = 0; i < 10; ++i) q.update(i);
+    q.reset();
+    EXPECT_EQ(q.get_n_samples(), static_cast<size_t>(0));
+    q.update(7.);
+    EXPECT_DOUBLE_EQ(q.get_quantile(), 7.);
+}
+
+} // namespace math
+} // namespace ppl
@@ -46,8 +46,62 @@ TEST_F(welford_fixture, update_two)
     EXPECT_EQ(wel.get_n_samples(), static_cast<size_t>(2));
 
     v = wel.get_variance() / (wel.get_n_samples() - 1);
-    EXPECT_DOUBLE_EQ(v[0], 0.25);
-    EXPECT_DOUBLE_EQ(v[1], 0.25);
+    EXPECT_DOUBLE_EQ(v[0], 0.5);
+    EXPECT_DOUBLE_EQ(v[1], 0.5);
+    EXPECT_DOUBLE_EQ(wel.get_mean()[0], 0.5);
+    EXPECT_DOUBLE_EQ(wel.get_mean()[1], 0.5);
+}
+
+TEST_F(welford_fixture, update_many)
+{
+    constexpr size_t n = 100;
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(n, 3);
+
+    WelfordVar wel(3);
+    for (size_t i = 0; i < n; ++i) {
+        wel.update(X.row(i).transpose());
+    }
+
+    Eigen::MatrixXd centered = X.rowwise() - X.colwise().mean();
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(wel.get_mean()(i), X.col(i).mean(), 1e-14);
+        EXPECT_NEAR(wel.get_variance()(i), centered.col(i).squaredNorm(), 1e-12);
+    }
+}
+
+TEST_F(welford_fixture, cov_ctor)
+{
+    WelfordCov wel(2);
+    EXPECT_EQ(wel.get_n_samples(), static_cast<size_t>(0));
+    EXPECT_DOUBLE_EQ(wel.get_covariance().norm(), 0.);
+}
+
+TEST_F(welford_fixture, cov_update)
+{
+    constexpr size_t n = 100;
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(n, 3);
+    X.col(2) = 2 * X.col(0) - X.col(1);
+
+    WelfordCov wel(3);
+    for (size_t i = 0; i < n; ++i) {
+        wel.update(X.row(i).transpose());
+    }
+
+    EXPECT_EQ(wel.get_n_samples(), n);
+
+    Eigen::MatrixXd centered = X.rowwise() - X.colwise().mean();
+    Eigen::MatrixXd expected = centered.transpose() * centered;
+    Eigen::MatrixXd actual = wel.get_covariance();
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(wel.get_mean()(i), X.col(i).mean(), 1e-14);
+        for (int j = 0; j < 3; ++j) {
+            EXPECT_NEAR(actual(i,j), expected(i,j), 1e-12);
+        }
+    }
+
+    wel.reset();
+    EXPECT_EQ(wel.get_n_samples(), static_cast<size_t>(0));
+    EXPECT_DOUBLE_EQ(wel.get_covariance().norm(), 0.);
 }
 
 } // namespace math
@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+#include <numeric>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/hmc/chees/chees.hpp>
+#include <testutil/sample_tools.hpp>
+
+namespace ppl {
+
+struct chees_fixture : ::testing::Test
+{
+protected:
+    size_t n_samples = 2000;
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w, b;
+    d_vec_t x, y;
+
+    ChEESConfig<> config;
+
+    chees_fixture()
+        : w{}
+        , b{}
+        , x(6)
+        , y(6)
+    {
+        x.get() << 2.5, 3, 3.5, 4, 4.5, 5.;
+        y.get() << 3.5, 4, 4.5, 5, 5.5, 6.;
+
+        config.samples = n_samples;
+        config.warmup = n_samples;
+        config.seed = 0;
+    }
+
+    template <class VecType>
+    double sample_average(const VecType& v)
+    {
+        return std::accumulate(v.data(), v.data() + v.size(), 0.)/v.size();
+    }
+};
+
+TEST_F(chees_fixture, chees_gradient_sign)
+{
+    // proposals spread out further than previous states while moving outwards:
+    // longer trajectories increase ChEES
+    Eigen::MatrixXd prev(1, 2);
+    Eigen::MatrixXd prop(1, 2);
+    Eigen::MatrixXd velocity(1, 2);
+    Eigen::VectorXd accept(2);
+    prev << -0.1, 0.1;
+    prop << -1., 1.;
+    velocity << -1., 1.;
+    accept << 1., 1.;
+    EXPECT_GT(mcmc::chees_gradient(prev, prop, velocity, accept, 1.), 0.);
+
+    // moving inwards: shorter trajectories increase ChEES
+    velocity << 1., -1.;
+    EXPECT_LT(mcmc::chees_gradient(prev, prop, velocity, accept, 1.), 0.);
+
+    // rejected (divergent) proposals are ignored
+    prop(0, 1) = std::numeric_limits<double>::quiet_NaN();
+    accept << 0., 0.;
+    EXPECT_DOUBLE_EQ(mcmc::chees_gradient(prev, prop, velocity, accept, 1.), 0.);
+}
+
+TEST_F(chees_fixture, trajectory_adapter_clamps)
+{
+    mcmc::TrajectoryAdapter adapter(1.);
+    for (size_t i = 0; i < 1000; ++i) {
+        adapter.adapt(1., 0.1, 2.);
+    }
+    EXPECT_NEAR(adapter.integration_time(), 2., 1e-12);
+    for (size_t i = 0; i < 1000; ++i) {
+        adapter.adapt(-1., 0.1, 2.);
+    }
+    EXPECT_NEAR(adapter.integration_time(), 0.1, 1e-12);
+}
+
+TEST_F(chees_fixture, chees_std_normal)
+{
+    auto model = (
+        w |= normal(0., 1.)
+    );
+
+    auto out = chees(model, config);
+
+    EXPECT_EQ(out.name, "chees");
+    EXPECT_EQ(out.n_chains, config.n_chains);
+    plot_hist(out.cont_samples.col(0));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 0., 0.05);
+}
+
+TEST_F(chees_fixture, chees_sample_regression_dist_weight_bias)
+{
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    config.n_threads = 4;
+
+    auto out = chees(model, config);
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_NEAR(sample_average(out.cont_chain(c).col(0)), 1.0319, 0.08);
+        EXPECT_NEAR(sample_average(out.cont_chain(c).col(1)), 0.8712, 0.1);
+    }
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = chees(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+}
+
+} // namespace ppl
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include <numeric>
+#include <random>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/hmc/hmc/hmc.hpp>
+#include <testutil/sample_tools.hpp>
+
+namespace ppl {
+
+struct hmc_fixture : ::testing::Test
+{
+protected:
+    size_t n_samples = 5000;
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w, b;
+    d_vec_t x, y;
+
+    HMCConfig<> config;
+
+    hmc_fixture()
+        : w{}
+        , b{}
+        , x(6)
+        , y(6)
+    {
+        x.get() << 2.5, 3, 3.5, 4, 4.5, 5.;
+        y.get() << 3.5, 4, 4.5, 5, 5.5, 6.;
+
+        config.samples = n_samples;
+        config.warmup = n_samples;
+        config.seed = 0;
+    }
+
+    template <class VecType>
+    double sample_average(const VecType& v)
+    {
+        return std::accumulate(v.data(), v.data() + v.size(), 0.)/v.size();
+    }
+};
+
+TEST_F(hmc_fixture, n_leapfrog_steps)
+{
+    std::mt19937 gen(0);
+    std::uniform_real_distribution unif_sampler(0., 1.);
+
+    EXPECT_EQ(mcmc::n_leapfrog_steps(1., 0., 100, 0.1, unif_sampler, gen), 10ul);
+    EXPECT_EQ(mcmc::n_leapfrog_steps(1., 0., 100, 10., unif_sampler, gen), 1ul);
+    EXPECT_EQ(mcmc::n_leapfrog_steps(1., 0., 100, 1e-5, unif_sampler, gen), 100ul);
+
+    for (size_t i = 0; i < 100; ++i) {
+        size_t n = mcmc::n_leapfrog_steps(1., 0.5, 100, 0.01, unif_sampler, gen);
+        EXPECT_GE(n, 50ul);
+        EXPECT_LE(n, 150ul);
+    }
+}
+
+TEST_F(hmc_fixture, hmc_std_normal)
+{
+    auto model = (
+        w |= normal(0., 1.)
+    );
+
+    auto out = hmc(model, config);
+
+    plot_hist(out.cont_samples.col(0));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 0., 0.05);
+}
+
+TEST_F(hmc_fixture, hmc_sample_unif_normal_posterior_mean)
+{
+    Data<double> z(3.);
+    auto model = (
+        w |= uniform(-20., 20.),
+        z |= normal(w, 1.)
+    );
+    config.jitter = 0.2;
+
+    auto out = hmc(model, config);
+
+    plot_hist(out.cont_samples.col(0));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 3.0, 0.05);
+}
+
+TEST_F(hmc_fixture, hmc_sample_regression_dist_weight_bias)
+{
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    config.integration_time = 3.;
+
+    auto out = hmc(model, config);
+
+    plot_hist(out.cont_samples.col(0), 0.1);
+    plot_hist(out.cont_samples.col(1));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(hmc_fixture, hmc_multi_chain)
+{
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    config.n_chains = 3;
+    config.n_threads = 3;
+    auto out = hmc(model, config);
+
+    config.n_threads = 1;
+    auto out_serial = hmc(model, config);
+
+    EXPECT_EQ(out.name, "hmc");
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+    EXPECT_NE(out.cont_chain(0), out.cont_chain(1));
+}
+
+} // namespace ppl
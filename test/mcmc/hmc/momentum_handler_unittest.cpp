@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <autoppl/mcmc/hmc/momentum_handler.hpp>
+
+namespace ppl {
+namespace mcmc {
+
+struct momentum_handler_fixture : ::testing::Test
+{
+protected:
+    static constexpr size_t n_params = 4;
+    static constexpr size_t rank = 2;
+
+    LowRankMetric metric;
+    Eigen::MatrixXd dense_m_inverse;
+    std::mt19937 gen;
+
+    momentum_handler_fixture()
+        : metric(n_params)
+        , gen(0)
+    {
+        metric.scale << 0.5, 1., 2., 3.;
+
+        // orthonormal U
+        Eigen::MatrixXd A(n_params, rank);
+        A << 1, 0,
+             1, 1,
+             0, 1,
+             1, -1;
+        Eigen::HouseholderQR<Eigen::MatrixXd> qr(A);
+        metric.U = qr.householderQ() * Eigen::MatrixXd::Identity(n_params, rank);
+        metric.lambda.resize(rank);
+        metric.lambda << 10., 0.2;
+
+        // explicit S (I + U (Lambda - I) U^T) S
+        Eigen::MatrixXd inner = Eigen::MatrixXd::Identity(n_params, n_params) +
+            metric.U * (metric.lambda.array() - 1.).matrix().asDiagonal() * metric.U.transpose();
+        dense_m_inverse = metric.scale.asDiagonal() * inner * metric.scale.asDiagonal();
+    }
+};
+
+TEST_F(momentum_handler_fixture, lowrank_identity_init)
+{
+    MomentumHandler<lowrank_var> handler(n_params);
+    Eigen::VectorXd rho(n_params);
+    rho << 1., -2., 3., 0.5;
+    Eigen::VectorXd actual = handler.dkinetic_dr(rho);
+    for (size_t i = 0; i < n_params; ++i) {
+        EXPECT_DOUBLE_EQ(actual(i), rho(i));
+    }
+    EXPECT_DOUBLE_EQ(handler.kinetic(rho), 0.5 * rho.squaredNorm());
+}
+
+TEST_F(momentum_handler_fixture, lowrank_dkinetic_dr)
+{
+    MomentumHandler<lowrank_var> handler(n_params);
+    handler.get_m_inverse() = metric;
+    handler.update_metric();
+
+    Eigen::VectorXd rho(n_params);
+    rho << 1., -2., 3., 0.5;
+    Eigen::VectorXd expected = dense_m_inverse * rho;
+    Eigen::VectorXd actual = handler.dkinetic_dr(rho);
+    for (size_t i = 0; i < n_params; ++i) {
+        EXPECT_NEAR(actual(i), expected(i), 1e-12);
+    }
+    EXPECT_NEAR(handler.kinetic(rho), 0.5 * rho.dot(expected), 1e-12);
+}
+
+TEST_F(momentum_handler_fixture, lowrank_sample_cov)
+{
+    MomentumHandler<lowrank_var> handler(n_params);
+    handler.get_m_inverse() = metric;
+    handler.update_metric();
+
+    // sample covariance of momentum should be M = (M^{-1})^{-1}
+    constexpr size_t n_samples = 200000;
+    Eigen::MatrixXd samples(n_params, n_samples);
+    Eigen::VectorXd rho(n_params);
+    for (size_t i = 0; i < n_samples; ++i) {
+        handler.sample(rho, gen);
+        samples.col(i) = rho;
+    }
+    Eigen::MatrixXd cov = (samples * samples.transpose()) / n_samples;
+
+    // M^{-1} * cov ~ I
+    Eigen::MatrixXd actual = dense_m_inverse * cov;
+    for (size_t i = 0; i < n_params; ++i) {
+        for (size_t j = 0; j < n_params; ++j) {
+            EXPECT_NEAR(actual(i,j), (i == j) ? 1. : 0., 0.05);
+        }
+    }
+}
+
+TEST_F(momentum_handler_fixture, dense_dkinetic_dr)
+{
+    MomentumHandler<dense_var> handler(n_params);
+    handler.get_m_inverse() = dense_m_inverse;
+    handler.update_metric();
+
+    Eigen::VectorXd rho(n_params);
+    rho << 1., -2., 3., 0.5;
+    Eigen::VectorXd expected = dense_m_inverse * rho;
+    Eigen::VectorXd actual = handler.dkinetic_dr(rho);
+    for (size_t i = 0; i < n_params; ++i) {
+        EXPECT_NEAR(actual(i), expected(i), 1e-12);
+    }
+}
+
+} // namespace mcmc
+} // namespace ppl
@@ -1,8 +1,14 @@
 #include "gtest/gtest.h" 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
 #include <fastad>
 #include <autoppl/expression/model/bar_eq.hpp>
 #include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/constraint/lower.hpp>
 #include <autoppl/expression/constraint/pos_def.hpp>
 #include <autoppl/expression/variable/data.hpp>
 #include <autoppl/expression/variable/param.hpp>
@@ -116,6 +122,35 @@ TEST_F(nuts_tools_fixture, check_entropy_3d)
     EXPECT_TRUE(actual);
 }
 
+TEST_F(nuts_tools_fixture, tree_arena_aligned_disjoint)
+{
+    using namespace mcmc;
+    constexpr size_t n_params = 5;
+    constexpr size_t max_depth = 3;
+    TreeArena arena(n_params, max_depth);
+
+    std::vector<const double*> ptrs;
+    for (size_t i = 0; i <= max_depth; ++i) {
+        auto& state = arena.state(i);
+        for (size_t k = 0; k < TreeState::n_vecs; ++k) {
+            auto v = arena.vec(state, k);
+            EXPECT_EQ(v.size(), static_cast<int>(n_params));
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(v.data()) % 
+                      std::max(EIGEN_MAX_ALIGN_BYTES, 1), 
+                      static_cast<std::uintptr_t>(0));
+            v.setConstant(i * TreeState::n_vecs + k);
+            ptrs.push_back(v.data());
+        }
+    }
+
+    // every vector is distinct and writing one does not overwrite another
+    for (size_t j = 0; j < ptrs.size(); ++j) {
+        for (size_t l = 0; l < n_params; ++l) {
+            EXPECT_DOUBLE_EQ(ptrs[j][l], static_cast<double>(j));
+        }
+    }
+}
+
 struct nuts_fixture : nuts_tools_fixture
 {
 protected:
@@ -250,6 +285,25 @@ TEST_F(nuts_fixture, nuts_sample_regression_dist_weight_bias)
     EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
 }
 
+// the log-pdf column is the model log-pdf at the constrained values
+// (with constants, without log-jacobian), as for every other sampler
+TEST_F(nuts_fixture, nuts_log_pdf_column) {
+    auto s = make_param<value_t>(lower(0.));
+    auto model = (s |= uniform(0.5, 3.),
+                  y |= normal(5., s)
+    );
+
+    auto out = nuts(model, config);
+
+    ASSERT_EQ(out.cont_samples.cols(), 2);
+    for (int i = 0; i < out.cont_samples.rows(); i += 97) {
+        const double s_i = out.cont_samples(i, 0);
+        const double expected = math::uniform_log_pdf(s_i, 0.5, 3.) +
+                                math::normal_log_pdf(y.get(), 5., s_i);
+        EXPECT_NEAR(out.cont_samples(i, 1), expected, 1e-10);
+    }
+}
+
 TEST_F(nuts_fixture, nuts_sample_regression_dist_uniform) {
     auto model = (w |= uniform(0., 2.),
                   b |= uniform(0., 2.),
@@ -350,6 +404,29 @@ TEST_F(nuts_fixture, nuts_coin_flip) {
     EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 0.6, 0.02);
 }
 
+TEST_F(nuts_fixture, nuts_coin_flip_disc_param) {
+    std::vector<int> x_data({0, 1, 1});
+    DataView<int, vec> x(x_data.data(), x_data.size());
+    Param<int, vec> z(2);
+
+    // z marginalizes out: w ~ Beta(3, 2) and P(z_i = 1) = E[w] = 0.6
+    auto model = (w |= uniform(0., 1.),
+                  x |= bernoulli(w),
+                  z |= bernoulli(w)
+    );
+
+    for (bool enumerate : {false, true}) {
+        config.disc_config.enumerate = enumerate;
+        auto out = nuts(model, config);
+
+        EXPECT_EQ(out.disc_samples.cols(), 2);
+        plot_hist(out.cont_samples.col(0), 0.1, 0., 1.);
+        EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 0.6, 0.02);
+        EXPECT_NEAR(out.disc_samples.col(0).cast<double>().mean(), 0.6, 0.03);
+        EXPECT_NEAR(out.disc_samples.col(1).cast<double>().mean(), 0.6, 0.03);
+    }
+}
+
 TEST_F(nuts_fixture, nuts_mean_vec_stddev_vec) {
     d_vec_t x(2);
     d_vec_t y(2);
@@ -377,6 +454,299 @@ TEST_F(nuts_fixture, nuts_mean_vec_stddev_vec) {
     EXPECT_NEAR(sample_average(out.cont_samples.col(3)), 2.30538608, 0.25);
 }
 
+TEST_F(nuts_fixture, nuts_sample_regression_dense_metric) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    NUTSConfig<dense_var> dense_config;
+    dense_config.samples = config.samples;
+    dense_config.warmup = config.warmup;
+    dense_config.seed = config.seed;
+
+    auto out = nuts(model, dense_config);
+
+    plot_hist(out.cont_samples.col(0), 0.1);
+    plot_hist(out.cont_samples.col(1));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(nuts_fixture, nuts_sample_regression_lowrank_metric) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    NUTSConfig<lowrank_var> lowrank_config;
+    lowrank_config.samples = config.samples;
+    lowrank_config.warmup = config.warmup;
+    lowrank_config.seed = config.seed;
+    lowrank_config.var_config.rank = 1;
+
+    auto out = nuts(model, lowrank_config);
+
+    plot_hist(out.cont_samples.col(0), 0.1);
+    plot_hist(out.cont_samples.col(1));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(nuts_fixture, nuts_sample_regression_pathfinder_init) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    // starting in the typical set with a fitted metric needs much less warmup
+    config.warmup = 200;
+    config.pathfinder_config.enabled = true;
+
+    auto out = nuts(model, config);
+
+    plot_hist(out.cont_samples.col(0), 0.1);
+    plot_hist(out.cont_samples.col(1));
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(nuts_fixture, nuts_multi_chain) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    // single chain reference run
+    auto out_single = nuts(model, config);
+
+    config.n_chains = 4;
+    config.n_threads = 4;
+    auto out = nuts(model, config);
+
+    EXPECT_EQ(out.n_chains, config.n_chains);
+    EXPECT_EQ(out.cont_samples.rows(), 
+              static_cast<int>(config.samples * config.n_chains));
+
+    // chain 0 is seeded identically to a single-chain run
+    EXPECT_EQ(out.cont_chain(0), out_single.cont_samples);
+
+    // chains are run independently with different seeds
+    EXPECT_NE(out.cont_chain(0), out.cont_chain(1));
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_NEAR(sample_average(out.cont_chain(c).col(0)), 1.0319, 0.06);
+        EXPECT_NEAR(sample_average(out.cont_chain(c).col(1)), 0.8712, 0.08);
+    }
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = nuts(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+}
+
+TEST_F(nuts_fixture, nuts_transform_same_as_base) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    config.n_chains = 2;
+    config.n_threads = 2;
+
+    // draws transformed while sampling
+    auto out = nuts(model, config);
+
+    // draws stored unconstrained and transformed afterwards
+    auto out_base = mcmc::base_mcmc(model, config,
+            [](auto& program, const auto& config,
+               const auto& pack, auto& res, auto& pool) {
+                res.name = "nuts";
+                mcmc::nuts_(program, config, pack, res, pool);
+            });
+
+    EXPECT_EQ(out.name, out_base.name);
+    EXPECT_EQ(out.n_chains, out_base.n_chains);
+    EXPECT_EQ(out.cont_samples, out_base.cont_samples);
+    EXPECT_EQ(out.disc_samples, out_base.disc_samples);
+}
+
+TEST_F(nuts_fixture, nuts_early_stopping) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    config.warmup = 1000;
+    config.n_chains = 4;
+    config.n_threads = 2;
+    auto out_full = nuts(model, config);
+
+    config.stop_config.enabled = true;
+    config.stop_config.check_every = 50;
+    auto out = nuts(model, config);
+
+    // stopped at a check before the hard cap
+    const size_t n = out.n_samples();
+    EXPECT_LT(n, config.samples);
+    EXPECT_EQ(n % config.stop_config.check_every, 0UL);
+    EXPECT_EQ(out.cont_samples.rows(), static_cast<int>(n * config.n_chains));
+
+    // the kept draws are the first draws of the full run
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_EQ(out.cont_chain(c), out_full.cont_chain(c).topRows(n));
+    }
+
+    // stopping point does not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = nuts(model, config);
+    EXPECT_EQ(out_serial.n_samples(), n);
+
+    EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(nuts_fixture, nuts_checkpoint_resume) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    config.samples = 1000;
+    config.warmup = 1000;
+    config.n_chains = 2;
+    config.n_threads = 2;
+    auto out_full = nuts(model, config);
+
+    config.checkpoint_config.prefix = "nuts_unittest";
+    config.checkpoint_config.every = 150;
+
+    // interrupted during warmup, then during sampling (last checkpoints at 900 and 1650)
+    for (size_t samples : {0, 700}) {
+        config.samples = samples;
+        config.checkpoint_config.resume = false;
+        nuts(model, config);
+
+        // resumed chains do not depend on the seed anymore
+        config.samples = 1000;
+        config.checkpoint_config.resume = true;
+        config.seed = 1;
+        auto out = nuts(model, config);
+        config.seed = 0;
+
+        EXPECT_EQ(out.cont_samples, out_full.cont_samples);
+        EXPECT_EQ(out.disc_samples, out_full.disc_samples);
+    }
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        mcmc::ChainCheckpoint checkpoint(config.checkpoint_config, c, 2, 0);
+        std::remove(checkpoint.state_path().c_str());
+        std::remove(checkpoint.draws_path().c_str());
+    }
+}
+
+TEST_F(nuts_fixture, nuts_checkpoint_invalid) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    auto other_model = (w |= normal(0., 2.),
+                        y |= normal(x * w, 0.5)
+    );
+
+    config.samples = 100;
+    config.warmup = 100;
+    config.checkpoint_config.prefix = "nuts_unittest_invalid";
+    config.checkpoint_config.every = 50;
+    nuts(model, config);
+    mcmc::ChainCheckpoint checkpoint(config.checkpoint_config, 0, 2, 0);
+
+    // checkpoint of a different model
+    config.checkpoint_config.resume = true;
+    EXPECT_THROW(nuts(other_model, config), std::runtime_error);
+
+    // truncated draws file (the last checkpoint holds 100 draws)
+    std::filesystem::resize_file(checkpoint.draws_path(),
+                                 std::filesystem::file_size(checkpoint.draws_path()) / 2);
+    EXPECT_THROW(nuts(model, config), std::runtime_error);
+
+    // missing draws file
+    std::remove(checkpoint.draws_path().c_str());
+    EXPECT_THROW(nuts(model, config), std::runtime_error);
+
+    // truncated state file
+    std::filesystem::resize_file(checkpoint.state_path(), 
+                                 std::filesystem::file_size(checkpoint.state_path()) / 2);
+    EXPECT_THROW(nuts(model, config), std::runtime_error);
+
+    // without any checkpoint, chains start from scratch
+    std::remove(checkpoint.state_path().c_str());
+    EXPECT_NO_THROW(nuts(model, config));
+
+    std::remove(checkpoint.state_path().c_str());
+    std::remove(checkpoint.draws_path().c_str());
+}
+
+TEST_F(nuts_fixture, nuts_warm_start) {
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+
+    config.n_chains = 2;
+    config.n_threads = 2;
+    auto out = nuts(model, config);
+    EXPECT_EQ(out.adapted.size(), config.n_chains);
+
+    // no warmup: step size and metric are those of the previous run
+    config.warmup = 0;
+    config.warm_start_config.states = out.adapted;
+    auto out_warm = nuts(model, config);
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_EQ(out_warm.adapted[c].log_eps, out.adapted[c].log_eps);
+        EXPECT_EQ(out_warm.adapted[c].m_inverse, out.adapted[c].m_inverse);
+    }
+    EXPECT_NEAR(sample_average(out_warm.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out_warm.cont_samples.col(1)), 0.8712, 0.08);
+
+    // short warmup: only the step size is adapted again
+    config.warmup = 100;
+    auto out_short = nuts(model, config);
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_EQ(out_short.adapted[c].m_inverse, out.adapted[c].m_inverse);
+    }
+    EXPECT_NEAR(sample_average(out_short.cont_samples.col(0)), 1.0319, 0.06);
+    EXPECT_NEAR(sample_average(out_short.cont_samples.col(1)), 0.8712, 0.08);
+}
+
+TEST_F(nuts_fixture, nuts_warm_start_disc_param) {
+    std::vector<int> x_data({0, 1, 1});
+    DataView<int, vec> x(x_data.data(), x_data.size());
+    Param<int, vec> z(2);
+
+    // same model as nuts_coin_flip_disc_param
+    auto model = (w |= uniform(0., 1.),
+                  x |= bernoulli(w),
+                  z |= bernoulli(w)
+    );
+
+    auto out = nuts(model, config);
+    ASSERT_EQ(out.adapted.size(), 1ul);
+    EXPECT_EQ(out.adapted[0].disc.size(), 2);
+
+    // discrete values are restored from the state, or initialized if it has none
+    config.warmup = 0;
+    config.warm_start_config.states = out.adapted;
+    for (bool with_disc : {true, false}) {
+        if (!with_disc) config.warm_start_config.states[0].disc.resize(0);
+        auto out_warm = nuts(model, config);
+        EXPECT_EQ(out_warm.adapted[0].disc.size(), 2);
+        EXPECT_NEAR(sample_average(out_warm.cont_samples.col(0)), 0.6, 0.02);
+        EXPECT_NEAR(out_warm.disc_samples.col(0).cast<double>().mean(), 0.6, 0.03);
+        EXPECT_NEAR(out_warm.disc_samples.col(1).cast<double>().mean(), 0.6, 0.03);
+    }
+}
+
 TEST_F(nuts_fixture, nuts_wishart_cov) {
     d_vec_t y(2);
     y.get() << 1., -1.;
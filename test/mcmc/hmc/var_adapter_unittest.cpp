@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <random>
 #include <autoppl/mcmc/hmc/var_adapter.hpp>
 
 namespace ppl {
@@ -232,5 +233,108 @@ TEST_F(var_adapter_fixture, diag_ctor_case_33)
                 term_buffer, window_base);
 }
 
+TEST_F(var_adapter_fixture, dense_window_matches_diag)
+{
+    size_t warmup = 100;
+    size_t init_buffer = 5;
+    size_t term_buffer = 30;
+    size_t window_base = 10;
+    n_params = 2;
+
+    diag_adapter_t diag_adapter(n_params, warmup, init_buffer,
+                                term_buffer, window_base);
+    VarAdapter<dense_var> dense_adapter(n_params, warmup, init_buffer,
+                                        term_buffer, window_base);
+
+    Eigen::VectorXd x(n_params);
+    Eigen::VectorXd var(n_params);
+    Eigen::MatrixXd cov(n_params, n_params);
+
+    for (size_t i = 0; i < warmup; ++i) {
+        x << std::sin(i), std::sin(i) + 0.1 * std::cos(3*i);
+        bool diag_res = diag_adapter.adapt(x, var);
+        bool dense_res = dense_adapter.adapt(x, cov);
+        EXPECT_EQ(diag_res, dense_res);
+        if (dense_res) {
+            // regularized towards identity and strongly correlated
+            EXPECT_GT(cov(0,1), 0.);
+            EXPECT_DOUBLE_EQ(cov(0,1), cov(1,0));
+            Eigen::LLT<Eigen::MatrixXd> llt(cov);
+            EXPECT_EQ(llt.info(), Eigen::Success);
+        }
+    }
+}
+
+TEST_F(var_adapter_fixture, pooled_draws)
+{
+    size_t warmup = 100;
+    size_t init_buffer = 5;
+    size_t term_buffer = 30;
+    size_t window_base = 10;
+    n_params = 2;
+
+    // every column is a draw of a different chain in the same iteration
+    VarAdapter<dense_var> dense_adapter(n_params, warmup, init_buffer,
+                                        term_buffer, window_base);
+    VarAdapter<lowrank_var> lowrank_adapter(n_params, warmup, init_buffer,
+                                            term_buffer, window_base, 1);
+
+    Eigen::MatrixXd xs(n_params, 2);
+    Eigen::MatrixXd cov(n_params, n_params);
+    LowRankMetric metric(n_params);
+
+    size_t n_updates = 0;
+    for (size_t i = 0; i < warmup; ++i) {
+        xs << std::sin(i), std::cos(i),
+              std::sin(2*i), 0.5 * std::cos(5*i);
+        bool dense_res = dense_adapter.adapt(xs, cov);
+        bool lowrank_res = lowrank_adapter.adapt(xs, metric);
+        EXPECT_EQ(dense_res, lowrank_res);
+        if (dense_res) {
+            ++n_updates;
+            // both regularize the variance of all pooled draws the same way
+            for (size_t j = 0; j < n_params; ++j) {
+                EXPECT_NEAR(cov(j,j), metric.scale(j) * metric.scale(j), 1e-12);
+            }
+        }
+    }
+    EXPECT_GT(n_updates, static_cast<size_t>(0));
+}
+
+TEST_F(var_adapter_fixture, lowrank_leading_eigenvector)
+{
+    size_t warmup = 1000;
+    n_params = 5;
+    VarConfig var_config;
+    var_config.rank = 1;
+
+    auto adapter = make_var_adapter<lowrank_var>(n_params, warmup, var_config);
+    LowRankMetric metric(n_params);
+
+    // first two coordinates are perfectly correlated, rest is independent noise
+    std::mt19937 gen(0);
+    std::normal_distribution<> dist(0., 1.);
+    Eigen::VectorXd x(n_params);
+    size_t n_updates = 0;
+    for (size_t i = 0; i < warmup; ++i) {
+        x = Eigen::VectorXd::NullaryExpr(n_params, [&]() { return dist(gen); });
+        x(1) = 2. * x(0);
+        if (adapter.adapt(x, metric)) ++n_updates;
+    }
+    EXPECT_GT(n_updates, static_cast<size_t>(0));
+
+    ASSERT_EQ(metric.U.cols(), 1);
+    ASSERT_EQ(metric.lambda.size(), 1);
+
+    // standardized leading eigenvector is (1, 1, 0, 0, 0)/sqrt(2) with eigenvalue 2
+    EXPECT_NEAR(std::abs(metric.U(0,0)), 1./std::sqrt(2.), 0.05);
+    EXPECT_NEAR(std::abs(metric.U(1,0)), 1./std::sqrt(2.), 0.05);
+    EXPECT_NEAR(metric.lambda(0), 2., 0.2);
+
+    // scale is standard deviation
+    EXPECT_NEAR(metric.scale(0), 1., 0.1);
+    EXPECT_NEAR(metric.scale(1), 2., 0.2);
+}
+
 } // namespace mcmc
 } // namespace ppl
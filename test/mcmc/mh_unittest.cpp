@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include <array>
+#include <cstdio>
 #include <limits>
 #include <testutil/base_fixture.hpp>
 #include <testutil/sample_tools.hpp>
@@ -188,6 +189,111 @@ TEST_F(mh_fixture, sample_unif_bern_posterior_observe_one)
     EXPECT_NEAR(sample_average(out.cont_samples.col(0)), 2./3., 0.1);
 }
 
+TEST_F(mh_fixture, sample_multi_chain)
+{
+    d_cont_scl_t x(3.);
+    auto model = (
+        theta |= uniform(-20., 20.),
+        x |= normal(theta, 1.)
+    );
+
+    // single chain reference run
+    auto out_single = mh(model, config);
+
+    config.n_chains = 4;
+    config.n_threads = 4;
+    auto out = mh(model, config);
+
+    EXPECT_EQ(out.n_chains, config.n_chains);
+    EXPECT_EQ(out.cont_samples.rows(), 
+              static_cast<int>(config.samples * config.n_chains));
+
+    // chain 0 is seeded identically to a single-chain run
+    EXPECT_EQ(out.cont_chain(0), out_single.cont_samples);
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_NEAR(sample_average(out.cont_chain(c).col(0)), 3.0, 0.1);
+    }
+}
+
+TEST_F(mh_fixture, sample_early_stopping)
+{
+    d_cont_scl_t x(3.);
+    auto model = (
+        theta |= uniform(-20., 20.),
+        x |= normal(theta, 1.)
+    );
+
+    config.n_chains = 2;
+    auto out_full = mh(model, config);
+
+    config.stop_config.enabled = true;
+    config.stop_config.min_ess = 200;
+    auto out = mh(model, config);
+
+    const size_t n = out.n_samples();
+    EXPECT_LT(n, config.samples);
+    EXPECT_EQ(n % config.stop_config.check_every, 0UL);
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_EQ(out.cont_chain(c), out_full.cont_chain(c).topRows(n));
+    }
+}
+
+TEST_F(mh_fixture, sample_adaptive_anisotropic)
+{
+    auto model = (
+        theta |= normal(0., 10.),
+        theta_2 |= normal(0., 0.1)
+    );
+    config.adapt = true;
+    config.warmup = 5000;
+
+    auto out = mh(model, config);
+
+    Eigen::VectorXd mean = out.cont_samples.leftCols(2).colwise().mean();
+    Eigen::MatrixXd centered = out.cont_samples.leftCols(2).rowwise() - mean.transpose();
+    Eigen::VectorXd sd = (centered.colwise().squaredNorm() / 
+                          (centered.rows() - 1.)).cwiseSqrt();
+    EXPECT_NEAR(mean(0), 0., 1.);
+    EXPECT_NEAR(mean(1), 0., 0.01);
+    EXPECT_NEAR(sd(0), 10., 0.5);
+    EXPECT_NEAR(sd(1), 0.1, 0.005);
+}
+
+TEST_F(mh_fixture, checkpoint_resume)
+{
+    auto model = (
+        theta |= normal(0., 1.),
+        y |= normal(theta, 1.)
+    );
+
+    config.samples = 2000;
+    config.warmup = 1000;
+    config.adapt = true;
+    config.n_chains = 2;
+    auto out_full = mh(model, config);
+
+    config.checkpoint_config.prefix = "mh_unittest";
+    config.checkpoint_config.every = 300;
+
+    // interrupted after 1850 iterations (last checkpoint at 1800)
+    // and resumed with another seed, which must not matter
+    config.samples = 850;
+    mh(model, config);
+    config.samples = 2000;
+    config.checkpoint_config.resume = true;
+    config.seed = 1;
+    auto out = mh(model, config);
+
+    EXPECT_EQ(out.cont_samples, out_full.cont_samples);
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        mcmc::ChainCheckpoint checkpoint(config.checkpoint_config, c, 1, 0);
+        std::remove(checkpoint.state_path().c_str());
+        std::remove(checkpoint.draws_path().c_str());
+    }
+}
+
 // COMPILER ERROR: good :) discrete param should not be a continuous parameter
 //TEST_F(mh_fixture, sample_bern_normal_posterior)
 //{
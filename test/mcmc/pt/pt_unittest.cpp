@@ -0,0 +1,130 @@
+#include "gtest/gtest.h"
+#include <numeric>
+#include <stdexcept>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/pt/pt.hpp>
+#include <testutil/sample_tools.hpp>
+
+namespace ppl {
+
+struct pt_fixture : ::testing::Test
+{
+protected:
+    size_t n_samples = 5000;
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_scl_t = ppl::Data<value_t>;
+
+    p_scl_t w;
+    d_scl_t y;
+
+    pt_fixture()
+        : w{}
+        , y{4.}
+    {}
+
+    template <class ConfigType>
+    void init_config(ConfigType& config)
+    {
+        config.samples = n_samples;
+        config.warmup = n_samples;
+        config.seed = 0;
+        config.max_temperature = 100.;
+    }
+
+    template <class VecType>
+    double frac_positive(const VecType& v)
+    {
+        return (v.array() > 0).template cast<double>().mean();
+    }
+};
+
+TEST_F(pt_fixture, temperature_adapter_ladder)
+{
+    mcmc::TemperatureAdapter adapter(4, 8., 0.234, 0.6);
+    EXPECT_DOUBLE_EQ(adapter.beta(0), 1.);
+    EXPECT_NEAR(adapter.beta(1), 0.5, 1e-12);
+    EXPECT_NEAR(adapter.beta(2), 0.25, 1e-12);
+    EXPECT_NEAR(adapter.beta(3), 0.125, 1e-12);
+
+    // swaps accepted too often: temperatures spread out
+    adapter.adapt(0, 1.);
+    EXPECT_DOUBLE_EQ(adapter.beta(0), 1.);
+    EXPECT_LT(adapter.beta(1), 0.5);
+    EXPECT_LT(adapter.beta(3), 0.125);
+}
+
+// posterior of w is symmetric with well-separated modes at -2 and 2
+TEST_F(pt_fixture, pt_nuts_bimodal)
+{
+    auto model = (w |= normal(0., 3.),
+                  y |= normal(w * w, 0.3)
+    );
+    PTConfig<> config;
+    init_config(config);
+
+    auto out = pt(model, config);
+
+    EXPECT_EQ(out.name, "pt");
+    plot_hist(out.cont_samples.col(0));
+    EXPECT_NEAR(frac_positive(out.cont_samples.col(0)), 0.5, 0.1);
+}
+
+TEST_F(pt_fixture, pt_mh_bimodal)
+{
+    auto model = (w |= normal(0., 3.),
+                  y |= normal(w * w, 0.3)
+    );
+    PTConfig<MHConfig> config;
+    init_config(config);
+    config.sigma = 0.5;
+
+    auto out = pt(model, config);
+
+    plot_hist(out.cont_samples.col(0));
+    EXPECT_NEAR(frac_positive(out.cont_samples.col(0)), 0.5, 0.1);
+}
+
+TEST_F(pt_fixture, pt_multi_chain)
+{
+    auto model = (w |= normal(0., 3.),
+                  y |= normal(w * w, 0.3)
+    );
+    PTConfig<> config;
+    init_config(config);
+    config.n_chains = 2;
+    config.n_threads = 4;
+    auto out = pt(model, config);
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = pt(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+}
+
+TEST_F(pt_fixture, pt_unsupported_settings)
+{
+    auto model = (w |= normal(0., 3.),
+                  y |= normal(w * w, 0.3)
+    );
+    PTConfig<> config;
+    init_config(config);
+    config.stop_config.enabled = true;
+    EXPECT_THROW(pt(model, config), std::invalid_argument);
+
+    PTConfig<MHConfig> mh_config;
+    init_config(mh_config);
+    mh_config.checkpoint_config.every = 100;
+    EXPECT_THROW(pt(model, mh_config), std::invalid_argument);
+}
+
+} // namespace ppl
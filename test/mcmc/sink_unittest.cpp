@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/bernoulli.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/constraint/lower.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/hmc/nuts/nuts.hpp>
+#include <autoppl/mcmc/mh/mh.hpp>
+#include <autoppl/mcmc/sink.hpp>
+
+namespace ppl {
+
+struct sink_fixture : ::testing::Test
+{
+protected:
+    Param<double> w;
+    Param<double> mu;
+    Param<int, vec> z{2};
+    Data<double, vec> y{3};
+
+    sink_fixture()
+    {
+        y.get() << 0.5, 1.2, -0.3;
+    }
+};
+
+TEST_F(sink_fixture, nuts_memory_sink_same_as_result)
+{
+    auto model = (w |= uniform(0., 1.),
+                  mu |= normal(0., 3.),
+                  y |= normal(mu, w + 0.5)
+    );
+
+    NUTSConfig<> config;
+    config.warmup = 200;
+    config.samples = 300;
+    config.seed = 4;
+    config.n_chains = 2;
+    config.n_threads = 2;
+
+    auto out = nuts(model, config);
+
+    MemorySink sink;
+    auto stream_out = nuts(model, config, sink);
+
+    EXPECT_EQ(stream_out.name, "nuts");
+    EXPECT_EQ(stream_out.cont_samples.rows(), 0);
+    EXPECT_EQ(sink.result.cont_samples, out.cont_samples);
+    EXPECT_EQ(sink.stats.size(), config.samples * config.n_chains);
+    for (const auto& stats : sink.stats) {
+        EXPECT_GE(stats.accept_stat, 0.);
+        EXPECT_LE(stats.accept_stat, 1.);
+        EXPECT_GT(stats.n_steps, 0UL);
+        EXPECT_GT(stats.step_size, 0.);
+    }
+}
+
+TEST_F(sink_fixture, nuts_memory_sink_thin)
+{
+    auto model = (mu |= normal(0., 3.),
+                  y |= normal(mu, 1.)
+    );
+
+    NUTSConfig<> config;
+    config.warmup = 100;
+    config.samples = 100;
+    config.seed = 4;
+
+    auto out = nuts(model, config);
+
+    MemorySink sink;
+    sink.thin = 3;
+    nuts(model, config, sink);
+
+    EXPECT_EQ(sink.result.cont_samples.rows(), 34);
+    for (int i = 0; i < sink.result.cont_samples.rows(); ++i) {
+        EXPECT_EQ(sink.result.cont_samples.row(i), out.cont_samples.row(3*i));
+    }
+}
+
+TEST_F(sink_fixture, mh_binary_file_sink)
+{
+    auto model = (w |= uniform(0., 1.),
+                  z |= bernoulli(w),
+                  y |= normal(w, 1.)
+    );
+
+    MHConfig config;
+    config.warmup = 100;
+    config.samples = 500;
+    config.seed = 2;
+    config.n_chains = 2;
+
+    auto out = mh(model, config);
+
+    BinaryFileSink sink("sink_unittest");
+    auto stream_out = mh(model, config, sink);
+    EXPECT_TRUE(sink.good());
+    EXPECT_EQ(stream_out.name, "mh");
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        MCMCResult<> res;
+        std::vector<DrawStats> stats;
+        EXPECT_TRUE(read_draws(sink.path(c), res, stats));
+        EXPECT_EQ(res.cont_samples, out.cont_chain(c));
+        EXPECT_EQ(res.disc_samples, out.disc_chain(c));
+        EXPECT_EQ(stats.size(), config.samples);
+        std::remove(sink.path(c).c_str());
+    }
+}
+
+TEST_F(sink_fixture, discard_sink)
+{
+    auto model = (mu |= normal(0., 3.),
+                  y |= normal(mu, 1.)
+    );
+
+    MHConfig config;
+    config.warmup = 10;
+    config.samples = 100;
+
+    DiscardSink sink;
+    auto out = mh(model, config, sink);
+    EXPECT_EQ(out.cont_samples.rows(), 0);
+    EXPECT_EQ(out.cont_samples.cols(), 2);
+}
+
+TEST_F(sink_fixture, stopping_not_supported)
+{
+    auto model = (mu |= normal(0., 3.),
+                  y |= normal(mu, 1.)
+    );
+
+    // streamed draws are not kept, so convergence cannot be checked
+    DiscardSink sink;
+    MHConfig mh_config;
+    mh_config.stop_config.enabled = true;
+    EXPECT_THROW(mh(model, mh_config, sink), std::invalid_argument);
+
+    NUTSConfig<> nuts_config;
+    nuts_config.stop_config.enabled = true;
+    EXPECT_THROW(nuts(model, nuts_config, sink), std::invalid_argument);
+}
+
+TEST_F(sink_fixture, constrained_draw_recorded_log_pdf)
+{
+    Param<double> w1;
+    Param w2 = make_param<double>(lower(w1 - 1.));
+    auto model = (w2 |= normal(0., 2.),
+                  w1 |= normal(0., 1.),
+                  y |= normal(w1 + w2, 1.)
+    );
+
+    using program_t = util::convert_to_program_t<decltype(model)>;
+    program_t program = model;
+    auto pack = program.activate();
+
+    // full model evaluation vs. inverse transforms only
+    mcmc::ConstrainedDraw<program_t> full(program, pack);
+    mcmc::ConstrainedDraw<program_t> transform(program, pack);
+
+    Eigen::VectorXd cont(2);
+    cont << 0.3, -0.7;
+    Eigen::Matrix<util::disc_param_t, Eigen::Dynamic, 1> disc(0);
+
+    // repeated draws check that visit counts do not carry over
+    for (size_t k = 0; k < 3; ++k) {
+        full(cont, disc);
+        transform(cont, disc, -1.5);
+        EXPECT_EQ(transform.values.head(2), full.values.head(2));
+        EXPECT_GT(transform.values(0), transform.values(1) - 1.);
+        EXPECT_DOUBLE_EQ(transform.values(2), -1.5);
+        cont *= -2.;
+    }
+}
+
+} // namespace ppl
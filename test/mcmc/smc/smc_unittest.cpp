@@ -0,0 +1,177 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <stdexcept>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/constraint/lower.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/math/density.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/smc/smc.hpp>
+#include <testutil/sample_tools.hpp>
+
+namespace ppl {
+
+struct smc_fixture : ::testing::Test
+{
+protected:
+    size_t n_particles = 2000;
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w;
+    d_vec_t y;
+
+    // w ~ N(0, 1), y_i ~ N(w, 1) is conjugate:
+    // w | y ~ N(sum(y) / (n+1), 1 / (n+1)) and y ~ N(0, I + 11^T)
+    double post_mean;
+    double post_var;
+    double log_evidence;
+
+    smc_fixture()
+        : w{}
+        , y(5)
+    {
+        y.get() << 1.2, 0.8, 2.1, 1.5, 0.9;
+        const double n = y.size();
+        const double sum = y.get().sum();
+        const double sum_sq = y.get().squaredNorm();
+        post_mean = sum / (n + 1);
+        post_var = 1. / (n + 1);
+        log_evidence = -n * math::LOG_SQRT_TWO_PI - 0.5 * std::log(n + 1) -
+                       0.5 * (sum_sq - sum * sum / (n + 1));
+    }
+
+    template <class ConfigType>
+    void init_config(ConfigType& config)
+    {
+        config.samples = n_particles;
+        config.seed = 0;
+    }
+
+    template <class ResultType>
+    void check_result(const ResultType& out)
+    {
+        EXPECT_EQ(out.name, "smc");
+        ASSERT_EQ(out.log_evidence.size(), 1ul);
+        ASSERT_GE(out.betas[0].size(), 2ul);
+        EXPECT_DOUBLE_EQ(out.betas[0].front(), 0.);
+        EXPECT_DOUBLE_EQ(out.betas[0].back(), 1.);
+
+        auto sample = out.cont_samples.col(0);
+        plot_hist(sample);
+        const double mean = sample.mean();
+        const double var = (sample.array() - mean).square().mean();
+        EXPECT_NEAR(mean, post_mean, 0.05);
+        EXPECT_NEAR(var, post_var, 0.03);
+        EXPECT_NEAR(out.log_evidence[0], log_evidence, 0.15);
+    }
+};
+
+TEST_F(smc_fixture, smc_nuts_conjugate_normal)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    SMCConfig<> config;
+    init_config(config);
+    auto out = smc(model, config);
+    check_result(out);
+}
+
+TEST_F(smc_fixture, smc_mh_conjugate_normal)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    SMCConfig<MHConfig> config;
+    init_config(config);
+    config.sigma = 0.5;
+    auto out = smc(model, config);
+    check_result(out);
+}
+
+// tau ~ U(0.5, 2), w ~ N(0, tau^2), y_i ~ N(w, 1):
+// tau is constrained and referenced in the prior of w,
+// so the log-likelihood must not disturb its visit count.
+// Given tau, y ~ N(0, I + tau^2 11^T) and E[w | y, tau] = tau^2 sum(y) / (1 + n tau^2),
+// so the evidence and posterior mean of w are integrals over tau (midpoint rule).
+TEST_F(smc_fixture, smc_mh_constrained_scale)
+{
+    auto tau = make_param<value_t>(lower(0.));
+    auto model = (tau |= uniform(0.5, 2.),
+                  w |= normal(0., tau),
+                  y |= normal(w, 1.)
+    );
+
+    const double n = y.size();
+    const double sum = y.get().sum();
+    const double sum_sq = y.get().squaredNorm();
+    const size_t n_grid = 10000;
+    const double h = 1.5 / n_grid;
+    double evidence = 0.;
+    double w_mean = 0.;
+    for (size_t i = 0; i < n_grid; ++i) {
+        const double t2 = std::pow(0.5 + (i + 0.5) * h, 2);
+        const double lik = std::exp(
+                -n * math::LOG_SQRT_TWO_PI - 0.5 * std::log(1. + n * t2) -
+                0.5 * (sum_sq - t2 * sum * sum / (1. + n * t2)));
+        evidence += lik * h / 1.5;
+        w_mean += lik * h / 1.5 * t2 * sum / (1. + n * t2);
+    }
+    w_mean /= evidence;
+
+    SMCConfig<MHConfig> config;
+    init_config(config);
+    config.sigma = 0.5;
+    auto out = smc(model, config);
+
+    ASSERT_EQ(out.log_evidence.size(), 1ul);
+    EXPECT_DOUBLE_EQ(out.betas[0].back(), 1.);
+    EXPECT_NEAR(out.cont_samples.col(1).mean(), w_mean, 0.05);
+    EXPECT_NEAR(out.log_evidence[0], std::log(evidence), 0.15);
+}
+
+TEST_F(smc_fixture, smc_thread_invariant)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    SMCConfig<> config;
+    init_config(config);
+    config.n_chains = 2;
+    config.n_threads = 4;
+    auto out = smc(model, config);
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = smc(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+    EXPECT_EQ(out.log_evidence, out_serial.log_evidence);
+    EXPECT_NE(out.log_evidence[0], out.log_evidence[1]);
+}
+
+TEST_F(smc_fixture, smc_unsupported_settings)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    SMCConfig<> config;
+    init_config(config);
+    config.warm_start_config.states.resize(1);
+    EXPECT_THROW(smc(model, config), std::invalid_argument);
+
+    SMCConfig<MHConfig> mh_config;
+    init_config(mh_config);
+    mh_config.checkpoint_config.resume = true;
+    EXPECT_THROW(smc(model, mh_config), std::invalid_argument);
+}
+
+} // namespace ppl
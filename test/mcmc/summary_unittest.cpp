@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/mcmc/hmc/nuts/nuts.hpp>
+#include <autoppl/mcmc/summary.hpp>
+
+namespace ppl {
+
+struct summary_fixture : ::testing::Test
+{
+protected:
+    Param<double> w;
+    Param<double> mu;
+    Data<double, vec> y{3};
+    NUTSConfig<> config;
+
+    summary_fixture()
+    {
+        y.get() << 0.5, 1.2, -0.3;
+        config.warmup = 500;
+        config.samples = 2000;
+        config.seed = 4;
+        config.n_chains = 2;
+        config.n_threads = 2;
+    }
+};
+
+TEST_F(summary_fixture, nuts_summary_matches_draws)
+{
+    auto model = (w |= uniform(0., 1.),
+                  mu |= normal(0., 3.),
+                  y |= normal(mu, w + 0.5)
+    );
+
+    auto out = nuts(model, config);
+
+    SummarySink sink({0.1, 0.5, 0.9});
+    nuts(model, config, sink);
+    auto summary = sink.summary();
+
+    const auto& samples = out.cont_samples;
+    Eigen::RowVectorXd mean = samples.colwise().mean();
+    Eigen::MatrixXd centered = samples.rowwise() - mean;
+
+    EXPECT_EQ(summary.n_draws, config.samples * config.n_chains);
+    EXPECT_EQ(summary.mean.size(), samples.cols());
+    EXPECT_EQ(summary.quantiles.rows(), 3);
+    for (int j = 0; j < samples.cols(); ++j) {
+        EXPECT_NEAR(summary.mean(j), mean(j), 1e-10);
+        EXPECT_NEAR(summary.variance(j), 
+                    centered.col(j).squaredNorm() / (samples.rows() - 1), 1e-10);
+        EXPECT_GT(summary.mcse(j), 0.);
+        EXPECT_LT(summary.mcse(j), std::sqrt(summary.variance(j)));
+
+        Eigen::VectorXd sorted = samples.col(j);
+        std::sort(sorted.data(), sorted.data() + sorted.size());
+        const double sd = std::sqrt(summary.variance(j));
+        EXPECT_NEAR(summary.quantiles(1, j), sorted(sorted.size() / 2), 0.1 * sd);
+        EXPECT_LT(summary.quantiles(0, j), summary.quantiles(1, j));
+        EXPECT_LT(summary.quantiles(1, j), summary.quantiles(2, j));
+    }
+
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        auto chain_summary = sink.summary(c);
+        EXPECT_EQ(chain_summary.n_draws, config.samples);
+        EXPECT_NEAR(chain_summary.mean(1), out.cont_chain(c).col(1).mean(), 1e-10);
+    }
+}
+
+} // namespace ppl
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <limits>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/optim/laplace.hpp>
+
+namespace ppl {
+
+struct laplace_fixture : ::testing::Test
+{
+protected:
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w, b;
+    d_vec_t x, y;
+    LaplaceConfig config;
+
+    laplace_fixture()
+        : w{}
+        , b{}
+        , x(6)
+        , y(6)
+    {
+        x.get() << 2.5, 3, 3.5, 4, 4.5, 5.;
+        y.get() << 3.5, 4, 4.5, 5, 5.5, 6.;
+        config.samples = 10000;
+        config.seed = 0;
+    }
+};
+
+TEST_F(laplace_fixture, fd_hessian)
+{
+    // f(x) = x_0^2 x_1 + exp(x_1)
+    auto f = [](const Eigen::VectorXd& x, Eigen::VectorXd& grad) {
+        grad(0) = 2. * x(0) * x(1);
+        grad(1) = x(0) * x(0) + std::exp(x(1));
+        return x(0) * x(0) * x(1) + std::exp(x(1));
+    };
+    Eigen::VectorXd x(2);
+    x << 1.5, -0.5;
+    Eigen::MatrixXd hessian(2, 2);
+    optim::fd_hessian(f, x, 6e-6, hessian);
+    EXPECT_NEAR(hessian(0,0), 2. * x(1), 1e-6);
+    EXPECT_NEAR(hessian(0,1), 2. * x(0), 1e-6);
+    EXPECT_NEAR(hessian(1,0), 2. * x(0), 1e-6);
+    EXPECT_NEAR(hessian(1,1), std::exp(x(1)), 1e-6);
+}
+
+TEST_F(laplace_fixture, regularized_llt)
+{
+    Eigen::MatrixXd hessian(2, 2);
+    Eigen::LLT<Eigen::MatrixXd> llt(2);
+
+    hessian << 2., 1., 1., 2.;
+    EXPECT_EQ(optim::regularized_llt(hessian, llt), LaplaceStatus::success);
+    EXPECT_TRUE(llt.reconstructedMatrix().isApprox(hessian));
+
+    // indefinite: a multiple of the identity is added
+    hessian << -1., 0., 0., 2.;
+    EXPECT_EQ(optim::regularized_llt(hessian, llt), LaplaceStatus::success);
+    const Eigen::MatrixXd shift = llt.reconstructedMatrix() - hessian;
+    EXPECT_GT(shift(0,0), 1.);
+    EXPECT_NEAR(shift(0,0), shift(1,1), 1e-10);
+    EXPECT_NEAR(shift(0,1), 0., 1e-10);
+
+    // non-finite entries fail immediately
+    hessian(0,1) = hessian(1,0) = std::nan("");
+    EXPECT_EQ(optim::regularized_llt(hessian, llt), LaplaceStatus::hessian_not_finite);
+    hessian(0,1) = hessian(1,0) = std::numeric_limits<double>::infinity();
+    EXPECT_EQ(optim::regularized_llt(hessian, llt), LaplaceStatus::hessian_not_finite);
+}
+
+// w ~ N(0, 1), y_i ~ N(w, 1) is conjugate (and Gaussian): w | y ~ N(sum(y) / 7, 1 / 7)
+TEST_F(laplace_fixture, laplace_conjugate_normal)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    auto out = laplace(model, config);
+
+    EXPECT_EQ(out.name, "laplace");
+    EXPECT_EQ(out.laplace_status[0], LaplaceStatus::success);
+    EXPECT_EQ(out.cont_samples.rows(), static_cast<int>(config.samples));
+    auto sample = out.cont_samples.col(0);
+    const double mean = sample.mean();
+    const double var = (sample.array() - mean).square().mean();
+    EXPECT_NEAR(mean, y.get().sum() / 7., 0.02);
+    EXPECT_NEAR(var, 1. / 7., 0.01);
+}
+
+TEST_F(laplace_fixture, laplace_regression)
+{
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    config.n_chains = 2;
+    config.n_threads = 2;
+    auto out = laplace(model, config);
+
+    // posterior of (w, b) is strongly negatively correlated around y = x + 1
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        auto chain = out.cont_chain(c);
+        const double w_mean = chain.col(0).mean();
+        const double b_mean = chain.col(1).mean();
+        Eigen::MatrixXd centered = chain.leftCols(2).rowwise() - 
+                                   chain.leftCols(2).colwise().mean();
+        Eigen::MatrixXd cov = centered.transpose() * centered / centered.rows();
+        const double corr = cov(0,1) / std::sqrt(cov(0,0) * cov(1,1));
+        EXPECT_NEAR(w_mean + b_mean, 2., 0.3);
+        EXPECT_LT(corr, -0.8);
+    }
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = laplace(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+}
+
+} // namespace ppl
@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <Eigen/Dense>
+#include <autoppl/optim/lbfgs.hpp>
+
+namespace ppl {
+namespace optim {
+
+struct lbfgs_fixture : ::testing::Test
+{
+protected:
+    LBFGSConfig config;
+
+    // f(x) = sum_i 100 (x_{i+1} - x_i^2)^2 + (1 - x_i)^2 with minimum at x = 1
+    static double rosenbrock(const Eigen::VectorXd& x, Eigen::VectorXd& grad)
+    {
+        double f = 0.;
+        grad.setZero();
+        for (int i = 0; i + 1 < x.size(); ++i) {
+            const double a = x(i+1) - x(i) * x(i);
+            const double b = 1. - x(i);
+            f += 100. * a * a + b * b;
+            grad(i) += -400. * a * x(i) - 2. * b;
+            grad(i+1) += 200. * a;
+        }
+        return f;
+    }
+};
+
+TEST_F(lbfgs_fixture, history_direction_secant)
+{
+    // inverse Hessian approximation satisfies the secant equation H y = s of the latest pair
+    Eigen::MatrixXd A(2,2);
+    A << 2., 0.5,
+         0.5, 1.;
+    Eigen::VectorXd s1(2), s2(2);
+    s1 << 1., 0.;
+    s2 << 0.3, 1.;
+    LBFGSHistory history(2, 2);
+    EXPECT_TRUE(history.update(s1, A * s1));
+    EXPECT_TRUE(history.update(s2, A * s2));
+    EXPECT_EQ(history.size(), 2ul);
+
+    Eigen::VectorXd y = A * s2;
+    Eigen::VectorXd dir(2);
+    history.direction(y, dir);
+    EXPECT_NEAR(dir(0), -s2(0), 1e-12);
+    EXPECT_NEAR(dir(1), -s2(1), 1e-12);
+
+    // H is positive-definite: dir is a descent direction
+    Eigen::VectorXd grad(2);
+    grad << 1., -3.;
+    history.direction(grad, dir);
+    EXPECT_LT(grad.dot(dir), 0.);
+}
+
+TEST_F(lbfgs_fixture, history_skips_negative_curvature)
+{
+    LBFGSHistory history(2, 1);
+    EXPECT_FALSE(history.update(Eigen::Vector2d(1., 0.), Eigen::Vector2d(-1., 0.)));
+    EXPECT_EQ(history.size(), 0ul);
+
+    // oldest pair is overwritten once capacity is reached
+    EXPECT_TRUE(history.update(Eigen::Vector2d(1., 0.), Eigen::Vector2d(1., 0.)));
+    EXPECT_TRUE(history.update(Eigen::Vector2d(0., 1.), Eigen::Vector2d(0., 2.)));
+    EXPECT_EQ(history.size(), 1ul);
+    EXPECT_DOUBLE_EQ(history.y(0)(1), 2.);
+}
+
+TEST_F(lbfgs_fixture, minimize_quadratic)
+{
+    Eigen::VectorXd mu(3);
+    mu << 1., -2., 0.5;
+    Eigen::MatrixXd A(3,3);
+    A << 4., 1., 0.,
+         1., 3., 0.,
+         0., 0., 0.25;
+    auto f = [&](const Eigen::VectorXd& x, Eigen::VectorXd& grad) {
+        grad = A * (x - mu);
+        return 0.5 * (x - mu).dot(grad);
+    };
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(3);
+    LBFGS lbfgs(3, config);
+    size_t n_callbacks = 0;
+    auto status = lbfgs.minimize(f, x, [&](const LBFGS&) { ++n_callbacks; });
+
+    EXPECT_NE(status, LBFGSStatus::max_iter);
+    EXPECT_NE(status, LBFGSStatus::line_search_failed);
+    EXPECT_EQ(n_callbacks, lbfgs.n_iter());
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(x(i), mu(i), 1e-4);
+    }
+    EXPECT_NEAR(lbfgs.value(), 0., 1e-8);
+}
+
+TEST_F(lbfgs_fixture, minimize_rosenbrock)
+{
+    Eigen::VectorXd x = Eigen::VectorXd::Constant(10, -1.2);
+    LBFGS lbfgs(10, config);
+    auto status = lbfgs.minimize(rosenbrock, x);
+
+    EXPECT_NE(status, LBFGSStatus::max_iter);
+    EXPECT_NE(status, LBFGSStatus::line_search_failed);
+    for (int i = 0; i < x.size(); ++i) {
+        EXPECT_NEAR(x(i), 1., 1e-3);
+    }
+}
+
+TEST_F(lbfgs_fixture, minimize_non_finite_region)
+{
+    // f(x) = x - log(x) is infinite for x <= 0 and minimized at x = 1
+    auto f = [](const Eigen::VectorXd& x, Eigen::VectorXd& grad) {
+        grad(0) = 1. - 1. / x(0);
+        return (x(0) > 0.) ? x(0) - std::log(x(0)) :
+                             std::numeric_limits<double>::infinity();
+    };
+    Eigen::VectorXd x(1);
+    x << 10.;
+    config.init_alpha = 100.;
+    LBFGS lbfgs(1, config);
+    lbfgs.minimize(f, x);
+    EXPECT_NEAR(x(0), 1., 1e-5);
+}
+
+TEST_F(lbfgs_fixture, minimize_error)
+{
+    auto f = [](const Eigen::VectorXd&, Eigen::VectorXd& grad) {
+        grad.setZero();
+        return std::numeric_limits<double>::quiet_NaN();
+    };
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(2);
+    LBFGS lbfgs(2, config);
+    EXPECT_EQ(lbfgs.minimize(f, x), LBFGSStatus::error);
+}
+
+} // namespace optim
+} // namespace ppl
@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/constraint/lower.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/distribution/uniform.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/optim/optimize.hpp>
+
+namespace ppl {
+
+struct optimize_fixture : ::testing::Test
+{
+protected:
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w;
+    d_vec_t y;
+    OptimizeConfig config;
+
+    optimize_fixture()
+        : w{}
+        , y(5)
+    {
+        y.get() << 1., 2., 3., -1., 0.5;
+        config.seed = 0;
+    }
+
+    void expect_converged(const OptimizeResult<>& out)
+    {
+        for (auto status : out.status) {
+            EXPECT_NE(status, LBFGSStatus::max_iter);
+            EXPECT_NE(status, LBFGSStatus::line_search_failed);
+            EXPECT_NE(status, LBFGSStatus::error);
+        }
+    }
+};
+
+// w ~ N(0, 1), y_i ~ N(w, 1) is conjugate: w | y ~ N(sum(y) / 6, 1 / 6)
+TEST_F(optimize_fixture, optimize_conjugate_normal)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    auto out = optimize(model, config);
+
+    EXPECT_EQ(out.name, "optimize");
+    EXPECT_EQ(out.cont_samples.rows(), 1);
+    EXPECT_EQ(out.log_pdf.size(), 1ul);
+    expect_converged(out);
+    EXPECT_NEAR(out.cont_samples(0,0), y.get().sum() / 6., 1e-3);
+}
+
+// y_i ~ N(0, s^2) with flat prior on s > 0:
+// the mode of s is sqrt(sum(y^2) / n), while the mode of log(s)
+// (with log-jacobian log(s)) is at s = sqrt(sum(y^2) / (n-1)).
+TEST_F(optimize_fixture, optimize_jacobian)
+{
+    auto s = make_param<value_t>(lower(0.));
+    auto model = (s |= uniform(0., 100.),
+                  y |= normal(0., s)
+    );
+    const double ss = y.get().squaredNorm();
+    const double n = y.size();
+
+    auto out = optimize(model, config);
+    expect_converged(out);
+    EXPECT_NEAR(out.cont_samples(0,0), std::sqrt(ss / n), 1e-3);
+
+    config.jacobian = true;
+    auto out_jacobian = optimize(model, config);
+    expect_converged(out_jacobian);
+    EXPECT_NEAR(out_jacobian.cont_samples(0,0), std::sqrt(ss / (n - 1)), 1e-3);
+}
+
+TEST_F(optimize_fixture, optimize_multi_chain)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    config.n_chains = 3;
+    config.n_threads = 2;
+    config.samples = 100;   // ignored
+    auto out = optimize(model, config);
+
+    EXPECT_EQ(out.cont_samples.rows(), 3);
+    EXPECT_EQ(out.n_iter.size(), 3ul);
+    expect_converged(out);
+    for (size_t c = 0; c < config.n_chains; ++c) {
+        EXPECT_NEAR(out.cont_chain(c)(0,0), y.get().sum() / 6., 1e-3);
+        EXPECT_NEAR(out.log_pdf[c], out.log_pdf[0], 1e-6);
+    }
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = optimize(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+}
+
+} // namespace ppl
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include <random>
+#include <Eigen/Dense>
+#include <autoppl/optim/pathfinder.hpp>
+
+namespace ppl {
+namespace optim {
+
+// negative log-density of N(mu, prec^{-1}) up to a constant
+struct GaussianTarget
+{
+    Eigen::VectorXd mu;
+    Eigen::MatrixXd prec;
+
+    double operator()(const Eigen::VectorXd& x, Eigen::VectorXd& grad) const
+    {
+        grad = prec * (x - mu);
+        return 0.5 * (x - mu).dot(grad);
+    }
+};
+
+struct pathfinder_fixture : ::testing::Test
+{
+protected:
+    PathfinderConfig config;
+    GaussianTarget target;
+    Eigen::VectorXd& mu = target.mu;
+    Eigen::MatrixXd& prec = target.prec;
+    std::mt19937 gen{0};
+
+    void init(size_t n)
+    {
+        mu = Eigen::VectorXd::LinSpaced(n, -2., 3.);
+        Eigen::VectorXd sd = Eigen::VectorXd::LinSpaced(n, 0.5, 2.);
+        prec = sd.array().square().inverse().matrix().asDiagonal();
+    }
+};
+
+TEST_F(pathfinder_fixture, gaussian_matches_history)
+{
+    // the approximation implied by the history is the inverse Hessian of the two-loop recursion
+    init(6);
+    const size_t n = mu.size();
+    for (size_t m : {2ul, 5ul}) {
+        LBFGSHistory history(n, m);
+        std::normal_distribution norm(0., 1.);
+        for (size_t k = 0; k < m; ++k) {
+            Eigen::VectorXd s = Eigen::VectorXd::NullaryExpr(n, [&]() { return norm(gen); });
+            history.update(s, prec * s);
+        }
+        Eigen::VectorXd x = Eigen::VectorXd::Zero(n);
+        Eigen::VectorXd grad(n);
+        target(x, grad);
+
+        LBFGSGaussian approx(n);
+        EXPECT_TRUE(approx.fit(x, grad, history));
+
+        // H e_i through the two-loop recursion
+        Eigen::VectorXd dir(n);
+        for (size_t i = 0; i < n; ++i) {
+            history.direction(Eigen::VectorXd::Unit(n, i), dir);
+            EXPECT_NEAR(approx.variance(i), -dir(i), 1e-8);
+        }
+        history.direction(grad, dir);
+        for (size_t i = 0; i < n; ++i) {
+            EXPECT_NEAR(approx.mu(i), x(i) + dir(i), 1e-8);
+        }
+    }
+}
+
+TEST_F(pathfinder_fixture, sample_moments)
+{
+    init(8);
+    const size_t n = mu.size();
+    LBFGSHistory history(n, 2);
+    history.update(Eigen::VectorXd::Unit(n, 0), prec * Eigen::VectorXd::Unit(n, 0));
+    history.update(Eigen::VectorXd::Unit(n, 3), prec * Eigen::VectorXd::Unit(n, 3));
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(n);
+    Eigen::VectorXd grad(n);
+    target(x, grad);
+
+    LBFGSGaussian approx(n);
+    EXPECT_TRUE(approx.fit(x, grad, history));
+
+    const size_t n_draws = 20000;
+    Eigen::MatrixXd draws(n_draws, n);
+    Eigen::VectorXd theta(n);
+    for (size_t i = 0; i < n_draws; ++i) {
+        approx.sample(theta, gen);
+        draws.row(i) = theta;
+    }
+    Eigen::RowVectorXd mean = draws.colwise().mean();
+    Eigen::RowVectorXd var = (draws.rowwise() - mean).array().square().colwise().mean();
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_NEAR(mean(i), approx.mu(i), 0.05);
+        EXPECT_NEAR(var(i) / approx.variance(i), 1., 0.05);
+    }
+}
+
+TEST_F(pathfinder_fixture, pathfinder_gaussian)
+{
+    init(20);
+    const size_t n = mu.size();
+    Eigen::VectorXd x = Eigen::VectorXd::Constant(n, 10.);
+    Eigen::VectorXd variance(n);
+    const double elbo = pathfinder(target, x, variance, config, gen);
+
+    // the ELBO is at most the log-normalizing constant of exp(-f)
+    const double log_z = n * math::LOG_SQRT_TWO_PI - 0.5 * std::log(prec.determinant());
+    EXPECT_LT(elbo, log_z + 1e-8);
+    EXPECT_GT(elbo, log_z - 2.);
+
+    // x is a draw close to the typical set with reasonable marginal variances
+    const double sq_mahalanobis = (x - mu).dot(prec * (x - mu));
+    EXPECT_LT(sq_mahalanobis, 4. * n);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_GT(variance(i) * prec(i,i), 0.1);
+        EXPECT_LT(variance(i) * prec(i,i), 10.);
+    }
+}
+
+} // namespace optim
+} // namespace ppl
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <autoppl/util/thread_pool.hpp>
+
+namespace ppl {
+namespace util {
+
+struct thread_pool_fixture : ::testing::Test
+{
+protected:
+    static constexpr size_t n_tasks = 1000;
+    ThreadPool pool;
+
+    thread_pool_fixture()
+        : pool(4)
+    {}
+};
+
+TEST_F(thread_pool_fixture, size)
+{
+    EXPECT_EQ(pool.size(), static_cast<size_t>(4));
+    ThreadPool serial_pool;
+    EXPECT_EQ(serial_pool.size(), static_cast<size_t>(1));
+}
+
+TEST_F(thread_pool_fixture, parallel_for_empty)
+{
+    bool called = false;
+    pool.parallel_for(0, [&](size_t) { called = true; });
+    EXPECT_FALSE(called);
+}
+
+TEST_F(thread_pool_fixture, parallel_for_visits_all)
+{
+    std::vector<int> visits(n_tasks, 0);
+    pool.parallel_for(n_tasks, [&](size_t i) { ++visits[i]; });
+    for (size_t i = 0; i < n_tasks; ++i) {
+        EXPECT_EQ(visits[i], 1);
+    }
+}
+
+TEST_F(thread_pool_fixture, parallel_for_serial_in_order)
+{
+    ThreadPool serial_pool(1);
+    std::vector<size_t> order;
+    serial_pool.parallel_for(10, [&](size_t i) { order.push_back(i); });
+    std::vector<size_t> expected(10);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(order, expected);
+}
+
+TEST_F(thread_pool_fixture, parallel_for_nested)
+{
+    std::atomic<size_t> count(0);
+    pool.parallel_for(8, [&](size_t) {
+        pool.parallel_for(8, [&](size_t) { ++count; });
+    });
+    EXPECT_EQ(count.load(), static_cast<size_t>(64));
+}
+
+// A caller waiting for its nested tasks must not pick up another task of the outer call.
+// Task 1 occupies the worker until the nested call of task 0 is done (or times out),
+// so the outer tasks can only run on the caller of the nested call if it steals them.
+TEST_F(thread_pool_fixture, parallel_for_nested_runs_own_tasks)
+{
+    ThreadPool pair_pool(2);
+    std::atomic<std::thread::id> nested_caller;
+    std::atomic<bool> in_nested(false);
+    std::atomic<bool> nested_done(false);
+    std::atomic<bool> stolen(false);
+    pair_pool.parallel_for(3, [&](size_t i) {
+        if (i == 0) {
+            nested_caller = std::this_thread::get_id();
+            in_nested = true;
+            pair_pool.parallel_for(4, [&](size_t) {});
+            in_nested = false;
+            nested_done = true;
+            return;
+        }
+        if (in_nested && nested_caller.load() == std::this_thread::get_id()) {
+            stolen = true;
+        }
+        if (i == 1) {
+            const auto deadline = std::chrono::steady_clock::now() + 
+                                  std::chrono::seconds(5);
+            while (!nested_done && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    EXPECT_TRUE(nested_done.load());
+    EXPECT_FALSE(stolen.load());
+}
+
+TEST_F(thread_pool_fixture, parallel_for_reuse)
+{
+    for (size_t k = 0; k < 100; ++k) {
+        std::atomic<size_t> count(0);
+        pool.parallel_for(k, [&](size_t) { ++count; });
+        EXPECT_EQ(count.load(), k);
+    }
+}
+
+TEST_F(thread_pool_fixture, parallel_for_rethrows)
+{
+    std::atomic<size_t> count(0);
+    EXPECT_THROW(
+        pool.parallel_for(n_tasks, [&](size_t i) { 
+            ++count;
+            if (i == 3) throw std::runtime_error("task failed");
+        }), std::runtime_error);
+    // every task is still run before rethrowing
+    EXPECT_EQ(count.load(), n_tasks);
+}
+
+} // namespace util
+} // namespace ppl
@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+#include <fastad>
+#include <autoppl/expression/model/bar_eq.hpp>
+#include <autoppl/expression/model/glue.hpp>
+#include <autoppl/expression/variable/data.hpp>
+#include <autoppl/expression/variable/param.hpp>
+#include <autoppl/expression/variable/constant.hpp>
+#include <autoppl/expression/variable/binary.hpp>
+#include <autoppl/expression/distribution/normal.hpp>
+#include <autoppl/expression/program/program.hpp>
+#include <autoppl/expression/op_overloads.hpp>
+#include <autoppl/vi/advi/advi.hpp>
+#include <testutil/sample_tools.hpp>
+
+namespace ppl {
+
+struct advi_fixture : ::testing::Test
+{
+protected:
+    size_t n_samples = 5000;
+    using value_t = double;
+    using p_scl_t = ppl::Param<value_t>;
+    using d_vec_t = ppl::Data<value_t, ppl::vec>;
+
+    p_scl_t w, b;
+    d_vec_t x, y;
+
+    advi_fixture()
+        : w{}
+        , b{}
+        , x(6)
+        , y(6)
+    {
+        x.get() << 2.5, 3, 3.5, 4, 4.5, 5.;
+        y.get() << 3.5, 4, 4.5, 5, 5.5, 6.;
+    }
+
+    template <class ConfigType>
+    void init_config(ConfigType& config)
+    {
+        config.samples = n_samples;
+        config.seed = 0;
+        config.tol_rel_obj = 0.001;
+    }
+};
+
+// w ~ N(0, 1), y_i ~ N(w, 1) is conjugate: w | y ~ N(sum(y) / 7, 1 / 7)
+TEST_F(advi_fixture, advi_meanfield_conjugate_normal)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    ADVIConfig<meanfield> config;
+    init_config(config);
+    auto out = advi(model, config);
+
+    EXPECT_EQ(out.name, "advi");
+    auto sample = out.cont_samples.col(0);
+    plot_hist(sample);
+    const double mean = sample.mean();
+    const double var = (sample.array() - mean).square().mean();
+    EXPECT_NEAR(mean, y.get().sum() / 7., 0.1);
+    EXPECT_NEAR(var, 1. / 7., 0.05);
+}
+
+TEST_F(advi_fixture, advi_fullrank_regression)
+{
+    auto model = (w |= normal(0., 2.),
+                  b |= normal(0., 2.),
+                  y |= normal(x * w + b, 0.5)
+    );
+    ADVIConfig<fullrank> config;
+    init_config(config);
+    auto out = advi(model, config);
+
+    // posterior of (w, b) is strongly negatively correlated around y = x + 1
+    const double w_mean = out.cont_samples.col(0).mean();
+    const double b_mean = out.cont_samples.col(1).mean();
+    Eigen::MatrixXd centered = out.cont_samples.leftCols(2).rowwise() - 
+                               out.cont_samples.leftCols(2).colwise().mean();
+    Eigen::MatrixXd cov = centered.transpose() * centered / centered.rows();
+    const double corr = cov(0,1) / std::sqrt(cov(0,0) * cov(1,1));
+    EXPECT_NEAR(w_mean + b_mean, 2., 0.3);
+    EXPECT_LT(corr, -0.8);
+}
+
+TEST_F(advi_fixture, advi_multi_chain)
+{
+    auto model = (w |= normal(0., 1.),
+                  y |= normal(w, 1.)
+    );
+    ADVIConfig<> config;
+    init_config(config);
+    config.n_chains = 2;
+    config.n_threads = 2;
+    auto out = advi(model, config);
+
+    // results do not depend on the number of threads
+    config.n_threads = 1;
+    auto out_serial = advi(model, config);
+    EXPECT_EQ(out.cont_samples, out_serial.cont_samples);
+    EXPECT_NEAR(out.cont_chain(1).col(0).mean(), y.get().sum() / 7., 0.1);
+}
+
+} // namespace ppl